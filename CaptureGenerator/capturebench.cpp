@@ -0,0 +1,239 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  capturebench.cpp
+ *  @brief: Measure raw capture against writing a TTree directly.
+ */
+
+/**
+ * Generates code for a declaration file with capturegenerate and with
+ * rootgenerate.  Each is compiled with a driver that writes the same
+ * events:  the capture driver once with io_uring and once with POSIX AIO,
+ * the TTree driver with the Root target's CommitEvent.  Then the
+ * generated converter turns the io_uring capture into a tree.  For each
+ * the bench reports:
+ *   -  Events per second, including Finish (or writing and closing the
+ *      Root file), so everything has been handed to the kernel.
+ *   -  Bytes of file per event.
+ * Capturing and converting later is a win when the capture rate is well
+ * above the TTree rate:  the unpacker keeps up with the data and the
+ * conversion runs when there's time.
+ *
+ * Usage:
+ *     capturebench ?parser? ?capturegenerate? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser          - path to the parser (defaults to ../intermed/parser).
+ *  capturegenerate - path to the generator (defaults to ./capturegenerate).
+ *  rootgenerate    - path to the Root generator
+ *                    (defaults to ../RootGenerator/rootgenerate).
+ *  compile-flags   - compiler and linker flags for Root
+ *                    (defaults to `root-config --cflags --libs`).
+ *                    The compiler is $CXX or g++.
+ *  rootcling       - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+static const int EVENTS(200000);
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "   array w[4]\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[512]\n";
+    f << "structarrayinstance det dets[64]\n";
+    f << "vector hits\n";
+}
+/**
+ * writeDriver
+ *    Write the driver.  It takes the output base name, the number of
+ *    events and (for the capture) io_uring or aio on its command line and
+ *    outputs the events per second, bytes per event and I/O method on
+ *    one line.  Compiled with -DCAPTURE it's the capture driver,
+ *    otherwise the TTree driver.
+ *
+ * @param filename - driver file.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n";
+    f << "#ifndef CAPTURE\n";
+    f << "#include <TFile.h>\n";
+    f << "#endif\n";
+    f << "#include <string>\n";
+    f << "#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n#include <sys/stat.h>\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "static double size(const std::string& path) {\n";
+    f << "   struct stat info;\n";
+    f << "   return stat(path.c_str(), &info) ? 0 : info.st_size;\n";
+    f << "}\n";
+    f << "static void unpack(int e) {\n";
+    f << "   bench::multiplicity = e % 512;\n";
+    f << "   for (int i = 0; i < 512; i++) bench::adc[i] = (e + i) % 4096;\n";
+    f << "   for (int i = 0; i < 64; i++) {\n";
+    f << "      bench::dets[i].e = (e*i) % 4096;\n";
+    f << "      bench::dets[i].t = e % 1000;\n";
+    f << "      for (int j = 0; j < 4; j++) bench::dets[i].w[j] = i + j;\n";
+    f << "   }\n";
+    f << "   for (int i = 0; i < e % 8; i++) bench::hits.push_back(i);\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   std::string base = argv[1];\n";
+    f << "   int events = atoi(argv[2]);\n";
+    f << "   double start = now();\n";
+    f << "#ifdef CAPTURE\n";
+    f << "   bench::Initialize(base.c_str(), std::string(argv[3]) != \"aio\");\n";
+    f << "#else\n";
+    f << "   TFile* file = new TFile((base + \".root\").c_str(), \"RECREATE\");\n";
+    f << "   bench::Initialize();\n";
+    f << "#endif\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      bench::SetupEvent();\n";
+    f << "      unpack(e);\n";
+    f << "      bench::CommitEvent();\n";
+    f << "   }\n";
+    f << "#ifdef CAPTURE\n";
+    f << "   bench::Finish();\n";
+    f << "   double bytes = size(base + \".cap\") + size(base + \".heap\");\n";
+    f << "   const char* io = bench::CaptureIO();\n";
+    f << "#else\n";
+    f << "   file->Write();\n";
+    f << "   double bytes = file->GetEND();\n";
+    f << "   file->Close();\n";
+    f << "   const char* io = \"root\";\n";
+    f << "#endif\n";
+    f << "   printf(\"%f %f %s\\n\", events/(now() - start), bytes/events, io);\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+/**
+ * now
+ *   @return double - seconds on the monotonic clock.
+ */
+static double
+now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1.0e-9;
+}
+/**
+ * report
+ *    Output a line of the table.
+ *
+ * @param target - what was measured.
+ * @param rate   - events per second.
+ * @param bytes  - bytes of file per event.
+ */
+static void
+report(const std::string& target, double rate, double bytes)
+{
+    std::cout << std::setw(10) << target
+              << std::fixed << std::setprecision(0) << std::setw(12) << rate
+              << std::setprecision(1) << std::setw(13) << bytes << std::endl;
+}
+/**
+ * runDriver
+ *    Run a driver and report what it measured.
+ *
+ * @param command - command that runs it.
+ */
+static void
+runDriver(const std::string& command)
+{
+    std::istringstream result(run(command));
+    double rate, bytes;
+    std::string io;
+    result >> rate >> bytes >> std::ws;
+    std::getline(result, io);                // The rest of the line:  "posix aio" has a space.
+    report(io, rate, bytes);
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./capturegenerate";
+    std::string rootgen   = argc > 3 ? argv[3] : "../RootGenerator/rootgenerate";
+    std::string flags     = argc > 4 ? argv[4] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 5 ? argv[5] : "rootcling";
+
+    std::string dir = makeBenchDirectory("capturebench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    std::string rdir = dir + "/root";
+    run("mkdir " + rdir);
+    run(rootgen + " " + rdir + "/bench " + dir + "/bench.gxir");
+    makeDictionary(rootcling, rdir);
+    compile(
+        rdir + "/driver", rdir,
+        dir + "/driver.cpp " + rdir + "/bench.cpp " + rdir + "/dict.cxx", flags
+    );
+    std::string cdir = dir + "/capture";
+    run("mkdir " + cdir);
+    run(generator + " " + cdir + "/bench " + dir + "/bench.gxir");
+    compile(cdir + "/driver", cdir, dir + "/driver.cpp " + cdir + "/bench.cpp", "-DCAPTURE -lrt");
+    compile(
+        cdir + "/convert", rdir,
+        cdir + "/bench-convert.cpp " + rdir + "/bench.cpp " + rdir + "/dict.cxx", flags
+    );
+
+    std::cout << EVENTS << " events\n";
+    std::cout << std::setw(10) << "target" << std::setw(12) << "events/s"
+              << std::setw(13) << "file/event" << std::endl;
+    std::ostringstream events;
+    events << " " << EVENTS;
+    runDriver(cdir + "/driver " + cdir + "/aio" + events.str() + " aio");
+    run("rm -f " + cdir + "/aio.cap " + cdir + "/aio.heap");
+    runDriver(cdir + "/driver " + cdir + "/uring" + events.str() + " io_uring");
+    runDriver(rdir + "/driver " + rdir + "/bench" + events.str());
+    run("rm -f " + rdir + "/bench.root");
+
+    double start = now();
+    run(cdir + "/convert " + cdir + "/uring " + rdir + "/converted.root");
+    double rate = EVENTS/(now() - start);
+    struct stat info;
+    stat((rdir + "/converted.root").c_str(), &info);
+    report("convert", rate, double(info.st_size)/EVENTS);
+
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,111 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  capturedriver.cpp
+ *  @brief: main for the standalone raw capture code generator.
+ */
+
+/**
+ * This program generates code to support environment neutral unpacking
+ * of event data captured as fixed size records with asynchronous writes
+ * and converted to a Root tree (or replayed into SpecTcl) later.  The
+ * intermediate representation is taken as input on stdin (so we can be
+ * pipelined) or from a .gxir file.
+ *
+ * Usage:
+ *      capturegenerate ?--split? ?--context? ?--batch=n? basename ?irfile?
+ *
+ * Which generates basename.h and basename.cpp, the writer,
+ * basename-replay.h, a header only reader that copies the records back
+ * into instances, and basename-convert.cpp, which converts a capture to
+ * a Root tree.  --split, --context and --batch are as for rootgenerate;
+ * the other options are accepted and ignored.
+ */
+#include "capturegenerate.h"
+#include "irfile.h"
+#include <iostream>
+#include <stdlib.h>
+
+/**
+ * usage
+ *    Outputs an error message and program usage text to the desired
+ *    stream.
+ *
+ * @param f - the stream to which output is directed.
+ * @param msg - the message that precedes the usage text.
+ */
+static void
+usage(std::ostream& f, const char * msg)
+{
+    f << msg << std::endl;
+    f << "Usage\n";
+    f << "   capturegenerate ?--split? ?--context? ?--batch=n? basename ?irfile?\n";
+    f << "Where:\n";
+    f << "   --split  also writes a .cpp for each struct and a list of the .cpp\n";
+    f << "            files (basename.mk) so they can be compiled in parallel\n";
+    f << "   --context makes the instances members of an EventContext class and adds\n";
+    f << "            SetupEvent and CommitEvent overloads that take one\n";
+    f << "   --batch=n implies --context and adds an EventBatch of n EventContexts\n";
+    f << "            with SetupBatch and CommitBatch\n";
+    f << "            The other options rootgenerate takes are accepted and ignored.\n";
+    f << "   basename is the base name for the generated files.  The files\n";
+    f << "            created are basename.h, basename.cpp, basename-replay.h and\n";
+    f << "            basename-convert.cpp\n";
+    f << "   irfile   is a .gxir intermediate representation file.  If it's omitted\n";
+    f << "            the intermediate representation is read from stdin\n";
+
+    exit(EXIT_FAILURE);
+}
+/**
+ * main
+ *   entry point
+ */
+int main (int argc, char** argv)
+{
+    GenerateOptions options;
+    int first = parseGenerateOptions(argc, argv, options);
+    if (first < 0) {
+        usage(std::cerr, "Unrecognized option");
+    }
+    if (optionConflict(options)) {
+        usage(std::cerr, optionConflict(options));
+    }
+    argc -= first - 1;                    // Now as if there were no options.
+    argv += first - 1;
+    if ((argc != 2) && (argc != 3)) {
+        usage(std::cerr, "Incorrect number of command line parameters");
+    }
+    IrFile ir;
+    bool ok = argc == 3 ? ir.open(argv[2]) : ir.read(std::cin);
+    if (!ok) {
+        std::cerr << "capturegenerate: " << ir.error() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    TypeList types;
+    InstanceList instances;
+    ir.load(nsName, types, instances);
+
+    std::string base = argv[1];
+    if (!generateCapture(base, namespaceFor(base), types, instances, options)) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+void yyerror(const char* msg)
+{
+    usage(std::cerr, msg);
+}
@@ -0,0 +1,1509 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  capturegenerate.cpp
+ *  @brief: Code generator for raw fixed record capture.
+ */
+
+/**
+ * This module generates the same unpacking API as rootgenerate.cpp but
+ * CommitEvent does as little as it can:  it appends the event to a file
+ * as one fixed size record, the image of the instances, and the records
+ * are converted to a Root tree (or replayed into SpecTcl) afterwards.
+ * It is linked both into the standalone capturegenerate program (see
+ * capturedriver.cpp) and directly into genx.
+ *
+ * A record is an EventRecord, a plain struct laid out like instanceStruct:
+ *   -  value       - a double.
+ *   -  array       - an array of doubles.
+ *   -  vector      - a uint64_t, the offset of its values in the heap file.
+ *   -  structure   - the image of the struct:  a plain struct with the
+ *                    same name and fields in nsname::capture.
+ *   -  structarray - an array of the images.
+ * With no vectors the image is instanceStruct itself, so committing an
+ * event is one copy into the write buffer.  Otherwise the record is
+ * built field by field and each vector is appended to base.heap as a
+ * uint64_t count followed by that many doubles.
+ *
+ * base.cap and base.heap start with a 64 byte header:  magic, layout
+ * hash and (for base.cap) the record size.  The records follow end to end.
+ * The writer fills large aligned buffers and writes them asynchronously,
+ * with io_uring where the kernel has it and POSIX AIO otherwise, so the
+ * unpacker only waits for the disk if it gets a few buffers ahead of it.
+ * Data are in the writer's byte order.
+ *
+ * generateCapture(basename, ...) generates basename.h and basename.cpp,
+ * the writer, basename-replay.h, a header only reader that maps the
+ * files and copies records back into instances, and basename-convert.cpp,
+ * a program that converts a capture to a Root tree with the code the Root
+ * target generates from the same declarations.
+ */
+
+#include "capturegenerate.h"
+#include "outputfile.h"
+#include "contenthash.h"
+#include <iostream>
+#include <sstream>
+#include <set>
+#include <stdlib.h>
+#include <libgen.h>
+#include <string.h>
+
+static const char* programVersionString("capturegenerate version 1.0 (c) NSCL/FRIB");
+
+/**
+ * commentHeader
+ *    Generate a comment header for a file.
+ * @param f - the file into which the header is generated.
+ * @param filename -name of the file.
+ * @param descrip - brief description
+ */
+static void commentHeader(std::ostream& f, const std::string& filename,  const char* descrip)
+{
+    f << "/**\n";
+    f << "*  @file  " << filename << std::endl;
+    f << "*  @brief " << descrip  << std::endl;
+    f << "*\n";
+    f << "*   This file was generated by " << programVersionString << std::endl;
+    f << "*   Do NOT edit by hand\n";
+    f << "*/\n";
+}
+/**
+ * baseName
+ *   @param path - a file path.
+ *   @return std::string - path with any leading directories stripped off.
+ */
+static std::string
+baseName(const std::string& path)
+{
+    char cstrName[path.size() + 1];
+    strcpy(cstrName, path.c_str());
+    return basename(cstrName);
+}
+/**
+ * guardName
+ *   @param name - a file name.
+ *   @return std::string - name made into an include guard.
+ */
+static std::string
+guardName(const std::string& name)
+{
+    std::string result = baseName(name);
+    for (size_t i = 0; i < result.size(); i++) {
+        if ((result[i] == '-') || (result[i] == '.')) result[i] = '_';
+    }
+    return result;
+}
+/**
+ * findType
+ *   @param types - the type list.
+ *   @param name  - name of a type.
+ *   @return const TypeDefinition& - the type called name.
+ */
+static const TypeDefinition&
+findType(const TypeList& types, const std::string& name)
+{
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        if (p->s_typename == name) {
+            return *p;
+        }
+    }
+    std::cerr << "Undefined struct type: " << name << std::endl;
+    exit(EXIT_FAILURE);
+}
+/**
+ * hasVectors
+ *   @param types - the type list.
+ *   @param i     - a field or instance.
+ *   @return bool - true if there's a vector in i.  Those fields can't be
+ *                  copied as they are;  their values go to the heap.
+ */
+static bool
+hasVectors(const TypeList& types, const Instance& i)
+{
+    if (i.s_type == vector) {
+        return true;
+    }
+    if ((i.s_type == structure) || (i.s_type == structarray)) {
+        const FieldList& fields(findType(types, i.s_typename).s_fields);
+        for (FieldList::const_iterator p = fields.begin(); p != fields.end(); p++) {
+            if (hasVectors(types, *p)) return true;
+        }
+    }
+    return false;
+}
+/**
+ * hasVectors
+ *   @param types - the type list.
+ *   @param fields - fields of a struct or the instances.
+ *   @return bool - true if there's a vector in any of them.
+ */
+static bool
+hasVectors(const TypeList& types, const FieldList& fields)
+{
+    for (FieldList::const_iterator p = fields.begin(); p != fields.end(); p++) {
+        if (hasVectors(types, *p)) return true;
+    }
+    return false;
+}
+/**
+ * checkNames
+ *    The struct images share nsname::capture with the replay code;  make
+ *    sure none of them takes one of its names.
+ *
+ * @param types - the type list.
+ */
+static void
+checkNames(const TypeList& types)
+{
+    std::set<std::string> reserved;
+    reserved.insert("EventRecord");
+    reserved.insert("Replay");
+    reserved.insert("assign");
+    reserved.insert("CAPTURE_MAGIC");
+    reserved.insert("HEAP_MAGIC");
+    reserved.insert("LAYOUT");
+    reserved.insert("HEADER_BYTES");
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        if (reserved.count(p->s_typename)) {
+            std::cerr << "The struct name " << p->s_typename
+                      << " is used by the capture code;  please rename it\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+/**
+ * writeMember
+ *    Write the declaration of a struct field or instance:
+ *    values are doubles, arrays are arrays of doubles, vectors are
+ *    std::vector<double> and structures and struct arrays are their type.
+ *    The layout, storage and branches attributes don't apply;  the whole
+ *    event is captured.
+ *
+ * @param f      - stream to which the declaration is written.
+ * @param i      - the field or instance.
+ * @param prefix - put before the name, e.g. "(&" for a reference.
+ * @param suffix - put after the name.
+ */
+static void
+writeMember(
+    std::ostream& f, const Instance& i, const char* prefix = "", const char* suffix = ""
+)
+{
+    std::string type = "double";
+    if ((i.s_type == structure) || (i.s_type == structarray)) {
+        type = i.s_typename;
+    }
+    if (i.s_type == vector) {
+        type = "std::vector<double>";
+    }
+    f << type << " " << prefix << i.s_name << suffix;
+    if ((i.s_type == array) || (i.s_type == structarray)) {
+        f << "[" << i.s_elementCount << "]";
+    }
+}
+/**
+ * writeImageMember
+ *    Write the declaration of a field or instance in a record:  as
+ *    writeMember but vectors are the uint64_t heap offset of their values.
+ *
+ * @param f - stream to which the declaration is written.
+ * @param i - the field or instance.
+ */
+static void
+writeImageMember(std::ostream& f, const Instance& i)
+{
+    f << "   ";
+    if (i.s_type == vector) {
+        f << "uint64_t " << i.s_name << ";      // Heap offset of the values.\n";
+    } else {
+        writeMember(f, i);
+        f << ";\n";
+    }
+}
+/**
+ * writeStructureDefs
+ *    Write the struct definitions.  Each is a plain struct whose
+ *    constructor calls Reset, which sets everything in it to NaN (vectors
+ *    are emptied).
+ *
+ * @param f  - stream to which the code is written.
+ * @param types - List of type definitions to write.
+ */
+static void
+writeStructureDefs(std::ostream& f, const TypeList& types)
+{
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        f << "struct " << p->s_typename << " {\n";
+        f << "   " << p->s_typename << "();\n";
+        f << "   void Reset();\n\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            f << "   ";
+            writeMember(f, *fld);
+            f << ";\n";
+        }
+        f << "};\n\n";
+    }
+}
+/**
+ * writeInstanceMembers
+ *    Write the instances as members of a struct.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ */
+static void
+writeInstanceMembers(std::ostream& f, const InstanceList& instances)
+{
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "   ";
+        writeMember(f, *p);
+        f << ";\n";
+    }
+}
+/**
+ * writeInstanceDefs
+ *    Write the declarations of the instances:  as for the Root target they
+ *    are all members of instanceStruct and there's a reference to each.
+ *    With --context instanceStruct is an EventContext.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ * @param options - generation options.
+ */
+static void
+writeInstanceDefs(
+    std::ostream& f, const InstanceList& instances, const GenerateOptions& options
+)
+{
+    if (options.s_context) {
+        f << "// An event's worth of instances.  Several can be unpacked at once.\n\n";
+        f << "class EventContext {\n";
+        f << "public:\n";
+        writeInstanceMembers(f, instances);
+        f << "};\n\n";
+    }
+    f << "#ifndef IMPLEMENTATION_MODULE\n\n";
+    if (options.s_context) {
+        f << " extern EventContext instanceStruct;       // The one the API without a context uses.\n";
+    } else {
+        f << " extern struct {\n";
+        writeInstanceMembers(f, instances);
+        f << "}  instanceStruct;\n";
+    }
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "extern    ";
+        writeMember(f, *p, "(&", ")");
+        f << ";\n";
+    }
+    f << "\n#endif\n\n";
+}
+/**
+ * writeApiPrototypes
+ *    Writes the prototypes for the API functions.
+ *
+ * @param f - stream to which the prototypes are written.
+ * @param options - generation options (--context and --batch change the
+ *                  API).
+ */
+static void
+writeApiPrototypes(std::ostream& f, const GenerateOptions& options)
+{
+    f << "// Captures the events to base.cap (and their vectors' values to base.heap)\n";
+    f << "// with asynchronous writes.  Replay them with the -replay.h file generated\n";
+    f << "// with this one or convert them to a Root tree with the -convert.cpp file.\n\n";
+    f << "void Initialize(const char* base, bool useUring = true);   // false: POSIX AIO.\n";
+    f << "void Finish();            // Writes what's buffered and closes the files.\n";
+    f << "const char* CaptureIO();  // \"io_uring\" or \"posix aio\".\n";
+    f << "void SetupEvent();\n";
+    f << "void CommitEvent();\n";
+    if (options.s_context) {
+        f << "\nvoid SetupEvent(EventContext& context);\n";
+        f << "void CommitEvent(EventContext& context);   // Calls must be serialized.\n";
+    }
+    if (!options.s_batch.empty()) {
+        f << "\n// A batch of events:  unpack event k into batch[k].  It's big;  make it with new.\n\n";
+        f << "class EventBatch {\n";
+        f << "public:\n";
+        f << "   EventContext& operator[](size_t k) { return m_slots[k]; }\n";
+        f << "   size_t size() const { return " << options.s_batch << "; }\n";
+        f << "private:\n";
+        f << "   EventContext m_slots[" << options.s_batch << "];\n";
+        f << "};\n";
+        f << "void SetupBatch(EventBatch& batch);              // Resets every slot.\n";
+        f << "void CommitBatch(EventBatch& batch, size_t n);   // Writes slots 0 - n-1.\n";
+    }
+}
+/**
+ * generateHeader
+ *    Generate the header file.
+ *
+ *  @param fname - base name of the output file.
+ *  @param nsname - name of the namespace all the decls go into.
+ *  @param types  - list of data types.
+ *  @param instances - list of top level instances.
+ *  @param options - generation options.
+ *  @return bool - true if the file was written.
+ */
+static bool
+generateHeader(
+    const std::string& fname, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    std::string headerName = fname + ".h";
+    OutputFile f(headerName);
+    commentHeader(f, headerName, "Defines types, instances and API");
+    std::string baseFilename = baseName(fname);
+
+    f << "#ifndef " << baseFilename << "_h\n";
+    f << "#define " << baseFilename << "_h\n";
+    f << "#include <vector>\n";
+    f << "#include <cstddef>\n";
+    f << "\nnamespace " << nsname << " {\n\n";
+    writeStructureDefs(f, types);
+    writeInstanceDefs(f, instances, options);
+    writeApiPrototypes(f, options);
+    f << "}\n";
+    f << "#endif\n";
+    return f.close();
+}
+/**
+ * writeReset
+ *    Write the statements that reset a field or instance.
+ *
+ * @param f      - stream to which the code is written.
+ * @param i      - the field or instance.
+ * @param object - what it's a member of, with the trailing . or empty.
+ */
+static void
+writeReset(std::ostream& f, const Instance& i, const std::string& object)
+{
+    std::string name = object + i.s_name;
+    switch (i.s_type) {
+    case value:
+        f << "   " << name << " = NAN;\n";
+        break;
+    case array:
+        f << "   fillNaN(" << name << ", " << i.s_elementCount << ");\n";
+        break;
+    case vector:
+        f << "   " << name << ".clear();\n";
+        break;
+    case structure:
+        f << "   " << name << ".Reset();\n";
+        break;
+    case structarray:
+        f << "   for (int i = 0; i < " << i.s_elementCount << "; i++) {\n";
+        f << "      " << name << "[i].Reset();\n";
+        f << "   }\n";
+        break;
+    default:
+        std::cerr << "Unrecognized data type: " << i.s_type << std::endl;
+        std::cerr << i.toString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+/**
+ * generateStructImplementations
+ *    Implement the constructor and Reset method of each struct.
+ *
+ *  @param f       - stream into which the code is generated.
+ *  @param nsname  - Name of the namespace the structs were generated in.
+ *  @param first, last - range of types defined by the user.
+ */
+static void
+generateStructImplementations(
+    std::ostream& f, const std::string& nsname,
+    TypeList::const_iterator first, TypeList::const_iterator last
+)
+{
+    f << "// Struct method implementations: \n\n";
+    for (TypeList::const_iterator p = first; p != last; p++) {
+        std::string name = nsname + "::" + p->s_typename;
+        f << name << "::" << p->s_typename << "() {\n";
+        f << "   Reset();\n";
+        f << "}\n\n";
+        f << "void " << name << "::Reset() {\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            writeReset(f, *fld, "");
+        }
+        f << "}\n\n";
+    }
+}
+/**
+ * generatePrologue
+ *    Generate what goes at the top of each C++ file.  Only the main file
+ *    writes the capture;  the --split files just implement the struct
+ *    methods.
+ *
+ * @param f - stream into which the code is generated.
+ * @param fname - name of the file being generated.
+ * @param base - output file base name.
+ * @param writer - true to include what the writer needs.
+ */
+static void
+generatePrologue(
+    std::ostream& f, const std::string& fname, const std::string& base, bool writer
+)
+{
+    commentHeader(f, fname, "C++ Implementation file for raw capture");
+    f << "#define IMPLEMENTATION_MODULE\n";
+    f << "#include \"" << baseName(base) << ".h\"\n";
+    if (writer) {
+        f << "#include \"" << baseName(base) << "-replay.h\"\n";
+    }
+    f << "\n#include <cmath>\n";
+    f << "#include <cstddef>\n";
+    if (writer) {
+        f << "#include <algorithm>\n";
+        f << "#include <cerrno>\n";
+        f << "#include <cstdlib>\n";
+        f << "#include <cstring>\n";
+        f << "#include <memory>\n";
+        f << "#include <new>\n";
+        f << "#include <stdexcept>\n";
+        f << "#include <string>\n";
+        f << "#include <stdint.h>\n";
+        f << "#include <aio.h>\n";
+        f << "#include <fcntl.h>\n";
+        f << "#include <sys/mman.h>\n";
+        f << "#include <sys/uio.h>\n";
+        f << "#include <unistd.h>\n";
+        f << "#if defined(__linux__) && defined(__has_include)\n";
+        f << "#if __has_include(<linux/io_uring.h>)\n";
+        f << "#include <linux/io_uring.h>\n";
+        f << "#include <sys/syscall.h>\n";
+        f << "#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)\n";
+        f << "#define CAPTURE_URING\n";
+        f << "#endif\n";
+        f << "#endif\n";
+        f << "#endif\n";
+        f << "#ifndef O_DIRECT\n";
+        f << "#define O_DIRECT 0\n";
+        f << "#endif\n";
+    }
+    f << "\nnamespace {\n";
+    f << "inline void fillNaN(double* p, size_t n) {\n";
+    f << "   for (size_t i = 0; i < n; i++) p[i] = NAN;\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateInstances
+ *    Define instanceStruct and the references to its members.
+ *
+ * @param f      - stream to which code is written.
+ * @param nsname - namespace in which everything is defined.
+ * @param instances- instance list.
+ * @param options - generation options (--context).
+ */
+static void
+generateInstances(
+    std::ostream& f, const std::string& nsname, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    f << "//   Instance definitions\n\n";
+    f << "namespace " << nsname << " {\n";
+    if (options.s_context) {
+        f << "EventContext instanceStruct;\n";
+    } else {
+        f << "struct {\n";
+        writeInstanceMembers(f, instances);
+        f << "}  instanceStruct;\n";
+    }
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeMember(f, *p, "(&", ")");
+        f << "(instanceStruct." << p->s_name << ");\n";
+    }
+    f << "}\n\n";
+}
+/**
+ * writeAsyncIO
+ *    Write the asynchronous writers:  AsyncIO, the interface, UringIO,
+ *    which drives an io_uring with the raw system calls (so nothing more
+ *    than the kernel headers is needed), and AioIO, POSIX AIO.  Each
+ *    write has a slot;  a slot has one write in flight at a time and wait
+ *    returns what it wrote or -errno.
+ *
+ * @param f - stream into which the code is generated.
+ */
+static void
+writeAsyncIO(std::ostream& f)
+{
+    f << "// Asynchronous writes:\n\n";
+    f << "namespace {\n";
+    f << "const size_t BLOCK(4096);                   // O_DIRECT alignment.\n";
+    f << "const size_t BUFFER_BYTES(4*1024*1024);\n";
+    f << "const int    BUFFERS(4);                    // Per file;  all can be in flight.\n\n";
+
+    f << "class AsyncIO {\n";
+    f << "public:\n";
+    f << "   virtual ~AsyncIO() {}\n";
+    f << "   virtual const char* name() const = 0;\n";
+    f << "   virtual void write(int slot, int fd, const char* p, size_t n, uint64_t offset) = 0;\n";
+    f << "   virtual ssize_t wait(int slot) = 0;\n";
+    f << "};\n\n";
+
+    f << "#ifdef CAPTURE_URING\n";
+    f << "class UringIO : public AsyncIO {\n";
+    f << "public:\n";
+    f << "   explicit UringIO(unsigned slots);\n";
+    f << "   ~UringIO() { release(); }\n";
+    f << "   const char* name() const { return \"io_uring\"; }\n";
+    f << "   void write(int slot, int fd, const char* p, size_t n, uint64_t offset);\n";
+    f << "   ssize_t wait(int slot);\n";
+    f << "private:\n";
+    f << "   void release();\n";
+    f << "   void reap();\n";
+    f << "   int           m_fd;\n";
+    f << "   void*         m_pSq;\n";
+    f << "   size_t        m_sqBytes;\n";
+    f << "   void*         m_pCq;\n";
+    f << "   size_t        m_cqBytes;\n";
+    f << "   io_uring_sqe* m_pSqes;\n";
+    f << "   size_t        m_sqeBytes;\n";
+    f << "   unsigned*     m_sqTail;\n";
+    f << "   unsigned*     m_sqMask;\n";
+    f << "   unsigned*     m_sqArray;\n";
+    f << "   unsigned*     m_cqHead;\n";
+    f << "   unsigned*     m_cqTail;\n";
+    f << "   unsigned*     m_cqMask;\n";
+    f << "   io_uring_cqe* m_cqes;\n";
+    f << "   std::vector<iovec>   m_iov;           // The kernel reads them until the write is done.\n";
+    f << "   std::vector<char>    m_done;\n";
+    f << "   std::vector<ssize_t> m_result;\n";
+    f << "};\n\n";
+
+    f << "UringIO::UringIO(unsigned slots) :\n";
+    f << "   m_fd(-1), m_pSq(MAP_FAILED), m_sqBytes(0), m_pCq(MAP_FAILED), m_cqBytes(0),\n";
+    f << "   m_pSqes(static_cast<io_uring_sqe*>(MAP_FAILED)), m_sqeBytes(0),\n";
+    f << "   m_iov(slots), m_done(slots, 1), m_result(slots, 0) {\n";
+    f << "   io_uring_params params;\n";
+    f << "   std::memset(&params, 0, sizeof(params));\n";
+    f << "   m_fd = syscall(__NR_io_uring_setup, slots, &params);\n";
+    f << "   if (m_fd < 0) {\n";
+    f << "      throw std::runtime_error(std::string(\"io_uring_setup: \") + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   m_sqBytes = params.sq_off.array + params.sq_entries*sizeof(unsigned);\n";
+    f << "   m_cqBytes = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);\n";
+    f << "   bool single = params.features & IORING_FEAT_SINGLE_MMAP;\n";
+    f << "   if (single) {\n";
+    f << "      m_sqBytes = m_cqBytes = std::max(m_sqBytes, m_cqBytes);\n";
+    f << "   }\n";
+    f << "   m_pSq = mmap(0, m_sqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,\n";
+    f << "                m_fd, IORING_OFF_SQ_RING);\n";
+    f << "   if (!single && (m_pSq != MAP_FAILED)) {\n";
+    f << "      m_pCq = mmap(0, m_cqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,\n";
+    f << "                   m_fd, IORING_OFF_CQ_RING);\n";
+    f << "   }\n";
+    f << "   m_sqeBytes = params.sq_entries*sizeof(io_uring_sqe);\n";
+    f << "   m_pSqes = static_cast<io_uring_sqe*>(mmap(\n";
+    f << "      0, m_sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES\n";
+    f << "   ));\n";
+    f << "   if ((m_pSq == MAP_FAILED) || (!single && (m_pCq == MAP_FAILED)) || (m_pSqes == MAP_FAILED)) {\n";
+    f << "      release();\n";
+    f << "      throw std::runtime_error(\"Can't map the io_uring\");\n";
+    f << "   }\n";
+    f << "   char* sq = static_cast<char*>(m_pSq);\n";
+    f << "   char* cq = static_cast<char*>(single ? m_pSq : m_pCq);\n";
+    f << "   m_sqTail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);\n";
+    f << "   m_sqMask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);\n";
+    f << "   m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);\n";
+    f << "   m_cqHead  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);\n";
+    f << "   m_cqTail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);\n";
+    f << "   m_cqMask  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);\n";
+    f << "   m_cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);\n";
+    f << "}\n";
+    f << "void UringIO::release() {\n";
+    f << "   if (m_pSqes != MAP_FAILED) munmap(m_pSqes, m_sqeBytes);\n";
+    f << "   if (m_pCq != MAP_FAILED) munmap(m_pCq, m_cqBytes);\n";
+    f << "   if (m_pSq != MAP_FAILED) munmap(m_pSq, m_sqBytes);\n";
+    f << "   if (m_fd >= 0) close(m_fd);\n";
+    f << "}\n";
+    f << "void UringIO::write(int slot, int fd, const char* p, size_t n, uint64_t offset) {\n";
+    f << "   m_iov[slot].iov_base = const_cast<char*>(p);\n";
+    f << "   m_iov[slot].iov_len  = n;\n";
+    f << "   m_done[slot] = 0;\n";
+    f << "   unsigned tail  = *m_sqTail;               // Only we move the tail.\n";
+    f << "   unsigned index = tail & *m_sqMask;\n";
+    f << "   io_uring_sqe& sqe(m_pSqes[index]);\n";
+    f << "   std::memset(&sqe, 0, sizeof(sqe));\n";
+    f << "   sqe.opcode    = IORING_OP_WRITEV;\n";
+    f << "   sqe.fd        = fd;\n";
+    f << "   sqe.addr      = reinterpret_cast<uint64_t>(&m_iov[slot]);\n";
+    f << "   sqe.len       = 1;\n";
+    f << "   sqe.off       = offset;\n";
+    f << "   sqe.user_data = slot;\n";
+    f << "   m_sqArray[index] = index;\n";
+    f << "   __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);\n";
+    f << "   while (syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, 0, 0) < 0) {\n";
+    f << "      if (errno != EINTR) {\n";
+    f << "         throw std::runtime_error(std::string(\"io_uring_enter: \") + std::strerror(errno));\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "void UringIO::reap() {\n";
+    f << "   unsigned head = *m_cqHead;                // Only we move the head.\n";
+    f << "   unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);\n";
+    f << "   while (head != tail) {\n";
+    f << "      const io_uring_cqe& cqe(m_cqes[head & *m_cqMask]);\n";
+    f << "      m_done[cqe.user_data]   = 1;\n";
+    f << "      m_result[cqe.user_data] = cqe.res;\n";
+    f << "      head++;\n";
+    f << "   }\n";
+    f << "   __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);\n";
+    f << "}\n";
+    f << "ssize_t UringIO::wait(int slot) {\n";
+    f << "   for (;;) {\n";
+    f << "      reap();\n";
+    f << "      if (m_done[slot]) {\n";
+    f << "         return m_result[slot];\n";
+    f << "      }\n";
+    f << "      if ((syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0)\n";
+    f << "          && (errno != EINTR)) {\n";
+    f << "         throw std::runtime_error(std::string(\"io_uring_enter: \") + std::strerror(errno));\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "#endif\n\n";
+
+    f << "class AioIO : public AsyncIO {\n";
+    f << "public:\n";
+    f << "   explicit AioIO(unsigned slots) : m_cbs(slots) {}\n";
+    f << "   const char* name() const { return \"posix aio\"; }\n";
+    f << "   void write(int slot, int fd, const char* p, size_t n, uint64_t offset) {\n";
+    f << "      aiocb& cb(m_cbs[slot]);\n";
+    f << "      std::memset(&cb, 0, sizeof(cb));\n";
+    f << "      cb.aio_fildes = fd;\n";
+    f << "      cb.aio_buf    = const_cast<char*>(p);\n";
+    f << "      cb.aio_nbytes = n;\n";
+    f << "      cb.aio_offset = offset;\n";
+    f << "      if (aio_write(&cb) < 0) {\n";
+    f << "         throw std::runtime_error(std::string(\"aio_write: \") + std::strerror(errno));\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   ssize_t wait(int slot) {\n";
+    f << "      aiocb& cb(m_cbs[slot]);\n";
+    f << "      const aiocb* list[1] = {&cb};\n";
+    f << "      int status;\n";
+    f << "      while ((status = aio_error(&cb)) == EINPROGRESS) {\n";
+    f << "         aio_suspend(list, 1, 0);\n";
+    f << "      }\n";
+    f << "      ssize_t result = aio_return(&cb);\n";
+    f << "      return status ? -status : result;\n";
+    f << "   }\n";
+    f << "private:\n";
+    f << "   std::vector<aiocb> m_cbs;\n";
+    f << "};\n\n";
+
+    f << "AsyncIO* makeIO(unsigned slots, bool useUring) {\n";
+    f << "#ifdef CAPTURE_URING\n";
+    f << "   if (useUring) {\n";
+    f << "      try {\n";
+    f << "         return new UringIO(slots);\n";
+    f << "      }\n";
+    f << "      catch (std::runtime_error&) {}      // No io_uring here (or it's not allowed).\n";
+    f << "   }\n";
+    f << "#endif\n";
+    f << "   return new AioIO(slots);\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * writeStream
+ *    Write the Stream class, an output file written through a ring of
+ *    aligned buffers.  When a buffer fills it's written asynchronously and
+ *    the next one is waited for, so writes overlap the unpacking until
+ *    the disk falls a ring behind.  Files are opened O_DIRECT where the
+ *    file system allows;  the last buffer is then padded to a block and
+ *    the file truncated back to its length when it's closed.
+ *
+ * @param f - stream into which the code is generated.
+ */
+static void
+writeStream(std::ostream& f)
+{
+    f << "// An output file:\n\n";
+    f << "namespace {\n";
+    f << "class Stream {\n";
+    f << "public:\n";
+    f << "   Stream(AsyncIO& io, int firstSlot, const std::string& path);\n";
+    f << "   ~Stream();\n";
+    f << "   void append(const void* p, size_t n) {\n";
+    f << "      const char* q = static_cast<const char*>(p);\n";
+    f << "      while (n) {\n";
+    f << "         size_t chunk = std::min(n, BUFFER_BYTES - m_fill);\n";
+    f << "         std::memcpy(m_buffers[m_current] + m_fill, q, chunk);\n";
+    f << "         m_fill += chunk;\n";
+    f << "         q      += chunk;\n";
+    f << "         n      -= chunk;\n";
+    f << "         if (m_fill == BUFFER_BYTES) submit();\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   uint64_t appendVector(const std::vector<double>& v) {   // Returns its offset.\n";
+    f << "      uint64_t at = m_offset + m_fill;\n";
+    f << "      uint64_t n  = v.size();\n";
+    f << "      append(&n, sizeof(n));\n";
+    f << "      append(v.data(), n*sizeof(double));\n";
+    f << "      return at;\n";
+    f << "   }\n";
+    f << "   void close();\n";
+    f << "private:\n";
+    f << "   Stream(const Stream&);\n";
+    f << "   Stream& operator=(const Stream&);\n";
+    f << "   void submit();\n";
+    f << "   void complete(int k);\n";
+    f << "   AsyncIO&    m_io;\n";
+    f << "   int         m_firstSlot;\n";
+    f << "   std::string m_path;\n";
+    f << "   int         m_fd;\n";
+    f << "   bool        m_direct;\n";
+    f << "   char*       m_buffers[BUFFERS];\n";
+    f << "   size_t      m_pending[BUFFERS];        // Bytes being written from each, 0 if none.\n";
+    f << "   int         m_current;\n";
+    f << "   size_t      m_fill;\n";
+    f << "   uint64_t    m_offset;                  // Where the current buffer goes in the file.\n";
+    f << "};\n\n";
+
+    f << "Stream::Stream(AsyncIO& io, int firstSlot, const std::string& path) :\n";
+    f << "   m_io(io), m_firstSlot(firstSlot), m_path(path), m_fd(-1), m_direct(true),\n";
+    f << "   m_current(0), m_fill(0), m_offset(0) {\n";
+    f << "   m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);\n";
+    f << "   if ((m_fd < 0) && (errno == EINVAL)) {              // No O_DIRECT on this file system.\n";
+    f << "      m_direct = false;\n";
+    f << "      m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);\n";
+    f << "   }\n";
+    f << "   if (m_fd < 0) {\n";
+    f << "      throw std::runtime_error(\"Can't create \" + path + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   for (int k = 0; k < BUFFERS; k++) {\n";
+    f << "      m_pending[k] = 0;\n";
+    f << "      void* p;\n";
+    f << "      m_buffers[k] = posix_memalign(&p, BLOCK, BUFFER_BYTES) ? 0 : static_cast<char*>(p);\n";
+    f << "   }\n";
+    f << "   for (int k = 0; k < BUFFERS; k++) {\n";
+    f << "      if (!m_buffers[k]) {\n";
+    f << "         ::close(m_fd);\n";
+    f << "         for (int i = 0; i < BUFFERS; i++) std::free(m_buffers[i]);\n";
+    f << "         throw std::bad_alloc();\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "Stream::~Stream() {\n";
+    f << "   if (m_fd >= 0) {                     // Not closed:  the buffers can't go until\n";
+    f << "      for (int k = 0; k < BUFFERS; k++) {   // the kernel's done with them.\n";
+    f << "         try {\n";
+    f << "            complete(k);\n";
+    f << "         }\n";
+    f << "         catch (...) {}\n";
+    f << "      }\n";
+    f << "      ::close(m_fd);\n";
+    f << "   }\n";
+    f << "   for (int k = 0; k < BUFFERS; k++) std::free(m_buffers[k]);\n";
+    f << "}\n";
+    f << "void Stream::submit() {\n";
+    f << "   size_t n = m_fill;\n";
+    f << "   if (m_direct) {                      // Whole blocks;  close truncates the padding.\n";
+    f << "      size_t padded = (n + BLOCK - 1)/BLOCK*BLOCK;\n";
+    f << "      std::memset(m_buffers[m_current] + n, 0, padded - n);\n";
+    f << "      n = padded;\n";
+    f << "   }\n";
+    f << "   m_pending[m_current] = n;\n";
+    f << "   m_io.write(m_firstSlot + m_current, m_fd, m_buffers[m_current], n, m_offset);\n";
+    f << "   m_offset += m_fill;\n";
+    f << "   m_fill    = 0;\n";
+    f << "   m_current = (m_current + 1) % BUFFERS;\n";
+    f << "   complete(m_current);                 // Its last write must be done before it's refilled.\n";
+    f << "}\n";
+    f << "void Stream::complete(int k) {\n";
+    f << "   size_t expected = m_pending[k];\n";
+    f << "   if (!expected) return;\n";
+    f << "   m_pending[k] = 0;\n";
+    f << "   ssize_t result = m_io.wait(m_firstSlot + k);\n";
+    f << "   if (result < 0) {\n";
+    f << "      throw std::runtime_error(\"Write to \" + m_path + \" failed: \" + std::strerror(-result));\n";
+    f << "   }\n";
+    f << "   if (size_t(result) != expected) {\n";
+    f << "      throw std::runtime_error(\"Short write to \" + m_path);\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "void Stream::close() {\n";
+    f << "   if (m_fill) submit();\n";
+    f << "   for (int k = 0; k < BUFFERS; k++) {\n";
+    f << "      complete(k);\n";
+    f << "   }\n";
+    f << "   if (m_direct && (ftruncate(m_fd, m_offset) < 0)) {\n";
+    f << "      throw std::runtime_error(\"Can't truncate \" + m_path + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   int status = ::close(m_fd);\n";
+    f << "   m_fd = -1;\n";
+    f << "   if (status < 0) {\n";
+    f << "      throw std::runtime_error(\"Can't close \" + m_path + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * writeCaptureField
+ *    Write the statement that copies a field or instance into its image.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param types  - the type list.
+ * @param i      - the field or instance.
+ */
+static void
+writeCaptureField(std::ostream& f, const TypeList& types, const Instance& i)
+{
+    const std::string& name(i.s_name);
+    switch (i.s_type) {
+    case value:
+        f << "   image." << name << " = data." << name << ";\n";
+        break;
+    case vector:
+        f << "   image." << name << " = heap.appendVector(data." << name << ");\n";
+        break;
+    case array:
+        f << "   std::memcpy(image." << name << ", data." << name
+          << ", sizeof(image." << name << "));\n";
+        break;
+    case structure:
+        if (hasVectors(types, i)) {
+            f << "   captureImage(image." << name << ", data." << name << ", heap);\n";
+        } else {
+            f << "   std::memcpy(&image." << name << ", &data." << name
+              << ", sizeof(image." << name << "));\n";
+        }
+        break;
+    case structarray:
+        if (hasVectors(types, i)) {
+            f << "   for (int i = 0; i < " << i.s_elementCount << "; i++) {\n";
+            f << "      captureImage(image." << name << "[i], data." << name << "[i], heap);\n";
+            f << "   }\n";
+        } else {
+            f << "   std::memcpy(image." << name << ", data." << name
+              << ", sizeof(image." << name << "));\n";
+        }
+        break;
+    default:
+        std::cerr << "Unrecognized data type: " << i.s_type << std::endl;
+        std::cerr << i.toString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+/**
+ * writeCapture
+ *    Write the functions that build a record when there are vectors:  a
+ *    captureImage overload for each struct with vectors in it and
+ *    captureEvent for the instances.  Whatever has no vectors is copied
+ *    as it is.
+ *
+ * @param f         - stream into which the code is generated.
+ * @param nsname    - namespace of the generated code.
+ * @param types     - the type list.
+ * @param instances - the instances.
+ */
+static void
+writeCapture(
+    std::ostream& f, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances
+)
+{
+    f << "// Building a record:\n\n";
+    f << "namespace {\n";
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        if (!hasVectors(types, p->s_fields)) continue;
+        f << "void captureImage(" << nsname << "::capture::" << p->s_typename << "& image, const "
+          << nsname << "::" << p->s_typename << "& data, Stream& heap) {\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            writeCaptureField(f, types, *fld);
+        }
+        f << "}\n";
+    }
+    f << "template <class Instances>\n";
+    f << "void captureEvent(" << nsname
+      << "::capture::EventRecord& image, const Instances& data, Stream& heap) {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeCaptureField(f, types, *p);
+    }
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateAPI
+ *    Generates the API implementations.
+ *
+ *  @param f  - file into which code is being generated.
+ *  @param nsname - namespace all this stuff lives in.
+ *  @param heap - true if there are vectors, so there's a heap file.
+ *  @param options - generation options.
+ */
+static void
+generateAPI(
+    std::ostream& f, const std::string& nsname, bool heap, const GenerateOptions& options
+)
+{
+    bool context = options.s_context;
+    f << "// The capture being written:\n\n";
+    f << "namespace " << nsname << " {\n";
+    f << "std::unique_ptr<AsyncIO> pIO;\n";
+    f << "std::unique_ptr<Stream>  pRecords;\n";
+    if (heap) {
+        f << "std::unique_ptr<Stream>  pHeap;\n";
+        f << "std::unique_ptr<capture::EventRecord> pImage;     // Too big for the stack, maybe.\n";
+    }
+    f << "}\n\n";
+
+    f << "// Initialize - creates the files and writes their headers\n\n";
+    f << "void " << nsname << "::Initialize(const char* base, bool useUring) {\n";
+    f << "   pRecords.reset();\n";
+    if (heap) {
+        f << "   pHeap.reset();\n";
+    }
+    f << "   pIO.reset(makeIO(2*BUFFERS, useUring));\n";
+    f << "   uint64_t header[capture::HEADER_BYTES/sizeof(uint64_t)] = {\n";
+    f << "      capture::CAPTURE_MAGIC, capture::LAYOUT, sizeof(capture::EventRecord)\n";
+    f << "   };\n";
+    f << "   pRecords.reset(new Stream(*pIO, 0, std::string(base) + \".cap\"));\n";
+    f << "   pRecords->append(header, sizeof(header));\n";
+    if (heap) {
+        f << "   header[0] = capture::HEAP_MAGIC;\n";
+        f << "   pHeap.reset(new Stream(*pIO, BUFFERS, std::string(base) + \".heap\"));\n";
+        f << "   pHeap->append(header, sizeof(header));\n";
+        f << "   pImage.reset(new capture::EventRecord);\n";
+    }
+    f << "}\n";
+    f << "void " << nsname << "::Finish() {\n";
+    f << "   pRecords->close();\n";
+    if (heap) {
+        f << "   pHeap->close();\n";
+        f << "   pHeap.reset();\n";
+    }
+    f << "   pRecords.reset();\n";
+    f << "}\n";
+    f << "const char* " << nsname << "::CaptureIO() {\n";
+    f << "   return pIO ? pIO->name() : \"\";\n";
+    f << "}\n\n";
+
+    f << "// Setup event - resets the instances\n\n";
+    f << "void " << nsname << "::SetupEvent() {\n";
+    f << "   resetInstances(instanceStruct);\n";
+    f << "}\n";
+    if (context) {
+        f << "void " << nsname << "::SetupEvent(EventContext& context) {\n";
+        f << "   resetInstances(context);\n";
+        f << "}\n";
+    }
+    f << "\n// CommitEvent  Appends the event's record\n\n";
+    f << "namespace {\n";
+    f << "template <class Instances>\n";
+    f << "void appendEvent(const Instances& data) {\n";
+    if (heap) {
+        f << "   captureEvent(*" << nsname << "::pImage, data, *" << nsname << "::pHeap);\n";
+        f << "   " << nsname << "::pRecords->append(" << nsname << "::pImage.get(), sizeof("
+          << nsname << "::capture::EventRecord));\n";
+    } else {
+        f << "   static_assert(sizeof(data) == sizeof(" << nsname << "::capture::EventRecord),\n";
+        f << "                 \"The instances must be laid out like their record\");\n";
+        f << "   " << nsname << "::pRecords->append(&data, sizeof(data));      // Its own image.\n";
+    }
+    f << "}\n";
+    f << "}\n";
+    f << "void " << nsname << "::CommitEvent() {\n";
+    f << "   appendEvent(instanceStruct);\n";
+    f << "}\n";
+    if (context) {
+        f << "void " << nsname << "::CommitEvent(EventContext& context) {\n";
+        f << "   appendEvent(context);\n";
+        f << "}\n";
+    }
+    f << "\n";
+
+    if (!options.s_batch.empty()) {
+        f << "// SetupBatch and CommitBatch - SetupEvent and CommitEvent for a batch\n\n";
+        f << "void " << nsname << "::SetupBatch(EventBatch& batch) {\n";
+        f << "   for (size_t k = 0; k < batch.size(); k++) {\n";
+        f << "      resetInstances(batch[k]);\n";
+        f << "   }\n";
+        f << "}\n";
+        f << "void " << nsname << "::CommitBatch(EventBatch& batch, size_t n) {\n";
+        f << "   for (size_t k = 0; k < n; k++) {\n";
+        f << "      appendEvent(batch[k]);\n";
+        f << "   }\n";
+        f << "}\n\n";
+    }
+}
+/**
+ * writeResetInstances
+ *    Write resetInstances, which resets instanceStruct or an EventContext.
+ *
+ * @param f         - stream into which the code is generated.
+ * @param instances - the instances.
+ */
+static void
+writeResetInstances(std::ostream& f, const InstanceList& instances)
+{
+    f << "namespace {\n";
+    f << "template <class Instances>\n";
+    f << "void resetInstances(Instances& data) {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeReset(f, *p, "data.");
+    }
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * imageDefinitions
+ *    The definitions of the struct images and EventRecord.  Their text is
+ *    also what the layout hash is computed from.
+ *
+ * @param types     - the type list.
+ * @param instances - the instances.
+ * @return std::string - the definitions.
+ */
+static std::string
+imageDefinitions(const TypeList& types, const InstanceList& instances)
+{
+    std::ostringstream f;
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        f << "struct " << p->s_typename << " {\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            writeImageMember(f, *fld);
+        }
+        f << "};\n";
+    }
+    f << "struct EventRecord {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeImageMember(f, *p);
+    }
+    f << "};\n";
+    return f.str();
+}
+/**
+ * writeRestoreField
+ *    Write the statements that copy a field or instance back from its
+ *    image.  NaN values are skipped so what's copied into looks like it
+ *    did when it was captured:  unset values stay unset.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param i      - the field or instance.
+ * @param data   - what it's a member of, with the trailing . or ::.
+ * @param replay - what restore is called on, with the trailing ., or empty
+ *                 in the Replay class.
+ * @param indent - put before each statement.
+ */
+static void
+writeRestoreField(
+    std::ostream& f, const Instance& i, const std::string& data,
+    const std::string& replay, const std::string& indent
+)
+{
+    std::string name  = data + i.s_name;
+    std::string image = "image." + i.s_name;
+    switch (i.s_type) {
+    case value:
+        f << indent << "if (!std::isnan(" << image << ")) " << name << " = " << image << ";\n";
+        break;
+    case array:
+        f << indent << "for (int i = 0; i < " << i.s_elementCount << "; i++) {\n";
+        f << indent << "   if (!std::isnan(" << image << "[i])) " << name
+          << "[i] = " << image << "[i];\n";
+        f << indent << "}\n";
+        break;
+    case vector:
+        f << indent << replay << "restoreVector(" << name << ", " << image << ");\n";
+        break;
+    case structure:
+        f << indent << replay << "restore(" << name << ", " << image << ");\n";
+        break;
+    case structarray:
+        f << indent << "for (int i = 0; i < " << i.s_elementCount << "; i++) {\n";
+        f << indent << "   " << replay << "restore(" << name << "[i], " << image << "[i]);\n";
+        f << indent << "}\n";
+        break;
+    default:
+        std::cerr << "Unrecognized data type: " << i.s_type << std::endl;
+        std::cerr << i.toString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+/**
+ * writeReplayClass
+ *    Write the Replay class:  the mapped capture and the code that copies
+ *    its records into instances.  That's templated on what it's copied
+ *    into so it works for any target's instances with the same members:
+ *    the Root target's or a SpecTcl EventContext (whose tree parameters
+ *    take doubles) or, one at a time, the namespace's instances.
+ *
+ * @param f         - stream into which the code is generated.
+ * @param types     - the type list.
+ * @param instances - the instances.
+ * @param heap      - true if there are vectors, so there's a heap file.
+ */
+static void
+writeReplayClass(
+    std::ostream& f, const TypeList& types, const InstanceList& instances, bool heap
+)
+{
+    f << "// A capture, mapped read only:\n";
+    f << "//    capture::Replay events(\"run23\");\n";
+    f << "//    for (uint64_t n = 0; n < events.events(); n++) {\n";
+    f << "//       SetupEvent(context);\n";
+    f << "//       events.read(n, context);   ...\n";
+    f << "// read takes anything with the instances as members (an EventContext);\n";
+    f << "// readEvent in the -convert.cpp file reads into the namespace's instances.\n\n";
+    f << "class Replay {\n";
+    f << "public:\n";
+    f << "   explicit Replay(const std::string& base);\n";
+    f << "   ~Replay();\n";
+    f << "   uint64_t events() const { return m_events; }\n";
+    f << "   const EventRecord& record(uint64_t n) const {\n";
+    f << "      if (n >= m_events) {\n";
+    f << "         throw std::out_of_range(\"No such event in the capture\");\n";
+    f << "      }\n";
+    f << "      return reinterpret_cast<const EventRecord*>(m_pRecords + HEADER_BYTES)[n];\n";
+    f << "   }\n";
+    f << "   template <class Instances>\n";
+    f << "   void read(uint64_t n, Instances& data) const {    // Sets what's set in record n.\n";
+    f << "      restore(data, record(n));\n";
+    f << "   }\n\n";
+    f << "   // Copying an image into what it's the image of (NaNs are skipped):\n\n";
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        f << "   template <class T>\n";
+        f << "   void restore(T&& data, const " << p->s_typename << "& image) const {\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            writeRestoreField(f, *fld, "data.", "", "      ");
+        }
+        f << "   }\n";
+    }
+    f << "   template <class T>\n";
+    f << "   void restore(T&& data, const EventRecord& image) const {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeRestoreField(f, *p, "data.", "", "      ");
+    }
+    f << "   }\n";
+    if (heap) {
+        f << "   template <class V>\n";
+        f << "   void restoreVector(V& v, uint64_t at) const {\n";
+        f << "      size_t n;\n";
+        f << "      const double* p = values(at, n);\n";
+        f << "      assign(v, p, n);\n";
+        f << "   }\n";
+    }
+    f << "private:\n";
+    f << "   Replay(const Replay&);\n";
+    f << "   Replay& operator=(const Replay&);\n";
+    f << "   static char* map(const std::string& path, size_t& bytes, uint64_t magic);\n";
+    if (heap) {
+        f << "   const double* values(uint64_t at, size_t& n) const {\n";
+        f << "      if ((at % sizeof(uint64_t)) || (at < HEADER_BYTES) || (at > m_heapBytes - sizeof(uint64_t))) {\n";
+        f << "         throw std::runtime_error(\"Bad vector offset in \" + m_base + \".cap\");\n";
+        f << "      }\n";
+        f << "      n = *reinterpret_cast<const uint64_t*>(m_pHeap + at);\n";
+        f << "      if (n > (m_heapBytes - at - sizeof(uint64_t))/sizeof(double)) {\n";
+        f << "         throw std::runtime_error(m_base + \".heap is truncated\");\n";
+        f << "      }\n";
+        f << "      return reinterpret_cast<const double*>(m_pHeap + at + sizeof(uint64_t));\n";
+        f << "   }\n";
+    }
+    f << "   std::string m_base;\n";
+    f << "   char*       m_pRecords;\n";
+    f << "   size_t      m_recordBytes;\n";
+    f << "   char*       m_pHeap;\n";
+    f << "   size_t      m_heapBytes;\n";
+    f << "   uint64_t    m_events;\n";
+    f << "};\n\n";
+
+    f << "inline char* Replay::map(const std::string& path, size_t& bytes, uint64_t magic) {\n";
+    f << "   int fd = open(path.c_str(), O_RDONLY);\n";
+    f << "   if (fd < 0) {\n";
+    f << "      throw std::runtime_error(\"Can't open \" + path + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   struct stat info;\n";
+    f << "   void* p = MAP_FAILED;\n";
+    f << "   if ((fstat(fd, &info) == 0) && (size_t(info.st_size) >= HEADER_BYTES)) {\n";
+    f << "      bytes = info.st_size;\n";
+    f << "      p = mmap(0, bytes, PROT_READ, MAP_SHARED, fd, 0);\n";
+    f << "   }\n";
+    f << "   close(fd);\n";
+    f << "   if (p == MAP_FAILED) {\n";
+    f << "      throw std::runtime_error(\"Can't map \" + path);\n";
+    f << "   }\n";
+    f << "   const uint64_t* header = static_cast<const uint64_t*>(p);\n";
+    f << "   if ((header[0] != magic) || (header[1] != LAYOUT)) {\n";
+    f << "      munmap(p, bytes);\n";
+    f << "      throw std::runtime_error(path + \" isn't a capture of these declarations\");\n";
+    f << "   }\n";
+    f << "   return static_cast<char*>(p);\n";
+    f << "}\n";
+    f << "inline Replay::Replay(const std::string& base) :\n";
+    f << "   m_base(base), m_pRecords(0), m_recordBytes(0), m_pHeap(0), m_heapBytes(0), m_events(0) {\n";
+    f << "   m_pRecords = map(base + \".cap\", m_recordBytes, CAPTURE_MAGIC);\n";
+    f << "   const uint64_t* header = reinterpret_cast<const uint64_t*>(m_pRecords);\n";
+    f << "   if ((header[2] != sizeof(EventRecord))\n";
+    f << "       || ((m_recordBytes - HEADER_BYTES) % sizeof(EventRecord))) {\n";
+    f << "      munmap(m_pRecords, m_recordBytes);\n";
+    f << "      throw std::runtime_error(base + \".cap is truncated or has the wrong record size\");\n";
+    f << "   }\n";
+    f << "   m_events = (m_recordBytes - HEADER_BYTES)/sizeof(EventRecord);\n";
+    if (heap) {
+        f << "   try {\n";
+        f << "      m_pHeap = map(base + \".heap\", m_heapBytes, HEAP_MAGIC);\n";
+        f << "   }\n";
+        f << "   catch (...) {\n";
+        f << "      munmap(m_pRecords, m_recordBytes);\n";
+        f << "      throw;\n";
+        f << "   }\n";
+    }
+    f << "}\n";
+    f << "inline Replay::~Replay() {\n";
+    f << "   munmap(m_pRecords, m_recordBytes);\n";
+    f << "   if (m_pHeap) munmap(m_pHeap, m_heapBytes);\n";
+    f << "}\n";
+}
+/**
+ * generateReplay
+ *    Generate base-replay.h, the record layout and the header only replay
+ *    code.  It doesn't need base.h, so it can be used with the code any
+ *    target generates.  The writer includes it for the record layout.
+ *
+ * @param base      - output file base name.
+ * @param nsname    - namespace;  the replay code goes in nsname::capture.
+ * @param types     - the type list.
+ * @param instances - the instances.
+ * @return bool - true if the file was written.
+ */
+static bool
+generateReplay(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances
+)
+{
+    std::string headerName = base + "-replay.h";
+    OutputFile f(headerName);
+    commentHeader(f, headerName, "Record layout and header only replay of the capture");
+    std::string guard = guardName(headerName);
+    bool heap = hasVectors(types, instances);
+    std::string images = imageDefinitions(types, instances);
+
+    f << "#ifndef " << guard << "\n";
+    f << "#define " << guard << "\n";
+    f << "#include <cerrno>\n";
+    f << "#include <cmath>\n";
+    f << "#include <cstddef>\n";
+    f << "#include <cstring>\n";
+    f << "#include <stdexcept>\n";
+    f << "#include <string>\n";
+    f << "#include <vector>\n";
+    f << "#include <stdint.h>\n";
+    f << "#include <fcntl.h>\n";
+    f << "#include <sys/mman.h>\n";
+    f << "#include <sys/stat.h>\n";
+    f << "#include <unistd.h>\n";
+    f << "\nnamespace " << nsname << " {\n";
+    f << "namespace capture {\n\n";
+    f << "const uint64_t CAPTURE_MAGIC(0x31504143584e4547ULL);   // \"GENXCAP1\"\n";
+    f << "const uint64_t HEAP_MAGIC(0x31504548584e4547ULL);      // \"GENXHEP1\"\n";
+    f << "const uint64_t LAYOUT(0x" << std::hex << contentHash(images) << std::dec << "ULL);\n";
+    f << "const size_t   HEADER_BYTES(64);\n\n";
+    f << "// The struct images and the record:\n\n";
+    f << images << "\n";
+    if (heap) {
+        f << "// Setting a vector from the heap:\n\n";
+        f << "template <class T>\n";
+        f << "void assign(std::vector<T>& v, const double* p, size_t n) {\n";
+        f << "   v.assign(p, p + n);\n";
+        f << "}\n";
+        f << "template <class V>\n";
+        f << "void assign(V& v, const double* p, size_t n) {    // E.g. a CTreeParameterVector.\n";
+        f << "   for (size_t i = 0; i < n; i++) v[i] = p[i];\n";
+        f << "}\n\n";
+    }
+    writeReplayClass(f, types, instances, heap);
+    f << "}\n";
+    f << "}\n";
+    f << "#endif\n";
+    return f.close();
+}
+/**
+ * generateConverter
+ *    Generate base-convert.cpp, a program that converts a capture to a
+ *    Root tree.  It's compiled with the code the Root target generates
+ *    from the same declarations and base name, in another directory
+ *    (as genx --target=capture,root does):  that base.h is found with -I,
+ *    this directory's base-replay.h as a local include.
+ *
+ *    Its readEvent copies a record into the namespace's instances, which
+ *    the SpecTcl target declares the same way;  compiled with -DREPLAY_ONLY
+ *    there's just readEvent, for replaying into SpecTcl.
+ *
+ * @param base      - output file base name.
+ * @param nsname    - namespace of the generated code.
+ * @param instances - the instances.
+ * @return bool - true if the file was written.
+ */
+static bool
+generateConverter(const std::string& base, const std::string& nsname, const InstanceList& instances)
+{
+    std::string fname = base + "-convert.cpp";
+    std::string name  = baseName(base);
+    OutputFile f(fname);
+    commentHeader(f, fname, "Converts a capture to a Root tree");
+    f << "//  Build with the Root target's code for the same declarations, e.g.:\n";
+    f << "//     genx --target=capture,root decls " << name << "\n";
+    f << "//     cd capture\n";
+    f << "//     g++ -o " << name << "-convert -I../root " << name << "-convert.cpp ../root/"
+      << name << ".cpp ../root/dict.cxx `root-config --cflags --libs`\n";
+    f << "//  Usage:\n";
+    f << "//     " << name << "-convert capture-base rootfile\n";
+    f << "//  With -DREPLAY_ONLY and -I the SpecTcl target's code there's no main, just\n";
+    f << "//  readEvent for an event processor to call after SetupEvent.\n\n";
+    f << "#include <" << name << ".h>             // The Root or SpecTcl target's.\n";
+    f << "#include \"" << name << "-replay.h\"\n";
+    f << "#include <stdint.h>\n";
+    f << "#ifndef REPLAY_ONLY\n";
+    f << "#include <TFile.h>\n";
+    f << "#include <exception>\n";
+    f << "#include <iostream>\n";
+    f << "#include <stdlib.h>\n";
+    f << "#endif\n\n";
+    f << "// Copies what's set in record n into the instances.\n\n";
+    f << "void readEvent(const " << nsname << "::capture::Replay& replay, uint64_t n) {\n";
+    f << "   const " << nsname << "::capture::EventRecord& image(replay.record(n));\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeRestoreField(f, *p, nsname + "::", "replay.", "   ");
+    }
+    f << "}\n\n";
+    f << "#ifndef REPLAY_ONLY\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   if (argc != 3) {\n";
+    f << "      std::cerr << \"Usage: \" << argv[0] << \" capture-base rootfile\\n\";\n";
+    f << "      return EXIT_FAILURE;\n";
+    f << "   }\n";
+    f << "   try {\n";
+    f << "      " << nsname << "::capture::Replay replay(argv[1]);\n";
+    f << "      TFile file(argv[2], \"RECREATE\");\n";
+    f << "      " << nsname << "::Initialize();\n";
+    f << "      for (uint64_t n = 0; n < replay.events(); n++) {\n";
+    f << "         " << nsname << "::SetupEvent();\n";
+    f << "         readEvent(replay, n);\n";
+    f << "         " << nsname << "::CommitEvent();\n";
+    f << "      }\n";
+    f << "      file.Write();\n";
+    f << "      file.Close();\n";
+    f << "   }\n";
+    f << "   catch (std::exception& e) {\n";
+    f << "      std::cerr << argv[0] << \": \" << e.what() << std::endl;\n";
+    f << "      return EXIT_FAILURE;\n";
+    f << "   }\n";
+    f << "   return EXIT_SUCCESS;\n";
+    f << "}\n";
+    f << "#endif\n";
+    return f.close();
+}
+/**
+ * generateCPP
+ *    Generate the C++ file.
+ * @param base - output file base name.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @param instances - The instance definitions.
+ * @param options - generation options.  With --split the struct
+ *                  implementations are in their own files.
+ * @return bool - true if the file was written.
+ */
+static bool
+generateCPP(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    std::string fname = base + ".cpp";
+    bool heap = hasVectors(types, instances);
+    OutputFile f(fname);
+    generatePrologue(f, fname, base, true);
+    if (!options.s_split) {
+        generateStructImplementations(f, nsname, types.begin(), types.end());
+    }
+    generateInstances(f, nsname, instances, options);
+    writeResetInstances(f, instances);
+    writeAsyncIO(f);
+    writeStream(f);
+    if (heap) {
+        writeCapture(f, nsname, types, instances);
+    }
+    generateAPI(f, nsname, heap, options);
+    return f.close();
+}
+/**
+ * generateStructCPPs
+ *    For --split, generate base-typename.cpp for each struct with its
+ *    methods and list them with base.cpp in base.mk.
+ *
+ * @param base - output file base name.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @return bool - true if the files were written.
+ */
+static bool
+generateStructCPPs(const std::string& base, const std::string& nsname, const TypeList& types)
+{
+    std::vector<std::string> sources(1, base + ".cpp");
+    bool ok = true;
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        std::string fname = base + "-" + p->s_typename + ".cpp";
+        OutputFile f(fname);
+        generatePrologue(f, fname, base, false);
+        generateStructImplementations(f, nsname, p, p + 1);
+        ok = f.close() && ok;
+        sources.push_back(fname);
+    }
+    return writeSourceList(base, sources) && ok;
+}
+/**
+ * generateCapture
+ *   Generate the header, writer, replay header and converter from the
+ *   intermediate representation.
+ *
+ * @param base      - output file base name (may include a path).
+ * @param nsname    - namespace the generated code lives in.
+ * @param types     - the derived type definitions.
+ * @param instances - the instance definitions.
+ * @param options   - generation options:  --split, --context and --batch.
+ *                    The others are ignored.
+ * @return bool - true if all the files were written.
+ */
+bool
+generateCapture(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    checkNames(types);
+    bool ok = generateHeader(base, nsname, types, instances, options);
+    ok = generateCPP(base, nsname, types, instances, options) && ok;
+    ok = generateReplay(base, nsname, types, instances) && ok;
+    ok = generateConverter(base, nsname, instances) && ok;
+    if (options.s_split) {
+        ok = generateStructCPPs(base, nsname, types) && ok;
+    }
+    return ok;
+}
@@ -0,0 +1,281 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  columnarbench.cpp
+ *  @brief: Measure reading columnar files vs. reading a TTree.
+ */
+
+/**
+ * Generates code for a declaration file with columnargenerate and with
+ * rootgenerate.  Each is compiled with a driver that writes the same
+ * events and then reads them back twice:  every column, and just one
+ * (adc).  The TTree is read with GetEntry (with only the adc branch
+ * enabled for the one column read);  the columnar files through the
+ * generated reader's spans.  For each the driver reports:
+ *   -  Events per second written.
+ *   -  Bytes of file per event.
+ *   -  Events per second read, all columns and one column.
+ *   -  The sum of the values read, which should be the same for both.
+ * The files were just written, so they're read from the page cache:  the
+ * reads measure the cost of getting the values out of the files, not
+ * the disk.
+ *
+ * Usage:
+ *     columnarbench ?parser? ?columnargenerate? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser           - path to the parser (defaults to ../intermed/parser).
+ *  columnargenerate - path to the generator (defaults to ./columnargenerate).
+ *  rootgenerate     - path to the Root generator
+ *                     (defaults to ../RootGenerator/rootgenerate).
+ *  compile-flags    - compiler and linker flags for Root
+ *                     (defaults to `root-config --cflags --libs`).
+ *                     The compiler is $CXX or g++.
+ *  rootcling        - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+
+static const int EVENTS(200000);
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "   array w[4]\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[512]\n";
+    f << "structarrayinstance det dets[64]\n";
+    f << "vector hits\n";
+}
+/**
+ * writeDriver
+ *    Write the driver.  It takes the output base name and the number of
+ *    events on its command line and outputs the figures described above
+ *    on one line.  Compiled with -DCOLUMNAR it's the columnar driver,
+ *    otherwise the TTree driver.
+ *
+ * @param filename - driver file.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n";
+    f << "#ifdef COLUMNAR\n";
+    f << "#include \"bench-reader.h\"\n";
+    f << "#include <sys/stat.h>\n";
+    f << "#else\n";
+    f << "#include <TFile.h>\n#include <TTree.h>\n";
+    f << "#endif\n";
+    f << "#include <fstream>\n#include <string>\n";
+    f << "#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "static void unpack(int e) {\n";
+    f << "   bench::multiplicity = e % 512;\n";
+    f << "   for (int i = 0; i < 512; i++) bench::adc[i] = (e + i) % 4096;\n";
+    f << "   for (int i = 0; i < 64; i++) {\n";
+    f << "      bench::dets[i].e = (e*i) % 4096;\n";
+    f << "      bench::dets[i].t = e % 1000;\n";
+    f << "      for (int j = 0; j < 4; j++) bench::dets[i].w[j] = i + j;\n";
+    f << "   }\n";
+    f << "   for (int i = 0; i < e % 8; i++) bench::hits.push_back(i);\n";
+    f << "}\n";
+    f << "static double sum(const double* p, size_t n) {\n";
+    f << "   double result = 0;\n";
+    f << "   for (size_t i = 0; i < n; i++) result += p[i];\n";
+    f << "   return result;\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   std::string base = argv[1];\n";
+    f << "   int events = atoi(argv[2]);\n";
+    f << "   double start = now();\n";
+    f << "#ifdef COLUMNAR\n";
+    f << "   bench::Initialize(base.c_str());\n";
+    f << "#else\n";
+    f << "   TFile* file = new TFile((base + \".root\").c_str(), \"RECREATE\");\n";
+    f << "   bench::Initialize();\n";
+    f << "#endif\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      bench::SetupEvent();\n";
+    f << "      unpack(e);\n";
+    f << "      bench::CommitEvent();\n";
+    f << "   }\n";
+    f << "   double bytes = 0;\n";
+    f << "#ifdef COLUMNAR\n";
+    f << "   bench::Finish();\n";
+    f << "   std::ifstream index((base + \".columns\").c_str());\n";
+    f << "   std::string directory = base.substr(0, base.rfind('/') + 1);\n";
+    f << "   std::string line, name;\n";
+    f << "   std::getline(index, line);\n";
+    f << "   while (index >> name >> line) {\n";
+    f << "      struct stat info;\n";
+    f << "      stat((directory + name).c_str(), &info);\n";
+    f << "      bytes += info.st_size;\n";
+    f << "   }\n";
+    f << "#else\n";
+    f << "   file->Write();\n";
+    f << "   bytes = file->GetEND();\n";
+    f << "   file->Close();\n";
+    f << "#endif\n";
+    f << "   double written = events/(now() - start);\n\n";
+
+    f << "   double all = 0, one = 0;\n";
+    f << "   start = now();\n";
+    f << "#ifdef COLUMNAR\n";
+    f << "   {\n";
+    f << "      bench::columnar::Reader in(base);\n";
+    f << "      for (size_t k = 0; k < in.chunks(); k++) {\n";
+    f << "         const bench::columnar::Chunk& c(in[k]);\n";
+    f << "         all += sum(c.multiplicity().data(), c.rows());\n";
+    f << "         all += sum(c.adc().values().data(), c.adc().values().size());\n";
+    f << "         all += sum(c.dets_e().values().data(), c.dets_e().values().size());\n";
+    f << "         all += sum(c.dets_t().values().data(), c.dets_t().values().size());\n";
+    f << "         all += sum(c.dets_w().values().data(), c.dets_w().values().size());\n";
+    f << "         all += sum(c.hits().values().data(), c.hits().values().size());\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "#else\n";
+    f << "   {\n";
+    f << "      TFile in((base + \".root\").c_str());\n";
+    f << "      TTree* tree = static_cast<TTree*>(in.Get(\"bench\"));\n";
+    f << "      tree->SetBranchAddress(\"multiplicity\", &bench::multiplicity);\n";
+    f << "      tree->SetBranchAddress(\"adc\", bench::adc);\n";
+    f << "      bench::det* dets[64];\n";
+    f << "      for (int i = 0; i < 64; i++) {\n";
+    f << "         char name[16];\n";
+    f << "         sprintf(name, \"dets_%02d\", i);\n";
+    f << "         dets[i] = &bench::dets[i];\n";
+    f << "         tree->SetBranchAddress(name, &dets[i]);\n";
+    f << "      }\n";
+    f << "      std::vector<double>* hits = &bench::hits;\n";
+    f << "      tree->SetBranchAddress(\"hits\", &hits);\n";
+    f << "      for (Long64_t e = 0; e < tree->GetEntries(); e++) {\n";
+    f << "         tree->GetEntry(e);\n";
+    f << "         all += bench::multiplicity;\n";
+    f << "         all += sum(bench::adc, 512);\n";
+    f << "         for (int i = 0; i < 64; i++) {\n";
+    f << "            all += bench::dets[i].e + bench::dets[i].t + sum(bench::dets[i].w, 4);\n";
+    f << "         }\n";
+    f << "         all += sum(hits->data(), hits->size());\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "#endif\n";
+    f << "   double readAll = events/(now() - start);\n\n";
+
+    f << "   start = now();\n";
+    f << "#ifdef COLUMNAR\n";
+    f << "   {\n";
+    f << "      bench::columnar::Reader in(base);\n";
+    f << "      for (size_t k = 0; k < in.chunks(); k++) {\n";
+    f << "         bench::columnar::Span<double> adc = in[k].adc().values();\n";
+    f << "         one += sum(adc.data(), adc.size());\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "#else\n";
+    f << "   {\n";
+    f << "      TFile in((base + \".root\").c_str());\n";
+    f << "      TTree* tree = static_cast<TTree*>(in.Get(\"bench\"));\n";
+    f << "      tree->SetBranchStatus(\"*\", 0);\n";
+    f << "      tree->SetBranchStatus(\"adc\", 1);\n";
+    f << "      tree->SetBranchAddress(\"adc\", bench::adc);\n";
+    f << "      for (Long64_t e = 0; e < tree->GetEntries(); e++) {\n";
+    f << "         tree->GetEntry(e);\n";
+    f << "         one += sum(bench::adc, 512);\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "#endif\n";
+    f << "   double readOne = events/(now() - start);\n";
+    f << "   printf(\"%f %f %f %f %.0f\\n\", written, bytes/events, readAll, readOne, all + one);\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+/**
+ * report
+ *    Run a driver and output what it measured.
+ *
+ * @param target  - what it was generated for.
+ * @param command - command that runs it.
+ */
+static void
+report(const char* target, const std::string& command)
+{
+    std::istringstream result(run(command));
+    double written, fileBytes, readAll, readOne;
+    std::string sum;
+    result >> written >> fileBytes >> readAll >> readOne >> sum;
+    std::cout << std::setw(10) << target
+              << std::fixed << std::setprecision(0) << std::setw(12) << written
+              << std::setprecision(1) << std::setw(13) << fileBytes
+              << std::setprecision(0) << std::setw(12) << readAll
+              << std::setw(12) << readOne << "  " << sum << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./columnargenerate";
+    std::string rootgen   = argc > 3 ? argv[3] : "../RootGenerator/rootgenerate";
+    std::string flags     = argc > 4 ? argv[4] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 5 ? argv[5] : "rootcling";
+
+    std::string dir = makeBenchDirectory("columnarbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    std::string cdir = dir + "/columnar";
+    run("mkdir " + cdir);
+    run(generator + " " + cdir + "/bench " + dir + "/bench.gxir");
+    compile(cdir + "/driver", cdir, dir + "/driver.cpp " + cdir + "/bench.cpp", "-DCOLUMNAR");
+    std::string rdir = dir + "/root";
+    run("mkdir " + rdir);
+    run(rootgen + " " + rdir + "/bench " + dir + "/bench.gxir");
+    makeDictionary(rootcling, rdir);
+    compile(
+        rdir + "/driver", rdir,
+        dir + "/driver.cpp " + rdir + "/bench.cpp " + rdir + "/dict.cxx", flags
+    );
+
+    std::cout << EVENTS << " events\n";
+    std::cout << std::setw(10) << "target" << std::setw(12) << "events/s"
+              << std::setw(13) << "file/event" << std::setw(12) << "read all/s"
+              << std::setw(12) << "read one/s" << "  sum" << std::endl;
+    std::ostringstream events;
+    events << " " << EVENTS;
+    report("columnar", cdir + "/driver " + cdir + "/bench" + events.str());
+    report("root", rdir + "/driver " + rdir + "/bench" + events.str());
+
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,108 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  columnardriver.cpp
+ *  @brief: main for the standalone columnar binary code generator.
+ */
+
+/**
+ * This program generates code to support environment neutral unpacking
+ * of event data written as columns of doubles in plain binary files.  The
+ * intermediate representation is taken as input on stdin (so we can be
+ * pipelined) or from a .gxir file.
+ *
+ * Usage:
+ *      columnargenerate ?--split? ?--context? ?--batch=n? basename ?irfile?
+ *
+ * Which generates basename.h and basename.cpp, the writer, and
+ * basename-reader.h, a header only reader that maps the files the writer
+ * writes.  Neither needs Root or SpecTcl.  --split, --context and --batch
+ * are as for rootgenerate;  the other options are accepted and ignored.
+ */
+#include "columnargenerate.h"
+#include "irfile.h"
+#include <iostream>
+#include <stdlib.h>
+
+/**
+ * usage
+ *    Outputs an error message and program usage text to the desired
+ *    stream.
+ *
+ * @param f - the stream to which output is directed.
+ * @param msg - the message that precedes the usage text.
+ */
+static void
+usage(std::ostream& f, const char * msg)
+{
+    f << msg << std::endl;
+    f << "Usage\n";
+    f << "   columnargenerate ?--split? ?--context? ?--batch=n? basename ?irfile?\n";
+    f << "Where:\n";
+    f << "   --split  also writes a .cpp for each struct and a list of the .cpp\n";
+    f << "            files (basename.mk) so they can be compiled in parallel\n";
+    f << "   --context makes the instances members of an EventContext class and adds\n";
+    f << "            SetupEvent and CommitEvent overloads that take one\n";
+    f << "   --batch=n implies --context and adds an EventBatch of n EventContexts\n";
+    f << "            with SetupBatch and CommitBatch\n";
+    f << "            The other options rootgenerate takes are accepted and ignored.\n";
+    f << "   basename is the base name for the generated files.  The files\n";
+    f << "            created are basename.h, basename.cpp and basename-reader.h\n";
+    f << "   irfile   is a .gxir intermediate representation file.  If it's omitted\n";
+    f << "            the intermediate representation is read from stdin\n";
+
+    exit(EXIT_FAILURE);
+}
+/**
+ * main
+ *   entry point
+ */
+int main (int argc, char** argv)
+{
+    GenerateOptions options;
+    int first = parseGenerateOptions(argc, argv, options);
+    if (first < 0) {
+        usage(std::cerr, "Unrecognized option");
+    }
+    if (optionConflict(options)) {
+        usage(std::cerr, optionConflict(options));
+    }
+    argc -= first - 1;                    // Now as if there were no options.
+    argv += first - 1;
+    if ((argc != 2) && (argc != 3)) {
+        usage(std::cerr, "Incorrect number of command line parameters");
+    }
+    IrFile ir;
+    bool ok = argc == 3 ? ir.open(argv[2]) : ir.read(std::cin);
+    if (!ok) {
+        std::cerr << "columnargenerate: " << ir.error() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    TypeList types;
+    InstanceList instances;
+    ir.load(nsName, types, instances);
+
+    std::string base = argv[1];
+    if (!generateColumnar(base, namespaceFor(base), types, instances, options)) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+void yyerror(const char* msg)
+{
+    usage(std::cerr, msg);
+}
@@ -0,0 +1,1325 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  columnargenerate.cpp
+ *  @brief: Code generator for framework free columnar binary output.
+ */
+
+/**
+ * This module generates the same unpacking API as rootgenerate.cpp but the
+ * events are written as columns of doubles in plain binary files that
+ * need neither Root nor SpecTcl to write or read.  It is linked both into
+ * the standalone columnargenerate program (see columnardriver.cpp) and
+ * directly into genx.
+ *
+ * Each leaf of the IR is a column:
+ *   -  value       - one double per event.
+ *   -  array       - n doubles per event, the elements in order.
+ *   -  vector      - an offsets column and a values column (see below).
+ *   -  structure   - a column for each leaf of the struct, named
+ *                    instance.field.
+ *   -  structarray - as structure, but each column holds the field of
+ *                    every element, element 0 first.
+ * A leaf inside struct arrays (which can nest) has as many values per
+ * event as the product of the element counts;  they're stored with the
+ * outermost index varying slowest.
+ *
+ * A vector leaf is a collection per event (or per struct array element).
+ * Its values are all stored end to end in the values column;  the offsets
+ * column has, for collection k of the chunk, offsets[k] and offsets[k+1]
+ * bracketing its values.  offsets[0] is 0 so there's one more offset
+ * than collections.
+ *
+ * The writer buffers a chunk of events and writes it to base-nnnn.col:
+ *   -  A header of uint64_t:  magic, layout hash, rows (events), columns.
+ *   -  A table of uint64_t pairs, the byte offset and number of elements
+ *      of each column.
+ *   -  The columns, each 64 byte aligned.  The fixed width columns come
+ *      first in leaf order, then the offsets and values of each vector.
+ *      All elements are 8 bytes:  doubles, or uint64_t offsets.
+ * base.columns lists the chunk files and the rows in each.  Data are in
+ * the writer's byte order.
+ *
+ * generateColumnar(basename, ...) generates basename.h and basename.cpp,
+ * the writer, and basename-reader.h.  The reader is header only:  it maps
+ * each chunk file and returns spans of the columns in place, without
+ * copying or converting them.
+ */
+
+#include "columnargenerate.h"
+#include "outputfile.h"
+#include "contenthash.h"
+#include <iostream>
+#include <sstream>
+#include <set>
+#include <stdlib.h>
+#include <libgen.h>
+#include <string.h>
+
+static const char* programVersionString("columnargenerate version 1.0 (c) NSCL/FRIB");
+static const int DEFAULT_CHUNK_EVENTS(65536);
+
+/**
+ * A leaf of the IR flattened into a column.  access is how the generated
+ * code gets at it from the instances, using i0, i1... for the indices of
+ * the struct arrays it's in, and loops are the element counts of those
+ * struct arrays.  elements is the element count of an array leaf (1 for
+ * values and vectors).
+ */
+struct Leaf {
+    std::string           s_name;
+    std::string           s_access;
+    std::vector<unsigned> s_loops;
+    unsigned              s_elements;
+    bool                  s_jagged;
+
+    unsigned width() const {
+        unsigned result = s_elements;
+        for (size_t i = 0; i < s_loops.size(); i++) {
+            result *= s_loops[i];
+        }
+        return result;
+    }
+};
+typedef std::vector<Leaf> LeafList;
+
+/**
+ * commentHeader
+ *    Generate a comment header for a file.
+ * @param f - the file into which the header is generated.
+ * @param filename -name of the file.
+ * @param descrip - brief description
+ */
+static void commentHeader(std::ostream& f, const std::string& filename,  const char* descrip)
+{
+    f << "/**\n";
+    f << "*  @file  " << filename << std::endl;
+    f << "*  @brief " << descrip  << std::endl;
+    f << "*\n";
+    f << "*   This file was generated by " << programVersionString << std::endl;
+    f << "*   Do NOT edit by hand\n";
+    f << "*/\n";
+}
+/**
+ * baseName
+ *   @param path - a file path.
+ *   @return std::string - path with any leading directories stripped off.
+ */
+static std::string
+baseName(const std::string& path)
+{
+    char cstrName[path.size() + 1];
+    strcpy(cstrName, path.c_str());
+    return basename(cstrName);
+}
+/**
+ * findType
+ *   @param types - the type list.
+ *   @param name  - name of a type.
+ *   @return const TypeDefinition& - the type called name.
+ */
+static const TypeDefinition&
+findType(const TypeList& types, const std::string& name)
+{
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        if (p->s_typename == name) {
+            return *p;
+        }
+    }
+    std::cerr << "Undefined struct type: " << name << std::endl;
+    exit(EXIT_FAILURE);
+}
+/**
+ * flatten
+ *    Add the leaves of a field or instance to the leaf list.
+ *
+ * @param types  - the type list.
+ * @param i      - the field or instance.
+ * @param name   - column name of i.
+ * @param access - expression for i relative to the instances.
+ * @param loops  - element counts of the struct arrays i is in.
+ * @param leaves - the list the leaves are added to.
+ */
+static void
+flatten(
+    const TypeList& types, const Instance& i, const std::string& name,
+    const std::string& access, const std::vector<unsigned>& loops, LeafList& leaves
+)
+{
+    Leaf leaf;
+    leaf.s_name     = name;
+    leaf.s_access   = access;
+    leaf.s_loops    = loops;
+    leaf.s_elements = 1;
+    leaf.s_jagged   = false;
+    switch (i.s_type) {
+    case value:
+        leaves.push_back(leaf);
+        break;
+    case array:
+        leaf.s_elements = i.s_elementCount;
+        leaves.push_back(leaf);
+        break;
+    case vector:
+        leaf.s_jagged = true;
+        leaves.push_back(leaf);
+        break;
+    case structure:
+    case structarray:
+        {
+            const TypeDefinition& type(findType(types, i.s_typename));
+            std::string element = access;
+            std::vector<unsigned> elementLoops(loops);
+            if (i.s_type == structarray) {
+                std::ostringstream index;
+                index << "[i" << loops.size() << "]";
+                element += index.str();
+                elementLoops.push_back(i.s_elementCount);
+            }
+            for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
+                flatten(
+                    types, *p, name + "." + p->s_name, element + "." + p->s_name,
+                    elementLoops, leaves
+                );
+            }
+        }
+        break;
+    default:
+        std::cerr << "Unrecognized data type: " << i.s_type << std::endl;
+        std::cerr << i.toString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+/**
+ * accessorName
+ *   @param leaf - a leaf.
+ *   @return std::string - the name of the reader method that returns its
+ *                         column:  the column name with . replaced by _.
+ */
+static std::string
+accessorName(const Leaf& leaf)
+{
+    std::string result = leaf.s_name;
+    for (size_t i = 0; i < result.size(); i++) {
+        if (result[i] == '.') {
+            result[i] = '_';
+        }
+    }
+    return result;
+}
+/**
+ * makeLeaves
+ *    Flatten the instances into their leaves, fixed width leaves first
+ *    (that's the order of their columns in the files), and make sure each
+ *    leaf gets its own reader method.
+ *
+ * @param types     - the type list.
+ * @param instances - the instances.
+ * @return LeafList - the leaves.
+ */
+static LeafList
+makeLeaves(const TypeList& types, const InstanceList& instances)
+{
+    LeafList all;
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        flatten(types, *p, p->s_name, p->s_name, std::vector<unsigned>(), all);
+    }
+    LeafList result;
+    for (size_t i = 0; i < all.size(); i++) {
+        if (!all[i].s_jagged) result.push_back(all[i]);
+    }
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i].s_jagged) result.push_back(all[i]);
+    }
+
+    std::set<std::string> names;
+    names.insert("Chunk");               // The reader's own members.
+    names.insert("rows");
+    names.insert("m_pBase");
+    names.insert("m_bytes");
+    names.insert("m_rows");
+    for (size_t i = 0; i < result.size(); i++) {
+        if (!names.insert(accessorName(result[i])).second) {
+            std::cerr << "The column " << result[i].s_name << " has the same reader method ("
+                      << accessorName(result[i]) << ") as another column or the reader\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    return result;
+}
+/**
+ * fixedCount
+ *   @param leaves - the leaves.
+ *   @return size_t - how many have a fixed width column.
+ */
+static size_t
+fixedCount(const LeafList& leaves)
+{
+    size_t result = 0;
+    for (size_t i = 0; i < leaves.size(); i++) {
+        if (!leaves[i].s_jagged) result++;
+    }
+    return result;
+}
+/**
+ * layoutHash
+ *    Hash of the columns and their widths.  The writer puts it in each
+ *    chunk file and the reader checks it, so a reader generated for other
+ *    declarations can't misread the files.
+ *
+ * @param leaves - the leaves.
+ * @return uint64_t - the hash.
+ */
+static uint64_t
+layoutHash(const LeafList& leaves)
+{
+    std::ostringstream layout;
+    for (size_t i = 0; i < leaves.size(); i++) {
+        layout << leaves[i].s_name << (leaves[i].s_jagged ? " offsets " : " ")
+               << leaves[i].width() << "\n";
+    }
+    return contentHash(layout.str());
+}
+/**
+ * writeMember
+ *    Write the declaration of a struct field or instance:
+ *    values are doubles, arrays are arrays of doubles, vectors are
+ *    std::vector<double> and structures and struct arrays are their type.
+ *    The layout, storage and branches attributes don't apply;  every leaf
+ *    is already its own column.
+ *
+ * @param f      - stream to which the declaration is written.
+ * @param i      - the field or instance.
+ * @param prefix - put before the name, e.g. "(&" for a reference.
+ * @param suffix - put after the name.
+ */
+static void
+writeMember(
+    std::ostream& f, const Instance& i, const char* prefix = "", const char* suffix = ""
+)
+{
+    std::string type = "double";
+    if ((i.s_type == structure) || (i.s_type == structarray)) {
+        type = i.s_typename;
+    }
+    if (i.s_type == vector) {
+        type = "std::vector<double>";
+    }
+    f << type << " " << prefix << i.s_name << suffix;
+    if ((i.s_type == array) || (i.s_type == structarray)) {
+        f << "[" << i.s_elementCount << "]";
+    }
+}
+/**
+ * writeStructureDefs
+ *    Write the struct definitions.  Each is a plain struct whose
+ *    constructor calls Reset, which sets everything in it to NaN (vectors
+ *    are emptied).
+ *
+ * @param f  - stream to which the code is written.
+ * @param types - List of type definitions to write.
+ */
+static void
+writeStructureDefs(std::ostream& f, const TypeList& types)
+{
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        f << "struct " << p->s_typename << " {\n";
+        f << "   " << p->s_typename << "();\n";
+        f << "   void Reset();\n\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            f << "   ";
+            writeMember(f, *fld);
+            f << ";\n";
+        }
+        f << "};\n\n";
+    }
+}
+/**
+ * writeInstanceMembers
+ *    Write the instances as members of a struct.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ */
+static void
+writeInstanceMembers(std::ostream& f, const InstanceList& instances)
+{
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "   ";
+        writeMember(f, *p);
+        f << ";\n";
+    }
+}
+/**
+ * writeInstanceDefs
+ *    Write the declarations of the instances:  as for the Root target they
+ *    are all members of instanceStruct and there's a reference to each.
+ *    With --context instanceStruct is an EventContext.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ * @param options - generation options.
+ */
+static void
+writeInstanceDefs(
+    std::ostream& f, const InstanceList& instances, const GenerateOptions& options
+)
+{
+    if (options.s_context) {
+        f << "// An event's worth of instances.  Several can be unpacked at once.\n\n";
+        f << "class EventContext {\n";
+        f << "public:\n";
+        writeInstanceMembers(f, instances);
+        f << "};\n\n";
+    }
+    f << "#ifndef IMPLEMENTATION_MODULE\n\n";
+    if (options.s_context) {
+        f << " extern EventContext instanceStruct;       // The one the API without a context uses.\n";
+    } else {
+        f << " extern struct {\n";
+        writeInstanceMembers(f, instances);
+        f << "}  instanceStruct;\n";
+    }
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "extern    ";
+        writeMember(f, *p, "(&", ")");
+        f << ";\n";
+    }
+    f << "\n#endif\n\n";
+}
+/**
+ * writeApiPrototypes
+ *    Writes the prototypes for the API functions.
+ *
+ * @param f - stream to which the prototypes are written.
+ * @param options - generation options (--context and --batch change the
+ *                  API).
+ */
+static void
+writeApiPrototypes(std::ostream& f, const GenerateOptions& options)
+{
+    f << "// Writes base-0000.col, base-0001.col... each holding chunkEvents events\n";
+    f << "// (the last may hold fewer) and lists them in base.columns.  Read them\n";
+    f << "// with the reader in the -reader.h file generated with this one.\n\n";
+    f << "void Initialize(const char* base, size_t chunkEvents = "
+      << DEFAULT_CHUNK_EVENTS << ");\n";
+    f << "void Finish();         // Writes the last chunk.\n";
+    f << "void SetupEvent();\n";
+    f << "void CommitEvent();\n";
+    if (options.s_context) {
+        f << "\nvoid SetupEvent(EventContext& context);\n";
+        f << "void CommitEvent(EventContext& context);   // Calls must be serialized.\n";
+    }
+    if (!options.s_batch.empty()) {
+        f << "\n// A batch of events:  unpack event k into batch[k].  It's big;  make it with new.\n\n";
+        f << "class EventBatch {\n";
+        f << "public:\n";
+        f << "   EventContext& operator[](size_t k) { return m_slots[k]; }\n";
+        f << "   size_t size() const { return " << options.s_batch << "; }\n";
+        f << "private:\n";
+        f << "   EventContext m_slots[" << options.s_batch << "];\n";
+        f << "};\n";
+        f << "void SetupBatch(EventBatch& batch);              // Resets every slot.\n";
+        f << "void CommitBatch(EventBatch& batch, size_t n);   // Writes slots 0 - n-1.\n";
+    }
+}
+/**
+ * generateHeader
+ *    Generate the header file.
+ *
+ *  @param fname - base name of the output file.
+ *  @param nsname - name of the namespace all the decls go into.
+ *  @param types  - list of data types.
+ *  @param instances - list of top level instances.
+ *  @param options - generation options.
+ *  @return bool - true if the file was written.
+ */
+static bool
+generateHeader(
+    const std::string& fname, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    std::string headerName = fname + ".h";
+    OutputFile f(headerName);
+    commentHeader(f, headerName, "Defines types, instances and API");
+    std::string baseFilename = baseName(fname);
+
+    f << "#ifndef " << baseFilename << "_h\n";
+    f << "#define " << baseFilename << "_h\n";
+    f << "#include <vector>\n";
+    f << "#include <cstddef>\n";
+    f << "\nnamespace " << nsname << " {\n\n";
+    writeStructureDefs(f, types);
+    writeInstanceDefs(f, instances, options);
+    writeApiPrototypes(f, options);
+    f << "}\n";
+    f << "#endif\n";
+    return f.close();
+}
+/**
+ * writeReset
+ *    Write the statements that reset a field or instance.
+ *
+ * @param f      - stream to which the code is written.
+ * @param i      - the field or instance.
+ * @param object - what it's a member of, with the trailing . or empty.
+ */
+static void
+writeReset(std::ostream& f, const Instance& i, const std::string& object)
+{
+    std::string name = object + i.s_name;
+    switch (i.s_type) {
+    case value:
+        f << "   " << name << " = NAN;\n";
+        break;
+    case array:
+        f << "   fillNaN(" << name << ", " << i.s_elementCount << ");\n";
+        break;
+    case vector:
+        f << "   " << name << ".clear();\n";
+        break;
+    case structure:
+        f << "   " << name << ".Reset();\n";
+        break;
+    case structarray:
+        f << "   for (int i = 0; i < " << i.s_elementCount << "; i++) {\n";
+        f << "      " << name << "[i].Reset();\n";
+        f << "   }\n";
+        break;
+    default:
+        std::cerr << "Unrecognized data type: " << i.s_type << std::endl;
+        std::cerr << i.toString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+/**
+ * generateStructImplementations
+ *    Implement the constructor and Reset method of each struct.
+ *
+ *  @param f       - stream into which the code is generated.
+ *  @param nsname  - Name of the namespace the structs were generated in.
+ *  @param first, last - range of types defined by the user.
+ */
+static void
+generateStructImplementations(
+    std::ostream& f, const std::string& nsname,
+    TypeList::const_iterator first, TypeList::const_iterator last
+)
+{
+    f << "// Struct method implementations: \n\n";
+    for (TypeList::const_iterator p = first; p != last; p++) {
+        std::string name = nsname + "::" + p->s_typename;
+        f << name << "::" << p->s_typename << "() {\n";
+        f << "   Reset();\n";
+        f << "}\n\n";
+        f << "void " << name << "::Reset() {\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            writeReset(f, *fld, "");
+        }
+        f << "}\n\n";
+    }
+}
+/**
+ * generatePrologue
+ *    Generate what goes at the top of each C++ file.  Only the main file
+ *    writes columns;  the --split files just implement the struct methods.
+ *
+ * @param f - stream into which the code is generated.
+ * @param fname - name of the file being generated.
+ * @param headerName -name of the header file.
+ * @param writer - true to include what the writer needs.
+ */
+static void
+generatePrologue(
+    std::ostream& f, const std::string& fname, const std::string& headerName,
+    bool writer
+)
+{
+    commentHeader(f, fname, "C++ Implementation file for columnar binary output");
+    f << "#define IMPLEMENTATION_MODULE\n";
+    f << "#include \"" << baseName(headerName) << "\"\n\n";
+    f << "#include <cmath>\n";
+    f << "#include <cstddef>\n";
+    if (writer) {
+        f << "#include <cerrno>\n";
+        f << "#include <cstdio>\n";
+        f << "#include <cstring>\n";
+        f << "#include <memory>\n";
+        f << "#include <stdexcept>\n";
+        f << "#include <string>\n";
+        f << "#include <stdint.h>\n";
+    }
+    f << "\nnamespace {\n";
+    f << "inline void fillNaN(double* p, size_t n) {\n";
+    f << "   for (size_t i = 0; i < n; i++) p[i] = NAN;\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateInstances
+ *    Define instanceStruct and the references to its members.
+ *
+ * @param f      - stream to which code is written.
+ * @param nsname - namespace in which everything is defined.
+ * @param instances- instance list.
+ * @param options - generation options (--context).
+ */
+static void
+generateInstances(
+    std::ostream& f, const std::string& nsname, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    f << "//   Instance definitions\n\n";
+    f << "namespace " << nsname << " {\n";
+    if (options.s_context) {
+        f << "EventContext instanceStruct;\n";
+    } else {
+        f << "struct {\n";
+        writeInstanceMembers(f, instances);
+        f << "}  instanceStruct;\n";
+    }
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeMember(f, *p, "(&", ")");
+        f << "(instanceStruct." << p->s_name << ");\n";
+    }
+    f << "}\n\n";
+}
+/**
+ * writeWidths
+ *    Write a table of column widths.  It ends in a 0 so it's never empty.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param name   - name of the table.
+ * @param leaves - the leaves.
+ * @param jagged - true for the vector leaves, false for the others.
+ */
+static void
+writeWidths(std::ostream& f, const char* name, const LeafList& leaves, bool jagged)
+{
+    f << "const size_t " << name << "[] = {";
+    for (size_t i = 0; i < leaves.size(); i++) {
+        if (leaves[i].s_jagged == jagged) {
+            f << leaves[i].width() << ", ";
+        }
+    }
+    f << "0};\n";
+}
+/**
+ * writeColumns
+ *    Write the Columns class, which buffers a chunk of events and writes
+ *    it.  A fixed width column is sized for the whole chunk when it's
+ *    made, so each event's values are just stored into it;  the vectors'
+ *    values columns grow as needed and are reused from chunk to chunk.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param leaves - the leaves.
+ * @param layout - hash of the columns.
+ */
+static void
+writeColumns(std::ostream& f, const LeafList& leaves, uint64_t layout)
+{
+    size_t fixed = fixedCount(leaves);
+    f << "// The columns of a chunk of events and writing them to a chunk file:\n\n";
+    f << "namespace {\n";
+    f << "const uint64_t COLUMNAR_MAGIC(0x314c4f43584e4547ULL);   // \"GENXCOL1\"\n";
+    f << "const uint64_t LAYOUT(0x" << std::hex << layout << std::dec << "ULL);\n";
+    f << "const size_t   FIXED(" << fixed << ");\n";
+    f << "const size_t   JAGGED(" << leaves.size() - fixed << ");\n";
+    f << "const uint64_t ALIGNMENT(64);\n";
+    writeWidths(f, "fixedWidth", leaves, false);
+    writeWidths(f, "jaggedWidth", leaves, true);
+    f << "\n";
+    f << "class Columns {\n";
+    f << "public:\n";
+    f << "   Columns(const char* base, size_t chunkEvents);\n";
+    f << "   ~Columns();\n";
+    f << "   double* row(size_t c) { return &m_fixed[c][m_rows*fixedWidth[c]]; }\n";
+    f << "   void append(size_t c, const std::vector<double>& v) {\n";
+    f << "      m_values[c].insert(m_values[c].end(), v.begin(), v.end());\n";
+    f << "      m_offsets[c].push_back(m_values[c].size());\n";
+    f << "   }\n";
+    f << "   void commit() { if (++m_rows == m_chunkEvents) writeChunk(); }\n";
+    f << "   void finish();\n";
+    f << "private:\n";
+    f << "   void writeChunk();\n";
+    f << "   static void write(std::FILE* f, const void* p, size_t n, uint64_t& position);\n";
+    f << "   std::string m_base;\n";
+    f << "   size_t      m_chunkEvents;\n";
+    f << "   size_t      m_rows;                 // Events in the chunk so far.\n";
+    f << "   unsigned    m_chunks;               // Chunk files written.\n";
+    f << "   std::FILE*  m_pIndex;               // base.columns\n";
+    f << "   std::vector<std::vector<double> >   m_fixed;\n";
+    f << "   std::vector<std::vector<double> >   m_values;\n";
+    f << "   std::vector<std::vector<uint64_t> > m_offsets;\n";
+    f << "};\n\n";
+
+    f << "Columns::Columns(const char* base, size_t chunkEvents) :\n";
+    f << "   m_base(base), m_chunkEvents(chunkEvents ? chunkEvents : 1), m_rows(0),\n";
+    f << "   m_chunks(0), m_fixed(FIXED), m_values(JAGGED), m_offsets(JAGGED, std::vector<uint64_t>(1, 0))\n";
+    f << "{\n";
+    f << "   for (size_t c = 0; c < FIXED; c++) {\n";
+    f << "      m_fixed[c].resize(m_chunkEvents*fixedWidth[c]);\n";
+    f << "   }\n";
+    f << "   for (size_t c = 0; c < JAGGED; c++) {\n";
+    f << "      m_offsets[c].reserve(m_chunkEvents*jaggedWidth[c] + 1);\n";
+    f << "   }\n";
+    f << "   std::string index = m_base + \".columns\";\n";
+    f << "   m_pIndex = std::fopen(index.c_str(), \"w\");\n";
+    f << "   if (!m_pIndex) {\n";
+    f << "      throw std::runtime_error(\"Can't create \" + index + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   std::fprintf(m_pIndex, \"# genx columnar %llx\\n\", (unsigned long long)LAYOUT);\n";
+    f << "}\n";
+    f << "Columns::~Columns() {\n";
+    f << "   if (m_pIndex) std::fclose(m_pIndex);\n";
+    f << "}\n";
+    f << "void Columns::finish() {\n";
+    f << "   if (m_rows) writeChunk();\n";
+    f << "   std::FILE* pIndex = m_pIndex;\n";
+    f << "   m_pIndex = 0;\n";
+    f << "   if (std::fclose(pIndex) != 0) {\n";
+    f << "      throw std::runtime_error(\"Can't write \" + m_base + \".columns\");\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "void Columns::write(std::FILE* f, const void* p, size_t n, uint64_t& position) {\n";
+    f << "   static const char zeros[ALIGNMENT] = {0};\n";
+    f << "   if (n && (std::fwrite(p, 1, n, f) != n)) {\n";
+    f << "      throw std::runtime_error(std::string(\"Can't write a chunk file: \") + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   position += n;\n";
+    f << "   size_t pad = (ALIGNMENT - position % ALIGNMENT) % ALIGNMENT;\n";
+    f << "   if (pad && (std::fwrite(zeros, 1, pad, f) != pad)) {\n";
+    f << "      throw std::runtime_error(std::string(\"Can't write a chunk file: \") + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   position += pad;\n";
+    f << "}\n\n";
+
+    f << "// The header and column table, then the columns.\n\n";
+    f << "void Columns::writeChunk() {\n";
+    f << "   char suffix[32];\n";
+    f << "   std::snprintf(suffix, sizeof(suffix), \"-%04u.col\", m_chunks);\n";
+    f << "   std::string name = m_base + suffix;\n";
+    f << "   std::vector<const void*> data;\n";
+    f << "   std::vector<uint64_t>    count;\n";
+    f << "   for (size_t c = 0; c < FIXED; c++) {\n";
+    f << "      data.push_back(m_fixed[c].data());\n";
+    f << "      count.push_back(m_rows*fixedWidth[c]);\n";
+    f << "   }\n";
+    f << "   for (size_t c = 0; c < JAGGED; c++) {\n";
+    f << "      data.push_back(m_offsets[c].data());\n";
+    f << "      count.push_back(m_offsets[c].size());\n";
+    f << "      data.push_back(m_values[c].data());\n";
+    f << "      count.push_back(m_values[c].size());\n";
+    f << "   }\n";
+    f << "   std::vector<uint64_t> header;\n";
+    f << "   header.push_back(COLUMNAR_MAGIC);\n";
+    f << "   header.push_back(LAYOUT);\n";
+    f << "   header.push_back(m_rows);\n";
+    f << "   header.push_back(data.size());\n";
+    f << "   uint64_t offset = (4 + 2*data.size())*sizeof(uint64_t);\n";
+    f << "   for (size_t c = 0; c < data.size(); c++) {\n";
+    f << "      offset += (ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT;\n";
+    f << "      header.push_back(offset);\n";
+    f << "      header.push_back(count[c]);\n";
+    f << "      offset += count[c]*sizeof(uint64_t);\n";
+    f << "   }\n\n";
+    f << "   std::FILE* pFile = std::fopen(name.c_str(), \"wb\");\n";
+    f << "   if (!pFile) {\n";
+    f << "      throw std::runtime_error(\"Can't create \" + name + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   try {\n";
+    f << "      uint64_t position = 0;\n";
+    f << "      write(pFile, header.data(), header.size()*sizeof(uint64_t), position);\n";
+    f << "      for (size_t c = 0; c < data.size(); c++) {\n";
+    f << "         write(pFile, data[c], count[c]*sizeof(uint64_t), position);\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   catch (...) {\n";
+    f << "      std::fclose(pFile);\n";
+    f << "      throw;\n";
+    f << "   }\n";
+    f << "   if (std::fclose(pFile) != 0) {\n";
+    f << "      throw std::runtime_error(\"Can't write \" + name + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   std::string file = name.substr(name.rfind('/') + 1);\n";
+    f << "   std::fprintf(m_pIndex, \"%s %llu\\n\", file.c_str(), (unsigned long long)m_rows);\n";
+    f << "   std::fflush(m_pIndex);\n\n";
+    f << "   m_chunks++;\n";
+    f << "   m_rows = 0;\n";
+    f << "   for (size_t c = 0; c < JAGGED; c++) {\n";
+    f << "      m_values[c].clear();\n";
+    f << "      m_offsets[c].resize(1);\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * writeLoops
+ *    Open a for loop over each struct array a leaf is in.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param leaf   - the leaf.
+ * @param indent - indentation of the outermost loop.
+ * @return std::string - indentation inside the loops.
+ */
+static std::string
+writeLoops(std::ostream& f, const Leaf& leaf, std::string indent)
+{
+    for (size_t i = 0; i < leaf.s_loops.size(); i++) {
+        f << indent << "for (size_t i" << i << " = 0; i" << i << " < " << leaf.s_loops[i]
+          << "; i" << i << "++) {\n";
+        indent += "   ";
+    }
+    return indent;
+}
+/**
+ * closeLoops
+ *    Close the loops writeLoops opened.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param leaf   - the leaf.
+ * @param indent - indentation of the outermost loop.
+ */
+static void
+closeLoops(std::ostream& f, const Leaf& leaf, const std::string& indent)
+{
+    for (size_t i = leaf.s_loops.size(); i > 0; i--) {
+        f << indent << std::string(3*(i - 1), ' ') << "}\n";
+    }
+}
+/**
+ * writeAppend
+ *    Write appendEvent, which copies an event from instances into the
+ *    columns, and resetInstances.  They're templates so they work on
+ *    instanceStruct or any EventContext.  The values of a leaf in struct
+ *    arrays are gathered into its row;  an array leaf is copied a whole
+ *    array at a time.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param leaves - the leaves.
+ * @param instances - the instances.
+ */
+static void
+writeAppend(std::ostream& f, const LeafList& leaves, const InstanceList& instances)
+{
+    f << "namespace {\n";
+    f << "template <class Instances>\n";
+    f << "void appendEvent(Columns& columns, const Instances& data) {\n";
+    size_t fixed = 0;
+    size_t jagged = 0;
+    for (size_t i = 0; i < leaves.size(); i++) {
+        const Leaf& leaf(leaves[i]);
+        std::string source = "data." + leaf.s_access;
+        if (leaf.s_jagged) {
+            std::string indent = writeLoops(f, leaf, "   ");
+            f << indent << "columns.append(" << jagged++ << ", " << source << ");\n";
+            closeLoops(f, leaf, "   ");
+        } else if (leaf.s_loops.empty() && (leaf.s_elements == 1)) {
+            f << "   *columns.row(" << fixed++ << ") = " << source << ";\n";
+        } else if (leaf.s_loops.empty()) {
+            f << "   std::memcpy(columns.row(" << fixed++ << "), " << source << ", "
+              << leaf.s_elements << "*sizeof(double));\n";
+        } else {
+            f << "   {\n";
+            f << "      double* p = columns.row(" << fixed++ << ");\n";
+            std::string indent = writeLoops(f, leaf, "      ");
+            if (leaf.s_elements == 1) {
+                f << indent << "*p++ = " << source << ";\n";
+            } else {
+                f << indent << "std::memcpy(p, " << source << ", " << leaf.s_elements
+                  << "*sizeof(double));\n";
+                f << indent << "p += " << leaf.s_elements << ";\n";
+            }
+            closeLoops(f, leaf, "      ");
+            f << "   }\n";
+        }
+    }
+    f << "}\n";
+    f << "template <class Instances>\n";
+    f << "void resetInstances(Instances& data) {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeReset(f, *p, "data.");
+    }
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateAPI
+ *    Generates the API implementations.
+ *
+ *  @param f  - file into which code is being generated.
+ *  @param nsname - namespace all this stuff lives in.
+ *  @param options - generation options.
+ */
+static void
+generateAPI(std::ostream& f, const std::string& nsname, const GenerateOptions& options)
+{
+    bool context = options.s_context;
+    f << "// The columns being written:\n\n";
+    f << "namespace " << nsname << " {\n";
+    f << "std::unique_ptr<Columns> pColumns;\n";
+    f << "}\n\n";
+
+    f << "// Initialize - starts the first chunk\n\n";
+    f << "void " << nsname << "::Initialize(const char* base, size_t chunkEvents) {\n";
+    f << "   pColumns.reset(new Columns(base, chunkEvents));\n";
+    f << "}\n";
+    f << "void " << nsname << "::Finish() {\n";
+    f << "   pColumns->finish();\n";
+    f << "   pColumns.reset();\n";
+    f << "}\n\n";
+
+    f << "// Setup event - resets the instances\n\n";
+    f << "void " << nsname << "::SetupEvent() {\n";
+    f << "   resetInstances(instanceStruct);\n";
+    f << "}\n";
+    if (context) {
+        f << "void " << nsname << "::SetupEvent(EventContext& context) {\n";
+        f << "   resetInstances(context);\n";
+        f << "}\n";
+    }
+    f << "\n// CommitEvent  Appends the event to the columns\n\n";
+    f << "void " << nsname << "::CommitEvent() {\n";
+    if (context) {
+        f << "   CommitEvent(instanceStruct);\n";
+        f << "}\n";
+        f << "void " << nsname << "::CommitEvent(EventContext& context) {\n";
+        f << "   appendEvent(*pColumns, context);\n";
+    } else {
+        f << "   appendEvent(*pColumns, instanceStruct);\n";
+    }
+    f << "   pColumns->commit();\n";
+    f << "}\n\n";
+
+    if (!options.s_batch.empty()) {
+        f << "// SetupBatch and CommitBatch - SetupEvent and CommitEvent for a batch\n\n";
+        f << "void " << nsname << "::SetupBatch(EventBatch& batch) {\n";
+        f << "   for (size_t k = 0; k < batch.size(); k++) {\n";
+        f << "      resetInstances(batch[k]);\n";
+        f << "   }\n";
+        f << "}\n";
+        f << "void " << nsname << "::CommitBatch(EventBatch& batch, size_t n) {\n";
+        f << "   for (size_t k = 0; k < n; k++) {\n";
+        f << "      appendEvent(*pColumns, batch[k]);\n";
+        f << "      pColumns->commit();\n";
+        f << "   }\n";
+        f << "}\n\n";
+    }
+}
+/**
+ * writeSpans
+ *    Write the classes the reader returns columns as:  Span, a run of
+ *    values, Strided, a column with several values per row, and Jagged,
+ *    a vector's offsets and values.
+ *
+ * @param f - stream into which the code is generated.
+ */
+static void
+writeSpans(std::ostream& f)
+{
+    f << "// A column, or part of one, in place in a mapped chunk file.\n\n";
+    f << "template <class T>\n";
+    f << "class Span {\n";
+    f << "public:\n";
+    f << "   Span() : m_data(0), m_size(0) {}\n";
+    f << "   Span(const T* data, size_t size) : m_data(data), m_size(size) {}\n";
+    f << "   const T* data() const { return m_data; }\n";
+    f << "   size_t size() const { return m_size; }\n";
+    f << "   bool empty() const { return m_size == 0; }\n";
+    f << "   const T& operator[](size_t i) const { return m_data[i]; }\n";
+    f << "   const T* begin() const { return m_data; }\n";
+    f << "   const T* end() const { return m_data + m_size; }\n";
+    f << "private:\n";
+    f << "   const T* m_data;\n";
+    f << "   size_t   m_size;\n";
+    f << "};\n\n";
+
+    f << "// A column with width values per row:  arrays and the fields of struct arrays.\n\n";
+    f << "class Strided {\n";
+    f << "public:\n";
+    f << "   Strided(const double* data, size_t rows, size_t width) :\n";
+    f << "      m_data(data), m_rows(rows), m_width(width) {}\n";
+    f << "   size_t size() const { return m_rows; }\n";
+    f << "   size_t width() const { return m_width; }\n";
+    f << "   Span<double> operator[](size_t row) const {\n";
+    f << "      return Span<double>(m_data + row*m_width, m_width);\n";
+    f << "   }\n";
+    f << "   double operator()(size_t row, size_t k) const { return m_data[row*m_width + k]; }\n";
+    f << "   Span<double> values() const { return Span<double>(m_data, m_rows*m_width); }\n";
+    f << "private:\n";
+    f << "   const double* m_data;\n";
+    f << "   size_t        m_rows;\n";
+    f << "   size_t        m_width;\n";
+    f << "};\n\n";
+
+    f << "// A vector column:  width collections per row (more than one if the vector\n";
+    f << "// is a field of a struct array).\n\n";
+    f << "class Jagged {\n";
+    f << "public:\n";
+    f << "   Jagged(const uint64_t* offsets, const double* values, size_t rows, size_t width) :\n";
+    f << "      m_offsets(offsets), m_values(values), m_rows(rows), m_width(width) {}\n";
+    f << "   size_t size() const { return m_rows; }\n";
+    f << "   size_t width() const { return m_width; }\n";
+    f << "   Span<double> operator()(size_t row, size_t k = 0) const {\n";
+    f << "      size_t c = row*m_width + k;\n";
+    f << "      return Span<double>(m_values + m_offsets[c], m_offsets[c + 1] - m_offsets[c]);\n";
+    f << "   }\n";
+    f << "   Span<uint64_t> offsets() const { return Span<uint64_t>(m_offsets, m_rows*m_width + 1); }\n";
+    f << "   Span<double> values() const { return Span<double>(m_values, m_offsets[m_rows*m_width]); }\n";
+    f << "private:\n";
+    f << "   const uint64_t* m_offsets;\n";
+    f << "   const double*   m_values;\n";
+    f << "   size_t          m_rows;\n";
+    f << "   size_t          m_width;\n";
+    f << "};\n\n";
+}
+/**
+ * writeChunkCheck
+ *    Write the layout tables and checkChunk, which makes sure a mapped file
+ *    is a chunk of these columns and every column is inside it, so
+ *    nothing the Chunk methods return can point outside the mapping.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param leaves - the leaves.
+ * @param layout - hash of the columns.
+ */
+static void
+writeChunkCheck(std::ostream& f, const LeafList& leaves, uint64_t layout)
+{
+    size_t fixed = fixedCount(leaves);
+    f << "const uint64_t COLUMNAR_MAGIC(0x314c4f43584e4547ULL);   // \"GENXCOL1\"\n";
+    f << "const uint64_t LAYOUT(0x" << std::hex << layout << std::dec << "ULL);\n";
+    f << "const size_t   FIXED(" << fixed << ");\n";
+    f << "const size_t   JAGGED(" << leaves.size() - fixed << ");\n";
+    writeWidths(f, "fixedWidth", leaves, false);
+    writeWidths(f, "jaggedWidth", leaves, true);
+    f << "\n";
+    f << "inline const uint64_t* column(const char* base, size_t c) {\n";
+    f << "   const uint64_t* table = reinterpret_cast<const uint64_t*>(base) + 4;\n";
+    f << "   return reinterpret_cast<const uint64_t*>(base + table[2*c]);\n";
+    f << "}\n";
+    f << "inline const char* checkChunk(const char* base, size_t bytes) {\n";
+    f << "   const uint64_t* header = reinterpret_cast<const uint64_t*>(base);\n";
+    f << "   size_t columns = FIXED + 2*JAGGED;\n";
+    f << "   if ((bytes < 4*sizeof(uint64_t)) || (header[0] != COLUMNAR_MAGIC)) {\n";
+    f << "      return \"not a columnar chunk file\";\n";
+    f << "   }\n";
+    f << "   if ((header[1] != LAYOUT) || (header[3] != columns)) {\n";
+    f << "      return \"written for other declarations\";\n";
+    f << "   }\n";
+    f << "   if (bytes < (4 + 2*columns)*sizeof(uint64_t)) {\n";
+    f << "      return \"truncated\";\n";
+    f << "   }\n";
+    f << "   uint64_t rows = header[2];\n";
+    f << "   const uint64_t* table = header + 4;\n";
+    f << "   for (size_t c = 0; c < columns; c++) {\n";
+    f << "      uint64_t expected = 0;\n";
+    f << "      if (c < FIXED) {\n";
+    f << "         expected = rows*fixedWidth[c];\n";
+    f << "      } else if ((c - FIXED) % 2 == 0) {\n";
+    f << "         expected = rows*jaggedWidth[(c - FIXED)/2] + 1;\n";
+    f << "      } else {\n";
+    f << "         expected = column(base, c - 1)[table[2*c - 1] - 1];    // The last offset.\n";
+    f << "      }\n";
+    f << "      if ((table[2*c] % sizeof(uint64_t)) || (table[2*c] > bytes)\n";
+    f << "          || (table[2*c + 1] > (bytes - table[2*c])/sizeof(uint64_t))) {\n";
+    f << "         return \"truncated\";\n";
+    f << "      }\n";
+    f << "      if (table[2*c + 1] != expected) {\n";
+    f << "         return \"a column is the wrong size\";\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   return 0;\n";
+    f << "}\n\n";
+}
+/**
+ * writeChunkClass
+ *    Write the Chunk class:  a mapped chunk file with a method for each
+ *    leaf that returns its column.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param leaves - the leaves.
+ */
+static void
+writeChunkClass(std::ostream& f, const LeafList& leaves)
+{
+    f << "// One chunk file, mapped read only.  The spans it returns point into the\n";
+    f << "// mapping, so they're good only as long as the Chunk is.\n\n";
+    f << "class Chunk {\n";
+    f << "public:\n";
+    f << "   explicit Chunk(const std::string& path);\n";
+    f << "   ~Chunk() { munmap(m_pBase, m_bytes); }\n";
+    f << "   size_t rows() const { return m_rows; }\n\n";
+    size_t fixed = fixedCount(leaves);
+    size_t c     = 0;
+    size_t k     = 0;
+    for (size_t i = 0; i < leaves.size(); i++) {
+        const Leaf& leaf(leaves[i]);
+        std::string name = accessorName(leaf);
+        if (leaf.s_jagged) {
+            size_t offsets = fixed + 2*k++;
+            f << "   Jagged " << name << "() const {\n";
+            f << "      return Jagged(column(m_pBase, " << offsets
+              << "), reinterpret_cast<const double*>(column(m_pBase, " << offsets + 1
+              << ")), m_rows, " << leaf.width() << ");\n";
+            f << "   }\n";
+        } else if (leaf.width() == 1) {
+            f << "   Span<double> " << name << "() const {\n";
+            f << "      return Span<double>(reinterpret_cast<const double*>(column(m_pBase, "
+              << c++ << ")), m_rows);\n";
+            f << "   }\n";
+        } else {
+            f << "   Strided " << name << "() const {\n";
+            f << "      return Strided(reinterpret_cast<const double*>(column(m_pBase, "
+              << c++ << ")), m_rows, " << leaf.width() << ");\n";
+            f << "   }\n";
+        }
+    }
+    f << "private:\n";
+    f << "   Chunk(const Chunk&);\n";
+    f << "   Chunk& operator=(const Chunk&);\n";
+    f << "   char*  m_pBase;\n";
+    f << "   size_t m_bytes;\n";
+    f << "   size_t m_rows;\n";
+    f << "};\n\n";
+
+    f << "inline Chunk::Chunk(const std::string& path) : m_pBase(0), m_bytes(0), m_rows(0) {\n";
+    f << "   int fd = open(path.c_str(), O_RDONLY);\n";
+    f << "   if (fd < 0) {\n";
+    f << "      throw std::runtime_error(\"Can't open \" + path + \": \" + std::strerror(errno));\n";
+    f << "   }\n";
+    f << "   struct stat info;\n";
+    f << "   void* p = MAP_FAILED;\n";
+    f << "   if ((fstat(fd, &info) == 0) && (info.st_size > 0)) {\n";
+    f << "      m_bytes = info.st_size;\n";
+    f << "      p = mmap(0, m_bytes, PROT_READ, MAP_SHARED, fd, 0);\n";
+    f << "   }\n";
+    f << "   close(fd);\n";
+    f << "   if (p == MAP_FAILED) {\n";
+    f << "      throw std::runtime_error(\"Can't map \" + path);\n";
+    f << "   }\n";
+    f << "   m_pBase = static_cast<char*>(p);\n";
+    f << "   const char* problem = checkChunk(m_pBase, m_bytes);\n";
+    f << "   if (problem) {\n";
+    f << "      munmap(m_pBase, m_bytes);\n";
+    f << "      throw std::runtime_error(path + \": \" + problem);\n";
+    f << "   }\n";
+    f << "   m_rows = reinterpret_cast<const uint64_t*>(m_pBase)[2];\n";
+    f << "}\n\n";
+}
+/**
+ * writeReaderClass
+ *    Write the Reader class, which maps every chunk listed in base.columns.
+ *
+ * @param f - stream into which the code is generated.
+ */
+static void
+writeReaderClass(std::ostream& f)
+{
+    f << "// All the chunks written by one Initialize/Finish:\n";
+    f << "//    columnar::Reader events(\"run23\");\n";
+    f << "//    for (size_t k = 0; k < events.chunks(); k++) {\n";
+    f << "//       Span<double> e = events[k].e();  ...\n\n";
+    f << "class Reader {\n";
+    f << "public:\n";
+    f << "   explicit Reader(const std::string& base);\n";
+    f << "   size_t chunks() const { return m_chunks.size(); }\n";
+    f << "   const Chunk& operator[](size_t k) const { return *m_chunks[k]; }\n";
+    f << "   uint64_t rows() const { return m_rows; }\n";
+    f << "private:\n";
+    f << "   Reader(const Reader&);\n";
+    f << "   Reader& operator=(const Reader&);\n";
+    f << "   std::vector<std::unique_ptr<Chunk> > m_chunks;\n";
+    f << "   uint64_t                             m_rows;\n";
+    f << "};\n\n";
+
+    f << "inline Reader::Reader(const std::string& base) : m_rows(0) {\n";
+    f << "   std::string index = base + \".columns\";\n";
+    f << "   std::ifstream f(index.c_str());\n";
+    f << "   std::string line;\n";
+    f << "   if (!std::getline(f, line)) {\n";
+    f << "      throw std::runtime_error(\"Can't read \" + index);\n";
+    f << "   }\n";
+    f << "   std::istringstream header(line);\n";
+    f << "   std::string mark, genx, columnar, hash;\n";
+    f << "   header >> mark >> genx >> columnar >> hash;\n";
+    f << "   std::ostringstream layout;\n";
+    f << "   layout << std::hex << LAYOUT;\n";
+    f << "   if ((genx != \"genx\") || (columnar != \"columnar\") || (hash != layout.str())) {\n";
+    f << "      throw std::runtime_error(index + \" isn't a columnar index for these declarations\");\n";
+    f << "   }\n";
+    f << "   std::string directory = base.substr(0, base.rfind('/') + 1);\n";
+    f << "   while (std::getline(f, line)) {\n";
+    f << "      std::istringstream entry(line);\n";
+    f << "      std::string file;\n";
+    f << "      uint64_t    rows;\n";
+    f << "      if (!(entry >> file >> rows)) {\n";
+    f << "         throw std::runtime_error(\"Bad line in \" + index + \": \" + line);\n";
+    f << "      }\n";
+    f << "      m_chunks.push_back(std::unique_ptr<Chunk>(new Chunk(directory + file)));\n";
+    f << "      if (m_chunks.back()->rows() != rows) {\n";
+    f << "         throw std::runtime_error(directory + file + \" doesn't match \" + index);\n";
+    f << "      }\n";
+    f << "      m_rows += rows;\n";
+    f << "   }\n";
+    f << "}\n";
+}
+/**
+ * generateReader
+ *    Generate base-reader.h, the header only reader.  It doesn't need
+ *    base.h or anything the writer does, so it can be used on its own.
+ *
+ * @param base   - output file base name.
+ * @param nsname - namespace;  the reader goes in nsname::columnar.
+ * @param leaves - the leaves.
+ * @param layout - hash of the columns.
+ * @return bool - true if the file was written.
+ */
+static bool
+generateReader(
+    const std::string& base, const std::string& nsname, const LeafList& leaves,
+    uint64_t layout
+)
+{
+    std::string headerName = base + "-reader.h";
+    OutputFile f(headerName);
+    commentHeader(f, headerName, "Header only reader of the columnar files");
+    std::string guard = baseName(base) + "_reader_h";
+    for (size_t i = 0; i < guard.size(); i++) {
+        if (guard[i] == '-') guard[i] = '_';
+    }
+    f << "#ifndef " << guard << "\n";
+    f << "#define " << guard << "\n";
+    f << "#include <cerrno>\n";
+    f << "#include <cstddef>\n";
+    f << "#include <cstring>\n";
+    f << "#include <fstream>\n";
+    f << "#include <memory>\n";
+    f << "#include <sstream>\n";
+    f << "#include <stdexcept>\n";
+    f << "#include <string>\n";
+    f << "#include <vector>\n";
+    f << "#include <stdint.h>\n";
+    f << "#include <fcntl.h>\n";
+    f << "#include <sys/mman.h>\n";
+    f << "#include <sys/stat.h>\n";
+    f << "#include <unistd.h>\n";
+    f << "\nnamespace " << nsname << " {\n";
+    f << "namespace columnar {\n\n";
+    writeSpans(f);
+    writeChunkCheck(f, leaves, layout);
+    writeChunkClass(f, leaves);
+    writeReaderClass(f);
+    f << "}\n";
+    f << "}\n";
+    f << "#endif\n";
+    return f.close();
+}
+/**
+ * generateCPP
+ *    Generate the C++ file.
+ * @param fname - name of the file to be generated.
+ * @param headerName -name of the header file.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @param instances - The instance definitions.
+ * @param leaves - the leaves of the instances.
+ * @param options - generation options.  With --split the struct
+ *                  implementations are in their own files.
+ * @return bool - true if the file was written.
+ */
+static bool
+generateCPP(
+    const std::string& fname, const std::string& headerName,
+    const std::string& nsname,
+    const TypeList& types, const InstanceList& instances, const LeafList& leaves,
+    const GenerateOptions& options
+)
+{
+    OutputFile f(fname);
+    generatePrologue(f, fname, headerName, true);
+    if (!options.s_split) {
+        generateStructImplementations(f, nsname, types.begin(), types.end());
+    }
+    generateInstances(f, nsname, instances, options);
+    writeColumns(f, leaves, layoutHash(leaves));
+    writeAppend(f, leaves, instances);
+    generateAPI(f, nsname, options);
+    return f.close();
+}
+/**
+ * generateStructCPPs
+ *    For --split, generate base-typename.cpp for each struct with its
+ *    methods and list them with base.cpp in base.mk.
+ *
+ * @param base - output file base name.
+ * @param headerName -name of the header file.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @return bool - true if the files were written.
+ */
+static bool
+generateStructCPPs(
+    const std::string& base, const std::string& headerName,
+    const std::string& nsname, const TypeList& types
+)
+{
+    std::vector<std::string> sources(1, base + ".cpp");
+    bool ok = true;
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        std::string fname = base + "-" + p->s_typename + ".cpp";
+        OutputFile f(fname);
+        generatePrologue(f, fname, headerName, false);
+        generateStructImplementations(f, nsname, p, p + 1);
+        ok = f.close() && ok;
+        sources.push_back(fname);
+    }
+    return writeSourceList(base, sources) && ok;
+}
+/**
+ * generateColumnar
+ *   Generate the header, implementation and reader files from the
+ *   intermediate representation.
+ *
+ * @param base      - output file base name (may include a path).
+ * @param nsname    - namespace the generated code lives in.
+ * @param types     - the derived type definitions.
+ * @param instances - the instance definitions.
+ * @param options   - generation options:  --split, --context and --batch.
+ *                    The others are ignored.
+ * @return bool - true if all the files were written.
+ */
+bool
+generateColumnar(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    LeafList leaves = makeLeaves(types, instances);
+    std::string headerName = base + ".h";
+    bool ok = generateHeader(base, nsname, types, instances, options);
+    ok = generateCPP(base + ".cpp", headerName, nsname, types, instances, leaves, options) && ok;
+    ok = generateReader(base, nsname, leaves, layoutHash(leaves)) && ok;
+    if (options.s_split) {
+        ok = generateStructCPPs(base, headerName, nsname, types) && ok;
+    }
+    return ok;
+}
@@ -0,0 +1,178 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  batchbench.cpp
+ *  @brief: Measure event throughput of SetupBatch/CommitBatch vs. SetupEvent/CommitEvent.
+ */
+
+/**
+ * Generates Root code for a declaration file with --batch for a few batch
+ * sizes.  Each is compiled with its dictionary and a driver.  The driver
+ * either unpacks events one at a time into an EventContext with
+ * SetupEvent/CommitEvent or a batch at a time into an EventBatch with
+ * SetupBatch/CommitBatch.  It reports events per second including the
+ * time to write and close the file.
+ *
+ * Usage:
+ *     batchbench ?parser? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ *  rootcling     - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+
+static const int EVENTS(200000);
+static const int BATCHES[] = {8, 64, 512};   // Batch sizes to try.
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[64]\n";
+    f << "structarrayinstance det dets[32]\n";
+}
+/**
+ * writeDriver
+ *    Write the driver.  It takes the output file, the mode (event or
+ *    batch) and the number of events on its command line and outputs
+ *    events per second.
+ *
+ * @param filename - driver file.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n#include <TFile.h>\n";
+    f << "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n#include <time.h>\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "static void unpack(bench::EventContext& c, int e) {\n";
+    f << "   c.multiplicity = e % 32;\n";
+    f << "   for (int i = 0; i < 64; i += 1 + e % 3) c.adc[i] = (e*i) % 4096;\n";
+    f << "   for (int i = 0; i < e % 32; i++) {\n";
+    f << "      c.dets[i].e = (e + i) % 4096;\n";
+    f << "      c.dets[i].t = (e - i) % 1024;\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   bool batched = strcmp(argv[2], \"batch\") == 0;\n";
+    f << "   int events = atoi(argv[3]);\n";
+    f << "   bench::EventContext* context = new bench::EventContext;\n";
+    f << "   bench::EventBatch* batch = new bench::EventBatch;\n";
+    f << "   double start = now();\n";
+    f << "   TFile file(argv[1], \"RECREATE\");\n";
+    f << "   bench::Initialize();\n";
+    f << "   if (batched) {\n";
+    f << "      for (int e = 0; e < events; e += batch->size()) {\n";
+    f << "         size_t n = events - e < int(batch->size()) ? events - e : batch->size();\n";
+    f << "         bench::SetupBatch(*batch);\n";
+    f << "         for (size_t k = 0; k < n; k++) unpack((*batch)[k], e + k);\n";
+    f << "         bench::CommitBatch(*batch, n);\n";
+    f << "      }\n";
+    f << "   } else {\n";
+    f << "      for (int e = 0; e < events; e++) {\n";
+    f << "         bench::SetupEvent(*context);\n";
+    f << "         unpack(*context, e);\n";
+    f << "         bench::CommitEvent(*context);\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   file.Write();\n";
+    f << "   file.Close();\n";
+    f << "   printf(\"%f\\n\", events/(now() - start));\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+/**
+ * report
+ *    Run a driver and output its throughput.
+ *
+ * @param mode    - what to call the run.
+ * @param batch   - batch size it was generated for.
+ * @param command - command that runs it.
+ */
+static void
+report(const char* mode, int batch, const std::string& command)
+{
+    std::istringstream result(run(command));
+    double rate;
+    result >> rate;
+    std::cout << std::setw(10) << mode << std::setw(10) << batch
+              << std::setw(14) << std::fixed << std::setprecision(0) << rate << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 4 ? argv[4] : "rootcling";
+
+    std::string dir = makeBenchDirectory("batchbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    std::cout << EVENTS << " events\n";
+    std::cout << std::setw(10) << "mode" << std::setw(10) << "batch"
+              << std::setw(14) << "events/s" << std::endl;
+    for (size_t i = 0; i < sizeof(BATCHES)/sizeof(BATCHES[0]); i++) {
+        std::ostringstream bdir;
+        bdir << dir << "/" << BATCHES[i];
+        std::string mdir = bdir.str();
+        std::ostringstream batch;
+        batch << " --batch=" << BATCHES[i] << " ";
+        run("mkdir " + mdir);
+        run(generator + batch.str() + mdir + "/bench " + dir + "/bench.gxir");
+        makeDictionary(rootcling, mdir);
+        compile(
+            mdir + "/driver", mdir,
+            dir + "/driver.cpp " + mdir + "/bench.cpp " + mdir + "/dict.cxx", flags
+        );
+        const char* modes[] = {"event", "batch"};
+        for (int m = 0; m < 2; m++) {
+            std::ostringstream command;
+            command << mdir << "/driver " << mdir << "/bench.root " << modes[m] << " " << EVENTS;
+            report(modes[m], BATCHES[i], command.str());
+        }
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,177 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  branchbench.cpp
+ *  @brief: Measure Fill time and file size for a branch per struct array element vs. --single-branch.
+ */
+
+/**
+ * Generates Root code for a declaration file with a large struct array,
+ * once with a branch per element and once with --single-branch.  Each is
+ * compiled with its dictionary and a small driver that fills a tree in a
+ * file for a number of events, setting a fraction of the elements in each
+ * event.  The drivers report the branch and leaf counts and the average
+ * time CommitEvent (TTree::Fill) takes; the file sizes are reported too.
+ *
+ * Usage:
+ *     branchbench ?parser? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ *  rootcling     - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static const int ELEMENTS(1000);              // structarrayinstance det dets[ELEMENTS]
+static const int EVENTS(2000);
+
+static const double occupancies[] = {0.01, 0.1, 1.0};
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "   array raw[2]\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "structarrayinstance det dets[" << ELEMENTS << "]\n";
+}
+/**
+ * writeDriver
+ *    Write the driver program.  It takes the output file, occupancy and
+ *    number of events on its command line and outputs the number of
+ *    branches, the number of leaves and the average microseconds per
+ *    CommitEvent.  Hit patterns are computed before timing starts.
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n";
+    f << "#include <TFile.h>\n#include <TTree.h>\n";
+    f << "#include <vector>\n#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n";
+    f << "namespace bench { extern TTree* pTheTree; }\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   const int elements = " << ELEMENTS << ", patterns = 16;\n";
+    f << "   double occupancy = atof(argv[2]);\n";
+    f << "   int events = atoi(argv[3]);\n";
+    f << "   int hits = occupancy*elements;\n";
+    f << "   std::vector<int> pattern(hits*patterns);\n";
+    f << "   srand(1);\n";
+    f << "   for (size_t i = 0; i < pattern.size(); i++) pattern[i] = rand() % elements;\n";
+    f << "   TFile file(argv[1], \"RECREATE\");\n";
+    f << "   bench::Initialize();\n";
+    f << "   double fill = 0;\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      const int* p = &pattern[(e % patterns)*hits];\n";
+    f << "      bench::SetupEvent();\n";
+    f << "      bench::multiplicity = hits;\n";
+    f << "      for (int i = 0; i < hits; i++) {\n";
+    f << "         bench::dets[p[i]].e = rand() % 4096;\n";
+    f << "         bench::dets[p[i]].t = rand() % 1024;\n";
+    f << "         bench::dets[p[i]].raw[0] = i;\n";
+    f << "      }\n";
+    f << "      double start = now();\n";
+    f << "      bench::CommitEvent();\n";
+    f << "      fill += now() - start;\n";
+    f << "   }\n";
+    f << "   printf(\"%d %d %f\\n\", int(bench::pTheTree->GetNbranches()),\n";
+    f << "          int(bench::pTheTree->GetListOfLeaves()->GetEntries()), fill*1.0e6/events);\n";
+    f << "   file.Write();\n";
+    f << "   file.Close();\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 4 ? argv[4] : "rootcling";
+
+    std::string dir = makeBenchDirectory("branchbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    const char* modes[] = {"elements", "single"};
+    for (int i = 0; i < 2; i++) {
+        std::string mdir = dir + "/" + modes[i];
+        run("mkdir " + mdir);
+        run(generator + (i ? " --single-branch " : " ") + mdir + "/bench " + dir + "/bench.gxir");
+        makeDictionary(rootcling, mdir);
+        compile(
+            mdir + "/driver", mdir,
+            dir + "/driver.cpp " + mdir + "/bench.cpp " + mdir + "/dict.cxx", flags
+        );
+    }
+
+    std::cout << ELEMENTS << " element struct array, " << EVENTS << " events\n";
+    std::cout << std::setw(10) << "occupancy" << std::setw(10) << "mode"
+              << std::setw(10) << "branches" << std::setw(10) << "leaves"
+              << std::setw(12) << "Fill(us)" << std::setw(14) << "file(bytes)" << std::endl;
+    for (size_t o = 0; o < sizeof(occupancies)/sizeof(occupancies[0]); o++) {
+        for (int i = 0; i < 2; i++) {
+            std::string rootFile = dir + "/" + modes[i] + "/bench.root";
+            std::ostringstream command;
+            command << dir << "/" << modes[i] << "/driver " << rootFile << " "
+                    << occupancies[o] << " " << EVENTS;
+            std::istringstream result(run(command.str()));
+            int    branches, leaves;
+            double fill;
+            result >> branches >> leaves >> fill;
+            struct stat info;
+            stat(rootFile.c_str(), &info);
+
+            std::cout.unsetf(std::ios::floatfield);
+            std::cout << std::setw(10) << std::setprecision(3) << occupancies[o]
+                      << std::setw(10) << modes[i]
+                      << std::setw(10) << branches << std::setw(10) << leaves
+                      << std::setw(12) << std::fixed << std::setprecision(1) << fill
+                      << std::setw(14) << info.st_size << std::endl;
+        }
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
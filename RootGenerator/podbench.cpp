@@ -0,0 +1,190 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  podbench.cpp
+ *  @brief: Measure the memory and streaming cost of TObject vs. --pod classes.
+ */
+
+/**
+ * Generates Root code for a declaration file with --context, once with
+ * the default TObject classes and once with --pod.  Each is compiled with
+ * its dictionary and a driver.  For each the driver reports:
+ *   -  The bytes of memory an event takes (sizeof(EventContext)).
+ *   -  The number of leaves in the tree (each split TObject adds two).
+ *   -  Resets (SetupEvent) and copies of an EventContext per second.
+ *   -  Events per second written, including writing and closing the file.
+ *   -  Bytes of file per event.
+ *
+ * Usage:
+ *     podbench ?parser? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ *  rootcling     - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+
+static const int EVENTS(200000);
+static const int COPIES(2000000);
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct stamp {\n";
+    f << "   value coarse\n";
+    f << "   value fine\n";
+    f << "}\n";
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   struct stamp t\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[64]\n";
+    f << "structarrayinstance det dets[32]\n";
+}
+/**
+ * writeDriver
+ *    Write the driver.  It takes the output file and the number of events
+ *    and copies on its command line and outputs the figures described
+ *    above on one line.
+ *
+ * @param filename - driver file.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n#include <TFile.h>\n#include <TTree.h>\n";
+    f << "#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n";
+    f << "namespace bench { extern TTree* pTheTree; }\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "static void unpack(bench::EventContext& c, int e) {\n";
+    f << "   c.multiplicity = e % 32;\n";
+    f << "   for (int i = 0; i < 64; i += 1 + e % 3) c.adc[i] = (e*i) % 4096;\n";
+    f << "   for (int i = 0; i < e % 32; i++) {\n";
+    f << "      c.dets[i].e = (e + i) % 4096;\n";
+    f << "      c.dets[i].t.coarse = (e - i) % 1024;\n";
+    f << "      c.dets[i].t.fine = i;\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   int events = atoi(argv[2]);\n";
+    f << "   int copies = atoi(argv[3]);\n";
+    f << "   bench::EventContext* context = new bench::EventContext;\n";
+    f << "   bench::EventContext* copy = new bench::EventContext;\n";
+    f << "   unpack(*context, 31);\n";
+    f << "   double start = now();\n";
+    f << "   for (int i = 0; i < copies; i++) bench::SetupEvent(i % 2 ? *copy : *context);\n";
+    f << "   double resets = copies/(now() - start);\n";
+    f << "   unpack(*context, 31);\n";
+    f << "   start = now();\n";
+    f << "   for (int i = 0; i < copies; i++) {\n";
+    f << "      if (i % 2) *context = *copy; else *copy = *context;\n";
+    f << "   }\n";
+    f << "   double copyRate = copies/(now() - start);\n";
+    f << "   start = now();\n";
+    f << "   TFile file(argv[1], \"RECREATE\");\n";
+    f << "   bench::Initialize(*context);\n";
+    f << "   int leaves = bench::pTheTree->GetListOfLeaves()->GetEntries();\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      bench::SetupEvent(*context);\n";
+    f << "      unpack(*context, e);\n";
+    f << "      bench::CommitEvent(*context);\n";
+    f << "   }\n";
+    f << "   file.Write();\n";
+    f << "   Long64_t bytes = file.GetEND();\n";
+    f << "   file.Close();\n";
+    f << "   printf(\"%d %d %f %f %f %f\\n\", int(sizeof(bench::EventContext)), leaves,\n";
+    f << "          resets, copyRate, events/(now() - start), double(bytes)/events);\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+/**
+ * report
+ *    Run a driver and output what it measured.
+ *
+ * @param classes - what kind of classes it was generated with.
+ * @param command - command that runs it.
+ */
+static void
+report(const char* classes, const std::string& command)
+{
+    std::istringstream result(run(command));
+    int    bytes, leaves;
+    double resets, copies, events, fileBytes;
+    result >> bytes >> leaves >> resets >> copies >> events >> fileBytes;
+    std::cout << std::setw(9) << classes << std::setw(13) << bytes
+              << std::setw(8) << leaves << std::fixed << std::setprecision(0)
+              << std::setw(12) << resets << std::setw(12) << copies
+              << std::setw(12) << events << std::setprecision(1)
+              << std::setw(13) << fileBytes << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 4 ? argv[4] : "rootcling";
+
+    std::string dir = makeBenchDirectory("podbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    std::cout << EVENTS << " events, " << COPIES << " resets and copies\n";
+    std::cout << std::setw(9) << "classes" << std::setw(13) << "bytes/event"
+              << std::setw(8) << "leaves" << std::setw(12) << "resets/s"
+              << std::setw(12) << "copies/s" << std::setw(12) << "events/s"
+              << std::setw(13) << "file/event" << std::endl;
+    const char* classes[] = {"tobject", "pod"};
+    const char* options[] = {" --context ", " --context --pod "};
+    for (int i = 0; i < 2; i++) {
+        std::string mdir = dir + "/" + classes[i];
+        run("mkdir " + mdir);
+        run(generator + options[i] + mdir + "/bench " + dir + "/bench.gxir");
+        makeDictionary(rootcling, mdir);
+        compile(
+            mdir + "/driver", mdir,
+            dir + "/driver.cpp " + mdir + "/bench.cpp " + mdir + "/dict.cxx", flags
+        );
+        std::ostringstream command;
+        command << mdir << "/driver " << mdir << "/bench.root " << EVENTS << " " << COPIES;
+        report(classes[i], command.str());
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,166 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  resetbench.cpp
+ *  @brief: Measure SetupEvent cost against hit occupancy, with and without --sparse-reset.
+ */
+
+/**
+ * Generates Root code for a declaration file with a large array and a
+ * large struct array, once normally and once with --sparse-reset.  Each is
+ * compiled with a small driver that, for a range of occupancies (the
+ * fraction of array elements set per event), times SetupEvent and
+ * SetupEvent plus the writes that fill the event.  Each driver also
+ * checks that SetupEvent really does leave every element NaN.
+ *
+ * Usage:
+ *     resetbench ?parser? ?rootgenerate? ?compile-flags?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+
+static const int ADC_CHANNELS(65536);         // array adc[ADC_CHANNELS]
+static const int MODULES(1024);               // structarray of modules with
+static const int MODULE_CHANNELS(32);         //    array ch[MODULE_CHANNELS].
+static const int EVENTS(2000);
+
+static const double occupancies[] = {0.001, 0.01, 0.05, 0.1, 0.25, 0.5, 1.0};
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct module {\n";
+    f << "   array ch[" << MODULE_CHANNELS << "]\n";
+    f << "}\n";
+    f << "array adc[" << ADC_CHANNELS << "]\n";
+    f << "structarrayinstance module modules[" << MODULES << "]\n";
+}
+/**
+ * writeDriver
+ *    Write the driver program.  It takes the occupancy and number of events
+ *    on its command line and outputs the average microseconds per event in
+ *    SetupEvent and in SetupEvent plus the writes.  Hit patterns are
+ *    computed before timing starts.
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n";
+    f << "#include <cmath>\n#include <vector>\n#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   const int adcs = " << ADC_CHANNELS << ", modules = " << MODULES
+      << ", channels = " << MODULE_CHANNELS << ", patterns = 16;\n";
+    f << "   double occupancy = atof(argv[1]);\n";
+    f << "   int events = atoi(argv[2]);\n";
+    f << "   int adcHits = occupancy*adcs, moduleHits = occupancy*modules*channels;\n";
+    f << "   std::vector<int> adcPattern(adcHits*patterns), modulePattern(moduleHits*patterns);\n";
+    f << "   srand(1);\n";
+    f << "   for (size_t i = 0; i < adcPattern.size(); i++) adcPattern[i] = rand() % adcs;\n";
+    f << "   for (size_t i = 0; i < modulePattern.size(); i++) modulePattern[i] = rand() % (modules*channels);\n";
+    f << "   bench::Initialize();\n";
+    f << "   double setup = 0, total = 0;\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      const int* a = &adcPattern[(e % patterns)*adcHits];\n";
+    f << "      const int* m = &modulePattern[(e % patterns)*moduleHits];\n";
+    f << "      double start = now();\n";
+    f << "      bench::SetupEvent();\n";
+    f << "      double setupDone = now();\n";
+    f << "      for (int i = 0; i < adcHits; i++) bench::adc[a[i]] = i;\n";
+    f << "      for (int i = 0; i < moduleHits; i++) bench::modules[m[i]/channels].ch[m[i]%channels] = i;\n";
+    f << "      double end = now();\n";
+    f << "      setup += setupDone - start;\n";
+    f << "      total += end - start;\n";
+    f << "   }\n";
+    f << "   bench::SetupEvent();\n";
+    f << "   for (int i = 0; i < adcs; i++) {\n";
+    f << "      if (!std::isnan(double(bench::adc[i]))) { printf(\"adc[%d] not reset\\n\", i); return 1; }\n";
+    f << "   }\n";
+    f << "   for (int i = 0; i < modules*channels; i++) {\n";
+    f << "      if (!std::isnan(bench::modules[i/channels].ch[i%channels])) {\n";
+    f << "         printf(\"modules[%d].ch[%d] not reset\\n\", i/channels, i%channels); return 1;\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   printf(\"%f %f\\n\", setup*1.0e6/events, total*1.0e6/events);\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+
+    std::string dir = makeBenchDirectory("resetbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    const char* modes[] = {"full", "sparse"};
+    for (int i = 0; i < 2; i++) {
+        std::string mdir = dir + "/" + modes[i];
+        run("mkdir " + mdir);
+        run(generator + (i ? " --sparse-reset " : " ") + mdir + "/bench " + dir + "/bench.gxir");
+        compile(mdir + "/driver", mdir, dir + "/driver.cpp " + mdir + "/bench.cpp", flags);
+    }
+
+    std::cout << "Microseconds per event, " << ADC_CHANNELS + MODULES*MODULE_CHANNELS
+              << " leaves (SetupEvent / SetupEvent + writes)\n";
+    std::cout << std::setw(10) << "occupancy" << std::setw(22) << "full"
+              << std::setw(22) << "sparse" << std::endl;
+    for (size_t o = 0; o < sizeof(occupancies)/sizeof(occupancies[0]); o++) {
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setw(10) << std::setprecision(3) << occupancies[o];
+        for (int i = 0; i < 2; i++) {
+            std::ostringstream command;
+            command << dir << "/" << modes[i] << "/driver " << occupancies[o] << " " << EVENTS;
+            std::istringstream result(run(command.str()));
+            double setup, total;
+            result >> setup >> total;
+            std::cout << std::setw(11) << std::fixed << std::setprecision(1) << setup
+                      << std::setw(11) << total;
+        }
+        std::cout << std::endl;
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
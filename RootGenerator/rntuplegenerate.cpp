@@ -0,0 +1,803 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  rntuplegenerate.cpp
+ *  @brief: Code generator for CERN Root RNTuple output.
+ */
+
+/**
+ * This module generates the same unpacking API as rootgenerate.cpp but the
+ * events are written to an RNTuple rather than a TTree.  It is linked both
+ * into the standalone rntuplegenerate program (see rntupledriver.cpp) and
+ * directly into genx.
+ *
+ * The IR maps onto an RNTuple model as follows:
+ *   -  value       - a double field.
+ *   -  array       - an array field of doubles.
+ *   -  vector      - a collection (std::vector<double>) field.
+ *   -  structure   - a record field with a sub field for each struct field.
+ *   -  structarray - an array field of records.
+ *
+ * The structs are plain C++ structs laid out as the record fields lay out
+ * their values, and the entry the writer fills from is bound directly to
+ * the instances.  Since record fields need no dictionary, no linkdef file
+ * is generated.
+ *
+ * generateRNTuple(basename, ...) generates basename.h and basename.cpp.
+ * The generated code needs Root 6.34 or later.
+ */
+
+#include "rntuplegenerate.h"
+#include "outputfile.h"
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <libgen.h>
+#include <string.h>
+
+static const char* programVersionString("rntuplegenerate version 1.0 (c) NSCL/FRIB");
+
+/**
+ * threadLocal
+ *   @param threads - true for --threads.
+ *   @return const char* - storage class for the per thread data: the
+ *                         instances and the fill context and entry.
+ */
+static const char*
+threadLocal(bool threads)
+{
+    return threads ? "thread_local " : "";
+}
+/**
+ * commentHeader
+ *    Generate a comment header for a file.
+ * @param f - the file into which the header is generated.
+ * @param filename -name of the file.
+ * @param descrip - brief description
+ */
+static void commentHeader(std::ostream& f, const std::string& filename,  const char* descrip)
+{
+    f << "/**\n";
+    f << "*  @file  " << filename << std::endl;
+    f << "*  @brief " << descrip  << std::endl;
+    f << "*\n";
+    f << "*   This file was generated by " << programVersionString << std::endl;
+    f << "*   Do NOT edit by hand\n";
+    f << "*/\n";
+}
+/**
+ * writeMember
+ *    Write the declaration of a struct field or instance:
+ *    values are doubles, arrays are arrays of doubles, vectors are
+ *    std::vector<double> and structures and struct arrays are their type.
+ *    The layout=columns and branches=single attributes don't apply:  an
+ *    RNTuple already stores each field of a record in its own column.
+ *
+ * @param f      - stream to which the declaration is written.
+ * @param i      - the field or instance.
+ * @param prefix - put before the name, e.g. "(&" for a reference.
+ * @param suffix - put after the name.
+ */
+static void
+writeMember(
+    std::ostream& f, const Instance& i, const char* prefix = "", const char* suffix = ""
+)
+{
+    std::string type = "double";
+    if ((i.s_type == structure) || (i.s_type == structarray)) {
+        type = i.s_typename;
+    }
+    if (i.s_type == vector) {
+        type = "std::vector<double>";
+    }
+    f << type << " " << prefix << i.s_name << suffix;
+    if ((i.s_type == array) || (i.s_type == structarray)) {
+        f << "[" << i.s_elementCount << "]";
+    }
+}
+/**
+ * writeStructureDefs
+ *    Write the struct definitions.  Each is a plain struct whose
+ *    constructor calls Reset, which sets everything in it to NaN (vectors
+ *    are emptied).
+ *
+ * @param f  - stream to which the code is written.
+ * @param types - List of type definitions to write.
+ */
+static void
+writeStructureDefs(std::ostream& f, const TypeList& types)
+{
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        f << "struct " << p->s_typename << " {\n";
+        f << "   " << p->s_typename << "();\n";
+        f << "   void Reset();\n\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            f << "   ";
+            writeMember(f, *fld);
+            f << ";\n";
+        }
+        f << "};\n\n";
+    }
+}
+/**
+ * writeInstanceMembers
+ *    Write the instances as members of a struct.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ */
+static void
+writeInstanceMembers(std::ostream& f, const InstanceList& instances)
+{
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "   ";
+        writeMember(f, *p);
+        f << ";\n";
+    }
+}
+/**
+ * writeInstanceDefs
+ *    Write the declarations of the instances:  as for the Root target they
+ *    are all members of instanceStruct and there's a reference to each.
+ *    With --context instanceStruct is an EventContext and with --threads
+ *    each thread has its own.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ * @param options - generation options.
+ */
+static void
+writeInstanceDefs(
+    std::ostream& f, const InstanceList& instances, const GenerateOptions& options
+)
+{
+    bool threads = options.s_threads;
+    if (options.s_context) {
+        f << "// An event's worth of instances.  Several can be unpacked at once.\n\n";
+        f << "class EventContext {\n";
+        f << "public:\n";
+        writeInstanceMembers(f, instances);
+        f << "};\n\n";
+    }
+    f << "#ifndef IMPLEMENTATION_MODULE\n\n";
+    if (options.s_context) {
+        f << " extern EventContext instanceStruct;       // The one the API without a context uses.\n";
+    } else {
+        f << " extern " << threadLocal(threads) << "struct {\n";
+        writeInstanceMembers(f, instances);
+        f << "}  instanceStruct;\n";
+    }
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "extern " << threadLocal(threads) << "   ";
+        writeMember(f, *p, "(&", ")");
+        f << ";\n";
+    }
+    f << "\n#endif\n\n";
+}
+/**
+ * writeApiPrototypes
+ *    Writes the prototypes for the API functions.
+ *
+ * @param f - stream to which the prototypes are written.
+ * @param options - generation options (--threads, --context and --batch
+ *                  change the API).
+ */
+static void
+writeApiPrototypes(std::ostream& f, const GenerateOptions& options)
+{
+    if (options.s_threads) {
+        f << "// Each worker thread fills its own clusters through a parallel writer:\n\n";
+        f << "void InitializeWriter(const char* filename);   // Before the workers start.\n";
+        f << "void InitializeThread();                       // In each worker.\n";
+        f << "void FinishThread();                           // In each worker when it's done.\n";
+        f << "void CloseWriter();                            // After the workers are done.\n";
+    } else {
+        f << "void Initialize();     // Adds the RNTuple to the current directory (file).\n";
+        f << "void Finish();         // Writes the RNTuple.  Call it before closing the file.\n";
+    }
+    f << "void SetupEvent();\n";
+    f << "void CommitEvent();\n";
+    if (options.s_context) {
+        f << "\n// The entry is bound to the context being committed.\n\n";
+        f << "void SetupEvent(EventContext& context);\n";
+        f << "void CommitEvent(EventContext& context);   // Calls must be serialized.\n";
+    }
+    if (!options.s_batch.empty()) {
+        f << "\n// A batch of events:  unpack event k into batch[k].  It's big;  make it with new.\n\n";
+        f << "class EventBatch {\n";
+        f << "public:\n";
+        f << "   EventContext& operator[](size_t k) { return m_slots[k]; }\n";
+        f << "   size_t size() const { return " << options.s_batch << "; }\n";
+        f << "private:\n";
+        f << "   EventContext m_slots[" << options.s_batch << "];\n";
+        f << "};\n";
+        f << "void SetupBatch(EventBatch& batch);              // Resets every slot.\n";
+        f << "void CommitBatch(EventBatch& batch, size_t n);   // Fills from slots 0 - n-1.\n";
+    }
+}
+/**
+ * generateHeader
+ *    Generate the header file.  It doesn't need any Root headers.
+ *
+ *  @param fname - base name of the output file.
+ *  @param nsname - name of the namespace all the decls go into.
+ *  @param types  - list of data types.
+ *  @param instances - list of top level instances.
+ *  @param options - generation options.
+ *  @return bool - true if the file was written.
+ */
+static bool
+generateHeader(
+    const std::string& fname, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    std::string headerName = fname + ".h";
+    OutputFile f(headerName);
+    commentHeader(f, headerName, "Defines types, instances and API");
+    char cstrName[fname.size() + 1];
+    strcpy(cstrName, fname.c_str());
+    std::string baseFilename = basename(cstrName);
+
+    f << "#ifndef " << baseFilename << "_h\n";
+    f << "#define " << baseFilename << "_h\n";
+    f << "#include <vector>\n";
+    if (!options.s_batch.empty()) {
+        f << "#include <cstddef>\n";
+    }
+    f << "\nnamespace " << nsname << " {\n\n";
+    writeStructureDefs(f, types);
+    writeInstanceDefs(f, instances, options);
+    writeApiPrototypes(f, options);
+    f << "}\n";
+    f << "#endif\n";
+    return f.close();
+}
+/**
+ * writeReset
+ *    Write the statements that reset a field or instance.
+ *
+ * @param f      - stream to which the code is written.
+ * @param i      - the field or instance.
+ * @param object - what it's a member of, with the trailing . or empty.
+ */
+static void
+writeReset(std::ostream& f, const Instance& i, const std::string& object)
+{
+    std::string name = object + i.s_name;
+    switch (i.s_type) {
+    case value:
+        f << "   " << name << " = NAN;\n";
+        break;
+    case array:
+        f << "   fillNaN(" << name << ", " << i.s_elementCount << ");\n";
+        break;
+    case vector:
+        f << "   " << name << ".clear();\n";
+        break;
+    case structure:
+        f << "   " << name << ".Reset();\n";
+        break;
+    case structarray:
+        f << "   for (int i = 0; i < " << i.s_elementCount << "; i++) {\n";
+        f << "      " << name << "[i].Reset();\n";
+        f << "   }\n";
+        break;
+    default:
+        std::cerr << "Unrecognized data type: " << i.s_type << std::endl;
+        std::cerr << i.toString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+/**
+ * generateStructImplementations
+ *    Implement the constructor and Reset method of each struct.
+ *
+ *  @param f       - stream into which the code is generated.
+ *  @param nsname  - Name of the namespace the structs were generated in.
+ *  @param first, last - range of types defined by the user.
+ */
+static void
+generateStructImplementations(
+    std::ostream& f, const std::string& nsname,
+    TypeList::const_iterator first, TypeList::const_iterator last
+)
+{
+    f << "// Struct method implementations: \n\n";
+    for (TypeList::const_iterator p = first; p != last; p++) {
+        std::string name = nsname + "::" + p->s_typename;
+        f << name << "::" << p->s_typename << "() {\n";
+        f << "   Reset();\n";
+        f << "}\n\n";
+        f << "void " << name << "::Reset() {\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            writeReset(f, *fld, "");
+        }
+        f << "}\n\n";
+    }
+}
+/**
+ * generatePrologue
+ *    Generate what goes at the top of each C++ file.  Only the main file
+ *    uses RNTuple;  the --split files just implement the struct methods.
+ *
+ * @param f - stream into which the code is generated.
+ * @param fname - name of the file being generated.
+ * @param headerName -name of the header file.
+ * @param rntuple - true to include the RNTuple headers.
+ * @param threads - true for --threads.
+ */
+static void
+generatePrologue(
+    std::ostream& f, const std::string& fname, const std::string& headerName,
+    bool rntuple, bool threads
+)
+{
+    char cstrHeaderName[headerName.size() + 1];
+    strcpy(cstrHeaderName, headerName.c_str());
+    std::string headerBaseName = basename(cstrHeaderName);
+
+    commentHeader(f, fname, "C++ Implementation file for root RNTuple output");
+    f << "#define IMPLEMENTATION_MODULE\n";
+    f << "#include \"" << headerBaseName << "\"\n\n";
+    f << "#include <cmath>\n";
+    f << "#include <cstddef>\n";
+    if (rntuple) {
+        f << "#include <memory>\n";
+        f << "#include <stdexcept>\n";
+        f << "#include <string>\n";
+        f << "#include <utility>\n";
+        f << "#include <RVersion.h>\n";
+        f << "#include <TDirectory.h>\n";
+        f << "#include <ROOT/REntry.hxx>\n";
+        f << "#include <ROOT/RField.hxx>\n";
+        f << "#include <ROOT/RNTupleModel.hxx>\n";
+        f << "#include <ROOT/RNTupleWriteOptions.hxx>\n";
+        f << "#include <ROOT/RNTupleWriter.hxx>\n";
+        if (threads) {
+            f << "#include <TROOT.h>\n";
+            f << "#include <ROOT/RNTupleFillContext.hxx>\n";
+            f << "#include <ROOT/RNTupleParallelWriter.hxx>\n";
+        }
+        f << "\n// RNTuple moved out of ROOT::Experimental in Root 6.36 "
+          << "(the parallel writer didn't).\n\n";
+        f << "#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)\n";
+        f << "namespace RNT = ROOT;\n";
+        f << "#else\n";
+        f << "namespace RNT = ROOT::Experimental;\n";
+        f << "#endif\n";
+    }
+    f << "\nnamespace {\n";
+    f << "inline void fillNaN(double* p, size_t n) {\n";
+    f << "   for (size_t i = 0; i < n; i++) p[i] = NAN;\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateInstances
+ *    Define instanceStruct and the references to its members.
+ *
+ * @param f      - stream to which code is written.
+ * @param nsname - namespace in which everything is defined.
+ * @param instances- instance list.
+ * @param options - generation options (--threads, --context).
+ */
+static void
+generateInstances(
+    std::ostream& f, const std::string& nsname, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    bool threads = options.s_threads;
+    f << "//   Instance definitions\n\n";
+    f << "namespace " << nsname << " {\n";
+    if (options.s_context) {
+        f << "EventContext instanceStruct;\n";
+    } else {
+        f << threadLocal(threads) << "struct {\n";
+        writeInstanceMembers(f, instances);
+        f << "}  instanceStruct;\n";
+    }
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << threadLocal(threads);
+        writeMember(f, *p, "(&", ")");
+        f << "(instanceStruct." << p->s_name << ");\n";
+    }
+    f << "}\n\n";
+}
+/**
+ * fieldExpression
+ *    The expression that makes the field for a struct field or instance.
+ *
+ * @param i    - the field or instance.
+ * @param name - name to give the field.
+ * @return std::string - a C++ expression of type FieldPtr.
+ */
+static std::string
+fieldExpression(const Instance& i, const std::string& name)
+{
+    std::ostringstream result;
+    switch (i.s_type) {
+    case value:
+        result << "valueField(\"" << name << "\")";
+        break;
+    case array:
+        result << "arrayField(\"" << name << "\", valueField(\"_0\"), " << i.s_elementCount << ")";
+        break;
+    case vector:
+        result << "vectorField(\"" << name << "\")";
+        break;
+    case structure:
+        result << "field_" << i.s_typename << "(\"" << name << "\")";
+        break;
+    case structarray:
+        result << "arrayField(\"" << name << "\", field_" << i.s_typename << "(\"_0\"), "
+               << i.s_elementCount << ")";
+        break;
+    default:
+        std::cerr << "Unrecognized data type: " << i.s_type << std::endl;
+        std::cerr << i.toString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return result.str();
+}
+/**
+ * writeFieldHelpers
+ *    Write the functions that make the fields of the model.
+ *    checked makes sure the record field for a struct lays out its values
+ *    just as the compiler laid out the struct;  if it didn't, binding the
+ *    struct to it would read the wrong memory.
+ *
+ * @param f - stream into which the code is generated.
+ */
+static void
+writeFieldHelpers(std::ostream& f)
+{
+    f << "typedef std::unique_ptr<RNT::RFieldBase> FieldPtr;\n\n";
+    f << "FieldPtr valueField(const std::string& name) {\n";
+    f << "   return FieldPtr(new RNT::RField<double>(name));\n";
+    f << "}\n";
+    f << "FieldPtr vectorField(const std::string& name) {\n";
+    f << "   return FieldPtr(new RNT::RField<std::vector<double>>(name));\n";
+    f << "}\n";
+    f << "FieldPtr arrayField(const std::string& name, FieldPtr item, size_t n) {\n";
+    f << "   return FieldPtr(new RNT::RArrayField(name, std::move(item), n));\n";
+    f << "}\n";
+    f << "FieldPtr checked(FieldPtr field, size_t size, const char* type) {\n";
+    f << "   if (field->GetValueSize() != size) {\n";
+    f << "      throw std::logic_error(\n";
+    f << "         std::string(\"The RNTuple record for \") + type + \" doesn't match its layout\"\n";
+    f << "      );\n";
+    f << "   }\n";
+    f << "   return field;\n";
+    f << "}\n";
+}
+/**
+ * compressionSetting
+ *    Root compression settings are 100*algorithm + level.  If only one of
+ *    --compression and --compression-level is given, the other is Root's
+ *    default:  zstd for the algorithm and, for the level, the one Root
+ *    uses by default with the algorithm.
+ *
+ * @param options - generation options.
+ * @return std::string - the setting or empty to leave Root's default.
+ */
+static std::string
+compressionSetting(const GenerateOptions& options)
+{
+    if (options.s_compression.empty() && options.s_compressionLevel.empty()) {
+        return "";
+    }
+    int algorithm = 5;
+    int level     = 5;
+    if (options.s_compression == "zlib") { algorithm = 1; level = 1; }
+    if (options.s_compression == "lzma") { algorithm = 2; level = 7; }
+    if (options.s_compression == "lz4")  { algorithm = 4; level = 4; }
+    if (!options.s_compressionLevel.empty()) {
+        level = atoi(options.s_compressionLevel.c_str());
+    }
+    std::ostringstream result;
+    result << algorithm*100 + level;
+    return result.str();
+}
+/**
+ * generateModel
+ *    Generate the functions that make the RNTuple model, the write options
+ *    and bind an entry to the instances.  bindEntry is a template so it
+ *    binds instanceStruct or any EventContext.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ * @param types  - the struct types.
+ * @param instances - the instances.
+ * @param options - generation options (the tuning options).
+ */
+static void
+generateModel(
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    const InstanceList& instances, const GenerateOptions& options
+)
+{
+    f << "// The RNTuple model: values are double fields, arrays and struct arrays\n";
+    f << "// array fields, vectors collections and structs records.\n\n";
+    f << "namespace {\n";
+    writeFieldHelpers(f);
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        f << "FieldPtr field_" << p->s_typename << "(const std::string& name) {\n";
+        f << "   std::vector<FieldPtr> items;\n";
+        for (FieldList::const_iterator fld = p->s_fields.begin(); fld != p->s_fields.end(); fld++) {
+            f << "   items.push_back(" << fieldExpression(*fld, fld->s_name) << ");\n";
+        }
+        f << "   return checked(\n";
+        f << "      FieldPtr(new RNT::RRecordField(name, std::move(items))),\n";
+        f << "      sizeof(" << nsname << "::" << p->s_typename << "), \""
+          << nsname << "::" << p->s_typename << "\"\n";
+        f << "   );\n";
+        f << "}\n";
+    }
+    f << "std::unique_ptr<RNT::RNTupleModel> makeModel() {\n";
+    f << "   std::unique_ptr<RNT::RNTupleModel> model(RNT::RNTupleModel::CreateBare());\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "   model->AddField(" << fieldExpression(*p, p->s_name) << ");\n";
+    }
+    f << "   return model;\n";
+    f << "}\n";
+
+    f << "RNT::RNTupleWriteOptions writeOptions() {\n";
+    f << "   RNT::RNTupleWriteOptions options;\n";
+    std::string compression = compressionSetting(options);
+    if (!compression.empty()) {
+        f << "   options.SetCompression(" << compression << ");\n";
+    }
+    if (!options.s_clusterSize.empty()) {
+        f << "   options.SetApproxZippedClusterSize(" << options.s_clusterSize << ");\n";
+    }
+    if (!options.s_pageSize.empty()) {
+        f << "   options.SetMaxUnzippedPageSize(" << options.s_pageSize << ");\n";
+    }
+    if (!options.s_bufferedWrite.empty()) {
+        f << "   options.SetUseBufferedWrite("
+          << (options.s_bufferedWrite == "on" ? "true" : "false") << ");\n";
+    }
+    f << "   return options;\n";
+    f << "}\n";
+
+    f << "template <class Instances>\n";
+    f << "void bindEntry(RNT::REntry& entry, Instances& data) {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        f << "   entry.BindRawPtr(\"" << p->s_name << "\", static_cast<void*>(&data."
+          << p->s_name << "));\n";
+    }
+    f << "}\n";
+    f << "template <class Instances>\n";
+    f << "void resetInstances(Instances& data) {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeReset(f, *p, "data.");
+    }
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateThreadsAPI
+ *    Generate the --threads API.  An RNTupleParallelWriter writes the
+ *    file.  Each worker has its own instances, fill context and entry;
+ *    the fill context writes a cluster of the worker's events when it's
+ *    full and the last one when the worker finishes.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ */
+static void
+generateThreadsAPI(std::ostream& f, const std::string& nsname)
+{
+    f << "// The writer and each thread's fill context and entry:\n\n";
+    f << "namespace " << nsname << " {\n";
+    f << "std::unique_ptr<ROOT::Experimental::RNTupleParallelWriter> pWriter;\n";
+    f << "thread_local std::shared_ptr<ROOT::Experimental::RNTupleFillContext> pFillContext;\n";
+    f << "thread_local std::unique_ptr<RNT::REntry> pEntry;\n";
+    f << "}\n\n";
+
+    f << "void " << nsname << "::InitializeWriter(const char* filename) {\n";
+    f << "   ROOT::EnableThreadSafety();\n";
+    f << "   pWriter = ROOT::Experimental::RNTupleParallelWriter::Recreate(\n";
+    f << "      makeModel(), \"" << nsname << "\", filename, writeOptions()\n";
+    f << "   );\n";
+    f << "}\n";
+    f << "void " << nsname << "::InitializeThread() {\n";
+    f << "   pFillContext = pWriter->CreateFillContext();\n";
+    f << "   pEntry = pFillContext->CreateEntry();\n";
+    f << "   bindEntry(*pEntry, instanceStruct);\n";
+    f << "}\n";
+    f << "void " << nsname << "::FinishThread() {\n";
+    f << "   pEntry.reset();\n";
+    f << "   pFillContext.reset();                    // Writes the last cluster.\n";
+    f << "}\n";
+    f << "void " << nsname << "::CloseWriter() {\n";
+    f << "   pWriter.reset();                         // Writes the RNTuple.\n";
+    f << "}\n\n";
+
+    f << "// Setup event - resets the instances\n\n";
+    f << "void " << nsname << "::SetupEvent() {\n";
+    f << "   resetInstances(instanceStruct);\n";
+    f << "}\n\n";
+    f << "// CommitEvent  Fills the RNTuple\n\n";
+    f << "void " << nsname << "::CommitEvent() {\n";
+    f << "   pFillContext->Fill(*pEntry);\n";
+    f << "}\n\n";
+}
+/**
+ * generateAPI
+ *    Generates the API implementations.  The writer is appended to the
+ *    current directory like a TTree would be.  Without --context the
+ *    entry is bound to instanceStruct once;  with it CommitEvent binds
+ *    the entry to the context it's given, which just sets pointers.
+ *
+ *  @param f  - file into which code is being generated.
+ *  @param nsname - namespace all this stuff lives in.
+ *  @param options - generation options.
+ */
+static void
+generateAPI(std::ostream& f, const std::string& nsname, const GenerateOptions& options)
+{
+    if (options.s_threads) {
+        generateThreadsAPI(f, nsname);
+        return;
+    }
+    bool context = options.s_context;
+    f << "// The writer and the entry it's filled from:\n\n";
+    f << "namespace " << nsname << " {\n";
+    f << "std::unique_ptr<RNT::RNTupleWriter> pWriter;\n";
+    f << "std::unique_ptr<RNT::REntry> pEntry;\n";
+    f << "}\n\n";
+
+    f << "// Initialize - creates the writer and binds the entry\n\n";
+    f << "void " << nsname << "::Initialize() {\n";
+    f << "   pWriter = RNT::RNTupleWriter::Append(\n";
+    f << "      makeModel(), \"" << nsname << "\", *gDirectory, writeOptions()\n";
+    f << "   );\n";
+    f << "   pEntry = pWriter->CreateEntry();\n";
+    f << "   bindEntry(*pEntry, instanceStruct);\n";
+    f << "}\n";
+    f << "void " << nsname << "::Finish() {\n";
+    f << "   pEntry.reset();\n";
+    f << "   pWriter.reset();                         // Writes the RNTuple.\n";
+    f << "}\n\n";
+
+    f << "// Setup event - resets the instances\n\n";
+    f << "void " << nsname << "::SetupEvent() {\n";
+    f << "   resetInstances(instanceStruct);\n";
+    f << "}\n";
+    if (context) {
+        f << "void " << nsname << "::SetupEvent(EventContext& context) {\n";
+        f << "   resetInstances(context);\n";
+        f << "}\n";
+    }
+    f << "\n// CommitEvent  Fills the RNTuple\n\n";
+    f << "void " << nsname << "::CommitEvent() {\n";
+    if (context) {
+        f << "   CommitEvent(instanceStruct);\n";
+        f << "}\n";
+        f << "void " << nsname << "::CommitEvent(EventContext& context) {\n";
+        f << "   bindEntry(*pEntry, context);\n";
+    }
+    f << "   pWriter->Fill(*pEntry);\n";
+    f << "}\n\n";
+
+    if (!options.s_batch.empty()) {
+        f << "// SetupBatch and CommitBatch - SetupEvent and CommitEvent for a batch\n\n";
+        f << "void " << nsname << "::SetupBatch(EventBatch& batch) {\n";
+        f << "   for (size_t k = 0; k < batch.size(); k++) {\n";
+        f << "      resetInstances(batch[k]);\n";
+        f << "   }\n";
+        f << "}\n";
+        f << "void " << nsname << "::CommitBatch(EventBatch& batch, size_t n) {\n";
+        f << "   for (size_t k = 0; k < n; k++) {\n";
+        f << "      bindEntry(*pEntry, batch[k]);\n";
+        f << "      pWriter->Fill(*pEntry);\n";
+        f << "   }\n";
+        f << "}\n\n";
+    }
+}
+/**
+ * generateCPP
+ *    Generate the C++ file.
+ * @param fname - name of the file to be generated.
+ * @param headerName -name of the header file.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @param instances - The instance definitions.
+ * @param options - generation options.  With --split the struct
+ *                  implementations are in their own files.
+ * @return bool - true if the file was written.
+ */
+static bool
+generateCPP(
+    const std::string& fname, const std::string& headerName,
+    const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    OutputFile f(fname);
+    generatePrologue(f, fname, headerName, true, options.s_threads);
+    if (!options.s_split) {
+        generateStructImplementations(f, nsname, types.begin(), types.end());
+    }
+    generateInstances(f, nsname, instances, options);
+    generateModel(f, nsname, types, instances, options);
+    generateAPI(f, nsname, options);
+    return f.close();
+}
+/**
+ * generateStructCPPs
+ *    For --split, generate base-typename.cpp for each struct with its
+ *    methods and list them with base.cpp in base.mk.
+ *
+ * @param base - output file base name.
+ * @param headerName -name of the header file.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @return bool - true if the files were written.
+ */
+static bool
+generateStructCPPs(
+    const std::string& base, const std::string& headerName,
+    const std::string& nsname, const TypeList& types
+)
+{
+    std::vector<std::string> sources(1, base + ".cpp");
+    bool ok = true;
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        std::string fname = base + "-" + p->s_typename + ".cpp";
+        OutputFile f(fname);
+        generatePrologue(f, fname, headerName, false, false);
+        generateStructImplementations(f, nsname, p, p + 1);
+        ok = f.close() && ok;
+        sources.push_back(fname);
+    }
+    return writeSourceList(base, sources) && ok;
+}
+/**
+ * generateRNTuple
+ *   Generate the header and implementation files from the intermediate
+ *   representation.
+ *
+ * @param base      - output file base name (may include a path).
+ * @param nsname    - namespace the generated code lives in.
+ * @param types     - the derived type definitions.
+ * @param instances - the instance definitions.
+ * @param options   - generation options:  --split, --threads, --context,
+ *                    --batch, compression and the RNTuple write options.
+ *                    The TTree only options are ignored.
+ * @return bool - true if all the files were written.
+ */
+bool
+generateRNTuple(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    std::string headerName = base + ".h";
+    bool ok = generateHeader(base, nsname, types, instances, options);
+    ok = generateCPP(base + ".cpp", headerName, nsname, types, instances, options) && ok;
+    if (options.s_split) {
+        ok = generateStructCPPs(base, headerName, nsname, types) && ok;
+    }
+    return ok;
+}
@@ -0,0 +1,34 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  rntuplegenerate.h
+ *  @brief: Entry point to the CERN Root RNTuple code generator.
+ */
+#ifndef RNTUPLEGENERATE_H
+#define RNTUPLEGENERATE_H
+#include <instance.h>
+#include <definedtypes.h>
+#include <genoptions.h>
+#include <string>
+
+bool generateRNTuple(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options = GenerateOptions()
+);
+
+#endif
@@ -0,0 +1,197 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  rolloverbench.cpp
+ *  @brief: Measure writing one file vs. rolling over to numbered files.
+ */
+
+/**
+ * Generates Root code for a declaration file, once as is and once with
+ * --rollover-events (so the run is written as SEGMENTS files).  Each is
+ * compiled with its dictionary and a driver, which reports:
+ *   -  Events per second written, including closing the (last) file.
+ *   -  The longest CommitEvent in milliseconds.  With rollover this
+ *      includes opening the next file and cloning the tree into it.
+ *   -  How long closing the file (or the last file) took, in milliseconds.
+ *   -  The number of files written.
+ *
+ * Usage:
+ *     rolloverbench ?parser? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ *  rootcling     - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+
+static const int EVENTS(200000);
+static const int SEGMENTS(10);
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "   array w[4]\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[512]\n";
+    f << "structarrayinstance det dets[64]\n";
+}
+/**
+ * writeDriver
+ *    Write the driver.  It takes the output file base and the number of
+ *    events on its command line and outputs the figures described above
+ *    on one line.  Compiled with -DROLLOVER it writes with OpenOutput and
+ *    CloseOutput.
+ *
+ * @param filename - driver file.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n#include <TFile.h>\n#include <TTree.h>\n";
+    f << "#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n";
+    f << "#include <fstream>\n#include <string>\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "static void unpack(int e) {\n";
+    f << "   bench::multiplicity = e % 64;\n";
+    f << "   for (int i = 0; i < 512; i += 1 + e % 5) bench::adc[i] = (e + i) % 4096;\n";
+    f << "   for (int i = 0; i < 64; i += 1 + e % 3) {\n";
+    f << "      bench::dets[i].e = (e*i) % 4096;\n";
+    f << "      bench::dets[i].t = e;\n";
+    f << "      bench::dets[i].w[i % 4] = i;\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   std::string base = argv[1];\n";
+    f << "   int events = atoi(argv[2]);\n";
+    f << "   double start = now();\n";
+    f << "#ifdef ROLLOVER\n";
+    f << "   bench::OpenOutput(base.c_str());\n";
+    f << "#else\n";
+    f << "   TFile file((base + \".root\").c_str(), \"RECREATE\");\n";
+    f << "   bench::Initialize();\n";
+    f << "#endif\n";
+    f << "   double longest = 0;\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      bench::SetupEvent();\n";
+    f << "      unpack(e);\n";
+    f << "      double before = now();\n";
+    f << "      bench::CommitEvent();\n";
+    f << "      double took = now() - before;\n";
+    f << "      if (took > longest) longest = took;\n";
+    f << "   }\n";
+    f << "   double closing = now();\n";
+    f << "   int files = 1;\n";
+    f << "#ifdef ROLLOVER\n";
+    f << "   bench::CloseOutput();\n";
+    f << "   closing = now() - closing;\n";
+    f << "   std::ifstream manifest((base + \".manifest\").c_str());\n";
+    f << "   std::string line;\n";
+    f << "   for (files = 0; std::getline(manifest, line); ) {\n";
+    f << "      if (line[0] != '#') files++;\n";
+    f << "   }\n";
+    f << "#else\n";
+    f << "   file.Write();\n";
+    f << "   file.Close();\n";
+    f << "   closing = now() - closing;\n";
+    f << "#endif\n";
+    f << "   printf(\"%f %f %f %d\\n\", events/(now() - start), longest*1000, closing*1000, files);\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+/**
+ * report
+ *    Run a driver and output what it measured.
+ *
+ * @param output  - how it was generated (single or rollover).
+ * @param command - command that runs it.
+ */
+static void
+report(const char* output, const std::string& command)
+{
+    std::istringstream result(run(command));
+    double written, longest, closing;
+    int    files;
+    result >> written >> longest >> closing >> files;
+    std::cout << std::setw(10) << output
+              << std::fixed << std::setprecision(0) << std::setw(12) << written
+              << std::setprecision(2) << std::setw(14) << longest << std::setw(12) << closing
+              << std::setw(7) << files << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 4 ? argv[4] : "rootcling";
+
+    std::string dir = makeBenchDirectory("rolloverbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    std::ostringstream rollover;
+    rollover << " --rollover-events=" << EVENTS/SEGMENTS << " ";
+    
+    std::cout << EVENTS << " events\n";
+    std::cout << std::setw(10) << "output" << std::setw(12) << "events/s"
+              << std::setw(14) << "longest (ms)" << std::setw(12) << "close (ms)"
+              << std::setw(7) << "files" << std::endl;
+    const char* output[] = {"single", "rollover"};
+    std::string options[] = {" ", rollover.str()};
+    const char* defines[] = {"", " -DROLLOVER"};
+    for (int i = 0; i < 2; i++) {
+        std::string mdir = dir + "/" + output[i];
+        run("mkdir " + mdir);
+        run(generator + options[i] + mdir + "/bench " + dir + "/bench.gxir");
+        makeDictionary(rootcling, mdir);
+        compile(
+            mdir + "/driver", mdir,
+            dir + "/driver.cpp " + mdir + "/bench.cpp " + mdir + "/dict.cxx",
+            std::string("-std=c++11") + defines[i] + " " + flags + " -pthread"
+        );
+        std::ostringstream command;
+        command << mdir << "/driver " << mdir << "/run " << EVENTS;
+        report(output[i], command.str());
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,161 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  rootdriver.cpp
+ *  @brief: main for the standalone Root code generator.
+ */
+
+/**
+ * This program generates code to support environment neutral unpacking
+ * of event data.  The intermediate representation of type and instance
+ * definitions generated by the parser for the data definition language
+ * is taken as input on stdin (so we can be pipelined) or from a .gxir
+ * file.  A .h and .cpp file are generated.
+ *
+ * Usage:
+ *      rootgenerate ?--split? ?--sparse-reset? ?--single-branch? ?--threads? ?--context?
+ *                   ?--async? ?--pod? ?--zero-suppress? ?--shm? ?--name=value...?
+ *                   basename ?irfile?
+ *
+ * Which generates basename.h, basename.cpp, and basename-linkdef.h
+ * basename.h, basename.cpp are sufficient for the unpacking code
+ * basename-linkdef.h provides a file that can be used to generate a
+ * root dictionary for the classes/structs we generate.  With --split the
+ * methods of each class go in basename-classname.cpp and basename.mk
+ * lists the .cpp files.  With --sparse-reset, SetupEvent only resets the
+ * array and struct array elements that were set in the previous event.
+ * With --single-branch each struct array instance is one split branch.
+ * With --threads each thread fills its own instances and tree and a
+ * TBufferMerger writes them all to one file.  With --context the instances
+ * are members of an EventContext class and the API has overloads that
+ * take one.  With --async CommitEvent queues the event and a background
+ * thread fills the tree.  With --pod the classes don't derive from TObject.
+ * With --zero-suppress arrays and struct arrays are written sparse.
+ * With --shm committed events are also published in shared memory for
+ * EventSubscribers in other processes.
+ * --batch=n adds an EventBatch of n contexts.  --rollover-bytes=n,
+ * --rollover-events=n and --rollover-seconds=n add OpenOutput and
+ * CloseOutput, which write numbered files that roll over at those limits.
+ * The other --name=value options tune the TTree (see genx --help).
+ */
+#include "rootgenerate.h"
+#include "irfile.h"
+#include <iostream>
+#include <stdlib.h>
+
+/**
+ * usage
+ *    Outputs an error message and program usage text to the desired
+ *    stream.
+ *
+ * @param f - the stream to which output is directed.
+ * @param msg - the message that precedes the usage text.
+ */
+static void
+usage(std::ostream& f, const char * msg)
+{
+    f << msg << std::endl;
+    f << "Usage\n";
+    f << "   rootgenerate ?--split? ?--sparse-reset? ?--single-branch? ?--threads? ?--context?\n";
+    f << "                ?--async? ?--pod? ?--zero-suppress? ?--shm? ?--name=value...?\n";
+    f << "                basename ?irfile?\n";
+    f << "Where:\n";
+    f << "   --split  also writes a .cpp for each class and a list of the .cpp\n";
+    f << "            files (basename.mk) so they can be compiled in parallel\n";
+    f << "   --sparse-reset makes SetupEvent only reset the array and struct array\n";
+    f << "            elements set since the last SetupEvent\n";
+    f << "   --single-branch writes each struct array instance as one split branch\n";
+    f << "            rather than a branch per element\n";
+    f << "   --threads gives each thread its own instances and tree;  the trees\n";
+    f << "            are merged into one file with TBufferMerger\n";
+    f << "   --context makes the instances members of an EventContext class and adds\n";
+    f << "            Initialize, SetupEvent and CommitEvent overloads that take one\n";
+    f << "   --async makes CommitEvent copy the instances into one of --async-depth\n";
+    f << "            buffers that a background thread fills the tree from\n";
+    f << "   --pod    generates classes without a TObject base (ClassDefNV) that\n";
+    f << "            copy as plain data\n";
+    f << "   --zero-suppress writes only the elements of arrays and struct arrays\n";
+    f << "            that were set, with their indices, and adds a reader\n";
+    f << "   --shm    implies --context and --pod;  CommitEvent also publishes the\n";
+    f << "            event to a ring in POSIX shared memory that EventSubscribers\n";
+    f << "            in other processes read in place\n";
+    f << "   --batch=n implies --context and adds an EventBatch of n EventContexts\n";
+    f << "            with SetupBatch and CommitBatch\n";
+    f << "   --name=value sets a TTree tuning option, one of basket-size (bytes or auto),\n";
+    f << "            compression (zlib, lzma, lz4, zstd), compression-level (0-9),\n";
+    f << "            auto-flush, auto-save, split-level (0-99), precision (double,\n";
+    f << "            float or bins) or async-depth\n";
+    f << "   --rollover-bytes=n, --rollover-events=n and --rollover-seconds=n add\n";
+    f << "            OpenOutput(base) and CloseOutput, which write base-0000.root,\n";
+    f << "            base-0001.root... starting the next file when one of those\n";
+    f << "            limits is reached, and list them in base.manifest\n";
+    f << "   basename is the base name for the generated files.  The files\n";
+    f << "            created are basename.h, basename.cpp and basename-linkdef.h\n";
+    f << "   irfile   is a .gxir intermediate representation file.  If it's omitted\n";
+    f << "            the intermediate representation is read from stdin\n";
+    
+    exit(EXIT_FAILURE);
+}
+/**
+ * main
+ *   entry point
+ */
+int main (int argc, char** argv)
+{
+    GenerateOptions options;
+    int first = parseGenerateOptions(argc, argv, options);
+    if (first < 0) {
+        usage(std::cerr, "Unrecognized option");
+    }
+    if (optionConflict(options)) {
+        usage(std::cerr, optionConflict(options));
+    }
+    argc -= first - 1;                    // Now as if there were no options.
+    argv += first - 1;
+    if ((argc != 2) && (argc != 3)) {
+        usage(std::cerr, "Incorrect number of command line parameters");
+    }
+    // Read the intermediate representation:
+    
+    IrFile ir;
+    bool ok = argc == 3 ? ir.open(argv[2]) : ir.read(std::cin);
+    if (!ok) {
+        std::cerr << "rootgenerate: " << ir.error() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    TypeList types;
+    InstanceList instances;
+    ir.load(nsName, types, instances);
+    
+    // From the base name generate the names of the namespace.  Note that
+    // unless the declaration file named one, we use basename to
+    // remove any path information from basename as the user could do:
+    //
+    // rootgenerate ~/rootstuff/base
+    //
+    // which, by the time we're done gives us a namespace of base.
+    
+    std::string base   = argv[1];
+    if (!generateRoot(base, namespaceFor(base), types, instances, options)) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+void yyerror(const char* msg)
+{
+    usage(std::cerr, msg);
+}
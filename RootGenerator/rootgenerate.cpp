@@ -20,53 +20,63 @@
  */
 
 /**
- * This program generates code to support environment neutral unpacking
- * of event data.  The intermediate representation of type and instance
- * definitions generated by the parser for the data definition language
- * is taken as input on stdin (so we can be pipelined).  A .h and
- * .cpp file are generated.
+ * This module generates code to support environment neutral unpacking
+ * of event data from the intermediate representation of type and instance
+ * definitions generated by the parser for the data definition language.
+ * It is linked both into the standalone rootgenerate program (see
+ * rootdriver.cpp) and directly into genx.
  *
- * Usage:
- *      rootgenerate basename
- *
- * Which generates basename.h, basename.cpp, and basename-linkdef.h
- * basename.h, basename.cpp are sufficient for the unpacking code
- * basename-linkdef.h provides a file that can be used to generate a
- * root dictionary for the classes/structs we generate.
+ * generateRoot(basename, ...) generates basename.h, basename.cpp, and
+ * basename-linkdef.h.  basename.h, basename.cpp are sufficient for the
+ * unpacking code basename-linkdef.h provides a file that can be used to
+ * generate a root dictionary for the classes/structs we generate.
  */
 
+#include "rootgenerate.h"
+#include "outputfile.h"
+#include "contenthash.h"
 #include <iostream>
-#include <instance.h>
-#include <definedtypes.h>
-#include <fstream>
 #include <sstream>
 #include <stdlib.h>
 #include <libgen.h>
 #include <string.h>
 #include <math.h>
+#include <set>
+
+static const char* programVersionString("rootgenerate version 2.0 (c) NSCL/FRIB");
+static const int MAX_FIXED_RUN(16);          // Longest run with its own fillRuns.
+
+// For --basket-size=auto:
+
+static const long long VECTOR_GUESS(16);     // Doubles assumed per vector per event.
+static const long long CLUSTER_BYTES(30000000); // Root's default auto-flush (-30000000).
+static const long long MIN_BASKET(4096);
+static const long long MAX_BASKET(4*1024*1024);
 
-const char* programVersionString("rootgenerate version 2.0 (c) NSCL/FRIB");
+// For precision=bins:
+
+static const int MAX_MANTISSA_BITS(14);      // Root truncates mantissas to at most this.
+
+// For --sparse-reset: SetupEvent resets everything rather than just what
+// was set once more than 1/SPARSE_RESET_DIVISOR of the elements were set.
+// Setting a listed element to NaN costs about 7 times as much as a
+// fillNaN of the whole array does per element (98304 leaves, hits in
+// random order), so the two break even at about 1/7.  The tracked writes
+// are paid either way and don't move this;  they are why the option only
+// pays off overall below about 1-5% occupancy (see resetbench).
+
+static const int SPARSE_RESET_DIVISOR(8);
 
 /**
- * usage
- *    Outputs an error message and program usage text to the desired
- *    stream.
- *
- * @param f - the stream to which output is directed.
- * @param msg - the message that precedes the usage text.
+ * threadLocal
+ *   @param threads - true for --threads.
+ *   @return const char* - storage class for the per thread data: the
+ *                         instances, the tree and what SetupEvent keeps.
  */
-static void
-usage(std::ostream& f, const char * msg)
+static const char*
+threadLocal(bool threads)
 {
-    f << msg << std::endl;
-    f << "Usage\n";
-    f << "   rootgenerate basename\n";
-    f << "Where:\n";
-    f << "   basename is the base name for the generated files.  The files\n";
-    f << "            created are basename.h, basename.cpp and basename-linkdef.h\n";
-    f << "The program expects the intermediate representation to be on stdin\n";
-    
-    exit(EXIT_FAILURE);
+    return threads ? "thread_local " : "";
 }
 /**
  * commentHeader
@@ -86,16 +96,394 @@ static void commentHeader(std::ostream& f, const std::string& filename,  const c
     f << "*/\n";
 }
 
+/**
+ * isColumns
+ *   @param i - an instance or field.
+ *   @return bool - true if it's a struct array to be laid out as a struct of
+ *                  arrays (layout=columns).
+ */
+static bool
+isColumns(const Instance& i)
+{
+    return (i.s_type == structarray) && (i.s_options.attribute("layout") == "columns");
+}
+/**
+ * isZeroSuppressed
+ *   @param i - an instance.
+ *   @return bool - true if it's an array or a struct array that's not
+ *                  layout=columns and is written zero suppressed
+ *                  (storage=sparse): only the elements that were set are
+ *                  written, along with their indices.
+ */
+static bool
+isZeroSuppressed(const Instance& i)
+{
+    return ((i.s_type == array) || ((i.s_type == structarray) && !isColumns(i)))
+        && (i.s_options.attribute("storage") == "sparse");
+}
+/**
+ * isSingleBranch
+ *   @param i - an instance.
+ *   @return bool - true if it's a struct array that's written as one split
+ *                  branch (branches=single).  These are held in a
+ *                  std::vector so Root can split them.  Zero suppressed
+ *                  struct arrays aren't, their elements are compacted
+ *                  into a vector when the tree is filled.
+ */
+static bool
+isSingleBranch(const Instance& i)
+{
+    return (i.s_type == structarray) && !isColumns(i) && !isZeroSuppressed(i)
+        && (i.s_options.attribute("branches") == "single");
+}
+/**
+ * hasZeroSuppressed
+ *   @param instances - the instances.
+ *   @return bool - true if any of them are zero suppressed.
+ */
+static bool
+hasZeroSuppressed(const InstanceList& instances)
+{
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (isZeroSuppressed(*p)) return true;
+    }
+    return false;
+}
+/**
+ * hasRollover
+ *   @param options - generation options.
+ *   @return bool - true if the output rolls over to a new file by size,
+ *                  event count or time (--rollover-*).
+ */
+static bool
+hasRollover(const GenerateOptions& options)
+{
+    return !options.s_rolloverBytes.empty() || !options.s_rolloverEvents.empty()
+        || !options.s_rolloverSeconds.empty();
+}
+/**
+ * resolveBranches
+ *    With --single-branch, struct array instances that don't say otherwise
+ *    are written as single branches.  With --shm none are:  they'd be
+ *    vectors and the published events have to be plain data.
+ *
+ * @param instances - the instances.
+ * @param options   - generation options.
+ * @return InstanceList - the instances with branches=single given to those.
+ */
+static InstanceList
+resolveBranches(const InstanceList& instances, const GenerateOptions& options)
+{
+    InstanceList result(instances);
+    if (options.s_shm) {
+        for (InstanceList::iterator p = result.begin(); p != result.end(); p++) {
+            p->s_options.s_attributes.erase("branches");
+        }
+    }
+    if (options.s_singleBranch) {
+        for (InstanceList::iterator p = result.begin(); p != result.end(); p++) {
+            Attributes& attributes(p->s_options.s_attributes);
+            if ((p->s_type == structarray) && !attributes.count("branches")) {
+                attributes["branches"] = "single";
+            }
+        }
+    }
+    return result;
+}
+/**
+ * resolveStorage
+ *    With --zero-suppress, array and struct array instances that don't
+ *    have a storage attribute are written zero suppressed.
+ *
+ * @param instances - (in/out) the instances.
+ * @param options   - generation options.
+ */
+static void
+resolveStorage(InstanceList& instances, const GenerateOptions& options)
+{
+    if (options.s_zeroSuppress) {
+        for (InstanceList::iterator p = instances.begin(); p != instances.end(); p++) {
+            Attributes& attributes(p->s_options.s_attributes);
+            if (((p->s_type == array) || (p->s_type == structarray))
+                && !attributes.count("storage")) {
+                attributes["storage"] = "sparse";
+            }
+        }
+    }
+}
+/**
+ * resolveFieldPrecision
+ *    Give values and arrays that don't have a precision attribute the
+ *    --precision one.
+ *
+ * @param fields - (in/out) the fields or instances.
+ * @param precision - the --precision value (not empty).
+ */
+static void
+resolveFieldPrecision(std::vector<Instance>& fields, const std::string& precision)
+{
+    for (std::vector<Instance>::iterator p = fields.begin(); p != fields.end(); p++) {
+        Attributes& attributes(p->s_options.s_attributes);
+        if (((p->s_type == value) || (p->s_type == array)) && !attributes.count("precision")) {
+            attributes["precision"] = precision;
+        }
+    }
+}
+/**
+ * resolvePrecision
+ *    With --precision, values and arrays, both instances and struct
+ *    members, that don't say otherwise are stored with that precision.
+ *
+ * @param types     - (in/out) the types.
+ * @param instances - (in/out) the instances.
+ * @param options   - generation options.
+ */
+static void
+resolvePrecision(TypeList& types, InstanceList& instances, const GenerateOptions& options)
+{
+    if (!options.s_precision.empty()) {
+        for (TypeList::iterator p = types.begin(); p != types.end(); p++) {
+            resolveFieldPrecision(p->s_fields, options.s_precision);
+        }
+        resolveFieldPrecision(instances, options.s_precision);
+    }
+}
+/**
+ * mantissaBits
+ *    For precision=bins, the mantissa bits a float needs so that the values
+ *    it's truncated to are no further apart than a bin anywhere in
+ *    [low, high].  E.g. low=0 high=4096 bins=4096 (a 12 bit ADC) needs 12,
+ *    which holds every channel number exactly.
+ *
+ * @param o - the value's metadata.
+ * @return int - the bits or 0 if more than Root can truncate to are needed
+ *               (or the metadata make no sense);  a float is stored then.
+ */
+static int
+mantissaBits(const ValueOptions& o)
+{
+    if ((o.s_high <= o.s_low) || (o.s_bins == 0)) {
+        return 0;
+    }
+    double largest = fabs(o.s_low) > fabs(o.s_high) ? fabs(o.s_low) : fabs(o.s_high);
+    int bits = ceil(log2(largest * o.s_bins / (o.s_high - o.s_low)));
+    if (bits < 2) bits = 2;
+    return bits <= MAX_MANTISSA_BITS ? bits : 0;
+}
+/**
+ * isReduced
+ *   @param i - a value or array instance or field.
+ *   @return bool - true if it's stored with less than double precision
+ *                  (precision=float or bins).  In memory it's a double
+ *                  either way;  Double32_t members and /d leaves are
+ *                  written as floats.
+ */
+static bool
+isReduced(const Instance& i)
+{
+    std::string precision = i.s_options.attribute("precision", "double");
+    return ((i.s_type == value) || (i.s_type == array)) && (precision != "double");
+}
+/**
+ * precisionRange
+ *   @param i - a value or array instance or field.
+ *   @return std::string - the Double32_t range and bits that tell Root to
+ *                  truncate the mantissa (e.g. [0,0,12]) for precision=bins,
+ *                  otherwise empty.
+ */
+static std::string
+precisionRange(const Instance& i)
+{
+    int bits = 0;
+    if (isReduced(i) && (i.s_options.attribute("precision") == "bins")) {
+        bits = mantissaBits(i.s_options);
+    }
+    if (!bits) {
+        return "";
+    }
+    std::ostringstream result;
+    result << "[0,0," << bits << "]";
+    return result.str();
+}
+/**
+ * memberType
+ *   @param i - a value or array field.
+ *   @return std::string - the type of its class member(s).
+ */
+static std::string
+memberType(const Instance& i)
+{
+    return isReduced(i) ? "Double32_t" : "Double_t";
+}
+/**
+ * memberComment
+ *   @param i - a value or array field.
+ *   @return std::string - what follows its member declaration: for
+ *                  precision=bins the comment rootcling reads the range from.
+ */
+static std::string
+memberComment(const Instance& i)
+{
+    std::string range = precisionRange(i);
+    return range.empty() ? "" : std::string("   //") + range;
+}
+/**
+ * leafType
+ *   @param i - a value or array instance or field.
+ *   @return std::string - the type part of its leaf list, e.g. /D or /d[0,0,12].
+ */
+static std::string
+leafType(const Instance& i)
+{
+    return isReduced(i) ? "/d" + precisionRange(i) : "/D";
+}
+/**
+ * indexType
+ *   @param i - a zero suppressed instance.
+ *   @return const char* - the type of the indices of its elements that
+ *                  are written.
+ */
+static const char*
+indexType(const Instance& i)
+{
+    return i.s_elementCount < 65536 ? "UShort_t" : "UInt_t";
+}
+/**
+ * indexLeafType
+ *   @param i - a zero suppressed instance.
+ *   @return const char* - the type part of its index branch's leaf list.
+ */
+static const char*
+indexLeafType(const Instance& i)
+{
+    return i.s_elementCount < 65536 ? "/s" : "/i";
+}
+/**
+ * columnsType
+ *   @param name - name of a struct type.
+ *   @param n    - number of elements.
+ *   @return std::string - the struct of arrays type that holds n of them.
+ */
+static std::string
+columnsType(const std::string& name, unsigned n)
+{
+    std::ostringstream result;
+    result << name << "_columns<" << n << ">";
+    return result.str();
+}
+/**
+ * findType
+ *   @param types - the type list.
+ *   @param name  - name of a type in it.
+ *   @return const TypeDefinition& - its definition.
+ */
+static const TypeDefinition&
+findType(const TypeList& types, const std::string& name)
+{
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        if (p->s_typename == name) return *p;
+    }
+    std::cerr << "Undefined struct type: " << name << std::endl;
+    exit(EXIT_FAILURE);
+}
+/**
+ * hasVectors
+ *   @param types - the type list.
+ *   @param name  - name of a type in it.
+ *   @return bool - true if the type or any type it contains has a vector
+ *                  field, i.e. it can't be copied or reset as a block of
+ *                  Double_t's.
+ */
+static bool
+hasVectors(const TypeList& types, const std::string& name)
+{
+    const TypeDefinition& type(findType(types, name));
+    for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
+        if (p->s_type == vector) return true;
+        if (((p->s_type == structure) || (p->s_type == structarray))
+            && hasVectors(types, p->s_typename)) {
+            return true;
+        }
+    }
+    return false;
+}
+/**
+ * checkPublishable
+ *    --shm publishes events as plain data, which a vector isn't.  Exits
+ *    with a message if an instance is or holds one.
+ *
+ * @param types     - the type list.
+ * @param instances - the instances.
+ */
+static void
+checkPublishable(const TypeList& types, const InstanceList& instances)
+{
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if ((p->s_type == vector)
+            || (((p->s_type == structure) || (p->s_type == structarray))
+                && hasVectors(types, p->s_typename))) {
+            std::cerr << "--shm: " << p->s_name
+                      << " holds a vector;  published events must be fixed size" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+/**
+ * columnsTypes
+ *    Figure out which types need a struct of arrays template.  These are
+ *    the types of layout=columns struct arrays and the types they contain.
+ *
+ * @param types     - the type list.
+ * @param instances - the instances.
+ * @return std::set<std::string> - names of the types that need one.
+ */
+static std::set<std::string>
+columnsTypes(const TypeList& types, const InstanceList& instances)
+{
+    std::set<std::string> result;
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (isColumns(*p)) result.insert(p->s_typename);
+    }
+    for (TypeList::const_iterator t = types.begin(); t != types.end(); t++) {
+        for (FieldList::const_iterator p = t->s_fields.begin(); p != t->s_fields.end(); p++) {
+            if (isColumns(*p)) result.insert(p->s_typename);
+        }
+    }
+    // Types can only contain types defined before them so one pass from
+    // the end picks up everything:
+    
+    for (TypeList::const_reverse_iterator t = types.rbegin(); t != types.rend(); t++) {
+        if (result.count(t->s_typename)) {
+            for (FieldList::const_iterator p = t->s_fields.begin(); p != t->s_fields.end(); p++) {
+                if ((p->s_type == structure) || (p->s_type == structarray)) {
+                    result.insert(p->s_typename);
+                }
+            }
+        }
+    }
+    return result;
+}
 /**
  * writeClassHeader
  *    Write the invariant part of a class definition. This is the class,
- *    and canonical method definitions.
+ *    and canonical method definitions.  With --pod the class has no base
+ *    and the compiler's copy constructor, assignment and destructor are
+ *    used so that classes without vectors are trivially copyable.
  * @param f -- stream to which the definition is written.
  * @param name - name of the class
+ * @param pod  - true for --pod.
  */
 static void
-writeClassHeader(std::ostream& f, const std::string& name)
+writeClassHeader(std::ostream& f, const std::string& name, bool pod)
 {
+    if (pod) {
+        f << "class " << name << " {\n";
+        f << "public:\n";
+        f << "   " << name << "();\n";
+        f << "   void Reset(); \n";
+        f << std::endl;
+        return;
+    }
     f << "class " << name << " : public TObject {\n";
     f << "public:\n";
     f << "   " << name << "();\n";            // Default constructor.
@@ -117,7 +505,9 @@ writeClassHeader(std::ostream& f, const std::string& name)
  *
  *  @param f - stream to which code is emitted.
  *  @param flist - list of field definitions.
- *  @note in root we ignore the ValueOptions as they have no meaning.
+ *  @note in root we ignore the ValueOptions as they have no meaning, except
+ *        that values and arrays stored with less than double precision
+ *        (precision=float or bins) are Double32_t.
  */
 static void writeClassMembers(std::ostream& f, const FieldList& flist)
 {
@@ -125,7 +515,7 @@ static void writeClassMembers(std::ostream& f, const FieldList& flist)
         //  Let's try to be generic:
         
         std::string fieldName = p->s_name;
-        std::string fieldType = "Double_t";           // Default to primitive type.
+        std::string fieldType = memberType(*p);       // Default to primitive type.
         unsigned    n         = 1;                    // Default to scalar:
         
         if ((p->s_type == structure) || (p->s_type == structarray)) {
@@ -137,12 +527,16 @@ static void writeClassMembers(std::ostream& f, const FieldList& flist)
         if (p->s_type == vector) {
             fieldType = "std::vector<Double_t>";
         }
+        if (isColumns(*p)) {
+            fieldType = columnsType(p->s_typename, p->s_elementCount);
+            n = 1;
+        }
         f << "   " << fieldType << " " << fieldName;
         if (n > 1) {
             f << "[" << n << "]";
         }
         
-        f << ";\n";
+        f << ";" << memberComment(*p) << "\n";
     }
     f << "\n";
 }
@@ -150,14 +544,16 @@ static void writeClassMembers(std::ostream& f, const FieldList& flist)
 /**
  * writeClassTrailer
  *    Writes the  ClassDef directive and closes the class definition:
+ *    ClassDefNV for --pod, since it adds no virtual methods.
  *
  *  @param f - stream to which code is emitted.
  *  @param name - name of the class.
+ *  @param pod  - true for --pod.
  */
 static void
-writeClassTrailer(std::ostream& f, const std::string& name)
+writeClassTrailer(std::ostream& f, const std::string& name, bool pod)
 {
-    f << "  ClassDef(" << name << ", 1)\n";    // No semicolon allowed !!!
+    f << "  " << (pod ? "ClassDefNV(" : "ClassDef(") << name << ", 1)\n";    // No semicolon allowed !!!
     f << "};\n\n";
 }
 
@@ -166,48 +562,337 @@ writeClassTrailer(std::ostream& f, const std::string& name)
  *    Write the struture definitions.
  * @param f  - stream to which the code is written.
  * @param types - List of type definitions to write.
+ * @param pod   - true for --pod.
  */
 static void
-writeStructureDefs(std::ostream& f, const std::list<TypeDefinition>& types)
+writeStructureDefs(std::ostream& f, const TypeList& types, bool pod)
 {
     // For each struct we create a class that inherits from TOBject.
     // To be serializable the class has to have a default constructor,
     // destructor, copy constructor, assignment.  These will be implemented
     // in the CPP file not here.
     // we also need to close with a ClassDef directive.
+    // With --pod there's no TObject and the compiler supplies all but the
+    // default constructor.
     
-    for (std::list<TypeDefinition>::const_iterator p = types.begin();
+    for (TypeList::const_iterator p = types.begin();
           p != types.end(); p++) {
-        writeClassHeader(f, p->s_typename);
+        writeClassHeader(f, p->s_typename, pod);
         writeClassMembers(f, p->s_fields);
-        writeClassTrailer(f, p->s_typename);
+        writeClassTrailer(f, p->s_typename, pod);
     }
 }
 /**
- * writeInstanceDefs
- *    Write definitions of the instances declared by the user;
+ * writeColumnsTemplate
+ *    Write the struct of arrays template for a type.  T_columns<N> holds
+ *    N T's as one array (column) per field so loops over a field are
+ *    contiguous.  Struct fields are T_columns of their type and struct
+ *    array fields (of M elements) are columns of N*M elements where element
+ *    i's [j] is at i*M+j.  x[i] returns a reference object whose members
+ *    refer to element i's values so user code can still say x[i].e.
+ *
+ * @param f    - stream to which the code is written.
+ * @param type - the type.
+ */
+static void
+writeColumnsTemplate(std::ostream& f, const TypeDefinition& type)
+{
+    const std::string& name(type.s_typename);
+    const FieldList&   fields(type.s_fields);
+    
+    f << "// " << name << "s laid out as a struct of arrays (layout=columns).\n\n";
+    f << "template <int N>\n";
+    f << "struct " << name << "_columns {\n";
+    for (FieldList::const_iterator p = fields.begin(); p != fields.end(); p++) {
+        switch (p->s_type) {
+        case value:
+            f << "   " << memberType(*p) << " " << p->s_name << "[N];"
+              << memberComment(*p) << "\n";
+            break;
+        case array:
+            f << "   " << memberType(*p) << " " << p->s_name << "[N]["
+              << p->s_elementCount << "];" << memberComment(*p) << "\n";
+            break;
+        case vector:
+            f << "   std::vector<Double_t> " << p->s_name << "[N];\n";
+            break;
+        case structure:
+            f << "   " << p->s_typename << "_columns<N> " << p->s_name << ";\n";
+            break;
+        case structarray:
+            f << "   " << p->s_typename << "_columns<N*" << p->s_elementCount << "> "
+              << p->s_name << ";\n";
+            break;
+        }
+    }
+    f << "\n";
+    f << "   class reference {\n";
+    f << "   public:\n";
+    f << "      reference(" << name << "_columns& c, int i)";
+    const char* separator = " :\n         ";
+    for (FieldList::const_iterator p = fields.begin(); p != fields.end(); p++) {
+        f << separator << p->s_name << "(";
+        switch (p->s_type) {
+        case value:
+        case array:
+        case vector:
+            f << "c." << p->s_name << "[i]";
+            break;
+        case structure:
+            f << "c." << p->s_name << ", i";
+            break;
+        case structarray:
+            f << "c." << p->s_name << ", i*" << p->s_elementCount;
+            break;
+        }
+        f << ")";
+        separator = ", ";
+    }
+    f << " {}\n";
+    for (FieldList::const_iterator p = fields.begin(); p != fields.end(); p++) {
+        switch (p->s_type) {
+        case value:
+            f << "      Double_t& " << p->s_name << ";\n";
+            break;
+        case array:
+            f << "      Double_t (&" << p->s_name << ")[" << p->s_elementCount << "];\n";
+            break;
+        case vector:
+            f << "      std::vector<Double_t>& " << p->s_name << ";\n";
+            break;
+        case structure:
+            f << "      typename " << p->s_typename << "_columns<N>::reference "
+              << p->s_name << ";\n";
+            break;
+        case structarray:
+            f << "      ColumnSlice<" << p->s_typename << "_columns<N*"
+              << p->s_elementCount << "> > " << p->s_name << ";\n";
+            break;
+        }
+    }
+    f << "   };\n";
+    f << "   reference operator[](int i) { return reference(*this, i); }\n";
+    f << "   int size() const { return N; }\n";
+    f << "   void Reset() {\n";
+    for (FieldList::const_iterator p = fields.begin(); p != fields.end(); p++) {
+        switch (p->s_type) {
+        case value:
+            f << "      for (int i = 0; i < N; i++) " << p->s_name << "[i] = NAN;\n";
+            break;
+        case array:
+            f << "      for (int i = 0; i < N; i++) {\n";
+            f << "         for (int j = 0; j < " << p->s_elementCount << "; j++) "
+              << p->s_name << "[i][j] = NAN;\n";
+            f << "      }\n";
+            break;
+        case vector:
+            f << "      for (int i = 0; i < N; i++) " << p->s_name << "[i].clear();\n";
+            break;
+        case structure:
+        case structarray:
+            f << "      " << p->s_name << ".Reset();\n";
+            break;
+        }
+    }
+    f << "   }\n";
+    f << "};\n\n";
+}
+/**
+ * writeColumnsSupport
+ *    Write the struct of arrays templates needed for layout=columns.
+ *    They go before the classes since classes can have layout=columns
+ *    fields.
+ *
+ * @param f       - stream to which the code is written.
+ * @param types   - the type list.
+ * @param needed  - the types that need templates (see columnsTypes).
+ */
+static void
+writeColumnsSupport(
+    std::ostream& f, const TypeList& types, const std::set<std::string>& needed
+)
+{
+    f << "// Elements first.. of a struct of arrays: a struct array field of\n";
+    f << "// an element in a struct of arrays.\n\n";
+    f << "template <class C>\n";
+    f << "class ColumnSlice {\n";
+    f << "public:\n";
+    f << "   ColumnSlice(C& columns, int first) : m_columns(columns), m_first(first) {}\n";
+    f << "   typename C::reference operator[](int i) { return m_columns[m_first + i]; }\n";
+    f << "private:\n";
+    f << "   C&  m_columns;\n";
+    f << "   int m_first;\n";
+    f << "};\n\n";
+    
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        if (needed.count(p->s_typename)) {
+            writeColumnsTemplate(f, *p);
+        }
+    }
+}
+/**
+ * writeTrackingSupport
+ *    For --sparse-reset, write the classes through which the instance arrays
+ *    and struct arrays are accessed.  They record what is set during an
+ *    event so that SetupEvent only needs to reset that:
+ *    -  TrackedArray elements are TrackedLeaf objects.  Assigning to one
+ *       whose value is still NaN (i.e. the first time in an event) adds
+ *       its address to touchedLeaves.
+ *    -  TrackedStructArray records the index of each element that's used.
+ *    Writes through a raw pointer can't be tracked, so taking one
+ *    (data() or &a[i]) sets touchedAll and the next SetupEvent resets
+ *    everything.
  *
  * @param f - stream to which the code is generated.
- * @param instances - list of instances to generate.
- * 
  */
 static void
-writeInstanceDefs(std::ostream& f, const std::list<Instance>& instances)
+writeTrackingSupport(std::ostream& f, bool threads)
 {
-    // C++11 doesn't like a variable to be declared both  extern and defined
-    // in the file so we conditionalize all of this on IMPLEMENTATION_MODULE
-    // not being defined:
+    f << "// Sparse reset support: writes through these are recorded so that\n";
+    f << "// SetupEvent only resets what the previous event set.\n";
+    f << "//\n";
+    f << "// Writes through a raw pointer bypass the tracking.  Taking one with\n";
+    f << "// data() or &array[i] (e.g. to pass the array as a Double_t* or to\n";
+    f << "// memcpy into it) makes the next SetupEvent reset everything.  A pointer\n";
+    f << "// kept from an earlier event, or one to a struct array element used\n";
+    f << "// to get at the elements after it, is not seen:  elements set through\n";
+    f << "// it are not reset.\n\n";
+    f << "const int SPARSE_RESET_DIVISOR(" << SPARSE_RESET_DIVISOR
+      << ");   // Reset all when more than 1/this were set.\n";
+    f << "extern " << threadLocal(threads) << "std::vector<Double_t*> touchedLeaves;\n";
+    f << "extern " << threadLocal(threads) << "bool touchedAll;\n\n";
     
-    f << "#ifndef IMPLEMENTATION_MODULE\n\n";
+    f << "class TrackedLeaf {\n";
+    f << "public:\n";
+    f << "   explicit TrackedLeaf(Double_t* p) : m_p(p) {}\n";
+    f << "   TrackedLeaf& operator=(Double_t value) {\n";
+    f << "      if (std::isnan(*m_p)) touchedLeaves.push_back(m_p);\n";
+    f << "      *m_p = value;\n";
+    f << "      return *this;\n";
+    f << "   }\n";
+    f << "   TrackedLeaf& operator=(const TrackedLeaf& rhs) { return *this = Double_t(rhs); }\n";
+    f << "   TrackedLeaf& operator+=(Double_t value) { return *this = *m_p + value; }\n";
+    f << "   TrackedLeaf& operator-=(Double_t value) { return *this = *m_p - value; }\n";
+    f << "   TrackedLeaf& operator*=(Double_t value) { return *this = *m_p * value; }\n";
+    f << "   TrackedLeaf& operator/=(Double_t value) { return *this = *m_p / value; }\n";
+    f << "   TrackedLeaf& operator++() { return *this = *m_p + 1; }\n";
+    f << "   TrackedLeaf& operator--() { return *this = *m_p - 1; }\n";
+    f << "   Double_t operator++(int) { Double_t old = *m_p; *this = old + 1; return old; }\n";
+    f << "   Double_t operator--(int) { Double_t old = *m_p; *this = old - 1; return old; }\n";
+    f << "   Double_t* operator&() const { touchedAll = true; return m_p; }\n";
+    f << "   operator Double_t() const { return *m_p; }\n";
+    f << "private:\n";
+    f << "   Double_t* m_p;\n";
+    f << "};\n\n";
     
-    //  Note to better support marshalling this struct in and out of
-    //  MPI messages, we put all instances in a struct called
-    //  instanceStruct and then make individual references to the
-    //  struct elements.
+    f << "template <int N>\n";
+    f << "class TrackedArray {\n";
+    f << "public:\n";
+    f << "   explicit TrackedArray(Double_t* data) : m_data(data) {}\n";
+    f << "   TrackedLeaf operator[](int i) { return TrackedLeaf(m_data + i); }\n";
+    f << "   Double_t operator[](int i) const { return m_data[i]; }\n";
+    f << "   Double_t* data() { touchedAll = true; return m_data; }\n";
+    f << "   const Double_t* data() const { return m_data; }\n";
+    f << "   int size() const { return N; }\n";
+    f << "private:\n";
+    f << "   Double_t* m_data;\n";
+    f << "};\n\n";
     
-    // Build the struct of instances:
+    f << "template <class T, int N>\n";
+    f << "class TrackedStructArray {\n";
+    f << "public:\n";
+    f << "   explicit TrackedStructArray(T* data) : m_data(data), m_touched() {}\n";
+    f << "   T& operator[](int i) {\n";
+    f << "      if (!m_touched[i]) {\n";
+    f << "         m_touched[i] = true;\n";
+    f << "         m_list.push_back(i);\n";
+    f << "      }\n";
+    f << "      return m_data[i];\n";
+    f << "   }\n";
+    f << "   const T& operator[](int i) const { return m_data[i]; }\n";
+    f << "   T* data() { touchedAll = true; return m_data; }\n";
+    f << "   const T* data() const { return m_data; }\n";
+    f << "   int size() const { return N; }\n";
+    f << "   void Reset(bool all) {\n";
+    f << "      if (all || (m_list.size() > N/SPARSE_RESET_DIVISOR)) {\n";
+    f << "         for (int i = 0; i < N; i++) {\n";
+    f << "            m_data[i].Reset();\n";
+    f << "            m_touched[i] = false;\n";
+    f << "         }\n";
+    f << "      } else {\n";
+    f << "         for (size_t i = 0; i < m_list.size(); i++) {\n";
+    f << "            m_data[m_list[i]].Reset();\n";
+    f << "            m_touched[m_list[i]] = false;\n";
+    f << "         }\n";
+    f << "      }\n";
+    f << "      m_list.clear();\n";
+    f << "   }\n";
+    f << "private:\n";
+    f << "   T*               m_data;\n";
+    f << "   bool             m_touched[N];\n";
+    f << "   std::vector<int> m_list;\n";
+    f << "};\n\n";
+}
+/**
+ * writeInstanceReference
+ *    Write the declaration of the variable through which an instance
+ *    is accessed.  This is normally a reference to the instance's element
+ *    of instanceStruct.  With --sparse-reset, arrays and struct arrays
+ *    are accessed through tracking objects instead.
+ *
+ * @param f - stream to which the code is generated.
+ * @param i - the instance.
+ * @param sparse - true for --sparse-reset.
+ */
+static void
+writeInstanceReference(std::ostream& f, const Instance& i, bool sparse)
+{
+    if (isColumns(i)) {
+        f << columnsType(i.s_typename, i.s_elementCount) << " (&" << i.s_name << ")";
+        return;
+    }
+    if (sparse && (i.s_type == array)) {
+        f << "TrackedArray<" << i.s_elementCount << "> " << i.s_name;
+        return;
+    }
+    if (sparse && (i.s_type == structarray)) {
+        f << "TrackedStructArray<" << i.s_typename << ", " << i.s_elementCount << "> " << i.s_name;
+        return;
+    }
+    if (isSingleBranch(i)) {
+        f << "std::vector<" << i.s_typename << ">& " << i.s_name;
+        return;
+    }
+    std::string fieldType = "Double_t";           // Default to primitive type.
+    unsigned    n         = 1;                    // Default to scalar:
     
-    f << " extern struct { \n";
+    if ((i.s_type == structure) || (i.s_type == structarray)) {
+        fieldType = i.s_typename;
+    }
+    if ((i.s_type == array) || (i.s_type == structarray)) {
+        n = i.s_elementCount;
+    }
+    if (i.s_type == vector) {
+        fieldType = "std::vector<Double_t>";
+    }
+    f << fieldType << " (&" << i.s_name << ")";
+    if (n > 1) {
+        f << "[" << n << "]";
+    }
+}
+/**
+ * writeInstanceMembers
+ *    Write the members of the struct of instances.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ * @param initialize - true to give the members of branches=single struct
+ *                   arrays their size.  The header's extern declaration
+ *                   of the struct leaves that out.
+ */
+static void
+writeInstanceMembers(std::ostream& f, const InstanceList& instances, bool initialize)
+{
     for (auto p =instances.begin(); p != instances.end(); p++) {
         std::string fieldName = p->s_name;
         std::string fieldType = "   Double_t";           // Default to primitive type.
@@ -222,6 +907,19 @@ writeInstanceDefs(std::ostream& f, const std::list<Instance>& instances)
         if (p->s_type == vector) {
             fieldType = "std::vector<Double_t>";
         }
+        if (isColumns(*p)) {
+            fieldType = columnsType(p->s_typename, p->s_elementCount);
+            n = 1;
+        }
+        if (isSingleBranch(*p) && initialize) {     // Fixed size, Root can split it.
+            f << "   std::vector<" << p->s_typename << "> " << fieldName
+              << " = std::vector<" << p->s_typename << ">(" << p->s_elementCount << ");\n";
+            continue;
+        }
+        if (isSingleBranch(*p)) {
+            fieldType = "std::vector<" + p->s_typename + ">";
+            n = 1;
+        }
         
         f << "   " << fieldType << " " << fieldName;
         if (n > 1) {
@@ -230,54 +928,188 @@ writeInstanceDefs(std::ostream& f, const std::list<Instance>& instances)
         
         f << ";\n"; 
     }
-    f << "}  instanceStruct;\n";
+}
+/**
+ * writeContextClass
+ *    For --context, write the EventContext class.  Its members are the
+ *    instances, with the same names, so that unpacking code written for
+ *    the instances works on a context.
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances.
+ */
+static void
+writeContextClass(std::ostream& f, const InstanceList& instances)
+{
+    f << "// An event's worth of instances.  Several can be unpacked at once.\n\n";
+    f << "class EventContext {\n";
+    f << "public:\n";
+    writeInstanceMembers(f, instances, true);
+    f << "};\n\n";
+}
+/**
+ * writeInstanceDefs
+ *    Write definitions of the instances declared by the user;
+ *
+ * @param f - stream to which the code is generated.
+ * @param instances - list of instances to generate.
+ * @param options - generation options:  with --sparse-reset the references
+ *                  track what's set, with --threads each thread has its
+ *                  own instances and with --context the instances are an
+ *                  EventContext.
+ * 
+ */
+static void
+writeInstanceDefs(
+    std::ostream& f, const InstanceList& instances, const GenerateOptions& options
+)
+{
+    bool sparse  = options.s_sparseReset;
+    bool threads = options.s_threads;
+    bool context = options.s_context;
+    if (context) {
+        writeContextClass(f, instances);
+    }
+
+    // C++11 doesn't like a variable to be declared both  extern and defined
+    // in the file so we conditionalize all of this on IMPLEMENTATION_MODULE
+    // not being defined:
+    
+    f << "#ifndef IMPLEMENTATION_MODULE\n\n";
+    
+    //  Note to better support marshalling this struct in and out of
+    //  MPI messages, we put all instances in a struct called
+    //  instanceStruct and then make individual references to the
+    //  struct elements.
+    
+    // Build the struct of instances:
+    
+    if (context) {
+        f << " extern EventContext instanceStruct;       // The one the API without a context uses.\n";
+    } else {
+        f << " extern " << threadLocal(threads) << "struct { \n";
+        writeInstanceMembers(f, instances, false);
+        f << "}  instanceStruct;\n";
+    }
     
     // Now generate external references to the instanceStruct elements.
     // note that a reference to an array is
     //    datatype (&instancName)[array_size];
     
-    for (std::list<Instance>::const_iterator p = instances.begin();
+    for (InstanceList::const_iterator p = instances.begin();
          p != instances.end(); p++) {
 
-        // We should be able to use the strategy used to generate fields here too:
-        // TODO:  factor this out wrt writeClassMembers:
-        f << "extern ";
-        std::string fieldName = p->s_name;
-        std::string fieldType = "Double_t";           // Default to primitive type.
-        unsigned    n         = 1;                    // Default to scalar:
-        
-        if ((p->s_type == structure) || (p->s_type == structarray)) {
-            fieldType = p->s_typename;
-        }
-        if ((p->s_type == array) || (p->s_type == structarray)) {
-            n = p->s_elementCount;
-        }
-        if (p->s_type == vector) {
-            fieldType = "std::vector<Double_t>";
-        }
-        f << "   " << fieldType << " (&" << fieldName << ")";
-        if (n > 1) {
-            f << "[" << n << "]";
-        }
-        
+        f << "extern " << threadLocal(threads);
+        f << "   ";
+        writeInstanceReference(f, *p, sparse);
         f << ";\n";        
     }
     
     f << "\n#endif\n\n";
 }
+/**
+ * writeBatchClass
+ *    For --batch, write the EventBatch class:  a fixed number of
+ *    EventContexts, one for each event of a batch.
+ *
+ * @param f - stream to which the code is written.
+ * @param size - number of events in a batch.
+ */
+static void
+writeBatchClass(std::ostream& f, const std::string& size)
+{
+    f << "\n// A batch of events:  unpack event k into batch[k].  It's big;  make it with new.\n\n";
+    f << "class EventBatch {\n";
+    f << "public:\n";
+    f << "   EventContext& operator[](size_t k) { return m_slots[k]; }\n";
+    f << "   size_t size() const { return " << size << "; }\n";
+    f << "private:\n";
+    f << "   EventContext m_slots[" << size << "];\n";
+    f << "};\n";
+}
 /**
  * writeApiPrototypes
  *    Writes the prototypes for the API functions.
  *
  *  @param f - stream to which the prototypes are written
+ *  @param instances - the instances;  zero suppressed ones add a reader.
+ *  @param options - generation options (--threads, --context, --shm and
+ *                   --rollover-* add to the API).
  */
 static
-void writeApiPrototypes(std::ostream& f)
+void writeApiPrototypes(
+    std::ostream& f, const InstanceList& instances, const GenerateOptions& options
+)
 {
     f <<  "void Initialize();\n";
     f <<  "void SetupEvent();\n";
     f <<  "void CommitEvent();\n";
-    
+    if (options.s_context) {
+        f << "\n// The tree is filled from the context given to Initialize.\n\n";
+        f << "void Initialize(EventContext& context);\n";
+        f << "void SetupEvent(EventContext& context);\n";
+        f << "void CommitEvent(" << (options.s_shm ? "const " : "")
+          << "EventContext& context);   // Calls must be serialized.\n";
+    }
+    if (!options.s_batch.empty()) {
+        writeBatchClass(f, options.s_batch);
+        f << "void SetupBatch(EventBatch& batch);              // Resets every slot.\n";
+        f << "void CommitBatch(EventBatch& batch, size_t n);   // Fills the tree from slots 0 - n-1.\n";
+        f << "                                                 // n > batch.size() throws std::out_of_range.\n";
+    }
+    if (options.s_async) {
+        f << "\n// CommitEvent queues the event; a background thread fills the tree.\n\n";
+        f << "struct AsyncStatistics {\n";
+        f << "   unsigned long long s_commits;          // CommitEvent calls.\n";
+        f << "   unsigned long long s_blockedCommits;   // Ones that waited for a free buffer.\n";
+        f << "   double             s_blockedSeconds;   // Total time they waited.\n";
+        f << "   double             s_maxBlockedSeconds;\n";
+        f << "};\n";
+        f << "void Drain();                         // Wait until the queued events are in the tree.\n";
+        f << "void StopFilling();                   // Drain and stop the thread (Initialize restarts it).\n";
+        f << "AsyncStatistics GetAsyncStatistics();\n";
+    }
+    if (options.s_threads) {
+        f << "\n// Each worker thread fills its own tree into a file of the merger:\n\n";
+        f << "void InitializeMerger(const char* filename);   // Before the workers start.\n";
+        f << "void InitializeThread();                       // In each worker, not Initialize.\n";
+        f << "void FinishThread();                           // In each worker when it's done.\n";
+        f << "void CloseMerger();                            // After the workers are done.\n";
+    }
+    if (hasZeroSuppressed(instances)) {
+        f << "\n// Reading a tree back:  ReadEvent expands the zero suppressed instances.\n\n";
+        f << "void InitializeReader(TTree* tree);    // Points the tree's branches at the instances.\n";
+        f << "Long64_t ReadEvent(Long64_t entry);    // Returns GetEntry's bytes read.\n";
+    }
+    if (hasRollover(options)) {
+        f << "\n// Writing numbered files base-0000.root, base-0001.root... listed in base.manifest:\n\n";
+        f << "void OpenOutput(const char* base);     // Opens the first file and Initializes.\n";
+        if (options.s_context) {
+            f << "void OpenOutput(const char* base, EventContext& context);\n";
+        }
+        f << "void CloseOutput();                    // Closes the last and waits for the rest.\n";
+    }
+    if (options.s_shm) {
+        f << "\n// Publishing each committed event to other processes through shared memory:\n\n";
+        f << "void OpenPublisher(const char* name, unsigned slots = 64);  // Creates /name.\n";
+        f << "void ClosePublisher();                 // Subscribers read what's left, then stop.\n";
+        f << "struct EventRing;\n";
+        f << "class EventSubscriber {                // Reads the published events in place.\n";
+        f << "public:\n";
+        f << "   EventSubscriber(const char* name);  // Throws std::runtime_error if it can't.\n";
+        f << "   ~EventSubscriber();\n";
+        f << "   const EventContext* Next();         // Releases the last event, waits for the next;\n";
+        f << "                                       // null once the publisher is closed.\n";
+        f << "private:\n";
+        f << "   EventSubscriber(const EventSubscriber&);\n";
+        f << "   EventSubscriber& operator=(const EventSubscriber&);\n";
+        f << "   EventRing*         m_pRing;\n";
+        f << "   size_t             m_bytes;         // Mapped.\n";
+        f << "   unsigned           m_subscriber;    // Our place in the ring's subscriber table.\n";
+        f << "   unsigned long long m_next;          // The event Next returns next.\n";
+        f << "   bool               m_holding;       // Next returned m_next and it's not released.\n";
+        f << "};\n";
+    }
 }
 /**
  * generateHeader
@@ -287,15 +1119,18 @@ void writeApiPrototypes(std::ostream& f)
  *  @param nsname - name of the namespace all the decls go into.
  *  @param types  - list of data types.
  *  @param instances - list of top level instances.
+ *  @param options - generation options.
+ *  @return bool - true if the file was written.
  */
-static void
+static bool
 generateHeader(
     const std::string& fname, const std::string& nsname,
-    const std::list<TypeDefinition>& types, const std::list<Instance>& instances
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
 )
 {
     std::string headerName = fname+".h";
-    std::ofstream f(headerName.c_str());
+    OutputFile f(headerName);
     commentHeader(f, headerName, "Defines types, instances and API");
     char cstrName[fname.size() +1];
     strcpy(cstrName, fname.c_str());
@@ -303,59 +1138,134 @@ generateHeader(
     
     f << "#ifndef " << baseFilename << "_h" <<  std::endl;
     f << "#define " << baseFilename << "_h" <<  std::endl;
+    std::set<std::string> columns = columnsTypes(types, instances);
+    
     f << "#include <vector>\n";
-    f << "#include <TObject.h>\n\n";
+    if (options.s_sparseReset || !columns.empty()) {
+        f << "#include <cmath>\n";
+    }
+    if (!options.s_batch.empty() || options.s_shm) {
+        f << "#include <cstddef>\n";
+    }
+    if (options.s_pod) {
+        f << "#include <Rtypes.h>\n\n";
+    } else {
+        f << "#include <TObject.h>\n\n";
+    }
+    if (hasZeroSuppressed(instances)) {
+        f << "class TTree;\n\n";
+    }
 
     
     // All of the file lives in the namespace:
     
     f << "namespace " << nsname << " {\n\n";
     
-    writeStructureDefs(f, types);
-    writeInstanceDefs(f, instances);
-    writeApiPrototypes(f);
+    if (!columns.empty()) {
+        writeColumnsSupport(f, types, columns);
+    }
+    writeStructureDefs(f, types, options.s_pod);
+    if (options.s_sparseReset) {
+        writeTrackingSupport(f, options.s_threads);
+    }
+    writeInstanceDefs(f, instances, options);
+    writeApiPrototypes(f, instances, options);
     
     f << "}\n";
     f << "#endif\n";
-    f.close();
+    return f.close();
 }
 
+/**
+ * addColumnsLinks
+ *    Add a struct of arrays instantiation and those of its members to the
+ *    list of ones that need dictionaries.
+ *
+ * @param links - (in/out) the instantiations, in the order they were found.
+ * @param types - the type list.
+ * @param name  - the struct type.
+ * @param n     - number of elements.
+ */
+static void
+addColumnsLinks(
+    std::vector<std::string>& links, const TypeList& types,
+    const std::string& name, unsigned n
+)
+{
+    std::string link = columnsType(name, n);
+    for (size_t i = 0; i < links.size(); i++) {
+        if (links[i] == link) return;
+    }
+    links.push_back(link);
+    const TypeDefinition& type(findType(types, name));
+    for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
+        if (p->s_type == structure) {
+            addColumnsLinks(links, types, p->s_typename, n);
+        } else if (p->s_type == structarray) {
+            addColumnsLinks(links, types, p->s_typename, n*p->s_elementCount);
+        }
+    }
+}
 /**
  * generateLinkDef
  *    Generate a LinkDef file that specifies link C++ lines for each of our
- *    derived types (classes).
+ *    derived types (classes).  Classes with layout=columns fields also need
+ *    dictionaries for the struct of arrays they contain.  Instances don't
+ *    since their columns are written as leaf lists.  Single branch and zero
+ *    suppressed struct arrays need the std::vector of their type.
  *
  * @param fname - name of the file in which to do this.
  * @param ns    - Namespace name in which we've generated out classes.
  * @param types - Type list that has our class information.
+ * @return bool - true if the file was written.
  */
-static void
+static bool
 generateLinkDef(
     const std::string& fname, const std::string& nsname,
-    const std::list<TypeDefinition>& types
+    const TypeList& types, const InstanceList& instances
 )
 {
-    std::ofstream f(fname.c_str());
+    OutputFile f(fname);
     commentHeader(f, fname, "Linkdef file for dictionaries");
     f << "#ifdef __CINT__\n\n";
     f << "#pragma link off all globals;\n";
     f << "#pragma link off all classes;\n";
     f << "#pragma link off all functions;\n\n";
     
-    for (std::list<TypeDefinition>::const_iterator p = types.begin();
+    for (TypeList::const_iterator p = types.begin();
          p != types.end(); p++) {
         
         f << "#pragma link C++ class " << nsname << "::" << p->s_typename << "+;\n";
     }
+    std::vector<std::string> links;
+    for (TypeList::const_iterator t = types.begin(); t != types.end(); t++) {
+        for (FieldList::const_iterator p = t->s_fields.begin(); p != t->s_fields.end(); p++) {
+            if (isColumns(*p)) {
+                addColumnsLinks(links, types, p->s_typename, p->s_elementCount);
+            }
+        }
+    }
+    for (size_t i = 0; i < links.size(); i++) {
+        f << "#pragma link C++ class " << nsname << "::" << links[i] << "+;\n";
+    }
+    std::set<std::string> vectors;
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        bool inVector =
+            isSingleBranch(*p) || (isZeroSuppressed(*p) && (p->s_type == structarray));
+        if (inVector && vectors.insert(p->s_typename).second) {
+            f << "#pragma link C++ class std::vector<" << nsname << "::"
+              << p->s_typename << ">+;\n";
+        }
+    }
     
     f << "\n#endif\n";
-    f.close();
+    return f.close();
 }
 /**
  * generateResetImplementation
  *     Generates the Reset method of a class.
  *     -  For scaler values just set to NaN
- *     -  for arrays set each element to NaN
+ *     -  for arrays fillNaN the whole array.
  *     -  for structures  call Reset
  *     -  for structure arrays call Reset on each element of the array.
  *
@@ -382,23 +1292,27 @@ generateResetImplementation(
         // Arrays/structarrays need to generate loops.
         
         case array:
-            rhs = " = NAN";
+            f << "   fillNaN(" << p->s_name << ", " << p->s_elementCount << ");\n";
             break;
         case vector:
             f << "   " << p->s_name << ".clear();\n";
             break;
         case structarray:
-            rhs = ".Reset()";
+            if (isColumns(*p)) {
+                f << "   " << p->s_name << ".Reset();\n";
+            } else {
+                rhs = ".Reset()";
+            }
             break;
         default:
             std::cerr << "Unrecognized data type: " << p->s_type << std::endl;
             std::cerr << p->toString() <<std::endl;
             exit(EXIT_FAILURE);
         }
-        // if this is an array we an generate loops in common code using rhs
+        // if this is a struct array we generate a loop using rhs
         // after the common field name [i] crap:
         
-        if ((p->s_type == array) || (p->s_type == structarray)) {
+        if (!rhs.empty()) {
             
             f << "   for (int i = 0; i < " << p->s_elementCount << "; i++) {\n";
             f << "       " << p->s_name << "[i]" << rhs << ";\n";
@@ -407,6 +1321,43 @@ generateResetImplementation(
     }
     f << "}\n\n";
 }
+/**
+ * implementPodClass
+ *    Implements the methods of a --pod class.  Only the constructor and
+ *    Reset are needed.  A class without vectors is nothing but Double_t's
+ *    (ClassDefNV adds no data), so it's checked to be trivially copyable
+ *    (copies are then memcpy's) and Reset fills it with NaN's in one go.
+ *
+ *  @param f - The stream to which the implementation code is written.
+ *  @param nsname - namespace the class is defined in
+ *  @param types  - all of the types.
+ *  @param type   - References the type definition of the class.
+ */
+static void
+implementPodClass(
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    const TypeDefinition& type
+)
+{
+    std::string name = nsname + "::" + type.s_typename;
+    f << "// Implementation of methods for class: " << name << std::endl << std::endl;
+    
+    f << "ClassImp(" << name << ");\n\n";
+    f << name << "::" << type.s_typename << "() {\n";
+    f << "   Reset();\n";
+    f << "}\n\n";
+    
+    if (hasVectors(types, type.s_typename)) {
+        generateResetImplementation(f, nsname, type);
+        return;
+    }
+    f << "static_assert(std::is_trivially_copyable<" << name << ">::value &&\n";
+    f << "              sizeof(" << name << ") % sizeof(Double_t) == 0,\n";
+    f << "              \"" << name << " must be plain Double_t's\");\n\n";
+    f << "void " << name << "::Reset() {\n";
+    f << "   fillNaN(reinterpret_cast<Double_t*>(this), sizeof(*this)/sizeof(Double_t));\n";
+    f << "}\n\n";
+}
 /**
  * implementClass
  *    Implements the method of a class.
@@ -448,7 +1399,8 @@ implementClass(std::ostream& f, const std::string& nsname, const TypeDefinition&
       << nsname << "::" << type.s_typename << "& rhs) {\n";
     
     for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
-        if ((p->s_type == value) || (p->s_type == structure) || (p->s_type == vector)) {    // scalar:
+        if ((p->s_type == value) || (p->s_type == structure) || (p->s_type == vector) ||
+            isColumns(*p)) {                                                        // scalar:
             f << "   " << p->s_name << " = rhs." << p->s_name <<";\n";
         } else {                                                   // array gen forloop.
             f << "   for(int i = 0; i < " << p->s_elementCount << "; i++) { \n";
@@ -470,19 +1422,24 @@ implementClass(std::ostream& f, const std::string& nsname, const TypeDefinition&
  *
  *  @param f       - stream into which the code is generated.
  *  @param nsname  - Name of the namespace the classes were generated in.
- *  @param types   - list of types defined by the user.
+ *  @param types   - all of the types defined by the user.
+ *  @param first, last - range of types to implement.
+ *  @param pod     - true for --pod.
 */
 static void
 generateClassImplementations(
-    std::ostream& f, const std::string& nsname,
-    const std::list<TypeDefinition>& types
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    TypeList::const_iterator first, TypeList::const_iterator last, bool pod
 )
 {
     f << "// Class method implementations: \n\n";
     
-    for(std::list<TypeDefinition>::const_iterator p = types.begin();
-        p != types.end(); p++) {
-        implementClass(f, nsname, *p);
+    for(TypeList::const_iterator p = first; p != last; p++) {
+        if (pod) {
+            implementPodClass(f, nsname, types, *p);
+        } else {
+            implementClass(f, nsname, *p);
+        }
     }
 }
 /**
@@ -493,46 +1450,49 @@ generateClassImplementations(
  * @param f      - stream to which code is written.
  * @param nsname - namespace in which everything is defined.
  * @param instances- instance list.
+ * @param sparse - true for --sparse-reset.
+ * @param threads - true for --threads:  the instances and the references
+ *                  to them are thread_local.
+ * @param context - true for --context:  instanceStruct is an EventContext.
  */
 static void
 generateInstances(
-    std::ostream& f, const std::string& nsname, const std::list<Instance>& instances
+    std::ostream& f, const std::string& nsname, const InstanceList& instances,
+    bool sparse, bool threads, bool context
 )
 {
+    const char* storage = threadLocal(threads);
     f << "//   Instance definitions\n\n";
     f << "namespace " << nsname << " {\n";
     
     // What we write here is a struct of instances named 'instanceStruct'.
     // then we write and initialize references to each element of that struct.
     //
-    f << "struct { \n";
- for (auto p =instances.begin(); p != instances.end(); p++) {
-        std::string fieldName = p->s_name;
-        std::string fieldType = "   Double_t";           // Default to primitive type.
-        unsigned    n         = 1;                    // Default to scalar:
-        
-        if ((p->s_type == structure) || (p->s_type == structarray)) {
-            fieldType = p->s_typename;
-        }
-        if ((p->s_type == array) || (p->s_type == structarray)) {
-            n = p->s_elementCount;
-        }
-        if (p->s_type == vector) {
-            fieldType = "std::vector<Double_t>";
-        }
-        f << "   " << fieldType << " " << fieldName;
-        if (n > 1) {
-            f << "[" << n << "]";
-        }
-        
-        f << ";\n"; 
+    if (context) {
+        f << "EventContext instanceStruct;\n";
+    } else {
+        f << storage << "struct { \n";
+        writeInstanceMembers(f, instances, true);
+        f << "}  instanceStruct;\n";
     }
-    f << "}  instanceStruct;\n";
        
     
-    for (std::list<Instance>::const_iterator p = instances.begin();
+    for (InstanceList::const_iterator p = instances.begin();
          p != instances.end(); p++) {
         
+        f << storage;
+        if (sparse && isSingleBranch(*p)) {
+            writeInstanceReference(f, *p, sparse);
+            f << "(instanceStruct." << p->s_name << ".data());\n";
+            continue;
+        }
+        if (isColumns(*p) || isSingleBranch(*p)
+            || (sparse && ((p->s_type == array) || (p->s_type == structarray)))) {
+            writeInstanceReference(f, *p, sparse);
+            f << "(instanceStruct." << p->s_name << ");\n";
+            continue;
+        }
+        
         // Figure out the actual type to use:
         
         std::string typeName = "Double_t";        // Value and array:
@@ -553,248 +1513,2306 @@ generateInstances(
             << ";\n";
         
     }
+    if (sparse) {
+        f << storage << "std::vector<Double_t*> touchedLeaves;\n";
+        f << storage << "bool touchedAll(false);\n";
+    }
     f << "}\n";
 }
 /**
- * generateClearInstances
- *    Sets the entire tree to NAN:
- *    values - get set to NAN
- *    structure instances get Reset
- *    arrays - iterated over and set to NAN
- *    struct arrays iterated over and Reset.
+ * writeResetPlanClass
+ *    Write the ResetPlan class.  A reset plan is the list of runs of
+ *    Double_t's in the instances and the vectors that must be cleared to
+ *    reset everything.  Runs that are adjacent in memory are merged, so
+ *    the Double_t's between the TObject headers of the instances are each
+ *    set by one fillNaN (with --pod there are no headers so a struct array
+ *    of plain Double_t's is one run).  Runs of the same length at a fixed distance from
+ *    each other (e.g. the same members of each element of a struct array)
+ *    are kept as one run with a stride and repeat count.
  *
- * @param f   - Stream to which code is emitted.
- * @param nsname - namespace  in which all of these are defined.
- * @param instances - list of instances.
+ *    Runs of up to MAX_FIXED_RUN Double_t's are set by an instance of the
+ *    fillRuns template so that their length is a compile time constant.
+ *
+ *    The runs and vectors are kept as byte offsets from the object the plan
+ *    is made for, and run is given the object to reset, so with --context
+ *    one plan resets any context.  With --batch, repeated makes the plan
+ *    for a batch of contexts from the plan for one, so that each run
+ *    becomes a run repeated for every context.
+ *
+ * @param f - stream into which the code is generated.
+ * @param batch - true for --batch.
  */
 static void
-generateClearInstances(
-    std::ostream& f, const std::string& nsname,
-    const std::list<Instance>& instances
-)
+writeResetPlanClass(std::ostream& f, bool batch)
 {
-    for (std::list<Instance>::const_iterator p = instances.begin();
-         p != instances.end(); p++) {
-        
-        std::string suffix = "= NAN";           // For non structs.
-        if ((p->s_type == structure) || (p->s_type == structarray)) {
-            suffix = ".Reset()";
-        }
-        if (p->s_type == vector) {
-            suffix=".clear()";
-        }
-        // If scaler just a single statement otherwise generate a loop:
-        
-        if ((p->s_type == value) || (p->s_type == structure) || (p->s_type == vector)) {
-            f << "   " << nsname << "::" << p->s_name << suffix << ";\n";
-        } else {
-            f << "   " << "for (int i = 0; i < " << p->s_elementCount << "; i++) {\n";
-            f << "      " << nsname << "::" << p->s_name << "[i]" << suffix << ";\n";
-            f << "   }\n";
-        }
+    f << "// Repeated short runs (e.g. in struct arrays) with a length known at\n";
+    f << "// compile time.  The stride is in bytes.\n";
+    f << "template <int N>\n";
+    f << "void fillRuns(char* p, ptrdiff_t stride, size_t repeat) {\n";
+    f << "   const Double_t nan(NAN);\n";
+    f << "   for (size_t n = 0; n < repeat; n++, p += stride) {\n";
+    f << "      NaNStore<N>::at(reinterpret_cast<Double_t*>(p), nan);\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "class ResetPlan {\n";
+    f << "public:\n";
+    f << "   explicit ResetPlan(void* base) : m_base(static_cast<char*>(base)) {\n";
+    f << "      m_pending.s_count = 0;\n";
+    f << "   }\n";
+    f << "   void addDoubles(Double_t* p, size_t n) {\n";
+    f << "      ptrdiff_t offset = reinterpret_cast<char*>(p) - m_base;\n";
+    f << "      if (m_pending.s_count\n";
+    f << "          && (m_pending.s_offset + ptrdiff_t(m_pending.s_count*sizeof(Double_t)) == offset)) {\n";
+    f << "         m_pending.s_count += n;                 // Adjacent.\n";
+    f << "      } else {\n";
+    f << "         finish();\n";
+    f << "         Run run = {offset, n, 0, 1};\n";
+    f << "         m_pending = run;\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   // Add the run being built, as a repeat of the last one if it can be.\n";
+    f << "   void finish() {\n";
+    f << "      if (!m_pending.s_count) return;\n";
+    f << "      if (!m_runs.empty() && (m_runs.back().s_count == m_pending.s_count)) {\n";
+    f << "         Run& last(m_runs.back());\n";
+    f << "         ptrdiff_t stride =\n";
+    f << "            m_pending.s_offset - (last.s_offset + ptrdiff_t(last.s_repeat - 1)*last.s_stride);\n";
+    f << "         if ((last.s_repeat == 1) || (stride == last.s_stride)) {\n";
+    f << "            last.s_stride = stride;\n";
+    f << "            last.s_repeat++;\n";
+    f << "            m_pending.s_count = 0;\n";
+    f << "            return;\n";
+    f << "         }\n";
+    f << "      }\n";
+    f << "      m_runs.push_back(m_pending);\n";
+    f << "      m_pending.s_count = 0;\n";
+    f << "   }\n";
+    f << "   void addVector(std::vector<Double_t>* p) {\n";
+    f << "      m_vectors.push_back(reinterpret_cast<char*>(p) - m_base);\n";
+    f << "   }\n";
+    if (batch) {
+        f << "   // The plan for n of what this plans for, each bytes after the last.\n";
+        f << "   ResetPlan repeated(size_t n, ptrdiff_t bytes) const {\n";
+        f << "      ResetPlan result(m_base);\n";
+        f << "      for (size_t i = 0; i < m_runs.size(); i++) {\n";
+        f << "         const Run& r(m_runs[i]);\n";
+        f << "         if (r.s_repeat == 1) {\n";
+        f << "            Run run = {r.s_offset, r.s_count, bytes, n};\n";
+        f << "            result.m_runs.push_back(run);\n";
+        f << "            continue;\n";
+        f << "         }\n";
+        f << "         for (size_t k = 0; k < n; k++) {\n";
+        f << "            Run run = r;\n";
+        f << "            run.s_offset += ptrdiff_t(k)*bytes;\n";
+        f << "            result.m_runs.push_back(run);\n";
+        f << "         }\n";
+        f << "      }\n";
+        f << "      for (size_t k = 0; k < n; k++) {\n";
+        f << "         for (size_t i = 0; i < m_vectors.size(); i++) {\n";
+        f << "            result.m_vectors.push_back(m_vectors[i] + ptrdiff_t(k)*bytes);\n";
+        f << "         }\n";
+        f << "      }\n";
+        f << "      return result;\n";
+        f << "   }\n";
+    }
+    f << "   // Reset an object laid out like the one the plan was made for.\n";
+    f << "   void run(void* object) const {\n";
+    f << "      char* base = static_cast<char*>(object);\n";
+    f << "      for (size_t i = 0; i < m_runs.size(); i++) {\n";
+    f << "         const Run& r(m_runs[i]);\n";
+    f << "         switch (r.s_count) {\n";
+    for (int n = 1; n <= MAX_FIXED_RUN; n++) {
+        f << "         case " << n << ": fillRuns<" << n
+          << ">(base + r.s_offset, r.s_stride, r.s_repeat); break;\n";
     }
+    f << "         default:\n";
+    f << "            char* p = base + r.s_offset;\n";
+    f << "            for (size_t n = 0; n < r.s_repeat; n++, p += r.s_stride) {\n";
+    f << "               fillNaN(reinterpret_cast<Double_t*>(p), r.s_count);\n";
+    f << "            }\n";
+    f << "         }\n";
+    f << "      }\n";
+    f << "      for (size_t i = 0; i < m_vectors.size(); i++) {\n";
+    f << "         reinterpret_cast<std::vector<Double_t>*>(base + m_vectors[i])->clear();\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "private:\n";
+    f << "   struct Run {\n";
+    f << "      ptrdiff_t  s_offset;                   // Bytes from the base.\n";
+    f << "      size_t     s_count;\n";
+    f << "      ptrdiff_t  s_stride;                   // Bytes between repeats.\n";
+    f << "      size_t     s_repeat;\n";
+    f << "   };\n";
+    f << "   char*                  m_base;             // What the plan is being made for.\n";
+    f << "   Run                    m_pending;\n";
+    f << "   std::vector<Run>       m_runs;\n";
+    f << "   std::vector<ptrdiff_t> m_vectors;          // Offsets of the vectors.\n";
+    f << "};\n";
 }
 /**
- * createBranchStructArray
- *     Creates the branches associated with an array of structs.
- *     We're going to make one branch per array element.  The names of the
- *     branches will be instancename_nnn where nnn is the element number and
- *     has sufficient digits to maintain lexicographic sorting by indes number.
+ * writePlanItem
+ *    Write the code that adds a field or instance to a reset plan.
  *
- * @param f     - stream into which the code is emitted.
- * @param nsname - Name of the namespace containing objects and classes.
- * @param inst   - Instance for which we're making branches.
+ * @param f      - stream into which the code is generated.
+ * @param name   - expression for the item, e.g. o.a or ns::instanceStruct.a
+ * @param item   - the field or instance.
  */
 static void
-createBranchStructArray(
-    std::ostream& f, const std::string& nsname, const Instance& inst
-)
+writePlanItem(std::ostream& f, const std::string& name, const Instance& item)
 {
-    int digits = log10(inst.s_elementCount) + 1;         // # digits in the index.
-    f << "   for (int i = 0; i < " << inst.s_elementCount << "; i++) { \n";
-    f << "       char index[" << digits+2 <<"];\n";
-    f << "       sprintf(index, \"_%0" << digits << "d\", i);\n";  // Create the index part of the name.
-    f << "       std::string branchName = std::string(\"" << inst.s_name << "\") +  index;\n";
-    f << "       " << nsname << "::pTheTree->Branch(branchName.c_str(), \""
-                 << nsname << "::" << inst.s_typename << "\", &"
-                 << nsname << "::instanceStruct." << inst.s_name << "[i]);\n";
-    f << "   }\n";
+    unsigned count = item.s_elementCount;
+    if (isColumns(item)) {
+        f << "   planReset(plan, " << name << ");\n";
+        return;
+    }
+    switch (item.s_type) {
+    case value:
+        f << "   plan.addDoubles(&" << name << ", 1);\n";
+        break;
+    case array:
+        f << "   plan.addDoubles(" << name << ", " << count << ");\n";
+        break;
+    case structure:
+        f << "   planReset(plan, " << name << ");\n";
+        break;
+    case vector:
+        f << "   plan.addVector(&" << name << ");\n";
+        break;
+    case structarray:
+        f << "   for (int i = 0; i < " << count << "; i++) {\n";
+        f << "      planReset(plan, " << name << "[i]);\n";
+        f << "   }\n";
+        break;
+    }
 }
 /**
- * createTree
- *    create the tree and its branches - one per instance
+ * writeColumnsPlan
+ *    Write the planReset template for a struct of arrays.  Value and array
+ *    columns are each one run of doubles.
  *
- * @param f    - Stream into which the code is generated.
- * @param nsname - namespace in which everything was defined.
- * @param instances - list of instance descriptions.
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ * @param type   - the type the columns are of.
  */
 static void
-createTree(
-    std::ostream& f, const std::string& nsname,
-    const std::list<Instance>& instances
-)
+writeColumnsPlan(std::ostream& f, const std::string& nsname, const TypeDefinition& type)
 {
-    // Create the tree:
-    
-    f << "   " << nsname << "::pTheTree = new TTree(\""
-        << nsname << "\", \"" << nsname << "\");\n";
-    
-    // A branch for each instance with the instance as the data pointer.
-    
-    for (std::list<Instance>::const_iterator p = instances.begin();
-         p != instances.end(); p++) {
-        
+    f << "template <int N>\n";
+    f << "void planReset(ResetPlan& plan, " << nsname << "::" << type.s_typename
+      << "_columns<N>& o) {\n";
+    for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
         switch (p->s_type) {
         case value:
-            f << "   " << nsname << "::pTheTree->Branch(\"" << p->s_name << "\", &"
-                << nsname << "::instanceStruct." << p->s_name << ", \""
-                << p->s_name << "/D\");\n";
+            f << "   plan.addDoubles(o." << p->s_name << ", N);\n";
             break;
         case array:
-            f << "   " << nsname << "::pTheTree->Branch(\"" << p->s_name << "\", "
-                << nsname << "::instanceStruct." << p->s_name << ", \""
-                << p->s_name << "[" << p->s_elementCount << "]/D\");\n";
-            break;
-        
-        case structure:
-            f << "   " << nsname << "::pTheTree->Branch(\"" << p->s_name << "\", \""
-              << nsname << "::" << p->s_typename << "\", &"
-              << nsname << "::instanceStruct." << p->s_name << ");\n";
+            f << "   plan.addDoubles(&o." << p->s_name << "[0][0], N*"
+              << p->s_elementCount << ");\n";
             break;
         case vector:
-            f << "    " << nsname << "::pTheTree->Branch(\"" << p->s_name << "\","
-                << "&" << nsname << "::instanceStruct." << p->s_name << ");\n";
+            f << "   for (int i = 0; i < N; i++) plan.addVector(&o." << p->s_name << "[i]);\n";
             break;
-        case structarray:          
-            createBranchStructArray(f, nsname, *p);        // 'Array' of branches of structs.
+        case structure:
+        case structarray:
+            f << "   planReset(plan, o." << p->s_name << ");\n";
             break;
         }
     }
+    f << "}\n";
 }
-
 /**
- * generateAPI
- *    Generates API  implementations for Initialize, SetupEvent and CommitEvent.
+ * generateResetPlan
+ *    Generate the code that builds the reset plan SetupEvent uses.
+ *    There's a planReset function for each class, that adds its members
+ *    to a plan, and planInstances which makes the plan for all of
+ *    the instances.  The classes are defined in an order where each only
+ *    contains ones defined before it, so that's the order of the planReset
+ *    functions too.  The struct of arrays (layout=columns) ones come
+ *    first since classes can contain them.
  *
- *  @param f  - file into which code is being generated.
- *  @param nsname - namespace all this stuff lives in.
- *  @param instances - instance list.
+ *    With --context the elements of branches=single struct arrays aren't in
+ *    the context but in storage of their own, so each of those instances
+ *    gets its own plan made by planElements_name.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ * @param types  - the classes.
+ * @param instances - the instances.
+ * @param context - true for --context.
+ * @param batch - true for --batch.
  */
 static void
-generateAPI(
+generateResetPlan(
     std::ostream& f, const std::string& nsname,
-    const std::list<Instance>& instances
+    const TypeList& types, const InstanceList& instances, bool context, bool batch
 )
 {
-    f << "// Pointer to the tree:\n\n";
+    f << "// How SetupEvent resets the instances.\n\n";
+    f << "namespace {\n";
+    writeResetPlanClass(f, batch);
     
-    f << "namespace " << nsname << " {\n";
-    f << "TTree* " << "pTheTree(0);\n\n";
+    std::set<std::string> columns = columnsTypes(types, instances);
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        if (columns.count(p->s_typename)) {
+            writeColumnsPlan(f, nsname, *p);
+        }
+    }
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        f << "void planReset(ResetPlan& plan, " << nsname << "::" << p->s_typename << "& o) {\n";
+        for (FieldList::const_iterator i = p->s_fields.begin(); i != p->s_fields.end(); i++) {
+            writePlanItem(f, "o." + i->s_name, *i);
+        }
+        f << "}\n";
+    }
+    f << "ResetPlan planInstances() {\n";
+    f << "   ResetPlan plan(&" << nsname << "::instanceStruct);\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (!(context && isSingleBranch(*p))) {
+            writePlanItem(f, nsname + "::instanceStruct." + p->s_name, *p);
+        }
+    }
+    f << "   plan.finish();\n";
+    f << "   return plan;\n";
     f << "}\n";
-    
-    f << "// Setup event - resets the instances\n\n";
-    f << "void " << nsname << "::SetupEvent() {\n";
-    generateClearInstances(f, nsname, instances);
-    f << "}\n\n";
-    
-    f << "// CommitEvent  Fills the tree\n\n";
-    f << "void " << nsname << "::CommitEvent() {\n";
-    f << "   pTheTree->Fill();\n";
-    f << "}\n\n";
-    
-    f << "// Initialize - creates the trees and branches\n\n";
-    f << "void " <<nsname << "::Initialize() {\n";
-    createTree(f, nsname, instances);
+    for (InstanceList::const_iterator p = instances.begin(); context && (p != instances.end()); p++) {
+        if (isSingleBranch(*p)) {
+            f << "ResetPlan planElements_" << p->s_name << "() {\n";
+            f << "   ResetPlan plan(" << nsname << "::instanceStruct." << p->s_name << ".data());\n";
+            writePlanItem(f, nsname + "::instanceStruct." + p->s_name, *p);
+            f << "   plan.finish();\n";
+            f << "   return plan;\n";
+            f << "}\n";
+        }
+    }
     f << "}\n\n";
 }
 /**
- * generateCPP
- *    Generate the C++ file.
- * @param fname - name of the file to be generated.
- * @param headerName -name of the header file.
- * @param nsname - namespace all of the definitions live in.
- * @param types  - Derived type definitions.
- * @param instance - The instance definitions.
+ * generateClearInstances
+ *    Sets the entire tree to NAN and empties the vectors.  The reset
+ *    plan is made the first time through.
+ *
+ * @param f   - Stream to which code is emitted.
+ * @param threads - true for --threads; each thread has its own plan.
+ * @note for --sparse-reset see generateSparseClearInstances.
  */
 static void
-generateCPP(
-    const std::string& fname, const std::string& headerName,
-    const std::string & nsname,
-    const std::list<TypeDefinition>& types, const std::list<Instance>& instances
-)
+generateClearInstances(std::ostream& f, bool threads)
+{
+    f << "   static " << threadLocal(threads) << "ResetPlan plan(planInstances());\n";
+    f << "   plan.run(&instanceStruct);\n";
+}
+/**
+ * generateSparseClearInstances
+ *    The --sparse-reset SetupEvent.  Only the array elements set since
+ *    the last SetupEvent (touchedLeaves) are set to NAN and only
+ *    the struct array elements that were used are Reset.  Where more than
+ *    1/SPARSE_RESET_DIVISOR of the elements were set, it's faster to just
+ *    fillNaN all of the arrays.  That's also done for the first event since
+ *    nothing's been reset yet, and after a raw pointer to an array was
+ *    taken (touchedAll) since writes through it weren't tracked.  Values and structures are set to NAN and Reset,
+ *    and vectors are cleared.  Struct arrays with layout=columns aren't
+ *    tracked; they're Reset in full.
+ *
+ * @param f   - Stream to which code is emitted.
+ * @param nsname - namespace  in which all of these are defined.
+ * @param instances - list of instances.
+ * @param threads - true for --threads.
+ */
+static void
+generateSparseClearInstances(
+    std::ostream& f, const std::string& nsname,
+    const InstanceList& instances, bool threads
+)
+{
+    unsigned leaves = 0;                      // Array elements that can be tracked.
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (p->s_type == array) leaves += p->s_elementCount;
+    }
+    f << "   static " << threadLocal(threads)
+      << "bool resetAll(true);              // Nothing's been reset yet.\n";
+    f << "   if (" << nsname << "::touchedAll) resetAll = true;\n";
+    f << "   if (resetAll || (" << nsname << "::touchedLeaves.size() > "
+      << leaves/SPARSE_RESET_DIVISOR << ")) {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (p->s_type == array) {
+            f << "      fillNaN(" << nsname << "::instanceStruct." << p->s_name << ", "
+              << p->s_elementCount << ");\n";
+        }
+    }
+    f << "   } else {\n";
+    f << "      for (size_t i = 0; i < " << nsname << "::touchedLeaves.size(); i++) {\n";
+    f << "         *" << nsname << "::touchedLeaves[i] = NAN;\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   " << nsname << "::touchedLeaves.clear();\n";
+    f << "   " << nsname << "::touchedAll = false;\n";
+    
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        switch (p->s_type) {
+        case value:
+            f << "   " << nsname << "::" << p->s_name << "= NAN;\n";
+            break;
+        case structure:
+            f << "   " << nsname << "::" << p->s_name << ".Reset();\n";
+            break;
+        case vector:
+            f << "   " << nsname << "::" << p->s_name << ".clear();\n";
+            break;
+        case structarray:
+            f << "   " << nsname << "::" << p->s_name
+              << (isColumns(*p) ? ".Reset();\n" : ".Reset(resetAll);\n");
+            break;
+        default:
+            break;
+        }
+    }
+    f << "   resetAll = false;\n";
+}
+/**
+ * writeIsSet
+ *    Write the isSet overload for a type:  true if anything in one of them
+ *    was set, i.e. a value isn't NaN or a vector isn't empty.  With columns,
+ *    the overload is for its struct of arrays template.
+ *
+ * @param f       - stream into which the code is generated.
+ * @param nsname  - namespace the types are defined in.
+ * @param type    - the type.
+ * @param columns - true for the layout=columns template.
+ */
+static void
+writeIsSet(
+    std::ostream& f, const std::string& nsname, const TypeDefinition& type, bool columns
+)
+{
+    if (columns) {
+        f << "template <int N>\n";
+        f << "inline bool isSet(const " << nsname << "::" << type.s_typename
+          << "_columns<N>& o) {\n";
+    } else {
+        f << "inline bool isSet(const " << nsname << "::" << type.s_typename << "& o) {\n";
+    }
+    const char* each = columns ? "for (int i = 0; i < N; i++) " : "";
+    const char* at   = columns ? "[i]" : "";
+    for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
+        const std::string& name(p->s_name);
+        switch (p->s_type) {
+        case value:
+            f << "   " << each << "if (!std::isnan(o." << name << at << ")) return true;\n";
+            break;
+        case array:
+            f << "   " << each << "for (int j = 0; j < " << p->s_elementCount << "; j++) {\n";
+            f << "      if (!std::isnan(o." << name << at << "[j])) return true;\n";
+            f << "   }\n";
+            break;
+        case vector:
+            f << "   " << each << "if (!o." << name << at << ".empty()) return true;\n";
+            break;
+        case structure:
+            f << "   if (isSet(o." << name << ")) return true;\n";
+            break;
+        case structarray:
+            if (columns || isColumns(*p)) {
+                f << "   if (isSet(o." << name << ")) return true;\n";
+            } else {
+                f << "   for (int j = 0; j < " << p->s_elementCount << "; j++) {\n";
+                f << "      if (isSet(o." << name << "[j])) return true;\n";
+                f << "   }\n";
+            }
+            break;
+        }
+    }
+    f << "   return false;\n";
+    f << "}\n";
+}
+/**
+ * generateZeroSuppression
+ *    Generate what the zero suppressed (storage=sparse) instances need.
+ *    Their branches point into suppressed, which holds each one's count
+ *    of elements that were set, their indices and the elements.
+ *    suppressZeros compacts them into it from the instances the tree is
+ *    filled from:  array elements that aren't NaN and struct array elements
+ *    for which isSet is true.  expandZeros does the reverse for ReadEvent.
+ *
+ * @param f         - stream into which the code is generated.
+ * @param nsname    - namespace everything is defined in.
+ * @param types     - the type list.
+ * @param instances - the instances.
+ * @param threads   - true for --threads;  each thread has its own.
+ */
+static void
+generateZeroSuppression(
+    std::ostream& f, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances, bool threads
+)
+{
+    f << "// Zero suppressed instances (storage=sparse).\n\n";
+    f << "namespace {\n";
+    bool structs = false;
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (isZeroSuppressed(*p) && (p->s_type == structarray)) structs = true;
+    }
+    if (structs) {
+        std::set<std::string> columns = columnsTypes(types, instances);
+        for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+            if (columns.count(p->s_typename)) {
+                writeIsSet(f, nsname, *p, true);
+            }
+            writeIsSet(f, nsname, *p, false);
+        }
+    }
+    f << "struct ZeroSuppressed {\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (isZeroSuppressed(*p)) {
+            f << "   Int_t    " << p->s_name << "_n;\n";
+            f << "   " << indexType(*p) << " " << p->s_name << "_index["
+              << p->s_elementCount << "];\n";
+            if (p->s_type == array) {
+                f << "   Double_t " << p->s_name << "[" << p->s_elementCount << "];\n";
+            } else {
+                f << "   std::vector<" << nsname << "::" << p->s_typename << "> "
+                  << p->s_name << ";\n";
+            }
+        }
+    }
+    f << "};\n";
+    f << threadLocal(threads) << "ZeroSuppressed suppressed;\n";
+    
+    f << "template <class D>\n";
+    f << "void suppressZeros(const D& d) {\n";
+    f << "   ZeroSuppressed& s(suppressed);\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (!isZeroSuppressed(*p)) continue;
+        const std::string& name(p->s_name);
+        if (p->s_type == array) {
+            f << "   s." << name << "_n = 0;\n";
+            f << "   for (int i = 0; i < " << p->s_elementCount << "; i++) {\n";
+            f << "      if (!std::isnan(d." << name << "[i])) {\n";
+            f << "         s." << name << "_index[s." << name << "_n] = i;\n";
+            f << "         s." << name << "[s." << name << "_n++] = d." << name << "[i];\n";
+            f << "      }\n";
+            f << "   }\n";
+        } else {
+            f << "   s." << name << ".clear();\n";
+            f << "   for (int i = 0; i < " << p->s_elementCount << "; i++) {\n";
+            f << "      if (isSet(d." << name << "[i])) {\n";
+            f << "         s." << name << "_index[s." << name << ".size()] = i;\n";
+            f << "         s." << name << ".push_back(d." << name << "[i]);\n";
+            f << "      }\n";
+            f << "   }\n";
+            f << "   s." << name << "_n = s." << name << ".size();\n";
+        }
+    }
+    f << "}\n";
+    
+    f << "template <class D>\n";
+    f << "void expandZeros(D& d) {\n";
+    f << "   const ZeroSuppressed& s(suppressed);\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (!isZeroSuppressed(*p)) continue;
+        const std::string& name(p->s_name);
+        unsigned n = p->s_elementCount;
+        if (p->s_type == array) {
+            f << "   fillNaN(d." << name << ", " << n << ");\n";
+            f << "   for (Int_t i = 0; i < s." << name << "_n; i++) {\n";
+            f << "      if (s." << name << "_index[i] < " << n << ") d." << name
+              << "[s." << name << "_index[i]] = s." << name << "[i];\n";
+            f << "   }\n";
+        } else {
+            f << "   for (int i = 0; i < " << n << "; i++) d." << name << "[i].Reset();\n";
+            f << "   for (size_t i = 0; i < s." << name << ".size(); i++) {\n";
+            f << "      if (s." << name << "_index[i] < " << n << ") d." << name
+              << "[s." << name << "_index[i]] = s." << name << "[i];\n";
+            f << "   }\n";
+        }
+    }
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * BranchSettings
+ *    How an instance's branches are made:  the tree wide TTree tuning
+ *    options with the instance's attributes overriding them.  Empty strings
+ *    are Root's defaults.
+ */
+struct BranchSettings {
+    std::string s_basketSize;         // Bytes or auto.
+    std::string s_compression;        // zlib, lzma, lz4 or zstd.
+    std::string s_compressionLevel;
+    std::string s_splitLevel;
+    long long   s_clusterEntries;     // Entries per cluster (for auto).
+};
+static long long fieldBytes(const TypeList& types, const Instance& i);
+
+/**
+ * typeBytes
+ *   @param types - the type list.
+ *   @param name  - a struct type.
+ *   @return long long - bytes of data in one of them.
+ */
+static long long
+typeBytes(const TypeList& types, const std::string& name)
+{
+    const TypeDefinition& type(findType(types, name));
+    long long result = 0;
+    for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
+        result += fieldBytes(types, *p);
+    }
+    return result;
+}
+/**
+ * fieldBytes
+ *   @param types - the type list.
+ *   @param i     - a field or instance.
+ *   @return long long - bytes of data it holds per event.  Vectors are
+ *                       guessed at VECTOR_GUESS elements.
+ */
+static long long
+fieldBytes(const TypeList& types, const Instance& i)
+{
+    switch (i.s_type) {
+    case value:
+        return sizeof(double);
+    case array:
+        return sizeof(double) * i.s_elementCount;
+    case vector:
+        return sizeof(double) * VECTOR_GUESS;
+    case structure:
+        return typeBytes(types, i.s_typename);
+    case structarray:
+        return typeBytes(types, i.s_typename) * i.s_elementCount;
+    }
+    return 0;
+}
+/**
+ * objectLeafBytes
+ *    Bytes per event of the largest branch Root makes for an object.  When
+ *    split, each member is its own branch (struct members are split too,
+ *    struct array members aren't), otherwise the object is one branch.
+ *
+ * @param types - the type list.
+ * @param name  - the object's type.
+ * @param s     - the branch settings.
+ * @return long long
+ */
+static long long
+objectLeafBytes(const TypeList& types, const std::string& name, const BranchSettings& s)
+{
+    if (s.s_splitLevel == "0") {
+        return typeBytes(types, name);
+    }
+    const TypeDefinition& type(findType(types, name));
+    long long result = 0;
+    for (FieldList::const_iterator p = type.s_fields.begin(); p != type.s_fields.end(); p++) {
+        long long bytes = (p->s_type == structure) ?
+            objectLeafBytes(types, p->s_typename, s) : fieldBytes(types, *p);
+        if (bytes > result) result = bytes;
+    }
+    return result;
+}
+/**
+ * clusterEntries
+ *    Figure out how many entries there are between auto-flushes.  That's
+ *    the auto-flush setting if it's a number of entries.  Otherwise it's
+ *    how many events fit in the auto-flush number of bytes (Root's default
+ *    if there's no setting).
+ *
+ * @param types     - the type list.
+ * @param instances - the instances.
+ * @param options   - generation options.
+ * @return long long
+ */
+static long long
+clusterEntries(
+    const TypeList& types, const InstanceList& instances, const GenerateOptions& options
+)
+{
+    long long flush = atoll(options.s_autoFlush.c_str());
+    if (flush > 0) {
+        return flush;
+    }
+    long long eventBytes = 0;
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        eventBytes += fieldBytes(types, *p);
+    }
+    long long result = (flush < 0 ? -flush : CLUSTER_BYTES) / (eventBytes ? eventBytes : 1);
+    return result > 0 ? result : 1;
+}
+/**
+ * branchSettings
+ *
+ * @param i        - the instance.
+ * @param options  - generation options.
+ * @param clusterEntries - entries per cluster (see clusterEntries).
+ * @return BranchSettings - how to make the instance's branches.
+ */
+static BranchSettings
+branchSettings(const Instance& i, const GenerateOptions& options, long long clusterEntries)
+{
+    BranchSettings result;
+    result.s_basketSize       = i.s_options.attribute("basketsize", options.s_basketSize);
+    result.s_compression      = i.s_options.attribute("compression", options.s_compression);
+    result.s_compressionLevel =
+        i.s_options.attribute("compressionlevel", options.s_compressionLevel);
+    result.s_splitLevel       = i.s_options.attribute("splitlevel", options.s_splitLevel);
+    result.s_clusterEntries   = clusterEntries;
+    return result;
+}
+/**
+ * bufferArgs
+ *    The trailing arguments of a Branch call that give the basket size
+ *    and, for a branch holding objects, the split level.  Automatic basket
+ *    sizes hold a cluster's worth of the branch's data within
+ *    [MIN_BASKET, MAX_BASKET].
+ *
+ * @param s         - the branch settings.
+ * @param leafBytes - bytes per event in the branch's largest (sub)branch.
+ * @param object    - true if the branch holds objects.
+ * @return std::string - e.g. ", 64000, 1" or empty if Root's defaults do.
+ */
+static std::string
+bufferArgs(const BranchSettings& s, long long leafBytes, bool object)
+{
+    long long basket = atoll(s.s_basketSize.c_str());
+    if (s.s_basketSize == "auto") {
+        basket = leafBytes * s.s_clusterEntries;
+        if (basket < MIN_BASKET) basket = MIN_BASKET;
+        if (basket > MAX_BASKET) basket = MAX_BASKET;
+    }
+    bool split = object && !s.s_splitLevel.empty();
+    if (!basket && !split) {
+        return "";
+    }
+    std::ostringstream result;
+    result << ", " << (basket ? basket : 32000);
+    if (split) {
+        result << ", " << s.s_splitLevel;
+    }
+    return result.str();
+}
+/**
+ * compresses
+ *   @param s - branch settings.
+ *   @return bool - true if the branches set their own compression.
+ */
+static bool
+compresses(const BranchSettings& s)
+{
+    return !s.s_compression.empty() || !s.s_compressionLevel.empty();
+}
+/**
+ * writeBranch
+ *    Write a Branch call and, if the settings ask for it, set the new
+ *    branch's compression (that's inherited by its sub-branches).
+ *
+ * @param f      - stream into which the code is emitted.
+ * @param indent - indentation.
+ * @param call   - the call, e.g. ns::pTheTree->Branch("a", &a, "a/D")
+ * @param s      - branch settings.
+ */
+static void
+writeBranch(
+    std::ostream& f, const std::string& indent, const std::string& call,
+    const BranchSettings& s
+)
+{
+    if (!compresses(s)) {
+        f << indent << call << ";\n";
+        return;
+    }
+    f << indent << "pBranch = " << call << ";\n";
+    if (!s.s_compression.empty()) {
+        int algorithm = 1;                                 // ROOT::kZLIB
+        if (s.s_compression == "lzma") algorithm = 2;
+        if (s.s_compression == "lz4")  algorithm = 4;
+        if (s.s_compression == "zstd") algorithm = 5;
+        f << indent << "pBranch->SetCompressionAlgorithm(" << algorithm << ");    // "
+          << s.s_compression << "\n";
+    }
+    if (!s.s_compressionLevel.empty()) {
+        f << indent << "pBranch->SetCompressionLevel(" << s.s_compressionLevel << ");\n";
+    }
+}
+/**
+ * createBranchStructArray
+ *     Creates the branches associated with an array of structs.
+ *     We're going to make one branch per array element.  The names of the
+ *     branches will be instancename_nnn where nnn is the element number and
+ *     has sufficient digits to maintain lexicographic sorting by indes number.
+ *
+ * @param f     - stream into which the code is emitted.
+ * @param nsname - Name of the namespace containing objects and classes.
+ * @param types  - the type list.
+ * @param data   - expression for the instances (e.g. ns::instanceStruct).
+ * @param inst   - Instance for which we're making branches.
+ * @param s      - branch settings.
+ */
+static void
+createBranchStructArray(
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    const std::string& data, const Instance& inst, const BranchSettings& s
+)
+{
+    int digits = log10(inst.s_elementCount) + 1;         // # digits in the index.
+    f << "   for (int i = 0; i < " << inst.s_elementCount << "; i++) { \n";
+    f << "       char index[" << digits+2 <<"];\n";
+    f << "       sprintf(index, \"_%0" << digits << "d\", i);\n";  // Create the index part of the name.
+    f << "       std::string branchName = std::string(\"" << inst.s_name << "\") +  index;\n";
+    std::ostringstream call;
+    call << nsname << "::pTheTree->Branch(branchName.c_str(), \""
+         << nsname << "::" << inst.s_typename << "\", &"
+         << data << "." << inst.s_name << "[i]"
+         << bufferArgs(s, objectLeafBytes(types, inst.s_typename, s), true) << ")";
+    writeBranch(f, "       ", call.str(), s);
+    f << "   }\n";
+}
+/**
+ * createColumnBranches
+ *     Creates the branches for a layout=columns struct array.  Each value
+ *     and array column is a branch with a leaf list giving its dimensions,
+ *     e.g. aux.e with e[5]/D.  Vector columns get a branch per element,
+ *     named like the branches of ordinary struct arrays.  Struct columns
+ *     recurse with their name appended to the branch name and, for struct
+ *     arrays, their size appended to the dimensions.
+ *
+ * @param f      - stream into which the code is emitted.
+ * @param nsname - Name of the namespace containing objects and classes.
+ * @param types  - the type list.
+ * @param type   - name of the type the columns are of.
+ * @param name   - branch name prefix (e.g. aux or aux.s).
+ * @param expr   - expression for the columns (e.g. ns::instanceStruct.aux).
+ * @param dims   - dimensions of each column, e.g. [5] or [5][3].
+ * @param n      - product of the dimensions.
+ * @param s      - branch settings.
+ */
+static void
+createColumnBranches(
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    const std::string& type, const std::string& name, const std::string& expr,
+    const std::string& dims, unsigned n, const BranchSettings& s
+)
+{
+    const TypeDefinition& t(findType(types, type));
+    for (FieldList::const_iterator p = t.s_fields.begin(); p != t.s_fields.end(); p++) {
+        std::string branch = name + "." + p->s_name;
+        std::string column = expr + "." + p->s_name;
+        std::ostringstream count;
+        count << "[" << p->s_elementCount << "]";
+        std::ostringstream call;
+        switch (p->s_type) {
+        case value:
+            call << nsname << "::pTheTree->Branch(\"" << branch << "\", "
+                 << column << ", \"" << p->s_name << dims << leafType(*p) << "\""
+                 << bufferArgs(s, sizeof(double)*n, false) << ")";
+            writeBranch(f, "   ", call.str(), s);
+            break;
+        case array:
+            call << nsname << "::pTheTree->Branch(\"" << branch << "\", "
+                 << column << ", \"" << p->s_name << dims << count.str()
+                 << leafType(*p) << "\""
+                 << bufferArgs(s, sizeof(double)*n*p->s_elementCount, false) << ")";
+            writeBranch(f, "   ", call.str(), s);
+            break;
+        case vector:
+            {
+                int digits = log10(n) + 1;
+                f << "   for (int i = 0; i < " << n << "; i++) {\n";
+                f << "       char index[" << digits+2 << "];\n";
+                f << "       sprintf(index, \"_%0" << digits << "d\", i);\n";
+                f << "       std::string branchName = std::string(\"" << branch << "\") + index;\n";
+                call << nsname << "::pTheTree->Branch(branchName.c_str(), &"
+                     << column << "[i]" << bufferArgs(s, sizeof(double)*VECTOR_GUESS, false)
+                     << ")";
+                writeBranch(f, "       ", call.str(), s);
+                f << "   }\n";
+            }
+            break;
+        case structure:
+            createColumnBranches(
+                f, nsname, types, p->s_typename, branch, column, dims, n, s
+            );
+            break;
+        case structarray:
+            createColumnBranches(
+                f, nsname, types, p->s_typename, branch, column,
+                dims + count.str(), n * p->s_elementCount, s
+            );
+            break;
+        }
+    }
+}
+/**
+ * createZeroSuppressedBranches
+ *    Creates the branches of a zero suppressed instance x.  They point at
+ *    the compacted copy of it that suppressZeros makes before each Fill:
+ *    x_n, the number of elements that were set, x_index, their indices, and
+ *    x, the elements.  Array elements are a leaf list of x_n Double_t's,
+ *    struct array elements a std::vector that Root splits.
+ *
+ * @param f      - stream into which the code is emitted.
+ * @param nsname - Name of the namespace containing objects and classes.
+ * @param types  - the type list.
+ * @param inst   - the instance.
+ * @param s      - branch settings.
+ */
+static void
+createZeroSuppressedBranches(
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    const Instance& inst, const BranchSettings& s
+)
+{
+    const std::string& name(inst.s_name);
+    int indexBytes = inst.s_elementCount < 65536 ? 2 : 4;
+    std::ostringstream count;
+    count << nsname << "::pTheTree->Branch(\"" << name << "_n\", &suppressed." << name
+          << "_n, \"" << name << "_n/I\"" << bufferArgs(s, sizeof(int), false) << ")";
+    writeBranch(f, "   ", count.str(), s);
+    std::ostringstream index;
+    index << nsname << "::pTheTree->Branch(\"" << name << "_index\", suppressed." << name
+          << "_index, \"" << name << "_index[" << name << "_n]" << indexLeafType(inst) << "\""
+          << bufferArgs(s, indexBytes * inst.s_elementCount, false) << ")";
+    writeBranch(f, "   ", index.str(), s);
+    std::ostringstream call;
+    if (inst.s_type == array) {
+        call << nsname << "::pTheTree->Branch(\"" << name << "\", suppressed." << name
+             << ", \"" << name << "[" << name << "_n]" << leafType(inst) << "\""
+             << bufferArgs(s, fieldBytes(types, inst), false) << ")";
+    } else {
+        std::string args = bufferArgs(
+            s, objectLeafBytes(types, inst.s_typename, s) * inst.s_elementCount, true
+        );
+        call << nsname << "::pTheTree->Branch(\"" << name << "\", &suppressed." << name
+             << (args.empty() ? ", 32000, 99" : args) << ")";
+    }
+    writeBranch(f, "   ", call.str(), s);
+}
+/**
+ * createTree
+ *    create the tree and its branches - one per instance.  Struct arrays
+ *    get a branch per element, a branch per column (layout=columns) or
+ *    a single branch that Root splits into a sub-branch per member
+ *    (branches=single).  Zero suppressed arrays and struct arrays get
+ *    a count, an index and a data branch.  The TTree tuning options and
+ *    attributes set the tree's auto-flush and auto-save and each branch's
+ *    basket size, split level and compression.
+ *
+ * @param f    - Stream into which the code is generated.
+ * @param nsname - namespace in which everything was defined.
+ * @param types  - the type list.
+ * @param instances - list of instance descriptions.
+ * @param data    - expression for the instances the branches get their
+ *                  data from (e.g. ns::instanceStruct).
+ * @param options - generation options.
+ */
+static void
+createTree(
+    std::ostream& f, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const std::string& data, const GenerateOptions& options
+)
+{
+    // Create the tree:
+    
+    f << "   " << nsname << "::pTheTree = new TTree(\""
+        << nsname << "\", \"" << nsname << "\");\n";
+    if (!options.s_autoFlush.empty()) {
+        f << "   " << nsname << "::pTheTree->SetAutoFlush(" << options.s_autoFlush << ");\n";
+    }
+    if (!options.s_autoSave.empty()) {
+        f << "   " << nsname << "::pTheTree->SetAutoSave(" << options.s_autoSave << ");\n";
+    }
+    long long entries = clusterEntries(types, instances, options);
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (compresses(branchSettings(*p, options, entries))) {
+            f << "   TBranch* pBranch;\n";
+            break;
+        }
+    }
+    
+    // A branch for each instance with the instance as the data pointer.
+    
+    for (InstanceList::const_iterator p = instances.begin();
+         p != instances.end(); p++) {
+        
+        BranchSettings s = branchSettings(*p, options, entries);
+        if (isZeroSuppressed(*p)) {
+            createZeroSuppressedBranches(f, nsname, types, *p, s);
+            continue;
+        }
+        std::ostringstream call;
+        switch (p->s_type) {
+        case value:
+            call << nsname << "::pTheTree->Branch(\"" << p->s_name << "\", &"
+                << data << "." << p->s_name << ", \""
+                << p->s_name << leafType(*p) << "\""
+                << bufferArgs(s, fieldBytes(types, *p), false) << ")";
+            writeBranch(f, "   ", call.str(), s);
+            break;
+        case array:
+            call << nsname << "::pTheTree->Branch(\"" << p->s_name << "\", "
+                << data << "." << p->s_name << ", \""
+                << p->s_name << "[" << p->s_elementCount << "]" << leafType(*p) << "\""
+                << bufferArgs(s, fieldBytes(types, *p), false) << ")";
+            writeBranch(f, "   ", call.str(), s);
+            break;
+        
+        case structure:
+            call << nsname << "::pTheTree->Branch(\"" << p->s_name << "\", \""
+              << nsname << "::" << p->s_typename << "\", &"
+              << data << "." << p->s_name
+              << bufferArgs(s, objectLeafBytes(types, p->s_typename, s), true) << ")";
+            writeBranch(f, "   ", call.str(), s);
+            break;
+        case vector:
+            call << nsname << "::pTheTree->Branch(\"" << p->s_name << "\","
+                << "&" << data << "." << p->s_name
+                << bufferArgs(s, fieldBytes(types, *p), false) << ")";
+            writeBranch(f, "    ", call.str(), s);
+            break;
+        case structarray:          
+            if (isSingleBranch(*p)) {
+                std::string args = bufferArgs(
+                    s, objectLeafBytes(types, p->s_typename, s) * p->s_elementCount, true
+                );
+                call << nsname << "::pTheTree->Branch(\"" << p->s_name << "\", &"
+                  << data << "." << p->s_name
+                  << (args.empty() ? ", 32000, 99" : args) << ")";
+                writeBranch(f, "   ", call.str(), s);
+            } else if (isColumns(*p)) {
+                std::ostringstream dims;
+                dims << "[" << p->s_elementCount << "]";
+                createColumnBranches(
+                    f, nsname, types, p->s_typename, p->s_name,
+                    data + "." + p->s_name,
+                    dims.str(), p->s_elementCount, s
+                );
+            } else {
+                createBranchStructArray(f, nsname, types, data, *p, s);  // 'Array' of branches of structs.
+            }
+            break;
+        }
+    }
+}
+/**
+ * bindColumnBranches
+ *    For the reader, point the branches createColumnBranches makes at
+ *    the columns.
+ *
+ * @param f      - stream into which the code is emitted.
+ * @param types  - the type list.
+ * @param type   - name of the type the columns are of.
+ * @param name   - branch name prefix (e.g. aux or aux.s).
+ * @param expr   - expression for the columns (e.g. ns::instanceStruct.aux).
+ * @param n      - number of elements of each column.
+ */
+static void
+bindColumnBranches(
+    std::ostream& f, const TypeList& types, const std::string& type,
+    const std::string& name, const std::string& expr, unsigned n
+)
+{
+    const TypeDefinition& t(findType(types, type));
+    for (FieldList::const_iterator p = t.s_fields.begin(); p != t.s_fields.end(); p++) {
+        std::string branch = name + "." + p->s_name;
+        std::string column = expr + "." + p->s_name;
+        switch (p->s_type) {
+        case value:
+        case array:
+            f << "   tree->SetBranchAddress(\"" << branch << "\", (void*)" << column << ");\n";
+            break;
+        case vector:
+            {
+                int digits = log10(n) + 1;
+                f << "   for (int i = 0; i < " << n << "; i++) {\n";
+                f << "       char index[" << digits+2 << "];\n";
+                f << "       sprintf(index, \"_%0" << digits << "d\", i);\n";
+                f << "       std::string branchName = std::string(\"" << branch << "\") + index;\n";
+                f << "       bindObject(tree, branchName.c_str(), &" << column << "[i]);\n";
+                f << "   }\n";
+            }
+            break;
+        case structure:
+            bindColumnBranches(f, types, p->s_typename, branch, column, n);
+            break;
+        case structarray:
+            bindColumnBranches(f, types, p->s_typename, branch, column, n * p->s_elementCount);
+            break;
+        }
+    }
+}
+/**
+ * bindBranches
+ *    For the reader, point the branches createTree makes at the
+ *    instances, or for zero suppressed ones, at suppressed.  Leaf list
+ *    branches are given the data's address, object branches the address
+ *    of a pointer to it (see bindObject).
+ *
+ * @param f         - stream into which the code is generated.
+ * @param nsname    - namespace in which everything was defined.
+ * @param types     - the type list.
+ * @param instances - list of instance descriptions.
+ */
+static void
+bindBranches(
+    std::ostream& f, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances
+)
+{
+    std::string data = nsname + "::instanceStruct";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        const std::string& name(p->s_name);
+        if (isZeroSuppressed(*p)) {
+            f << "   tree->SetBranchAddress(\"" << name << "_n\", (void*)&suppressed."
+              << name << "_n);\n";
+            f << "   tree->SetBranchAddress(\"" << name << "_index\", (void*)suppressed."
+              << name << "_index);\n";
+            if (p->s_type == array) {
+                f << "   tree->SetBranchAddress(\"" << name << "\", (void*)suppressed."
+                  << name << ");\n";
+            } else {
+                f << "   bindObject(tree, \"" << name << "\", &suppressed." << name << ");\n";
+            }
+            continue;
+        }
+        switch (p->s_type) {
+        case value:
+            f << "   tree->SetBranchAddress(\"" << name << "\", (void*)&" << data << "."
+              << name << ");\n";
+            break;
+        case array:
+            f << "   tree->SetBranchAddress(\"" << name << "\", (void*)" << data << "."
+              << name << ");\n";
+            break;
+        case structure:
+        case vector:
+            f << "   bindObject(tree, \"" << name << "\", &" << data << "." << name << ");\n";
+            break;
+        case structarray:
+            if (isSingleBranch(*p)) {
+                f << "   bindObject(tree, \"" << name << "\", &" << data << "." << name << ");\n";
+            } else if (isColumns(*p)) {
+                bindColumnBranches(
+                    f, types, p->s_typename, name, data + "." + name, p->s_elementCount
+                );
+            } else {
+                int digits = log10(p->s_elementCount) + 1;
+                f << "   for (int i = 0; i < " << p->s_elementCount << "; i++) { \n";
+                f << "       char index[" << digits+2 <<"];\n";
+                f << "       sprintf(index, \"_%0" << digits << "d\", i);\n";
+                f << "       std::string branchName = std::string(\"" << name << "\") +  index;\n";
+                f << "       bindObject(tree, branchName.c_str(), &" << data << "." << name
+                  << "[i]);\n";
+                f << "   }\n";
+            }
+            break;
+        }
+    }
+}
+/**
+ * generateReaderAPI
+ *    Generate InitializeReader and ReadEvent for trees with zero suppressed
+ *    instances.  InitializeReader points a tree's branches at instanceStruct
+ *    and suppressed.  ReadEvent reads an entry and expands the zero
+ *    suppressed instances into instanceStruct, so the instances look as
+ *    they did when CommitEvent was called.  Object branches need the
+ *    address of a pointer to the object;  the pointers are kept in
+ *    readerObjects, a deque so they don't move.
+ *
+ * @param f         - stream into which the code is generated.
+ * @param nsname    - namespace in which everything was defined.
+ * @param types     - the type list.
+ * @param instances - list of instance descriptions.
+ * @param threads   - true for --threads;  each thread has its own reader.
+ */
+static void
+generateReaderAPI(
+    std::ostream& f, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances, bool threads
+)
+{
+    f << "// Reading the tree back\n\n";
+    f << "namespace {\n";
+    f << threadLocal(threads) << "TTree* pReaderTree(0);\n";
+    f << threadLocal(threads) << "std::deque<void*> readerObjects;\n";
+    f << "void bindObject(TTree* tree, const char* name, void* object) {\n";
+    f << "   readerObjects.push_back(object);\n";
+    f << "   tree->SetBranchAddress(name, (void*)&readerObjects.back());\n";
+    f << "}\n";
+    f << "}\n";
+    f << "void " << nsname << "::InitializeReader(TTree* tree) {\n";
+    f << "   pReaderTree = tree;\n";
+    f << "   readerObjects.clear();\n";
+    bindBranches(f, nsname, types, instances);
+    f << "}\n";
+    f << "Long64_t " << nsname << "::ReadEvent(Long64_t entry) {\n";
+    f << "   Long64_t result = pReaderTree->GetEntry(entry);\n";
+    f << "   expandZeros(instanceStruct);\n";
+    f << "   return result;\n";
+    f << "}\n\n";
+}
+/**
+ * writeFill
+ *    Write a Fill of the tree.  If there are zero suppressed instances
+ *    they're compacted first from the instances the tree is filled from.
+ *
+ * @param f       - stream into which the code is generated.
+ * @param indent  - indentation.
+ * @param tree    - expression for the tree.
+ * @param data    - expression for the instances the tree is filled from.
+ * @param suppress - true if there are zero suppressed instances.
+ * @param rollover - true if the output rolls over to new files;  the
+ *                 segments are told about each entry before it's filled.
+ */
+static void
+writeFill(
+    std::ostream& f, const std::string& indent, const std::string& tree,
+    const std::string& data, bool suppress, bool rollover
+)
+{
+    if (suppress) {
+        f << indent << "suppressZeros(" << data << ");\n";
+    }
+    if (rollover) {
+        f << indent << "pSegments->filling();\n";
+    }
+    f << indent << tree << "->Fill();\n";
+}
+/**
+ * writeAsyncFiller
+ *    Write the --async machinery.  The tree's branches point at fillBuffer.
+ *    CommitEvent copies the instances into a free snapshot buffer and
+ *    queues it;  when there's no free buffer it waits (and the wait is
+ *    timed), which limits how far the filling thread can fall behind.
+ *    The filling thread copies each queued buffer into fillBuffer, fills
+ *    the tree and frees the buffer.  The buffers are allocated once, so
+ *    the copies reuse the vectors' storage.  An exception from filling is
+ *    kept and rethrown by drain().  Deleting the filler fills what's still
+ *    queued, then stops and joins the thread.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ * @param suppress - true if there are zero suppressed instances.
+ * @param rollover - true if the output rolls over to new files.
+ */
+static void
+writeAsyncFiller(std::ostream& f, const std::string& nsname, bool suppress, bool rollover)
+{
+    f << "// Filling the tree in the background (--async).\n\n";
+    f << "namespace {\n";
+    f << "typedef decltype(" << nsname << "::instanceStruct) Instances;\n";
+    f << "Instances fillBuffer;                        // What the branches point at.\n";
+    f << "class AsyncFiller {\n";
+    f << "public:\n";
+    f << "   AsyncFiller(size_t depth) : m_buffers(depth), m_busy(false), m_stopping(false) {\n";
+    f << "      for (size_t i = 0; i < depth; i++) m_free.push_back(&m_buffers[i]);\n";
+    f << "      m_statistics.s_commits = m_statistics.s_blockedCommits = 0;\n";
+    f << "      m_statistics.s_blockedSeconds = m_statistics.s_maxBlockedSeconds = 0;\n";
+    f << "      m_thread = std::thread(&AsyncFiller::fill, this);\n";
+    f << "   }\n";
+    f << "   ~AsyncFiller() {                        // Fills what's queued, then stops.\n";
+    f << "      {\n";
+    f << "         std::lock_guard<std::mutex> lock(m_mutex);\n";
+    f << "         m_stopping = true;\n";
+    f << "      }\n";
+    f << "      m_ready.notify_one();\n";
+    f << "      m_thread.join();\n";
+    f << "   }\n";
+    f << "   void commit(const Instances& event) {\n";
+    f << "      std::unique_lock<std::mutex> lock(m_mutex);\n";
+    f << "      if (m_free.empty()) {\n";
+    f << "         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();\n";
+    f << "         while (m_free.empty()) m_freed.wait(lock);\n";
+    f << "         double blocked = std::chrono::duration<double>(\n";
+    f << "            std::chrono::steady_clock::now() - start\n";
+    f << "         ).count();\n";
+    f << "         m_statistics.s_blockedCommits++;\n";
+    f << "         m_statistics.s_blockedSeconds += blocked;\n";
+    f << "         if (blocked > m_statistics.s_maxBlockedSeconds) {\n";
+    f << "            m_statistics.s_maxBlockedSeconds = blocked;\n";
+    f << "         }\n";
+    f << "      }\n";
+    f << "      Instances* buffer = m_free.back();\n";
+    f << "      m_free.pop_back();\n";
+    f << "      m_statistics.s_commits++;\n";
+    f << "      lock.unlock();\n";
+    f << "      *buffer = event;\n";
+    f << "      lock.lock();\n";
+    f << "      m_queued.push_back(buffer);\n";
+    f << "      m_ready.notify_one();\n";
+    f << "   }\n";
+    f << "   void drain() {\n";
+    f << "      std::unique_lock<std::mutex> lock(m_mutex);\n";
+    f << "      while (m_busy || !m_queued.empty()) m_freed.wait(lock);\n";
+    f << "      if (m_error) {                       // Filling threw.\n";
+    f << "         std::exception_ptr error = m_error;\n";
+    f << "         m_error = nullptr;\n";
+    f << "         std::rethrow_exception(error);\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   " << nsname << "::AsyncStatistics statistics() {\n";
+    f << "      std::lock_guard<std::mutex> lock(m_mutex);\n";
+    f << "      return m_statistics;\n";
+    f << "   }\n";
+    f << "private:\n";
+    f << "   void fill() {\n";
+    f << "      std::unique_lock<std::mutex> lock(m_mutex);\n";
+    f << "      for (;;) {\n";
+    f << "         while (m_queued.empty() && !m_stopping) m_ready.wait(lock);\n";
+    f << "         if (m_queued.empty()) return;    // Stopping.\n";
+    f << "         Instances* buffer = m_queued.front();\n";
+    f << "         m_queued.pop_front();\n";
+    f << "         m_busy = true;\n";
+    f << "         lock.unlock();\n";
+    f << "         std::exception_ptr error;\n";
+    f << "         try {\n";
+    f << "            fillBuffer = *buffer;\n";
+    writeFill(f, "            ", nsname + "::pTheTree", "fillBuffer", suppress, rollover);
+    f << "         } catch (...) {\n";
+    f << "            error = std::current_exception();\n";
+    f << "         }\n";
+    f << "         lock.lock();\n";
+    f << "         if (error && !m_error) m_error = error;\n";
+    f << "         m_free.push_back(buffer);\n";
+    f << "         m_busy = false;\n";
+    f << "         m_freed.notify_all();\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   std::vector<Instances>     m_buffers;\n";
+    f << "   std::vector<Instances*>    m_free;\n";
+    f << "   std::deque<Instances*>     m_queued;\n";
+    f << "   bool                       m_busy;      // Filling one that's not queued or free.\n";
+    f << "   bool                       m_stopping;  // Stop once the queue is empty.\n";
+    f << "   std::exception_ptr         m_error;     // The first one filling threw.\n";
+    f << "   std::mutex                 m_mutex;\n";
+    f << "   std::condition_variable    m_ready;     // Something was queued.\n";
+    f << "   std::condition_variable    m_freed;     // A buffer was freed.\n";
+    f << "   " << nsname << "::AsyncStatistics m_statistics;\n";
+    f << "   std::thread                m_thread;\n";
+    f << "};\n";
+    f << "AsyncFiller* pFiller(0);\n";
+    f << nsname << "::AsyncStatistics stoppedStatistics = {0, 0, 0, 0};   // Of the last one stopped.\n";
+    f << "}\n\n";
+}
+/**
+ * writeMergerData
+ *    Write the data the --threads API keeps: the merger, and each thread's
+ *    file from it and number of entries filled.  TBufferMerger moved out
+ *    of ROOT::Experimental in Root 6.22.
+ *
+ * @param f - stream into which the code is generated.
+ */
+static void
+writeMergerData(std::ostream& f)
+{
+    f << "#if ROOT_VERSION_CODE >= ROOT_VERSION(6,22,0)\n";
+    f << "typedef ROOT::TBufferMerger     Merger;\n";
+    f << "typedef ROOT::TBufferMergerFile MergerFile;\n";
+    f << "#else\n";
+    f << "typedef ROOT::Experimental::TBufferMerger     Merger;\n";
+    f << "typedef ROOT::Experimental::TBufferMergerFile MergerFile;\n";
+    f << "#endif\n";
+    f << "Merger* pMerger(0);\n";
+    f << "thread_local std::shared_ptr<MergerFile> pThreadFile;\n";
+    f << "thread_local Long64_t                    threadEntries(0);\n\n";
+}
+/**
+ * generateMergerAPI
+ *    Generate the --threads API.  InitializeThread creates the calling
+ *    thread's tree in a file the merger gives it.  CommitEvent Writes that
+ *    file each auto-flush cluster, which hands the data to the merger and
+ *    empties the tree.  The merger writes everything to the output file
+ *    when it's deleted.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ */
+static void
+generateMergerAPI(std::ostream& f, const std::string& nsname)
+{
+    f << "// Multi-threaded output - each worker has a tree in its own merger file\n\n";
+    f << "void " << nsname << "::InitializeMerger(const char* filename) {\n";
+    f << "   ROOT::EnableThreadSafety();\n";
+    f << "   pMerger = new Merger(filename, \"RECREATE\");\n";
+    f << "}\n";
+    f << "void " << nsname << "::InitializeThread() {\n";
+    f << "   pThreadFile = pMerger->GetFile();\n";
+    f << "   pThreadFile->cd();\n";
+    f << "   Initialize();\n";
+    f << "}\n";
+    f << "void " << nsname << "::FinishThread() {\n";
+    f << "   pThreadFile->Write();\n";
+    f << "   pThreadFile.reset();                     // Deletes the tree too.\n";
+    f << "   pTheTree = 0;\n";
+    f << "   threadEntries = 0;\n";
+    f << "}\n";
+    f << "void " << nsname << "::CloseMerger() {\n";
+    f << "   delete pMerger;                          // Writes the output file.\n";
+    f << "   pMerger = 0;\n";
+    f << "}\n\n";
+}
+/**
+ * writeSegments
+ *    Write the --rollover-* machinery.  Before each Fill, Segments checks
+ *    the limits that were given and when one has been reached opens the
+ *    next numbered file and moves the tree there (so no file is empty):
+ *    CloneTree(0) makes an empty tree with the same branches, settings and
+ *    addresses, so none of Initialize is redone.  The old file (and the
+ *    old tree it owns) is handed to a closer thread which writes and
+ *    closes it and lists it in the manifest, so the fill loop doesn't wait
+ *    for that.  The size limit is checked against what's in the file, so
+ *    it's reached a basket or cluster at a time.
+ *
+ * @param f       - stream into which the code is generated.
+ * @param nsname  - namespace everything is defined in.
+ * @param options - generation options:  the limits.
+ */
+static void
+writeSegments(std::ostream& f, const std::string& nsname, const GenerateOptions& options)
+{
+    std::vector<std::string> limits;
+    if (!options.s_rolloverEvents.empty()) {
+        limits.push_back("m_entries >= " + options.s_rolloverEvents + "LL");
+    }
+    if (!options.s_rolloverBytes.empty()) {
+        limits.push_back("m_pFile->GetEND() >= " + options.s_rolloverBytes + "LL");
+    }
+    if (!options.s_rolloverSeconds.empty()) {
+        limits.push_back(
+            "std::chrono::steady_clock::now() - m_start >= std::chrono::seconds("
+            + options.s_rolloverSeconds + ")"
+        );
+    }
+    
+    f << "// Rolling the output over to numbered files (--rollover-*).\n\n";
+    f << "namespace {\n";
+    f << "struct RetiredFile {                         // A file for the closer.\n";
+    f << "   TFile*      s_pFile;\n";
+    f << "   std::string s_name;\n";
+    f << "   Long64_t    s_first;                      // Its first entry overall.\n";
+    f << "   Long64_t    s_entries;\n";
+    f << "};\n";
+    f << "class Segments {\n";
+    f << "public:\n";
+    f << "   Segments(const char* base) :\n";
+    f << "      m_base(base), m_number(0), m_first(0), m_entries(0), m_pFile(0),\n";
+    f << "      m_stop(false), m_manifest((m_base + \".manifest\").c_str()) {\n";
+    f << "      m_manifest << \"# file first-entry entries bytes\\n\";\n";
+    f << "      open();\n";
+    f << "      m_closer = std::thread(&Segments::close, this);\n";
+    f << "   }\n";
+    f << "   void filling() {\n";
+    f << "      if (m_entries && ";
+    if (limits.size() > 1) f << "(";
+    for (size_t i = 0; i < limits.size(); i++) {
+        if (i) f << " ||\n                         ";
+        f << limits[i];
+    }
+    if (limits.size() > 1) f << ")";
+    f << ") {\n";
+    f << "         next();\n";
+    f << "      }\n";
+    f << "      m_entries++;\n";
+    f << "   }\n";
+    f << "   void finish() {                           // Closes the last file.\n";
+    f << "      RetiredFile last = {m_pFile, m_name, m_first, m_entries};\n";
+    f << "      retire(last);\n";
+    f << "      {\n";
+    f << "         std::lock_guard<std::mutex> lock(m_mutex);\n";
+    f << "         m_stop = true;\n";
+    f << "         m_retired.notify_one();\n";
+    f << "      }\n";
+    f << "      m_closer.join();\n";
+    f << "      m_manifest.close();\n";
+    f << "      m_pFile = 0;\n";
+    f << "   }\n";
+    f << "private:\n";
+    f << "   void open() {\n";
+    f << "      char suffix[32];\n";
+    f << "      snprintf(suffix, sizeof(suffix), \"-%04d.root\", m_number);\n";
+    f << "      m_name = m_base + suffix;\n";
+    f << "      m_pFile = new TFile(m_name.c_str(), \"RECREATE\");\n";
+    f << "      m_start = std::chrono::steady_clock::now();\n";
+    f << "   }\n";
+    f << "   void next() {\n";
+    f << "      RetiredFile old = {m_pFile, m_name, m_first, m_entries};\n";
+    f << "      m_number++;\n";
+    f << "      m_first += m_entries;\n";
+    f << "      m_entries = 0;\n";
+    f << "      open();\n";
+    f << "      TTree* pTree = " << nsname << "::pTheTree->CloneTree(0);\n";
+    f << "      " << nsname << "::pTheTree->GetListOfClones()->Remove(pTree);  "
+      << "// Else deleting the old tree resets pTree's addresses.\n";
+    f << "      pTree->SetDirectory(m_pFile);\n";
+    f << "      " << nsname << "::pTheTree = pTree;\n";
+    f << "      retire(old);\n";
+    f << "   }\n";
+    f << "   void retire(const RetiredFile& file) {\n";
+    f << "      std::lock_guard<std::mutex> lock(m_mutex);\n";
+    f << "      m_queue.push_back(file);\n";
+    f << "      m_retired.notify_one();\n";
+    f << "   }\n";
+    f << "   void close() {                            // The closer thread.\n";
+    f << "      std::unique_lock<std::mutex> lock(m_mutex);\n";
+    f << "      for (;;) {\n";
+    f << "         while (m_queue.empty() && !m_stop) m_retired.wait(lock);\n";
+    f << "         if (m_queue.empty()) return;\n";
+    f << "         RetiredFile file = m_queue.front();\n";
+    f << "         m_queue.pop_front();\n";
+    f << "         lock.unlock();\n";
+    f << "         file.s_pFile->Write();\n";
+    f << "         Long64_t bytes = file.s_pFile->GetEND();\n";
+    f << "         file.s_pFile->Close();                // Deletes its tree too.\n";
+    f << "         delete file.s_pFile;\n";
+    f << "         m_manifest << file.s_name << ' ' << file.s_first << ' '\n";
+    f << "                    << file.s_entries << ' ' << bytes << std::endl;\n";
+    f << "         lock.lock();\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   std::string                m_base;\n";
+    f << "   std::string                m_name;      // Of the file being filled.\n";
+    f << "   int                        m_number;\n";
+    f << "   Long64_t                   m_first;\n";
+    f << "   Long64_t                   m_entries;\n";
+    f << "   TFile*                     m_pFile;\n";
+    f << "   std::chrono::steady_clock::time_point m_start;\n";
+    f << "   std::deque<RetiredFile>    m_queue;\n";
+    f << "   bool                       m_stop;\n";
+    f << "   std::mutex                 m_mutex;\n";
+    f << "   std::condition_variable    m_retired;   // Something was queued or m_stop set.\n";
+    f << "   std::ofstream              m_manifest;  // Written by the closer.\n";
+    f << "   std::thread                m_closer;\n";
+    f << "};\n";
+    f << "Segments* pSegments(0);\n";
+    f << "}\n\n";
+}
+/**
+ * generateRolloverAPI
+ *    Generate OpenOutput and CloseOutput for --rollover-*.  OpenOutput
+ *    opens the first file, which Initialize then makes the tree in.
+ *    CloseOutput (after draining the --async filler) closes the last file
+ *    and waits for the closer to finish the rest.
+ *
+ * @param f       - stream into which the code is generated.
+ * @param nsname  - namespace everything is defined in.
+ * @param options - generation options.
+ */
+static void
+generateRolloverAPI(std::ostream& f, const std::string& nsname, const GenerateOptions& options)
+{
+    f << "// OpenOutput and CloseOutput - numbered output files\n\n";
+    f << "void " << nsname << "::OpenOutput(const char* base) {\n";
+    if (options.s_context) {
+        f << "   OpenOutput(base, instanceStruct);\n";
+        f << "}\n";
+        f << "void " << nsname << "::OpenOutput(const char* base, EventContext& context) {\n";
+    }
+    f << "   ROOT::EnableThreadSafety();              // The closer writes files too.\n";
+    f << "   pSegments = new Segments(base);\n";
+    f << (options.s_context ? "   Initialize(context);\n" : "   Initialize();\n");
+    f << "}\n";
+    f << "void " << nsname << "::CloseOutput() {\n";
+    if (options.s_async) {
+        f << "   StopFilling();\n";
+    }
+    f << "   pSegments->finish();\n";
+    f << "   delete pSegments;\n";
+    f << "   pSegments = 0;\n";
+    f << "   pTheTree = 0;                            // The closer deleted it.\n";
+    f << "}\n\n";
+}
+/**
+ * layoutHash
+ *    Hash of the generated types and instances, which a subscriber checks
+ *    so it doesn't map events published by code generated from other
+ *    declarations (or with other options).
+ *
+ * @param types     - type list.
+ * @param instances - instance list.
+ * @param options   - generation options.
+ * @return uint64_t - the hash.
+ */
+static uint64_t
+layoutHash(const TypeList& types, const InstanceList& instances, const GenerateOptions& options)
+{
+    std::ostringstream layout;
+    std::set<std::string> columns = columnsTypes(types, instances);
+    if (!columns.empty()) {
+        writeColumnsSupport(layout, types, columns);
+    }
+    writeStructureDefs(layout, types, options.s_pod);
+    writeInstanceDefs(layout, instances, options);
+    return contentHash(layout.str());
+}
+/**
+ * writePublisher
+ *    Write the --shm ring and its publishing side.  The shared memory is an
+ *    EventRing header followed by the EventContext slots;  event n goes
+ *    in slot n % slots.  Everything
+ *    is synchronized with atomics, no locks:  the publisher copies an
+ *    event into its slot and then advances s_published;  each subscriber
+ *    has a cursor (s_next) it advances when it's done with an event.  The
+ *    publisher doesn't overwrite a slot until every subscriber's cursor is
+ *    past it, so subscribers can use the events in place.  A subscriber
+ *    whose process died is dropped when the publisher would wait for it.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ * @param layout - hash of the generated types.
+ */
+static void
+writePublisher(std::ostream& f, const std::string& nsname, uint64_t layout)
+{
+    f << "// Publishing events in POSIX shared memory (--shm).\n\n";
+    f << "struct " << nsname << "::EventRing {         // The slots follow it.\n";
+    f << "   struct Subscriber {\n";
+    f << "      std::atomic<int>                s_pid;    // 0 if it's free.\n";
+    f << "      std::atomic<unsigned long long> s_next;   // The event it reads next.\n";
+    f << "   };\n";
+    f << "   unsigned long long              s_magic;\n";
+    f << "   unsigned long long              s_layout;     // layoutHash of the generated code.\n";
+    f << "   unsigned long long              s_eventBytes;\n";
+    f << "   unsigned long long              s_slots;\n";
+    f << "   int                             s_publisher;  // Its pid.\n";
+    f << "   std::atomic<int>                s_closed;\n";
+    f << "   std::atomic<unsigned long long> s_published;  // Events published so far.\n";
+    f << "   Subscriber                      s_subscribers[16];\n";
+    f << "   static size_t header() { return (sizeof(EventRing) + 63) & ~size_t(63); }\n";
+    f << "   EventContext* slot(unsigned long long n) {\n";
+    f << "      return reinterpret_cast<EventContext*>(reinterpret_cast<char*>(this) + header())\n";
+    f << "         + n % s_slots;\n";
+    f << "   }\n";
+    f << "};\n\n";
+    f << "namespace {\n";
+    f << "typedef " << nsname << "::EventRing EventRing;\n";
+    f << "const unsigned long long RING_MAGIC(0x67656e7872696e67ULL);   // genxring\n";
+    f << "const unsigned long long LAYOUT(0x" << std::hex << layout << std::dec << "ULL);\n";
+    f << "const unsigned MAX_SUBSCRIBERS(16);\n";
+    f << "static_assert(std::is_trivially_copyable<" << nsname << "::EventContext>::value,\n";
+    f << "              \"published events are copied as plain data\");\n";
+    f << "static_assert(ATOMIC_LLONG_LOCK_FREE == 2, \"the ring needs lock free atomics\");\n";
+    f << "std::string shmName(const char* name) {\n";
+    f << "   return name[0] == '/' ? std::string(name) : std::string(\"/\") + name;\n";
+    f << "}\n";
+    f << "bool alive(int pid) {\n";
+    f << "   return (kill(pid, 0) == 0) || (errno != ESRCH);\n";
+    f << "}\n";
+    f << "bool stale(const std::string& name) {        // Left by a publisher that crashed?\n";
+    f << "   int fd = shm_open(name.c_str(), O_RDONLY, 0);\n";
+    f << "   struct stat info;\n";
+    f << "   if (fd < 0) {\n";
+    f << "      return errno == ENOENT;                  // Gone since.\n";
+    f << "   }\n";
+    f << "   if (fstat(fd, &info) < 0) {\n";
+    f << "      close(fd);\n";
+    f << "      return false;\n";
+    f << "   }\n";
+    f << "   if (size_t(info.st_size) < EventRing::header()) {\n";
+    f << "      close(fd);\n";
+    f << "      return true;\n";
+    f << "   }\n";
+    f << "   void* p = mmap(0, EventRing::header(), PROT_READ, MAP_SHARED, fd, 0);\n";
+    f << "   close(fd);\n";
+    f << "   if (p == MAP_FAILED) {\n";
+    f << "      return false;\n";
+    f << "   }\n";
+    f << "   const EventRing* pOld = static_cast<const EventRing*>(p);\n";
+    f << "   bool result = (pOld->s_magic != RING_MAGIC) || !alive(pOld->s_publisher);\n";
+    f << "   munmap(p, EventRing::header());\n";
+    f << "   return result;\n";
+    f << "}\n";
+    f << "void backoff(unsigned& tries) {             // Yield for a while, then sleep.\n";
+    f << "   if (++tries < 1000) {\n";
+    f << "      std::this_thread::yield();\n";
+    f << "   } else {\n";
+    f << "      std::this_thread::sleep_for(std::chrono::microseconds(50));\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "EventRing*         pRing(0);\n";
+    f << "size_t             ringBytes(0);\n";
+    f << "std::string        ringName;\n";
+    f << "unsigned long long oldest(0);               // No subscriber's cursor is before this.\n";
+    f << "void publish(const " << nsname << "::EventContext& event) {\n";
+    f << "   unsigned long long n = pRing->s_published.load();\n";
+    f << "   for (unsigned tries = 0; n - oldest >= pRing->s_slots; backoff(tries)) {\n";
+    f << "      oldest = n;\n";
+    f << "      for (unsigned i = 0; i < MAX_SUBSCRIBERS; i++) {\n";
+    f << "         EventRing::Subscriber& s(pRing->s_subscribers[i]);\n";
+    f << "         int pid = s.s_pid.load();\n";
+    f << "         if (pid && (tries >= 1000) && !alive(pid)) {\n";
+    f << "            s.s_pid.compare_exchange_strong(pid, 0);   // It died holding a slot.\n";
+    f << "         } else if (pid && (s.s_next.load() < oldest)) {\n";
+    f << "            oldest = s.s_next.load();\n";
+    f << "         }\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   memcpy(static_cast<void*>(pRing->slot(n)), &event, sizeof(event));\n";
+    f << "   pRing->s_published.store(n + 1);\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateSubscriberAPI
+ *    Generate OpenPublisher, ClosePublisher and EventSubscriber for --shm.
+ *    OpenPublisher only replaces a ring that's already there if it isn't
+ *    a ring or its publisher's process is gone;  a live ring is an error.
+ *    A subscriber claims a free entry in the ring's subscriber table and
+ *    starts at the next event published.  Its cursor is set before it
+ *    checks where the publisher is, and it starts again further on if the
+ *    publisher might have got a ring ahead meanwhile.  It gives up
+ *    waiting when the publisher is closed or its process is gone.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ */
+static void
+generateSubscriberAPI(std::ostream& f, const std::string& nsname)
+{
+    f << "// OpenPublisher, ClosePublisher and EventSubscriber - the shared memory ring\n\n";
+    f << "void " << nsname << "::OpenPublisher(const char* name, unsigned slots) {\n";
+    f << "   ringName = shmName(name);\n";
+    f << "   ringBytes = EventRing::header() + slots*sizeof(EventContext);\n";
+    f << "   int fd = shm_open(ringName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);\n";
+    f << "   if ((fd < 0) && (errno == EEXIST) && stale(ringName)) {\n";
+    f << "      shm_unlink(ringName.c_str());\n";
+    f << "      fd = shm_open(ringName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);\n";
+    f << "   }\n";
+    f << "   if ((fd < 0) || (ftruncate(fd, ringBytes) < 0)) {\n";
+    f << "      std::string reason(errno == EEXIST ? \"a running process publishes it\" : strerror(errno));\n";
+    f << "      if (fd >= 0) close(fd);\n";
+    f << "      throw std::runtime_error(\"OpenPublisher: \" + ringName + \": \" + reason);\n";
+    f << "   }\n";
+    f << "   void* p = mmap(0, ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);\n";
+    f << "   close(fd);\n";
+    f << "   if (p == MAP_FAILED) {\n";
+    f << "      throw std::runtime_error(\"OpenPublisher: \" + ringName + \": \" + strerror(errno));\n";
+    f << "   }\n";
+    f << "   pRing = new(p) EventRing;\n";
+    f << "   pRing->s_layout = LAYOUT;\n";
+    f << "   pRing->s_eventBytes = sizeof(EventContext);\n";
+    f << "   pRing->s_slots = slots;\n";
+    f << "   pRing->s_publisher = getpid();\n";
+    f << "   pRing->s_closed.store(0);\n";
+    f << "   pRing->s_published.store(0);\n";
+    f << "   for (unsigned i = 0; i < MAX_SUBSCRIBERS; i++) {\n";
+    f << "      pRing->s_subscribers[i].s_pid.store(0);\n";
+    f << "      pRing->s_subscribers[i].s_next.store(0);\n";
+    f << "   }\n";
+    f << "   oldest = 0;\n";
+    f << "   std::atomic_thread_fence(std::memory_order_seq_cst);\n";
+    f << "   pRing->s_magic = RING_MAGIC;               // Subscribers can attach now.\n";
+    f << "}\n";
+    f << "void " << nsname << "::ClosePublisher() {\n";
+    f << "   pRing->s_closed.store(1);\n";
+    f << "   munmap(pRing, ringBytes);\n";
+    f << "   shm_unlink(ringName.c_str());              // Subscribers keep their mappings.\n";
+    f << "   pRing = 0;\n";
+    f << "}\n";
+    f << nsname << "::EventSubscriber::EventSubscriber(const char* name) :\n";
+    f << "   m_pRing(0), m_bytes(0), m_subscriber(0), m_next(0), m_holding(false) {\n";
+    f << "   std::string shm = shmName(name);\n";
+    f << "   int fd = shm_open(shm.c_str(), O_RDWR, 0);\n";
+    f << "   struct stat info;\n";
+    f << "   if ((fd < 0) || (fstat(fd, &info) < 0)) {\n";
+    f << "      std::string reason(strerror(errno));\n";
+    f << "      if (fd >= 0) close(fd);\n";
+    f << "      throw std::runtime_error(\"EventSubscriber: \" + shm + \": \" + reason);\n";
+    f << "   }\n";
+    f << "   m_bytes = info.st_size;\n";
+    f << "   void* p = m_bytes ? mmap(0, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;\n";
+    f << "   close(fd);\n";
+    f << "   if (p == MAP_FAILED) {\n";
+    f << "      throw std::runtime_error(\"EventSubscriber: \" + shm + \" can't be mapped\");\n";
+    f << "   }\n";
+    f << "   m_pRing = static_cast<EventRing*>(p);\n";
+    f << "   if ((m_bytes < EventRing::header()) || (m_pRing->s_magic != RING_MAGIC)\n";
+    f << "       || (m_pRing->s_layout != LAYOUT) || (m_pRing->s_eventBytes != sizeof(EventContext))) {\n";
+    f << "      munmap(p, m_bytes);\n";
+    f << "      throw std::runtime_error(\"EventSubscriber: \" + shm + \" isn't a ring of these events\");\n";
+    f << "   }\n";
+    f << "   int pid = getpid();\n";
+    f << "   for (; m_subscriber < MAX_SUBSCRIBERS; m_subscriber++) {\n";
+    f << "      int free = 0;\n";
+    f << "      if (m_pRing->s_subscribers[m_subscriber].s_pid.compare_exchange_strong(free, pid)) {\n";
+    f << "         break;\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   if (m_subscriber == MAX_SUBSCRIBERS) {\n";
+    f << "      munmap(p, m_bytes);\n";
+    f << "      throw std::runtime_error(\"EventSubscriber: \" + shm + \" has too many subscribers\");\n";
+    f << "   }\n";
+    f << "   EventRing::Subscriber& me(m_pRing->s_subscribers[m_subscriber]);\n";
+    f << "   do {\n";
+    f << "      m_next = m_pRing->s_published.load();\n";
+    f << "      me.s_next.store(m_next);\n";
+    f << "   } while (m_pRing->s_published.load() - m_next >= m_pRing->s_slots);\n";
+    f << "}\n";
+    f << nsname << "::EventSubscriber::~EventSubscriber() {\n";
+    f << "   m_pRing->s_subscribers[m_subscriber].s_pid.store(0);\n";
+    f << "   munmap(m_pRing, m_bytes);\n";
+    f << "}\n";
+    f << "const " << nsname << "::EventContext* " << nsname << "::EventSubscriber::Next() {\n";
+    f << "   if (m_holding) {\n";
+    f << "      m_pRing->s_subscribers[m_subscriber].s_next.store(++m_next);   // Frees its slot.\n";
+    f << "      m_holding = false;\n";
+    f << "   }\n";
+    f << "   for (unsigned tries = 0; m_pRing->s_published.load() == m_next; backoff(tries)) {\n";
+    f << "      bool ended = m_pRing->s_closed.load()\n";
+    f << "         || ((tries >= 1000) && !alive(m_pRing->s_publisher));\n";
+    f << "      if (ended && (m_pRing->s_published.load() == m_next)) {\n";
+    f << "         return 0;\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "   m_holding = true;\n";
+    f << "   return m_pRing->slot(m_next);\n";
+    f << "}\n\n";
+}
+/**
+ * writeMovingBranches
+ *    For --batch, write what lets CommitBatch fill the tree from each slot
+ *    where it is instead of copying the slot into the tree's context.
+ *    findMovingBranches (called by Initialize) lists the tree's branches
+ *    whose data are in the tree's context, with the offset of the data in
+ *    it:  the same offset from &batch[k] is that data in slot k.  The
+ *    branches are found by their index, since rollover replaces the tree
+ *    with a clone.  Object branches (TBranchElement) are moved with
+ *    SetObject, leaf list branches with SetAddress.  The zero suppressed
+ *    branches point at suppressed and don't move.
+ *
+ * @param f      - stream into which the code is generated.
+ * @param nsname - namespace everything is defined in.
+ */
+static void
+writeMovingBranches(std::ostream& f, const std::string& nsname)
+{
+    f << "// Pointing the tree's branches at the slots of a batch (--batch).\n\n";
+    f << "namespace {\n";
+    f << "struct MovingBranch {\n";
+    f << "   Int_t     s_index;                       // In the tree's list of branches.\n";
+    f << "   ptrdiff_t s_offset;                      // Of its data in an EventContext.\n";
+    f << "   bool      s_object;                      // Moved with SetObject.\n";
+    f << "};\n";
+    f << "std::vector<MovingBranch> movingBranches;\n";
+    f << "void findMovingBranches() {\n";
+    f << "   movingBranches.clear();\n";
+    f << "   char* context = reinterpret_cast<char*>(" << nsname << "::pTreeContext);\n";
+    f << "   TObjArray* branches = " << nsname << "::pTheTree->GetListOfBranches();\n";
+    f << "   for (Int_t i = 0; i < branches->GetEntriesFast(); i++) {\n";
+    f << "      TBranch* pBranch = static_cast<TBranch*>(branches->UncheckedAt(i));\n";
+    f << "      TBranchElement* pElement = dynamic_cast<TBranchElement*>(pBranch);\n";
+    f << "      char* data = pElement ? pElement->GetObject() : pBranch->GetAddress();\n";
+    f << "      if (data >= context && data < context + sizeof(" << nsname << "::EventContext)) {\n";
+    f << "         MovingBranch b = {i, data - context, pElement != 0};\n";
+    f << "         movingBranches.push_back(b);\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "void pointBranches(" << nsname << "::EventContext& context) {\n";
+    f << "   char* base = reinterpret_cast<char*>(&context);\n";
+    f << "   TObjArray* branches = " << nsname << "::pTheTree->GetListOfBranches();\n";
+    f << "   for (size_t i = 0; i < movingBranches.size(); i++) {\n";
+    f << "      const MovingBranch& b(movingBranches[i]);\n";
+    f << "      TBranch* pBranch = static_cast<TBranch*>(branches->UncheckedAt(b.s_index));\n";
+    f << "      if (b.s_object) {\n";
+    f << "         pBranch->SetObject(base + b.s_offset);\n";
+    f << "      } else {\n";
+    f << "         pBranch->SetAddress(base + b.s_offset);\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generateBatchAPI
+ *    Generate SetupBatch and CommitBatch for --batch.  The slots of a batch
+ *    are next to each other, so SetupBatch resets them all with one plan
+ *    where each run of the plan for a context is repeated for each slot
+ *    (the elements of branches=single struct arrays, which are elsewhere,
+ *    are reset slot by slot).  CommitBatch points the tree's branches at
+ *    each slot in turn and fills it (see writeMovingBranches), then points
+ *    them back at the tree's context, even if a Fill throws.
+ *
+ * @param f  - file into which code is being generated.
+ * @param nsname - namespace all this stuff lives in.
+ * @param instances - instance list.
+ * @param options - generation options.
+ */
+static void
+generateBatchAPI(
+    std::ostream& f, const std::string& nsname, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    f << "// SetupBatch and CommitBatch - SetupEvent and CommitEvent for a batch\n\n";
+    f << "void " << nsname << "::SetupBatch(EventBatch& batch) {\n";
+    f << "   static ResetPlan plan(\n";
+    f << "      planInstances().repeated(batch.size(), sizeof(EventContext))\n";
+    f << "   );\n";
+    f << "   plan.run(&batch[0]);\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (isSingleBranch(*p)) {
+            f << "   static ResetPlan " << p->s_name << "Plan(planElements_" << p->s_name << "());\n";
+            f << "   for (size_t k = 0; k < batch.size(); k++) {\n";
+            f << "      " << p->s_name << "Plan.run(batch[k]." << p->s_name << ".data());\n";
+            f << "   }\n";
+        }
+    }
+    f << "}\n";
+    f << "void " << nsname << "::CommitBatch(EventBatch& batch, size_t n) {\n";
+    f << "   if (n > batch.size()) {\n";
+    f << "      throw std::out_of_range(\"CommitBatch: n is more than the batch holds\");\n";
+    f << "   }\n";
+    if (options.s_shm) {
+        f << "   if (pRing) {\n";
+        f << "      for (size_t k = 0; k < n; k++) publish(batch[k]);\n";
+        f << "   }\n";
+        f << "   if (!pTheTree) return;                   // Only publishing.\n";
+    }
+    f << "   try {\n";
+    f << "      for (size_t k = 0; k < n; k++) {\n";
+    f << "         pointBranches(batch[k]);\n";
+    writeFill(
+        f, "         ", "pTheTree", "batch[k]", hasZeroSuppressed(instances), hasRollover(options)
+    );
+    f << "      }\n";
+    f << "   }\n";
+    f << "   catch (...) {\n";
+    f << "      pointBranches(*pTreeContext);\n";
+    f << "      throw;\n";
+    f << "   }\n";
+    f << "   pointBranches(*pTreeContext);\n";
+    f << "}\n\n";
+}
+/**
+ * generateContextAPI
+ *    Generate the --context API.  The functions without a context use
+ *    instanceStruct.  Initialize makes the tree with its branches
+ *    pointing into the context it's given (the tree's context) and
+ *    CommitEvent copies the context it's given there if it's another one
+ *    before filling the tree.  SetupEvent runs the reset plans on the
+ *    context.
+ *
+ * @param f  - file into which code is being generated.
+ * @param nsname - namespace all this stuff lives in.
+ * @param types  - type list.
+ * @param instances - instance list.
+ * @param options - generation options.
+ */
+static void
+generateContextAPI(
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    const InstanceList& instances, const GenerateOptions& options
+)
+{
+    f << "// Pointer to the tree and the context it's filled from:\n\n";
+    
+    f << "namespace " << nsname << " {\n";
+    f << "TTree* " << "pTheTree(0);\n";
+    f << "EventContext* pTreeContext(0);\n\n";
+    f << "}\n";
+    if (hasRollover(options)) {
+        writeSegments(f, nsname, options);
+    }
+    if (options.s_shm) {
+        writePublisher(f, nsname, layoutHash(types, instances, options));
+    }
+    if (!options.s_batch.empty()) {
+        writeMovingBranches(f, nsname);
+    }
+    
+    f << "// Setup event - resets the instances\n\n";
+    f << "void " << nsname << "::SetupEvent() {\n";
+    f << "   SetupEvent(instanceStruct);\n";
+    f << "}\n";
+    f << "void " << nsname << "::SetupEvent(EventContext& context) {\n";
+    f << "   static ResetPlan plan(planInstances());\n";
+    f << "   plan.run(&context);\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        if (isSingleBranch(*p)) {
+            f << "   static ResetPlan " << p->s_name << "Plan(planElements_" << p->s_name << "());\n";
+            f << "   " << p->s_name << "Plan.run(context." << p->s_name << ".data());\n";
+        }
+    }
+    f << "}\n\n";
+    
+    f << "// CommitEvent  Fills the tree\n\n";
+    f << "void " << nsname << "::CommitEvent() {\n";
+    f << "   CommitEvent(instanceStruct);\n";
+    f << "}\n";
+    f << "void " << nsname << "::CommitEvent(" << (options.s_shm ? "const " : "")
+      << "EventContext& context) {\n";
+    if (options.s_shm) {
+        f << "   if (pRing) publish(context);\n";
+        f << "   if (!pTheTree) return;                   // Only publishing.\n";
+    }
+    f << "   if (&context != pTreeContext) {\n";
+    f << "      *pTreeContext = context;\n";
+    f << "   }\n";
+    writeFill(
+        f, "   ", "pTheTree", "*pTreeContext", hasZeroSuppressed(instances), hasRollover(options)
+    );
+    f << "}\n\n";
+    
+    f << "// Initialize - creates the trees and branches\n\n";
+    f << "void " << nsname << "::Initialize() {\n";
+    f << "   Initialize(instanceStruct);\n";
+    f << "}\n";
+    f << "void " << nsname << "::Initialize(EventContext& context) {\n";
+    f << "   " << nsname << "::pTreeContext = &context;\n";
+    createTree(f, nsname, types, instances, "context", options);
+    if (!options.s_batch.empty()) {
+        f << "   findMovingBranches();\n";
+    }
+    f << "}\n\n";
+    if (!options.s_batch.empty()) {
+        generateBatchAPI(f, nsname, instances, options);
+    }
+    if (hasRollover(options)) {
+        generateRolloverAPI(f, nsname, options);
+    }
+    if (options.s_shm) {
+        generateSubscriberAPI(f, nsname);
+    }
+}
+/**
+ * generateAPI
+ *    Generates API  implementations for Initialize, SetupEvent and CommitEvent.
+ *
+ *  @param f  - file into which code is being generated.
+ *  @param nsname - namespace all this stuff lives in.
+ *  @param types  - type list.
+ *  @param instances - instance list.
+ *  @param options - generation options.
+ */
+static void
+generateAPI(
+    std::ostream& f, const std::string& nsname, const TypeList& types,
+    const InstanceList& instances, const GenerateOptions& options
+)
+{
+    if (options.s_context) {
+        generateContextAPI(f, nsname, types, instances, options);
+        return;
+    }
+    bool threads = options.s_threads;
+    f << "// Pointer to the tree:\n\n";
+    
+    f << "namespace " << nsname << " {\n";
+    f << threadLocal(threads) << "TTree* " << "pTheTree(0);\n\n";
+    if (threads) {
+        writeMergerData(f);
+    }
+    f << "}\n";
+    if (hasRollover(options)) {
+        writeSegments(f, nsname, options);
+    }
+    if (options.s_async) {
+        writeAsyncFiller(f, nsname, hasZeroSuppressed(instances), hasRollover(options));
+    }
+    
+    f << "// Setup event - resets the instances\n\n";
+    f << "void " << nsname << "::SetupEvent() {\n";
+    if (options.s_sparseReset) {
+        generateSparseClearInstances(f, nsname, instances, threads);
+    } else {
+        generateClearInstances(f, threads);
+    }
+    f << "}\n\n";
+    
+    f << "// CommitEvent  Fills the tree\n\n";
+    f << "void " << nsname << "::CommitEvent() {\n";
+    if (options.s_async) {
+        f << "   pFiller->commit(instanceStruct);\n";
+    } else {
+        writeFill(
+            f, "   ", "pTheTree", nsname + "::instanceStruct", hasZeroSuppressed(instances),
+            hasRollover(options)
+        );
+    }
+    if (threads) {
+        f << "   if (pThreadFile && (++threadEntries % "
+          << clusterEntries(types, instances, options) << " == 0)) {\n";
+        f << "      pThreadFile->Write();               // Hand a cluster to the merger.\n";
+        f << "   }\n";
+    }
+    f << "}\n\n";
+    
+    f << "// Initialize - creates the trees and branches\n\n";
+    f << "void " <<nsname << "::Initialize() {\n";
+    if (options.s_async) {
+        std::string depth = options.s_asyncDepth.empty() ? "4" : options.s_asyncDepth;
+        f << "   StopFilling();                           // One from an earlier Initialize.\n";
+        f << "   ROOT::EnableThreadSafety();\n";
+        createTree(f, nsname, types, instances, "fillBuffer", options);
+        f << "   pFiller = new AsyncFiller(" << depth << ");\n";
+    } else {
+        createTree(f, nsname, types, instances, nsname + "::instanceStruct", options);
+    }
+    f << "}\n\n";
+    if (threads) {
+        generateMergerAPI(f, nsname);
+    }
+    if (options.s_async) {
+        f << "// Drain - wait for the filling thread to catch up\n\n";
+        f << "void " << nsname << "::Drain() {\n";
+        f << "   if (pFiller) pFiller->drain();\n";
+        f << "}\n";
+        f << "void " << nsname << "::StopFilling() {\n";
+        f << "   if (pFiller) {\n";
+        f << "      pFiller->drain();\n";
+        f << "      stoppedStatistics = pFiller->statistics();\n";
+        f << "      delete pFiller;\n";
+        f << "      pFiller = 0;\n";
+        f << "   }\n";
+        f << "}\n";
+        f << nsname << "::AsyncStatistics " << nsname << "::GetAsyncStatistics() {\n";
+        f << "   return pFiller ? pFiller->statistics() : stoppedStatistics;\n";
+        f << "}\n\n";
+    }
+    if (hasRollover(options)) {
+        generateRolloverAPI(f, nsname, options);
+    }
+}
+/**
+ * writeFillNaN
+ *    Write fillNaN which sets a run of Double_t's to NAN.  It stores a
+ *    constant in unrolled blocks of 8 (NaNStore), which compilers turn into
+ *    vector stores where they would not vectorize a loop whose length is
+ *    only known at run time.
+ *
+ * @param f - stream into which the code is generated.
+ */
+static void
+writeFillNaN(std::ostream& f)
+{
+    f << "namespace {\n";
+    f << "template <int N> struct NaNStore {          // N unrolled stores.\n";
+    f << "   static void at(Double_t* p, Double_t nan) {\n";
+    f << "      NaNStore<N-1>::at(p, nan);\n";
+    f << "      p[N-1] = nan;\n";
+    f << "   }\n";
+    f << "};\n";
+    f << "template <> struct NaNStore<0> {\n";
+    f << "   static void at(Double_t*, Double_t) {}\n";
+    f << "};\n";
+    f << "inline void fillNaN(Double_t* p, size_t n) {\n";
+    f << "   const Double_t nan(NAN);\n";
+    f << "   for (; n >= 8; n -= 8, p += 8) {\n";
+    f << "      NaNStore<8>::at(p, nan);\n";
+    f << "   }\n";
+    f << "   for (size_t i = 0; i < n; i++) p[i] = nan;\n";
+    f << "}\n";
+    f << "}\n\n";
+}
+/**
+ * generatePrologue
+ *    Generate what goes at the top of each C++ file.
+ *
+ * @param f - stream into which the code is generated.
+ * @param fname - name of the file being generated.
+ * @param headerName -name of the header file.
+ * @param options - generation options:  --threads, --async, --pod, --shm
+ *                  and --rollover-* need more headers.
+ * @param reader  - true if the file has the reader for zero suppressed
+ *                  instances.
+ */
+static void
+generatePrologue(
+    std::ostream& f, const std::string& fname, const std::string& headerName,
+    const GenerateOptions& options, bool reader
+)
 {
-    
     char cstrHeaderName[headerName.size()+1];
     strcpy(cstrHeaderName, headerName.c_str());
     std::string headerBaseName = basename(cstrHeaderName);
     
-    std::ofstream f(fname.c_str());
     commentHeader(f, fname, "C++ Implementation file for root");
     f << "#define IMPLEMENTATION_MODULE\n";
     f << "#include \"" << headerBaseName << "\"\n\n";
     f << "#include <cmath>\n";
+    f << "#include <cstddef>\n";
     f << "#include <TTree.h>\n";
     f << "#include <TBranch.h>\n";
+    if (options.s_threads) {
+        f << "#include <TROOT.h>\n";
+        f << "#include <RVersion.h>\n";
+        f << "#include <ROOT/TBufferMerger.hxx>\n";
+        f << "#include <memory>\n";
+    }
+    bool rollover = hasRollover(options);
+    if (options.s_async || rollover) {
+        f << "#include <TROOT.h>\n";
+        f << "#include <thread>\n";
+        f << "#include <mutex>\n";
+        f << "#include <condition_variable>\n";
+        f << "#include <chrono>\n";
+        f << "#include <deque>\n";
+    }
+    if (options.s_async) {
+        f << "#include <exception>\n";
+    }
+    if (rollover) {
+        f << "#include <TFile.h>\n";
+        f << "#include <fstream>\n";
+        f << "#include <string>\n";
+        f << "#include <cstdio>\n";
+    }
+    if (options.s_pod) {
+        f << "#include <type_traits>\n";
+    }
+    if (!options.s_batch.empty()) {
+        f << "#include <TObjArray.h>\n";
+        f << "#include <TBranchElement.h>\n";
+        if (!options.s_shm) {
+            f << "#include <stdexcept>\n";
+        }
+    }
+    if (options.s_shm) {
+        f << "#include <atomic>\n";
+        f << "#include <new>\n";
+        f << "#include <stdexcept>\n";
+        f << "#include <cstring>\n";
+        f << "#include <errno.h>\n";
+        f << "#include <fcntl.h>\n";
+        f << "#include <signal.h>\n";
+        f << "#include <sys/mman.h>\n";
+        f << "#include <sys/stat.h>\n";
+        f << "#include <unistd.h>\n";
+        if (!rollover) {
+            f << "#include <thread>\n";
+            f << "#include <chrono>\n";
+            f << "#include <string>\n";
+        }
+    }
+    if (reader && !options.s_async && !rollover) {
+        f << "#include <deque>\n";
+    }
     
     f << std::endl;
+    writeFillNaN(f);
+}
+/**
+ * generateCPP
+ *    Generate the C++ file.
+ * @param fname - name of the file to be generated.
+ * @param headerName -name of the header file.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @param instance - The instance definitions.
+ * @param options - generation options.  With --split the class
+ *                  implementations are in their own files.
+ * @return bool - true if the file was written.
+ */
+static bool
+generateCPP(
+    const std::string& fname, const std::string& headerName,
+    const std::string & nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    OutputFile f(fname);
+    bool suppress = hasZeroSuppressed(instances);
+    generatePrologue(f, fname, headerName, options, suppress);
     
+    if (!options.s_split) {
+        generateClassImplementations(
+            f, nsname, types, types.begin(), types.end(), options.s_pod
+        );
+    }
+    generateInstances(
+        f, nsname, instances, options.s_sparseReset, options.s_threads, options.s_context
+    );
+    if (!options.s_sparseReset) {
+        generateResetPlan(
+            f, nsname, types, instances, options.s_context, !options.s_batch.empty()
+        );
+    }
+    if (suppress) {
+        generateZeroSuppression(f, nsname, types, instances, options.s_threads);
+    }
+    generateAPI(f, nsname, types, instances, options);
+    if (suppress) {
+        generateReaderAPI(f, nsname, types, instances, options.s_threads);
+    }
     
-    generateClassImplementations(f, nsname, types);
-    generateInstances(f, nsname, instances);
-    generateAPI(f, nsname, instances);
-    
-    f.close();
+    return f.close();
 }
 /**
- * main
- *   entry point
+ * generateClassCPPs
+ *    For --split, generate a C++ file for each class, base-classname.cpp,
+ *    with its method implementations.  These, along with base.cpp, can
+ *    be compiled in parallel.  The files are listed in base.mk.
+ *
+ * @param base - output file base name.
+ * @param headerName -name of the header file.
+ * @param nsname - namespace all of the definitions live in.
+ * @param types  - Derived type definitions.
+ * @param pod    - true for --pod.
+ * @return bool - true if the files were written.
  */
-int main (int argc, char** argv)
+static bool
+generateClassCPPs(
+    const std::string& base, const std::string& headerName,
+    const std::string& nsname, const TypeList& types, bool pod
+)
 {
-    if (argc != 2) {
-        usage(std::cerr, "Incorrect number of command line parameters");
+    GenerateOptions classOptions;       // Only --pod matters to the classes.
+    classOptions.s_pod = pod;
+    std::vector<std::string> sources(1, base + ".cpp");
+    bool ok = true;
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        std::string fname = base + "-" + p->s_typename + ".cpp";
+        OutputFile f(fname);
+        generatePrologue(f, fname, headerName, classOptions, false);
+        generateClassImplementations(f, nsname, types, p, p + 1, pod);
+        ok = f.close() && ok;
+        sources.push_back(fname);
     }
-    // Deserialize the intermediate representation:
-    
-    std::list<TypeDefinition> types;
-    deserializeTypes(std::cin, types);
-    
-    std::list<Instance> instances;
-    deserializeInstances(std::cin, instances);
-    
-    // From the base name generate the names of the namespace, header, source
-    // and linkdef file.  Note that for the namespace, we use basename to
-    // remove any path information from basename as the user could do:
-    //
-    // rootgenerate ~/rootstuff/base
-    //
-    // which, by the time we're done gives us a namespace of base.
-    
-    
-    std::string base   = argv[1];
+    return writeSourceList(base, sources) && ok;
+}
+/**
+ * generateRoot
+ *   Generate the header, implementation and linkdef files from the
+ *   intermediate representation.
+ *
+ * @param base      - output file base name (may include a path).
+ * @param nsname    - namespace the generated code lives in.
+ * @param types     - the derived type definitions.
+ * @param instances - the instance definitions.
+ * @param options   - generation options.  With --split each class's
+ *                    methods are in base-classname.cpp and base.mk lists
+ *                    the C++ files.  --single-branch sets branches=single
+ *                    on struct array instances that don't have it and
+ *                    --precision sets the precision of values and arrays
+ *                    that don't have one.  --zero-suppress sets
+ *                    storage=sparse on array and struct array instances
+ *                    that don't have a storage attribute.
+ * @return bool - true if all the files were written.
+ */
+bool
+generateRoot(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
     std::string headerName = base + ".h";
     std::string cppName    = base + ".cpp";
     std::string linkdefName = base + "-linkdef.h";
     
-    
-    if (nsName == "") {
-        char cstrFilename[base.size() +1];  // all because basename(3) an
-        strcpy(cstrFilename, base.c_str()); // modify its parameter.   
-        nsName = basename(cstrFilename);        
-    }
-    
-    std::string nsname  = nsName;
-    
-    
     //  Here we go:
     
-    generateHeader(base, nsname, types, instances);
-    generateLinkDef(linkdefName, nsname, types);
-    generateCPP(cppName, headerName, nsname, types, instances);
-    
+    if (options.s_shm) {
+        checkPublishable(types, instances);
+    }
+    InstanceList resolved = resolveBranches(instances, options);
+    resolveStorage(resolved, options);
+    TypeList resolvedTypes(types);
+    resolvePrecision(resolvedTypes, resolved, options);
+    bool ok = generateHeader(base, nsname, resolvedTypes, resolved, options);
+    ok = generateLinkDef(linkdefName, nsname, resolvedTypes, resolved) && ok;
+    ok = generateCPP(cppName, headerName, nsname, resolvedTypes, resolved, options) && ok;
+    if (options.s_split) {
+        ok = generateClassCPPs(base, headerName, nsname, resolvedTypes, options.s_pod) && ok;
+    }
+    return ok;
 }
-
-void yyerror(const char* msg)
-{
-    usage(std::cerr, msg);
-}
\ No newline at end of file
@@ -0,0 +1,179 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  shmbench.cpp
+ *  @brief: Measure publishing events through shared memory (--shm).
+ */
+
+/**
+ * Generates Root code for a declaration file with --shm and compiles it
+ * with its dictionary and a driver.  The driver forks 0, 1, 2 and 4
+ * subscriber processes, then unpacks and publishes the events (it doesn't
+ * fill a tree).  Each subscriber checks every event it reads against one
+ * it unpacks itself.  For each number of subscribers it reports:
+ *   -  Events per second, from the first event published until every
+ *      subscriber has read the last one.
+ *   -  The number of subscribers that didn't read every event as it was
+ *      published.
+ *
+ * Usage:
+ *     shmbench ?parser? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ *  rootcling     - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const int EVENTS(1000000);
+static const int SUBSCRIBERS[] = {0, 1, 2, 4};
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "   array w[4]\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[512]\n";
+    f << "structarrayinstance det dets[64]\n";
+}
+/**
+ * writeDriver
+ *    Write the driver.  It takes the ring name, the number of events and
+ *    the number of subscribers on its command line and outputs the figures
+ *    described above on one line.
+ *
+ * @param filename - driver file.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n";
+    f << "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n#include <time.h>\n";
+    f << "#include <unistd.h>\n#include <sys/wait.h>\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "static void unpack(bench::EventContext& c, int e) {\n";
+    f << "   c.multiplicity = e % 64;\n";
+    f << "   for (int i = 0; i < 512; i += 1 + e % 5) c.adc[i] = (e + i) % 4096;\n";
+    f << "   for (int i = 0; i < 64; i += 1 + e % 3) {\n";
+    f << "      c.dets[i].e = (e*i) % 4096;\n";
+    f << "      c.dets[i].t = e;\n";
+    f << "      c.dets[i].w[i % 4] = i;\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "static int subscribe(const char* name, int events, int ready) {\n";
+    f << "   bench::EventSubscriber subscriber(name);\n";
+    f << "   if (write(ready, \"x\", 1) != 1) return 1;\n";
+    f << "   bench::EventContext* expected = new bench::EventContext;\n";
+    f << "   int n = 0, wrong = 0;\n";
+    f << "   while (const bench::EventContext* event = subscriber.Next()) {\n";
+    f << "      bench::SetupEvent(*expected);\n";
+    f << "      unpack(*expected, n++);\n";
+    f << "      if (memcmp(event, expected, sizeof(*event)) != 0) wrong++;\n";
+    f << "   }\n";
+    f << "   return (wrong != 0) || (n != events);\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   int events = atoi(argv[2]);\n";
+    f << "   int subscribers = atoi(argv[3]);\n";
+    f << "   bench::OpenPublisher(argv[1], 256);\n";
+    f << "   int ready[2];\n";
+    f << "   if (pipe(ready) < 0) return 1;\n";
+    f << "   for (int k = 0; k < subscribers; k++) {\n";
+    f << "      if (fork() == 0) _exit(subscribe(argv[1], events, ready[1]));\n";
+    f << "   }\n";
+    f << "   char c;\n";
+    f << "   for (int k = 0; k < subscribers; k++) {             // They've all attached.\n";
+    f << "      if (read(ready[0], &c, 1) != 1) return 1;\n";
+    f << "   }\n";
+    f << "   bench::EventContext* context = new bench::EventContext;\n";
+    f << "   double start = now();\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      bench::SetupEvent(*context);\n";
+    f << "      unpack(*context, e);\n";
+    f << "      bench::CommitEvent(*context);\n";
+    f << "   }\n";
+    f << "   bench::ClosePublisher();\n";
+    f << "   int failed = 0, status;\n";
+    f << "   while (wait(&status) > 0) {\n";
+    f << "      if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) failed++;\n";
+    f << "   }\n";
+    f << "   printf(\"%f %d\\n\", events/(now() - start), failed);\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 4 ? argv[4] : "rootcling";
+
+    std::string dir = makeBenchDirectory("shmbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+    run(generator + " --shm " + dir + "/bench " + dir + "/bench.gxir");
+    makeDictionary(rootcling, dir);
+    compile(
+        dir + "/driver", dir, dir + "/driver.cpp " + dir + "/bench.cpp " + dir + "/dict.cxx",
+        "-std=c++11 " + flags + " -lrt -pthread"
+    );
+
+    std::ostringstream ring;
+    ring << "/shmbench-" << getpid();
+    std::cout << EVENTS << " events\n";
+    std::cout << std::setw(12) << "subscribers" << std::setw(12) << "events/s"
+              << std::setw(8) << "failed" << std::endl;
+    for (size_t i = 0; i < sizeof(SUBSCRIBERS)/sizeof(SUBSCRIBERS[0]); i++) {
+        std::ostringstream command;
+        command << dir << "/driver " << ring.str() << " " << EVENTS << " " << SUBSCRIBERS[i];
+        std::istringstream result(run(command.str()));
+        double rate;
+        int    failed;
+        result >> rate >> failed;
+        std::cout << std::setw(12) << SUBSCRIBERS[i] << std::fixed << std::setprecision(0)
+                  << std::setw(12) << rate << std::setw(8) << failed << std::endl;
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
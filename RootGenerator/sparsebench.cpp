@@ -0,0 +1,217 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  sparsebench.cpp
+ *  @brief: Measure dense vs. zero suppressed (storage=sparse) output.
+ */
+
+/**
+ * Generates Root code for a declaration file with --context, once as is
+ * and once with --zero-suppress.  Each is compiled with its dictionary and
+ * a driver, which is run for several occupancies (the percentage of the
+ * array and struct array elements set in an event).  For each the driver
+ * reports:
+ *   -  Events per second written, including writing and closing the file.
+ *   -  Bytes of file per event.
+ *   -  For --zero-suppress, events per second read back with ReadEvent
+ *      and the number of events that didn't read back as they were
+ *      written.
+ *
+ * Usage:
+ *     sparsebench ?parser? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ *  rootcling     - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+
+static const int EVENTS(100000);
+static const int OCCUPANCIES[] = {1, 5, 25, 100};
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "   array w[4]\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[512]\n";
+    f << "structarrayinstance det dets[64]\n";
+}
+/**
+ * writeDriver
+ *    Write the driver.  It takes the output file, the number of events and
+ *    the occupancy on its command line and outputs the figures described
+ *    above on one line.  Compiled with -DREADER it reads the file back.
+ *
+ * @param filename - driver file.
+ */
+static void
+writeDriver(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "#include \"bench.h\"\n#include <TFile.h>\n#include <TTree.h>\n";
+    f << "#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n#include <cmath>\n";
+    f << "namespace bench { extern TTree* pTheTree; }\n";
+    f << "static double now() {\n";
+    f << "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n";
+    f << "   return t.tv_sec + t.tv_nsec*1.0e-9;\n";
+    f << "}\n";
+    f << "static int occupancy;\n";
+    f << "static bool hit(int e, int i) {               // Same hits every run.\n";
+    f << "   return (unsigned(e*2654435761u + i*40503u) >> 8) % 100 < unsigned(occupancy);\n";
+    f << "}\n";
+    f << "static void unpack(bench::EventContext& c, int e) {\n";
+    f << "   c.multiplicity = 0;\n";
+    f << "   for (int i = 0; i < 512; i++) {\n";
+    f << "      if (hit(e, i)) { c.adc[i] = (e + i) % 4096; c.multiplicity++; }\n";
+    f << "   }\n";
+    f << "   for (int i = 0; i < 64; i++) {\n";
+    f << "      if (hit(e, 1000 + i)) {\n";
+    f << "         c.dets[i].e = (e*i) % 4096;\n";
+    f << "         c.dets[i].t = e;\n";
+    f << "         c.dets[i].w[i % 4] = i;\n";
+    f << "      }\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "static bool same(double a, double b) {\n";
+    f << "   return std::isnan(a) ? std::isnan(b) : (a == b);\n";
+    f << "}\n";
+    f << "static bool same(const bench::EventContext& a, const bench::EventContext& b) {\n";
+    f << "   if (!same(a.multiplicity, b.multiplicity)) return false;\n";
+    f << "   for (int i = 0; i < 512; i++) if (!same(a.adc[i], b.adc[i])) return false;\n";
+    f << "   for (int i = 0; i < 64; i++) {\n";
+    f << "      if (!same(a.dets[i].e, b.dets[i].e) || !same(a.dets[i].t, b.dets[i].t)) return false;\n";
+    f << "      for (int j = 0; j < 4; j++) if (!same(a.dets[i].w[j], b.dets[i].w[j])) return false;\n";
+    f << "   }\n";
+    f << "   return true;\n";
+    f << "}\n";
+    f << "int main(int argc, char** argv) {\n";
+    f << "   int events = atoi(argv[2]);\n";
+    f << "   occupancy = atoi(argv[3]);\n";
+    f << "   bench::EventContext* context = new bench::EventContext;\n";
+    f << "   double start = now();\n";
+    f << "   TFile file(argv[1], \"RECREATE\");\n";
+    f << "   bench::Initialize(*context);\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      bench::SetupEvent(*context);\n";
+    f << "      unpack(*context, e);\n";
+    f << "      bench::CommitEvent(*context);\n";
+    f << "   }\n";
+    f << "   file.Write();\n";
+    f << "   Long64_t bytes = file.GetEND();\n";
+    f << "   file.Close();\n";
+    f << "   double written = events/(now() - start);\n";
+    f << "   double read = 0;\n";
+    f << "   int wrong = 0;\n";
+    f << "#ifdef READER\n";
+    f << "   start = now();\n";
+    f << "   TFile in(argv[1]);\n";
+    f << "   bench::InitializeReader(static_cast<TTree*>(in.Get(\"bench\")));\n";
+    f << "   for (int e = 0; e < events; e++) {\n";
+    f << "      bench::ReadEvent(e);\n";
+    f << "      bench::SetupEvent(*context);\n";
+    f << "      unpack(*context, e);\n";
+    f << "      if (!same(bench::instanceStruct, *context)) wrong++;\n";
+    f << "   }\n";
+    f << "   read = events/(now() - start);\n";
+    f << "#endif\n";
+    f << "   printf(\"%f %f %f %d\\n\", written, double(bytes)/events, read, wrong);\n";
+    f << "   return 0;\n";
+    f << "}\n";
+}
+/**
+ * report
+ *    Run a driver and output what it measured.
+ *
+ * @param storage   - how it was generated (dense or sparse).
+ * @param occupancy - percentage of elements set.
+ * @param command   - command that runs it.
+ */
+static void
+report(const char* storage, int occupancy, const std::string& command)
+{
+    std::istringstream result(run(command));
+    double written, fileBytes, read;
+    int    wrong;
+    result >> written >> fileBytes >> read >> wrong;
+    std::cout << std::setw(8) << storage << std::setw(10) << occupancy
+              << std::fixed << std::setprecision(0) << std::setw(12) << written
+              << std::setprecision(1) << std::setw(13) << fileBytes;
+    if (read > 0) {
+        std::cout << std::setprecision(0) << std::setw(12) << read << std::setw(8) << wrong;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 4 ? argv[4] : "rootcling";
+
+    std::string dir = makeBenchDirectory("sparsebench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDriver(dir + "/driver.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    std::cout << EVENTS << " events\n";
+    std::cout << std::setw(8) << "storage" << std::setw(10) << "occupancy"
+              << std::setw(12) << "events/s" << std::setw(13) << "file/event"
+              << std::setw(12) << "read/s" << std::setw(8) << "wrong" << std::endl;
+    const char* storage[] = {"dense", "sparse"};
+    const char* options[] = {" --context ", " --context --zero-suppress "};
+    const char* defines[] = {"", "-DREADER "};
+    for (int i = 0; i < 2; i++) {
+        std::string mdir = dir + "/" + storage[i];
+        run("mkdir " + mdir);
+        run(generator + options[i] + mdir + "/bench " + dir + "/bench.gxir");
+        makeDictionary(rootcling, mdir);
+        compile(
+            mdir + "/driver", mdir,
+            dir + "/driver.cpp " + mdir + "/bench.cpp " + mdir + "/dict.cxx", defines[i] + flags
+        );
+        for (size_t k = 0; k < sizeof(OCCUPANCIES)/sizeof(OCCUPANCIES[0]); k++) {
+            std::ostringstream command;
+            command << mdir << "/driver " << mdir << "/bench.root " << EVENTS << " "
+                    << OCCUPANCIES[k];
+            report(storage[i], OCCUPANCIES[k], command.str());
+        }
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,211 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  threadbench.cpp
+ *  @brief: Measure event throughput of --threads output vs. the number of threads.
+ */
+
+/**
+ * Generates Root code for a declaration file once as usual and once with
+ * --threads.  Each is compiled with its dictionary and a driver.  The
+ * serial driver fills a tree in a TFile; the threaded driver starts a
+ * number of threads, each of which fills its own tree, and the trees are
+ * merged into one file.  Each driver reports events per second including
+ * the time to write and close the file.  The threaded driver is run for
+ * 1, 2, 4... threads up to the number of hardware threads.
+ *
+ * Usage:
+ *     threadbench ?parser? ?rootgenerate? ?compile-flags? ?rootcling?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  rootgenerate  - path to the generator (defaults to ./rootgenerate).
+ *  compile-flags - compiler and linker flags for Root
+ *                  (defaults to `root-config --cflags --libs`).
+ *                  The compiler is $CXX or g++.
+ *  rootcling     - dictionary generator (defaults to rootcling).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <stdlib.h>
+
+static const int EVENTS(200000);              // Total over all threads.
+
+/**
+ * writeDeclarations
+ *
+ * @param filename - file to write.
+ */
+static void
+writeDeclarations(const std::string& filename)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct det {\n";
+    f << "   value e\n";
+    f << "   value t\n";
+    f << "}\n";
+    f << "value multiplicity\n";
+    f << "array adc[64]\n";
+    f << "structarrayinstance det dets[32]\n";
+}
+/**
+ * writeEvent
+ *    Write the code that makes an event; it's the same for both drivers.
+ *    The data depend on the event number so the file compresses about
+ *    the same regardless of how the events are split among threads.
+ *
+ * @param f - stream to write to.
+ */
+static void
+writeEvent(std::ostream& f)
+{
+    f << "static void event(int e) {\n";
+    f << "   bench::SetupEvent();\n";
+    f << "   bench::multiplicity = e % 32;\n";
+    f << "   for (int i = 0; i < 64; i += 1 + e % 3) bench::adc[i] = (e*i) % 4096;\n";
+    f << "   for (int i = 0; i < e % 32; i++) {\n";
+    f << "      bench::dets[i].e = (e + i) % 4096;\n";
+    f << "      bench::dets[i].t = (e - i) % 1024;\n";
+    f << "   }\n";
+    f << "   bench::CommitEvent();\n";
+    f << "}\n";
+}
+/**
+ * writeDrivers
+ *    Write the serial and threaded drivers.  They take the output file,
+ *    number of threads (threaded only) and number of events on their
+ *    command lines and output events per second.
+ *
+ * @param serial   - serial driver file.
+ * @param threaded - threaded driver file.
+ */
+static void
+writeDrivers(const std::string& serial, const std::string& threaded)
+{
+    const char* timer =
+        "static double now() {\n"
+        "   struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);\n"
+        "   return t.tv_sec + t.tv_nsec*1.0e-9;\n"
+        "}\n";
+
+    std::ofstream s(serial.c_str());
+    s << "#include \"bench.h\"\n#include <TFile.h>\n";
+    s << "#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n";
+    s << timer;
+    writeEvent(s);
+    s << "int main(int argc, char** argv) {\n";
+    s << "   int events = atoi(argv[2]);\n";
+    s << "   double start = now();\n";
+    s << "   TFile file(argv[1], \"RECREATE\");\n";
+    s << "   bench::Initialize();\n";
+    s << "   for (int e = 0; e < events; e++) event(e);\n";
+    s << "   file.Write();\n";
+    s << "   file.Close();\n";
+    s << "   printf(\"%f\\n\", events/(now() - start));\n";
+    s << "   return 0;\n";
+    s << "}\n";
+
+    std::ofstream t(threaded.c_str());
+    t << "#include \"bench.h\"\n";
+    t << "#include <thread>\n#include <vector>\n";
+    t << "#include <stdio.h>\n#include <stdlib.h>\n#include <time.h>\n";
+    t << timer;
+    writeEvent(t);
+    t << "static void worker(int first, int last) {\n";
+    t << "   bench::InitializeThread();\n";
+    t << "   for (int e = first; e < last; e++) event(e);\n";
+    t << "   bench::FinishThread();\n";
+    t << "}\n";
+    t << "int main(int argc, char** argv) {\n";
+    t << "   int threads = atoi(argv[2]);\n";
+    t << "   int events  = atoi(argv[3]);\n";
+    t << "   double start = now();\n";
+    t << "   bench::InitializeMerger(argv[1]);\n";
+    t << "   std::vector<std::thread> workers;\n";
+    t << "   for (int i = 0; i < threads; i++) {\n";
+    t << "      workers.push_back(std::thread(worker, i*events/threads, (i+1)*events/threads));\n";
+    t << "   }\n";
+    t << "   for (int i = 0; i < threads; i++) workers[i].join();\n";
+    t << "   bench::CloseMerger();\n";
+    t << "   printf(\"%f\\n\", events/(now() - start));\n";
+    t << "   return 0;\n";
+    t << "}\n";
+}
+/**
+ * report
+ *    Run a driver and output its throughput.
+ *
+ * @param mode    - what to call the run.
+ * @param threads - number of threads it uses.
+ * @param command - command that runs it.
+ */
+static void
+report(const char* mode, int threads, const std::string& command)
+{
+    std::istringstream result(run(command));
+    double rate;
+    result >> rate;
+    std::cout << std::setw(10) << mode << std::setw(10) << threads
+              << std::setw(14) << std::fixed << std::setprecision(0) << rate << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./rootgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "`root-config --cflags --libs`";
+    std::string rootcling = argc > 4 ? argv[4] : "rootcling";
+
+    std::string dir = makeBenchDirectory("threadbench");
+    writeDeclarations(dir + "/bench.decl");
+    writeDrivers(dir + "/serial.cpp", dir + "/threaded.cpp");
+    run(parser + " " + dir + "/bench.decl > " + dir + "/bench.gxir");
+
+    const char* modes[] = {"serial", "threaded"};
+    for (int i = 0; i < 2; i++) {
+        std::string mdir = dir + "/" + modes[i];
+        run("mkdir " + mdir);
+        run(generator + (i ? " --threads " : " ") + mdir + "/bench " + dir + "/bench.gxir");
+        makeDictionary(rootcling, mdir);
+        compile(
+            mdir + "/driver", mdir,
+            dir + "/" + modes[i] + ".cpp " + mdir + "/bench.cpp " + mdir + "/dict.cxx",
+            "-pthread " + flags
+        );
+    }
+
+    int hardware = std::thread::hardware_concurrency();
+    std::cout << EVENTS << " events, " << hardware << " hardware threads\n";
+    std::cout << std::setw(10) << "mode" << std::setw(10) << "threads"
+              << std::setw(14) << "events/s" << std::endl;
+    std::ostringstream serial;
+    serial << dir << "/serial/driver " << dir << "/serial/bench.root " << EVENTS;
+    report("serial", 1, serial.str());
+    for (int threads = 1; threads <= (hardware > 1 ? hardware : 1); threads *= 2) {
+        std::ostringstream threaded;
+        threaded << dir << "/threaded/driver " << dir << "/threaded/bench.root "
+                 << threads << " " << EVENTS;
+        report("threaded", threads, threaded.str());
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,112 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  sizebench.cpp
+ *  @brief: Measure how generated code size and compile time scale with struct array size.
+ */
+
+/**
+ * Generates declaration files with a struct array field and a struct
+ * array instance of 16, 64 ... elements, runs them through the parser and
+ * specgenerate and reports the size of the generated .cpp and how long
+ * the compiler takes to compile it.  Both should stay (roughly) flat
+ * as the element count grows.
+ *
+ * Usage:
+ *     sizebench ?parser? ?specgenerate? ?compile-flags? ?maxelements?
+ *
+ *  parser        - path to the parser (defaults to ../intermed/parser).
+ *  specgenerate  - path to the generator (defaults to ./specgenerate).
+ *  compile-flags - compiler flags; must include -I for the SpecTcl headers
+ *                  (defaults to -O2).  The compiler is $CXX or g++.
+ *  maxelements   - largest array to try (defaults to 4096).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/**
+ * writeDeclarations
+ *    Write a declaration file with a struct that has an elements element
+ *    struct array field and a top level elements element struct array
+ *    instance.
+ *
+ * @param filename - file to write.
+ * @param elements - number of array elements.
+ */
+static void
+writeDeclarations(const std::string& filename, unsigned elements)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+    f << "struct channel {\n";
+    f << "   value energy low=0 high=4095 bins=4096 units=channels\n";
+    f << "   value time\n";
+    f << "}\n";
+    f << "struct detector {\n";
+    f << "   structarray channel aux[" << elements << "]\n";
+    f << "   value total\n";
+    f << "}\n";
+    f << "structinstance detector det\n";
+    f << "structarrayinstance channel singles[" << elements << "]\n";
+}
+/**
+ * now
+ *   @return double - monotonic time in seconds.
+ */
+static double
+now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1.0e-9;
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser    = argc > 1 ? argv[1] : "../intermed/parser";
+    std::string generator = argc > 2 ? argv[2] : "./specgenerate";
+    std::string flags     = argc > 3 ? argv[3] : "-O2";
+    unsigned maxElements  = argc > 4 ? strtoul(argv[4], NULL, 0) : 4096;
+
+    std::string dir  = makeBenchDirectory("sizebench");
+    std::string decl = dir + "/bench.decl";
+    std::string base = dir + "/bench";
+
+    std::cout << std::setw(10) << "elements" << std::setw(12) << "cpp bytes"
+              << std::setw(14) << "compile secs" << std::endl;
+
+    for (unsigned elements = 16; elements <= maxElements; elements *= 4) {
+        writeDeclarations(decl, elements);
+        run(parser + " " + decl + " | " + generator + " " + base);
+        double start = now();
+        compile(base + ".o", dir, base + ".cpp", "-c " + flags);
+        double seconds = now() - start;
+        struct stat info;
+        stat((base + ".cpp").c_str(), &info);
+        std::cout << std::setw(10) << elements << std::setw(12) << info.st_size
+                  << std::setw(14) << std::fixed << std::setprecision(3) << seconds
+                  << std::endl;
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,96 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  specdriver.cpp
+ *  @brief: main for the standalone SpecTcl code generator.
+ */
+#include "specgenerate.h"
+#include "irfile.h"
+#include <iostream>
+#include <stdlib.h>
+
+/**
+ * usage:
+ *     Outputs an error message and program usage then exits in error.
+ * @param f - stream to which stuff are output.
+ * @param msg - message to output.
+ */
+static void usage(std::ostream& f , const char* msg)
+{
+    f << msg << std::endl;
+    f << "Usage\n";
+    f << "    specgenerate ?--split? ?--context? ?--batch=n? basname ?irfile?\n";
+    f << "Where:\n";
+    f << "  --split also writes a .cpp for each struct type and a list of the\n";
+    f << "  .cpp files (basename.mk) so they can be compiled in parallel.\n";
+    f << "  --context also generates an EventContext class holding the instances\n";
+    f << "  and API functions that take one.\n";
+    f << "  --batch=n also generates an EventBatch (n is for Root; SpecTcl batches\n";
+    f << "  hold one event).\n";
+    f << "  basename is the base name of the generated files.  Two files\n";
+    f << "  are created a header (basename.h) and code file (basename.cpp)\n";
+    f << "  irfile is a .gxir intermediate representation file; if omitted\n";
+    f << "  the intermediate representation is read from stdin.\n";
+    exit(EXIT_FAILURE);
+}
+
+/**
+ *  main
+ *     Entry point
+ *     Deserialize the intermediate representation of the parse
+ *     generate the header and implementation files.
+ *
+ *   Usage:
+ *       specgenerate ?--split? ?--context? ?--batch=n? outputbase ?irfile?
+ *
+ *   Files generated will be outputbase.h and outputbase.cpp
+ */
+int main (int argc, char** argv)
+{
+    GenerateOptions options;
+    int first = parseGenerateOptions(argc, argv, options);
+    if (first < 0) {
+        usage(std::cerr, "Unrecognized option");
+    }
+    argc -= first - 1;                    // Now as if there were no options.
+    argv += first - 1;
+    if ((argc != 2) && (argc != 3)) {
+        usage(std::cerr, "Incorrect number of command line parameters");
+    }
+    // Get the type and instance lists from the .gxir file or stdin.
+    
+    IrFile ir;
+    bool ok = argc == 3 ? ir.open(argv[2]) : ir.read(std::cin);
+    if (!ok) {
+        std::cerr << "specgenerate: " << ir.error() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    TypeList types;
+    InstanceList instances;
+    ir.load(nsName, types, instances);
+    
+    std::string base = argv[1];
+    if (!generateSpecTcl(base, namespaceFor(base), types, instances, options)) {
+        exit(EXIT_FAILURE);
+    }
+    
+    exit(EXIT_SUCCESS);
+}
+// Refernced by the stuff we use.
+void yyerror(const char* m) {
+    usage(std::cerr, m);
+}
@@ -17,40 +17,26 @@
 
 /** @file:  specgenerate.cpp
  *  @brief: Generate SpecTcl tree parameters etc. from intermediate representation.
+ *
+ *  This module is linked both into the standalone specgenerate program
+ *  (see specdriver.cpp) and directly into genx.
  */
 
-#include <instance.h>
-#include <definedtypes.h>
+#include "specgenerate.h"
+#include "outputfile.h"
 #include <iostream>
-#include <fstream>
 #include <stdlib.h>
 #include <libgen.h>
 #include <string.h>
 #include <math.h>
 
 
-const char* programVersionString("specgenerate version 2.0 (c) NSCL/FRIB");
+static const char* programVersionString("specgenerate version 2.0 (c) NSCL/FRIB");
 
 static inline int computeDigits(int n) {
     return (log10(n) + 1);
 }
 
-/**
- * usage:
- *     Outputs an error message and program usage then exits in error.
- * @param f - stream to which stuff are output.
- * @param msg - message to output.
- */
-static void usage(std::ostream& f , const char* msg)
-{
-    f << msg << std::endl;
-    f << "Usage\n";
-    f << "    specgenerate basname\n";
-    f << "Where:\n";
-    f << "  basename is the base name of the generated files.  Two files\n";
-    f << "  are created a header (basename.h) and code file (basename.cpp)\n";
-    exit(EXIT_FAILURE);
-}
 /**
  * commentHeader
  *    Create a comment header.
@@ -97,7 +83,10 @@ writeFieldDefinition(std::ostream& f, const Instance& field)
         f << "   struct " << field.s_typename << " " << field.s_name << ";\n";
         break;
     case structarray:
-        f << "   struct " << field.s_typename << " " << field.s_name << "[" << field.s_elementCount << "];\n";
+        // In an anonymous union so the constructor can build the elements in a loop:
+        
+        f << "   union { struct " << field.s_typename << " " << field.s_name << "["
+          << field.s_elementCount << "]; };\n";
         break;
     default:
         std::cerr << "**BUG: Invalid field type: " << field.s_type << std::endl;
@@ -105,6 +94,21 @@ writeFieldDefinition(std::ostream& f, const Instance& field)
         exit(EXIT_FAILURE);
     }
 }
+/**
+ * hasStructArray
+ *   @param fields - the fields of a type (or the instances of an EventContext).
+ *   @return bool - true if there are struct array fields.  Those are
+ *                  constructed and destroyed explicitly so the type needs
+ *                  a destructor.
+ */
+static bool
+hasStructArray(const FieldList& fields)
+{
+    for (FieldList::const_iterator p = fields.begin(); p != fields.end(); p++) {
+        if (p->s_type == structarray) return true;
+    }
+    return false;
+}
 /**
  * writeTypeDefinition
  *    Write a definition for a single type.  This is a struct whose fields
@@ -124,9 +128,52 @@ writeTypeDefinition(std::ostream& f, const TypeDefinition& t)
     f << "   void Initialize(const char* basename);\n";
     // We need a constructor to deal with vectors:
     f << "   " << t.s_typename << "(const char* basename);\n";
+    if (hasStructArray(t.s_fields)) {
+        f << "   ~" << t.s_typename << "();\n";
+    }
 
     f << "};\n\n";
 }
+/**
+ * writeContextClass
+ *    For --context, write the EventContext class.  Its members are
+ *    the instances with the same names (and tree parameter names) so
+ *    that unpacking code written for the instances works on a context.
+ *    The tree parameters of all contexts are bound to SpecTcl's event, as
+ *    tree parameters with the same name are, so two contexts would be the
+ *    same storage.  The class derives from SingleEventContext, whose
+ *    constructor throws std::logic_error if a context already exists.
+ *
+ *  @param f - the file stream to write to.
+ *  @param instances - the instances.
+ */
+static void
+writeContextClass(std::ostream& f, const InstanceList& instances)
+{
+    f << "\n/** The instances as a class so the unpacker can be given them **/\n\n";
+    f << "// SpecTcl binds tree parameters by name, so an EventContext is the same\n";
+    f << "// storage as the instances below (and as any other context would be).\n";
+    f << "// Only one may exist at a time:  constructing a second throws std::logic_error.\n\n";
+    f << "class SingleEventContext {\n";
+    f << "protected:\n";
+    f << "   SingleEventContext();\n";
+    f << "   ~SingleEventContext();\n";
+    f << "private:\n";
+    f << "   SingleEventContext(const SingleEventContext&);\n";
+    f << "   SingleEventContext& operator=(const SingleEventContext&);\n";
+    f << "   static bool s_exists;\n";
+    f << "};\n\n";
+    f << "class EventContext : private SingleEventContext {\n";
+    f << "public:\n";
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        writeFieldDefinition(f, *p);
+    }
+    f << "   EventContext();\n";
+    if (hasStructArray(instances)) {
+        f << "   ~EventContext();\n";
+    }
+    f << "};\n";
+}
 
 /** writeTypeDefs
  *   Write the type definitions.  Each type creates a struct definition
@@ -137,10 +184,10 @@ writeTypeDefinition(std::ostream& f, const TypeDefinition& t)
  * @param types - list of type definitions to write.
  */
 static void
-writeTypeDefs(std::ostream& f, const std::list<TypeDefinition>& types)
+writeTypeDefs(std::ostream& f, const TypeList& types)
 {
     f << "\n/** Data Structure definitions **/\n\n";
-    for (std::list<TypeDefinition>::const_iterator p = types.begin();
+    for (TypeList::const_iterator p = types.begin();
          p != types.end(); p++) {
         
         writeTypeDefinition(f, *p);
@@ -171,8 +218,8 @@ writeExternDecl(std::ostream& f, const Instance& i)
         f << "struct " << i.s_typename;
         break;
     case structarray:
-        f << "struct " << i.s_typename << " "
-            << i.s_name << "[" << i.s_elementCount << "];\n";
+        f << "struct " << i.s_typename << " (&"
+            << i.s_name << ")[" << i.s_elementCount << "];\n";
         return;              // since we need to add the index stuff.
     default:
         std::cerr << "*BUG - invalid  instance type  " << i.s_type << std::endl;
@@ -194,26 +241,53 @@ writeExternDecl(std::ostream& f, const Instance& i)
  *  @param instances -list of instanes for which we need to create externs.
  */
 static void
-writeExterns(std::ostream& f, const std::list<Instance>& instances)
+writeExterns(std::ostream& f, const InstanceList& instances)
 {
     f << "\n/** Actual instances that your unpacker fills in **/\n\n";
     f << "#ifndef IMPLEMENTATION_MODULE\n";
-    for (std::list<Instance>::const_iterator p = instances.begin();
+    for (InstanceList::const_iterator p = instances.begin();
          p != instances.end(); p++) {
         writeExternDecl(f, *p);
     }
     f << std::endl;
     f << "#endif";
 }
+/**
+ * writeBatchClass
+ *    For --batch, write the EventBatch class.  SpecTcl histograms each
+ *    event as it's unpacked and the tree parameters of every EventContext
+ *    are bound to the same SpecTcl parameters, so a batch only ever holds
+ *    one event:  size() is 1 whatever --batch says.  Asking for any other
+ *    slot throws std::out_of_range rather than losing the event.
+ *
+ * @param f - stream to which the class is written.
+ */
+static void
+writeBatchClass(std::ostream& f)
+{
+    f << "\n// A batch of events.  SpecTcl processes one event at a time so there's one slot.\n\n";
+    f << "class EventBatch {\n";
+    f << "public:\n";
+    f << "   EventContext& operator[](size_t k) {\n";
+    f << "      if (k != 0) throw std::out_of_range(\"SpecTcl EventBatch has one slot\");\n";
+    f << "      return m_slot;\n";
+    f << "   }\n";
+    f << "   size_t size() const { return 1; }\n";
+    f << "private:\n";
+    f << "   EventContext m_slot;\n";
+    f << "};\n";
+}
 /**
  * writeApi
  *    There's an API for this that's analyzer neutral.  We need to
  *    define the prototypes for it:
  *
  * @param f - stream to which to write the prototype definitions.
+ * @param context - true for --context:  add overloads that take an EventContext.
+ * @param batch - true for --batch:  add the EventBatch functions.
  */
 static void
-writeApi(std::ostream& f)
+writeApi(std::ostream& f, bool context, bool batch)
 {
     // There are three entry points that are provided.  Some targets
     // may use some others others.  These are:
@@ -227,6 +301,15 @@ writeApi(std::ostream& f)
     f << "void Initialize();\n";
     f << "void SetupEvent();\n";
     f << "void CommitEvent();\n";
+    if (context) {
+        f << "void Initialize(EventContext& context);\n";
+        f << "void SetupEvent(EventContext& context);\n";
+        f << "void CommitEvent(EventContext& context);\n";
+    }
+    if (batch) {
+        f << "void SetupBatch(EventBatch& batch);\n";
+        f << "void CommitBatch(EventBatch& batch, size_t n);\n";
+    }
     f << "\n";
 }
 /**
@@ -237,26 +320,29 @@ writeApi(std::ostream& f)
  *    it declares externs for each instance, and the prototypes for the
  *    API functions.
  *
- * @param base  - the output basename (used to create the namespace.)
+ * @param base  - the output basename.
+ * @param nsname - the namespace everything is generated in.
  * @param types - References the type list.
  * @param instances - References the instance list.
+ * @param context - true for --context:  also declare the EventContext class.
+ * @param batch - true for --batch:  also declare the EventBatch class.
+ * @return bool - true if the file was written.
  */
-static void generateHeader(
-    const std::string& base, const std::list<TypeDefinition>& types,
-    const std::list<Instance>& instances
+static bool generateHeader(
+    const std::string& base, const std::string& nsname, const TypeList& types,
+    const InstanceList& instances, bool context, bool batch
 )
 {
-    // Generate the filename for the header and the namespace name:
+    // Generate the filename for the header:
     
     std::string filename = base + ".h";    
-    std::string nsname   = nsName;
     char cstrBase[base.size() +1];
     strcpy(cstrBase, base.c_str());
     std::string baseFileName = basename(cstrBase);
     
     // Open the output file:
     
-    std::ofstream f(filename.c_str());
+    OutputFile f(filename);
     
     //  Throw out the comment header:
     
@@ -266,14 +352,26 @@ static void generateHeader(
     f << "#define " << baseFileName << "_h\n";
     f << "#include <TreeParameter.h>\n";   // We're generating tree parameter types.
     f << "#include <CTreeParameterVector.h>\n"; // We're using tree paramter vector (issue #1)
+    if (batch) {
+        f << "#include <cstddef>\n";
+    }
+    if (context) {
+        f << "#include <stdexcept>\n";
+    }
    
     // Everything we create is inside a namespace: nsname:
     
     f << "\nnamespace " << nsname  << "  {\n\n";
     
     writeTypeDefs(f, types);
+    if (context) {
+        writeContextClass(f, instances);
+    }
+    if (batch) {
+        writeBatchClass(f);
+    }
     writeExterns(f, instances);
-    writeApi(f);
+    writeApi(f, context, batch);
     
     f << "}\n";
    
@@ -282,7 +380,7 @@ static void generateHeader(
     
     // Close the output file before returning.
     
-    f.close();
+    return f.close();
 }
 /**
  * emitStructArrayInitialization
@@ -372,15 +470,15 @@ emitFieldInitialization(std::ostream& f, const Instance& i)
  *
  * @param f - output stream to which the code is written.
  * @param ns - Namespace in which everything lives.
- * @param types - List of derived types
+ * @param first, last - Range of derived types
  */
 static void
 emitInitializeMethods(
-   std::ostream& f, const std::string& ns, const std::list<TypeDefinition>& types
+   std::ostream& f, const std::string& ns,
+   TypeList::const_iterator first, TypeList::const_iterator last
 )
 {
-    for (std::list<TypeDefinition>::const_iterator p = types.begin();
-         p != types.end(); p++) {
+    for (TypeList::const_iterator p = first; p != last; p++) {
         
         f << "\n";
         f << "void " << ns << "::" << p->s_typename << "::Initialize(const char* basename)\n";
@@ -425,26 +523,15 @@ emitInstance(std::ostream& f, const Instance& i, const std::string& ns)
         break;
     case structarray:
         {
-            // For struct arrays we need to provid an initializer
-            // for all elmements of the array.  We'll
-            // provide the basename.n where n is the index
-            f << "struct " << i.s_typename << " "  << i.s_name << "[" << i.s_elementCount << "] = {\n";
-            int digits = computeDigits(i.s_elementCount);
-            char index[100];
-            char formatString[100];
-            sprintf(formatString, "%%0%dd", digits);
+            // The elements are constructed, with the names basename.n
+            // where n is the index, in a loop by a StructArray in
+            // structArrayStorage.  The instance refers to its elements.
             
-            for (int n = 0; n < i.s_elementCount; n++) {
-                sprintf(index, formatString, n);
-                f << i.s_typename << "(\"" << i.s_name << "." << index << "\")";
-                if (n+1 < i.s_elementCount) {
-                    // not last so emit a comma
-                    f << ",";
-                }
-                f << std::endl;
-                
-            }        
-            f << "};\n";
+            f << "namespace structArrayStorage { StructArray<struct " << i.s_typename << ", "
+              << i.s_elementCount << "> " << i.s_name << "(\"" << i.s_name << "\", "
+              << computeDigits(i.s_elementCount) << "); }\n";
+            f << "struct " << i.s_typename << " (&" << i.s_name << ")[" << i.s_elementCount
+              << "] = structArrayStorage::" << i.s_name << ".s_elements;\n";
         }
         return;                              // can't fall throgh.
     default:
@@ -454,6 +541,45 @@ emitInstance(std::ostream& f, const Instance& i, const std::string& ns)
     }
     f  << i.s_name << "(\"" << i.s_name << "\");\n";  // Construct with name.
 }
+/**
+ * emitStructArraySupport
+ *    Emit the templates used to build struct arrays.  Elements are
+ *    constructed at run time in a loop so that the generated code does
+ *    not grow with the number of elements.  Element n of an array named
+ *    basename is named basename.n where n is zero filled to digits digits.
+ *
+ * @param f - the stream to which the code is emitted.
+ */
+static void
+emitStructArraySupport(std::ostream& f)
+{
+    f << "namespace {\n";
+    f << "template <class T>\n";
+    f << "void constructElements(T* elements, int n, int digits, const std::string& basename)\n";
+    f << "{\n";
+    f << "   for (int i = 0; i < n; i++) {\n";
+    f << "      char index[16];\n";
+    f << "      sprintf(index, \"%0*d\", digits, i);\n";
+    f << "      new(elements + i) T((basename + \".\" + index).c_str());\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "template <class T>\n";
+    f << "void destroyElements(T* elements, int n)\n";
+    f << "{\n";
+    f << "   for (int i = 0; i < n; i++) {\n";
+    f << "      elements[i].~T();\n";
+    f << "   }\n";
+    f << "}\n";
+    f << "template <class T, int N>\n";
+    f << "union StructArray {\n";
+    f << "   T s_elements[N];\n";
+    f << "   StructArray(const char* basename, int digits) {\n";
+    f << "      constructElements(s_elements, N, digits, basename);\n";
+    f << "   }\n";
+    f << "   ~StructArray() { destroyElements(s_elements, N); }\n";
+    f << "};\n";
+    f << "}\n";
+}
 /**
  * emitInstances
  *   Emit the instance variables.  These are declared extern in the header.
@@ -463,9 +589,9 @@ emitInstance(std::ostream& f, const Instance& i, const std::string& ns)
  * @param ns    - namespace.
  */
 static void
-emitInstances(std::ostream& f, const std::list<Instance>& instances, const std::string& ns)
+emitInstances(std::ostream& f, const InstanceList& instances, const std::string& ns)
 {
-    for (std::list<Instance>::const_iterator p = instances.begin();
+    for (InstanceList::const_iterator p = instances.begin();
          p != instances.end(); p++) {
        emitInstance(f, *p, ns); 
     }
@@ -478,10 +604,10 @@ emitInstances(std::ostream& f, const std::list<Instance>& instances, const std::
  *
  *  @param f - stream to which the code is emitted.
  *  @param i - Instance reference.
- *  @param ns - namespace the instance lives in.
+ *  @param prefix - what the instance's name is qualified with (ns:: or context.).
  */
 static void
-initStructArrayInstance(std::ostream& f, const Instance& i, const std::string& ns)
+initStructArrayInstance(std::ostream& f, const Instance& i, const std::string& prefix)
 {
     int digits = computeDigits(i.s_elementCount);  // Number of digits in an index.
     
@@ -490,7 +616,7 @@ initStructArrayInstance(std::ostream& f, const Instance& i, const std::string& n
     f << "        char index[" << digits+1 << "];\n";
     f << "        sprintf(index, \"%0" << digits << "d\", i);\n";
     f << "        std::string elname = std::string(\"" << i.s_name << ".\") + index;\n";
-    f << "        " << ns << "::" << i.s_name  << "[i].Initialize(elname.c_str());\n";
+    f << "        " << prefix << i.s_name  << "[i].Initialize(elname.c_str());\n";
     f << "   }\n";
 }
 /**
@@ -499,14 +625,15 @@ initStructArrayInstance(std::ostream& f, const Instance& i, const std::string& n
  *
  * @param f - the stream to which code is written.
  * @param i - the instance being initialized.
- * @param ns - The namespace the instance lives in.
+ * @param prefix - what the instance's name is qualified with:  the
+ *                 namespace (ns::) or, for an EventContext, context.
  */
 static void
-initInstance(std::ostream& f, const Instance& i, const std::string& ns)
+initInstance(std::ostream& f, const Instance& i, const std::string& prefix)
 {
     switch (i.s_type) {
     case value:
-        f << "  " << ns << "::" << i.s_name << ".Initialize("
+        f << "  " << prefix << i.s_name << ".Initialize("
         << "\"" << i.s_name << "\", "
         << i.s_options.s_bins << ", "
         << i.s_options.s_low  << ", "
@@ -515,7 +642,7 @@ initInstance(std::ostream& f, const Instance& i, const std::string& ns)
         << ");\n";
         break;
     case array:
-        f << "  " << ns << "::" << i.s_name << ".Initialize("
+        f << "  " << prefix << i.s_name << ".Initialize("
           << "\"" << i.s_name << "\", "
           << i.s_options.s_bins << ", "
           << i.s_options.s_low  << ", "
@@ -524,17 +651,17 @@ initInstance(std::ostream& f, const Instance& i, const std::string& ns)
           << i.s_elementCount << ", 0);\n";
         break;
     case vector:
-        f << "   " << ns << "::" << i.s_name << ".setLow(" << i.s_options.s_low << ");\n";
-        f << "   " << ns << "::" << i.s_name << ".setHigh(" << i.s_options.s_high << ");\n";
-        f << "   " << ns << "::" << i.s_name << ".setBins(" << i.s_options.s_bins << ");\n";
-        f << "   " << ns << "::" << i.s_name << ".setUnits(\"" << i.s_options.s_units <<"\");\n";
+        f << "   " << prefix << i.s_name << ".setLow(" << i.s_options.s_low << ");\n";
+        f << "   " << prefix << i.s_name << ".setHigh(" << i.s_options.s_high << ");\n";
+        f << "   " << prefix << i.s_name << ".setBins(" << i.s_options.s_bins << ");\n";
+        f << "   " << prefix << i.s_name << ".setUnits(\"" << i.s_options.s_units <<"\");\n";
         break;
     case structure:
-        f << "  " << ns << "::" << i.s_name << ".Initialize("
+        f << "  " << prefix << i.s_name << ".Initialize("
           << "\"" << i.s_name << "\");\n";
         break;
     case structarray:
-        initStructArrayInstance(f, i, ns);
+        initStructArrayInstance(f, i, prefix);
         break;
     default:
         std::cerr << "*BUG unrecognized instance type: " << i.s_type << std::endl;
@@ -543,36 +670,69 @@ initInstance(std::ostream& f, const Instance& i, const std::string& ns)
     }
 }
 /**
- * emitSarrayInitializer
- *    Emit the initializers of a structure array element in a struct.
- *    This has formal parameters rather than actual parameterization.
- * 
- * @param f    - the output stream we're generating code into.
- * @param inst - references the field instance description caller ensures it's of type 
- *               structarray.
- * @param basename - This is a string that constructs the base name of the array elements.
- *                   it's something like "(std::string(basename) + fieldname)"
- *                   where fieldname is the name of our field.  Elements will
- *                   have names that look like:
- *                    "(((std::string(basename) + fieldname)).n).c_str()" where n is a multidigit
- *                   index number of an element. The number of digits is computed by 
- *                   computeDigits() above.
- * 
- * What we do is generate a field initializer for a constructor that is of the form
- *   {typename(indexname), ...}  In our case for readbility, we make each
- *   initialization inside the {} on one line.  The caller will put a ",\n" at the
- *   end of our initialization.
+ * emitConstructor
+ *   Emit the constructor (and, if there are struct array fields, the
+ *   destructor) of a struct type or of the EventContext.
+ *
+ *    @param f - stream on which output is done
+ *    @param cls - the class name qualified by the namespace.
+ *    @param name - the unqualified class name.
+ *    @param fields - the fields (the instances for the EventContext).
+ *    @param context - true for the EventContext.  Its constructor takes no
+ *                 basename; the fields' names are just their names.
+ * @note  struct array fields are constructed in a loop in the constructor body
+ *        (and destroyed in a loop by the destructor) so the code generated
+ *        doesn't depend on the number of elements.
  */
-static void 
-emitSArrayInitializer(std::ostream& f, const Instance& inst, const std::string& basename) {
-    int ndigits = computeDigits(inst.s_elementCount);
-    f << inst.s_name << "{\n";
-        for (int index = 0; index < inst.s_elementCount; index++) {
-            char indexString[1000];
-            sprintf(indexString, "%0*d", ndigits, index);
-            f << inst.s_typename << "((" << basename << " + \"." << indexString <<"\").c_str()),\n";
+static void
+emitConstructor(
+    std::ostream& f, const std::string& cls, const std::string& name,
+    const FieldList& fields, bool context
+) {
+    f << cls << "::" << name << (context ? "()" : "(const char* basename)");
+    const char* separator = " : \n";
+    for (const auto& field : fields) {
+        //Initialize the fields/substructures:
+        // We assume everything can be initialized with the name that
+        // arrays need the size in the tree parameter arra constructor.
+       
+        std::string fname="(std::string(basename) + \".";
+        fname += field.s_name;
+        fname += "\").c_str()";
+        if (context) {
+            fname = "\"" + field.s_name + "\"";
+        }
+        if (field.s_type == structarray) {
+            continue;                        // Done in the body.
+        }
+        f << separator;
+        if (field.s_type == array) {
+            f << field.s_name << "(" << fname << ", " << field.s_elementCount << ", 0)";
+        } else {
+            f << field.s_name << "(" << fname << ")";
         }
-    f << "}";
+        separator = ",\n";
+    }
+    f << "\n{";
+    for (const auto& field : fields) {
+        if (field.s_type == structarray) {
+            f << "\n   constructElements(" << field.s_name << ", " << field.s_elementCount
+              << ", " << computeDigits(field.s_elementCount) << ", "
+              << (context ? "\"" : "std::string(basename) + \".") << field.s_name << "\");";
+        }
+    }
+    f << (hasStructArray(fields) ? "\n}\n" : "}\n");
+
+    if (hasStructArray(fields)) {
+        f << cls << "::~" << name << "()\n";
+        f << "{\n";
+        for (const auto& field : fields) {
+            if (field.s_type == structarray) {
+                f << "   destroyElements(" << field.s_name << ", " << field.s_elementCount << ");\n";
+            }
+        }
+        f << "}\n";
+    }
 }
 /**
  * emitConstructors
@@ -580,46 +740,21 @@ emitSArrayInitializer(std::ostream& f, const Instance& inst, const std::string&
  *   We iterate through the types providing constructors for each struct type:
  * 
  *    @param f - stream on which output is done
- *    @param types - Type definitions.
+ *    @param first, last - Range of type definitions.
  *    @param ns- namespace our definitions live in.
  * @note  each struct defines a constructor so we can recursively construct those as well.
- * 
  */
 static void
-emitConstructors(std::ostream& f, const std::list<TypeDefinition>& types, const std::string& ns) {
-    for (const auto& t : types) {
+emitConstructors(
+    std::ostream& f, TypeList::const_iterator first, TypeList::const_iterator last,
+    const std::string& ns
+) {
+    for (TypeList::const_iterator pt = first; pt != last; pt++) {
+        const TypeDefinition& t(*pt);
         // Emit the constructor for the type:
 
         f << "// constructor for: " << t.s_typename << std::endl << std::endl;
-        f << ns << "::" << t.s_typename << "::" << t.s_typename << "(const char* basename) : " << std::endl;
-        for (const auto& field : t.s_fields) {
-            //Initialize the fields/substructures:
-            // We assume everything can be initialized with the name that
-            // With the exception of struct arrays, all fields initialize simply with the
-            // basename.  Arrays require a {} set of initializers like the instance
-            // construction of a struct array.
-            // arrays need the size in the tree parameter arra constructor.
-           
-            std::string fname="(std::string(basename) + \".";
-            fname += field.s_name;
-            fname += "\")";
-            if (field.s_type == structarray) {
-                emitSArrayInitializer(f, field, fname);
-            } else if (field.s_type == array) {
-                f << field.s_name << "(" << fname << ".c_str(), " << field.s_elementCount << ", 0)";
-            } else {
-                f << field.s_name << "(" << fname << ".c_str())";
-            }
-            // If this is not the last field, emit ,\n otherwise just an \n
-            if (field.s_name != t.s_fields.back().s_name) {
-                f << ",\n";
-            } else {
-                f << "\n";
-            }
-
-        }
-        
-        f << "{}\n";
+        emitConstructor(f, ns + "::" + t.s_typename, t.s_typename, t.s_fields, false);
     }
 }
 /**
@@ -631,9 +766,15 @@ emitConstructors(std::ostream& f, const std::list<TypeDefinition>& types, const
  * @param f - stream to which code is emitted.
  * @param instances - Instance list.
  * @param ns        - namespace our functions live in.
+ * @param context   - true for --context:  also emit the EventContext
+ *                    constructor and the overloads that take one.
+ * @param batch     - true for --batch:  also emit SetupBatch and CommitBatch.
  */
 static void
-emitApi(std::ostream& f, const std::list<Instance>& instances, const std::string& ns)
+emitApi(
+    std::ostream& f, const InstanceList& instances, const std::string& ns,
+    bool context, bool batch
+)
 {
     // First emit the ones that are empty:
     
@@ -643,49 +784,112 @@ emitApi(std::ostream& f, const std::list<Instance>& instances, const std::string
     // Initialize has to init each instance
     
     f << "void " << ns << "::Initialize()\n{\n";
-    for (std::list<Instance>::const_iterator p = instances.begin(); p != instances.end(); p++) {
-        initInstance(f, *p, ns);
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+        initInstance(f, *p, ns + "::");
     }
     f << "}\n";
+    if (context) {
+        f << "\n// The EventContext and the API functions that take one.\n\n";
+        f << "bool " << ns << "::SingleEventContext::s_exists(false);\n";
+        f << ns << "::SingleEventContext::SingleEventContext()\n{\n";
+        f << "   if (s_exists) {\n";
+        f << "      throw std::logic_error(\"SpecTcl tree parameters allow only one EventContext\");\n";
+        f << "   }\n";
+        f << "   s_exists = true;\n";
+        f << "}\n";
+        f << ns << "::SingleEventContext::~SingleEventContext() { s_exists = false; }\n";
+        emitConstructor(f, ns + "::EventContext", "EventContext", instances, true);
+        f << "void " << ns << "::SetupEvent(EventContext&) {}\n";
+        f << "void " << ns << "::CommitEvent(EventContext&) {}\n";
+        f << "void " << ns << "::Initialize(EventContext& context)\n{\n";
+        for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++) {
+            initInstance(f, *p, "context.");
+        }
+        f << "}\n";
+    }
+    if (batch) {
+        f << "void " << ns << "::SetupBatch(EventBatch&) {}\n";
+        f << "void " << ns << "::CommitBatch(EventBatch&, size_t n)\n{\n";
+        f << "   if (n > 1) throw std::out_of_range(\"SpecTcl EventBatch has one slot\");\n";
+        f << "}\n";
+    }
+}
+/**
+ * emitPrologue
+ *    Emits what goes at the top of each .cpp file: the comment header,
+ *    the include of the generated header and the struct array support.
+ *
+ *  @param f - stream to which code is emitted.
+ *  @param filename - name of the file being generated.
+ *  @param base - basename of the output files.
+ */
+static void
+emitPrologue(std::ostream& f, const std::string& filename, const std::string& base)
+{
+    char cstrFilename[base.size() + 1];
+    strcpy(cstrFilename, base.c_str());
+    std::string fname   = basename(cstrFilename);
+    std::string header  = fname + ".h";
+    
+    commentHeader(f, filename, "Actual data declarations and exectuable code");
+    f << "#define IMPLEMENTATION_MODULE\n";
+    f << "#include \"" << header <<"\"\n";
+    f << "#include <stdio.h>\n";
+    f << "#include <new>\n";
+    
+    f << "\n/** Struct array construction */\n\n";
+    emitStructArraySupport(f);
+}
+/**
+ * emitTypeImplementations
+ *    Emits the Initialize methods and constructors for a range of types.
+ *
+ *  @param f - stream to which code is emitted.
+ *  @param nsname - namespace in which all the functions will exist.
+ *  @param first, last - the types.
+ */
+static void
+emitTypeImplementations(
+    std::ostream& f, const std::string& nsname,
+    TypeList::const_iterator first, TypeList::const_iterator last
+)
+{
+    f << "\n/** Implementation of initialization methods */\n\n";
+    emitInitializeMethods(f, nsname, first, last);
+
+    f << "\n/** Implementation of  constructors -- where needed. */\n\n";
+    emitConstructors(f, first, last, nsname);
 }
 /**
  * generateCPP
  *    Generates the .cpp file.  This generates a file containing instances
  *    definitions as well as the implementations of the API functions.
+ *    Unless the types are split into their own files (see generateTypeCPPs)
+ *    the implementations of their methods go here too.
  *
- *  @param base - basename of the output file (the namespace name is derived from this).
+ *  @param base - basename of the output file.
+ *  @param nsname - namespace in which all the functions will exist.
  *  @param types - type definitions.
  *  @param instances - instance list.
+ *  @param withTypes - include the type implementations.
+ *  @param context - true for --context.
+ *  @param batch - true for --batch.
+ *  @return bool - true if the file was written.
  */
-static void
+static bool
 generateCPP(
-    const std::string& base, const std::list<TypeDefinition>& types,
-    const std::list<Instance>& instances
+    const std::string& base, const std::string& nsname, const TypeList& types,
+    const InstanceList& instances, bool withTypes, bool context, bool batch
 )
 {
-    // Generate the CPP filename and the namespace in which all the
-    // functions will exist:
-    
-    std::string filename = base + ".cpp";
-    char cstrFilename[base.size() + 1];
-    strcpy(cstrFilename, base.c_str());
-    std::string fname   = basename(cstrFilename);
-    std::string header  = fname + ".h";
-    std::string nsname  = nsName;
-    
     // open the output file:
     
-    std::ofstream f(filename.c_str());
+    std::string filename = base + ".cpp";
+    OutputFile f(filename);
     
     // Generate the file:
     
-    commentHeader(f, filename, "Actual data declarations and exectuable code");
-    f << "#define IMPLEMENTATION_MODULE\n";
-    f << "#include \"" << header <<"\"\n";
-    f << "#include <stdio.h>\n";
-    
-    // For each defined data type, we need to writes its Initialize
-    // method.
+    emitPrologue(f, filename, base);
     
     f << "\n/** Instance variables - unpack your stuff int these */ \n\n";
     
@@ -693,61 +897,74 @@ generateCPP(
     emitInstances(f, instances, nsname);
     f << "}\n";
     
-    f << "\n/** Implementation of initialization methods */\n\n";
-    emitInitializeMethods(f, nsname, types);
-
-    f << "\n/** Implementation of  constructors -- where needed. */\n\n";
-    emitConstructors(f, types, nsname);
+    // For each defined data type, we need to writes its Initialize
+    // method.
+    
+    if (withTypes) {
+        emitTypeImplementations(f, nsname, types.begin(), types.end());
+    }
     
     f << "\n/** Implementation of the API functions */ \n\n";
-    emitApi(f, instances, nsname);
+    emitApi(f, instances, nsname, context, batch);
     
-    f.close();
-        
+    return f.close();
 }
-
 /**
- *  main
- *     Entry point
- *     Deserialize the intermediate representation of the parse
- *     generate the header and implementation files.
- *
- *   Usage:
- *       specgenerate outputbase
+ * generateTypeCPPs
+ *    For --split, generate a .cpp for each type, base-typename.cpp, with
+ *    its method implementations.  These, along with base.cpp can be
+ *    compiled in parallel.  The files are listed in base.mk.
  *
- *   Files generated will be outputbase.h and outputbase.cpp
+ *  @param base - basename of the output files.
+ *  @param nsname - namespace in which all the functions will exist.
+ *  @param types - type definitions.
+ *  @return bool - true if the files were written.
  */
-int main (int argc, char** argv)
+static bool
+generateTypeCPPs(
+    const std::string& base, const std::string& nsname, const TypeList& types
+)
 {
-    if (argc != 2) {
-        usage(std::cerr, "Incorrect number of command line parameters");
+    std::vector<std::string> sources(1, base + ".cpp");
+    bool ok = true;
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++) {
+        std::string filename = base + "-" + p->s_typename + ".cpp";
+        OutputFile f(filename);
+        emitPrologue(f, filename, base);
+        emitTypeImplementations(f, nsname, p, p + 1);
+        ok = f.close() && ok;
+        sources.push_back(filename);
     }
-    // Deserialize the type and instance lists from stdin.
-    
-    std::list<TypeDefinition> types;
-    deserializeTypes(std::cin, types);
-    
-    std::list<Instance> instances;
-    deserializeInstances(std::cin, instances);
-    
-    std::string base = argv[1];
-    
-    // Set the namespace name if needed:
-    
-    if (nsName == "") {
-        char cstrFilename[base.size() + 1];
-        strcpy(cstrFilename, base.c_str());
-        nsName   = basename(cstrFilename);        // Since basename can modify.
+    return writeSourceList(base, sources) && ok;
+}
+
+/**
+ * generateSpecTcl
+ *    Generate the header and implementation files from the intermediate
+ *    representation.  Files generated will be base.h and base.cpp
+ *    (with --split also base-typename.cpp for each type and base.mk).
+ *
+ * @param base      - output file base name (may include a path).
+ * @param nsname    - namespace the generated code lives in.
+ * @param types     - the derived type definitions.
+ * @param instances - the instance definitions.
+ * @param options   - generation options.
+ * @return bool - true if all the files were written.
+ */
+bool
+generateSpecTcl(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options
+)
+{
+    bool batch = !options.s_batch.empty();
+    bool ok = generateHeader(base, nsname, types, instances, options.s_context, batch);
+    ok = generateCPP(
+        base, nsname, types, instances, !options.s_split, options.s_context, batch
+    ) && ok;
+    if (options.s_split) {
+        ok = generateTypeCPPs(base, nsname, types) && ok;
     }
-    
-    
-    generateHeader(base, types, instances);
-    generateCPP(base, types, instances);
-    
-    
-    exit(EXIT_SUCCESS);
+    return ok;
 }
-// Refernced by the stuff we use.
-void yyerror(const char* m) {
-    usage(std::cerr, m);
-}
\ No newline at end of file
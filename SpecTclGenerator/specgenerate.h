@@ -0,0 +1,34 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  specgenerate.h
+ *  @brief: Entry point to the SpecTcl code generator.
+ */
+#ifndef SPECGENERATE_H
+#define SPECGENERATE_H
+#include <instance.h>
+#include <definedtypes.h>
+#include <genoptions.h>
+#include <string>
+
+bool generateSpecTcl(
+    const std::string& base, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances,
+    const GenerateOptions& options = GenerateOptions()
+);
+
+#endif
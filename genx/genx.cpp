@@ -1,7 +1,30 @@
 #include "genxparams.h"
+#include "parsedecl.h"
+#include "preprocess.h"
+#include "definedtypes.h"
+#include "irfile.h"
+#include "outputfile.h"
+#include "contenthash.h"
+#include "genoptions.h"
+#include "rootgenerate.h"
+#include "rntuplegenerate.h"
+#include "columnargenerate.h"
+#include "capturegenerate.h"
+#include "specgenerate.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
 #include <string>
+#include <vector>
+#include <thread>
 
 #ifndef PREFIX
 #error "Must be compiled with -DPREFIX for installation directory"
@@ -9,6 +32,24 @@
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
+
+/**
+ * TargetJob
+ *    One back end to run: which target and the output basename
+ *    (including the target's output directory, if any).
+ */
+struct TargetJob {
+    enum enum_target s_target;
+    std::string      s_base;
+    std::string      s_directory;    // Target's directory to create (empty if none).
+    GenerateOptions  s_options;      // How the back end generates code.
+    uint64_t         s_key;          // Hash of everything the outputs depend on.
+    bool             s_upToDate;     // Outputs are current; no need to generate.
+    bool             s_failed;       // A file couldn't be written.
+    OutputLog        s_outputs;      // What the back end wrote.
+};
+typedef std::vector<TargetJob> TargetJobs;
+
 /**
  * usage:
  *    Output error message, program help and exit
@@ -23,54 +64,702 @@ usage(std::ostream& out, const char* msg)
     cmdline_parser_print_help();
     exit(EXIT_FAILURE);
 }
+/**
+ * targetName
+ *   @param target - a --target value.
+ *   @return const char* - the name of that target on the command line.
+ */
+static const char*
+targetName(enum enum_target target)
+{
+    switch (target) {
+    case target_arg_spectcl: return "spectcl";
+    case target_arg_rntuple: return "rntuple";
+    case target_arg_columnar: return "columnar";
+    case target_arg_capture:  return "capture";
+    default:                 return "root";
+    }
+}
+/**
+ * makeDirectories
+ *    Create a directory and any missing parents (like mkdir -p).
+ *
+ * @param path - the directory to create.
+ * @return bool - true if the directory exists on return.
+ */
+static bool
+makeDirectories(const std::string& path)
+{
+    for (size_t p = path.find('/', 1); ; p = path.find('/', p+1)) {
+        std::string dir = path.substr(0, p);
+        if (mkdir(dir.c_str(), 0777) && (errno != EEXIST)) {
+            std::cerr << "genx: Unable to create " << dir << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (p == std::string::npos) break;
+    }
+    return true;
+}
+/**
+ * setTuning
+ *    Set a TTree or RNTuple tuning option from the command line if it was given.
+ *
+ * @param options - (in/out) options to set it in.
+ * @param name    - option name.
+ * @param given   - number of times it was given.
+ * @param value   - its value.
+ */
+static void
+setTuning(GenerateOptions& options, const char* name, unsigned given, const char* value)
+{
+    if (given && !setTuningOption(options, name, value)) {
+        std::string msg = "Invalid --";
+        msg += name;
+        msg += " value: ";
+        msg += value;
+        usage(std::cerr, msg.c_str());
+    }
+}
+/**
+ * targetJobs
+ *    Pair each --target with its output basename.  With a single target
+ *    (and no --outdir), the basename is used as is.  Otherwise
+ *    each target's files go in its own directory: the corresponding
+ *    --outdir if one was given or a directory named after the target.
+ *    The files a target gets are thus the same as a separate
+ *    genx --target=t input outdir/basename run produces.
+ *
+ * @param parsedArgs - the parsed command line.
+ * @return TargetJobs - the back ends to run.
+ */
+static TargetJobs
+targetJobs(const gengetopt_args_info& parsedArgs)
+{
+    if (parsedArgs.outdir_given > parsedArgs.target_given) {
+        usage(std::cerr, "There are more --outdir directories than --target values");
+    }
+    TargetJobs result;
+    for (unsigned i = 0; i < parsedArgs.target_given; i++) {
+        TargetJob job;
+        job.s_target   = parsedArgs.target_arg[i];
+        job.s_key      = 0;
+        job.s_upToDate = false;
+        job.s_failed   = false;
+        job.s_options.s_split       = parsedArgs.split_flag;
+        job.s_options.s_sparseReset = parsedArgs.sparse_reset_flag;
+        job.s_options.s_singleBranch = parsedArgs.single_branch_flag;
+        job.s_options.s_threads = parsedArgs.threads_flag;
+        job.s_options.s_context = parsedArgs.context_flag || parsedArgs.shm_flag;
+        job.s_options.s_async = parsedArgs.async_flag;
+        job.s_options.s_pod = parsedArgs.pod_flag || parsedArgs.shm_flag;
+        job.s_options.s_zeroSuppress = parsedArgs.zero_suppress_flag;
+        job.s_options.s_shm = parsedArgs.shm_flag;
+        setTuning(
+            job.s_options, "basket-size", parsedArgs.basket_size_given, parsedArgs.basket_size_arg
+        );
+        setTuning(
+            job.s_options, "compression", parsedArgs.compression_given, parsedArgs.compression_arg
+        );
+        setTuning(
+            job.s_options, "compression-level", parsedArgs.compression_level_given,
+            parsedArgs.compression_level_arg
+        );
+        setTuning(
+            job.s_options, "auto-flush", parsedArgs.auto_flush_given, parsedArgs.auto_flush_arg
+        );
+        setTuning(
+            job.s_options, "auto-save", parsedArgs.auto_save_given, parsedArgs.auto_save_arg
+        );
+        setTuning(
+            job.s_options, "split-level", parsedArgs.split_level_given, parsedArgs.split_level_arg
+        );
+        setTuning(
+            job.s_options, "precision", parsedArgs.precision_given, parsedArgs.precision_arg
+        );
+        setTuning(
+            job.s_options, "async-depth", parsedArgs.async_depth_given, parsedArgs.async_depth_arg
+        );
+        setTuning(job.s_options, "batch", parsedArgs.batch_given, parsedArgs.batch_arg);
+        setTuning(
+            job.s_options, "rollover-bytes", parsedArgs.rollover_bytes_given,
+            parsedArgs.rollover_bytes_arg
+        );
+        setTuning(
+            job.s_options, "rollover-events", parsedArgs.rollover_events_given,
+            parsedArgs.rollover_events_arg
+        );
+        setTuning(
+            job.s_options, "rollover-seconds", parsedArgs.rollover_seconds_given,
+            parsedArgs.rollover_seconds_arg
+        );
+        setTuning(
+            job.s_options, "cluster-size", parsedArgs.cluster_size_given, parsedArgs.cluster_size_arg
+        );
+        setTuning(job.s_options, "page-size", parsedArgs.page_size_given, parsedArgs.page_size_arg);
+        setTuning(
+            job.s_options, "buffered-write", parsedArgs.buffered_write_given,
+            parsedArgs.buffered_write_arg
+        );
+        if (optionConflict(job.s_options)) {
+            usage(std::cerr, optionConflict(job.s_options));
+        }
+        for (unsigned j = 0; j < result.size(); j++) {
+            if (result[j].s_target == job.s_target) {
+                std::string msg = "Duplicate --target value: ";
+                usage(std::cerr, (msg + targetName(job.s_target)).c_str());
+            }
+        }
+        job.s_base = parsedArgs.inputs[1];
+        if (i < parsedArgs.outdir_given) {
+            job.s_directory = parsedArgs.outdir_arg[i];
+        } else if (parsedArgs.target_given > 1) {
+            job.s_directory = targetName(job.s_target);
+        }
+        if (!job.s_directory.empty()) {
+            job.s_base = job.s_directory + "/" + job.s_base;
+            job.s_directory = job.s_base.substr(0, job.s_base.rfind('/'));
+        }
+        result.push_back(job);
+    }
+    return result;
+}
+/**
+ * now
+ *   @return double - monotonic wall-clock time in seconds.
+ */
+static double
+now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1.0e-9;
+}
+/**
+ * runPipeline
+ *    The legacy compilation path:  Run the C preprocessor, the parser and
+ *    the backend as separate programs connected by pipes. The intermediate
+ *    representation is written by the parser as a .gxir file and read by the
+ *    back end.  This is done once for each target unless the parser's
+ *    output is being saved with --save-ir (or the input is already a .gxir
+ *    file) in which case the back ends read that file.
+ *
+ * @param parsedArgs - the parsed command line.
+ * @param jobs       - the targets to generate.
+ * @return bool - true if the pipeline succeeded.
+ */
+static bool
+runPipeline(const gengetopt_args_info& parsedArgs, const TargetJobs& jobs)
+{
+    // Figure out where all the skeletons are buried:
+
+    std::string bindir = TOSTRING(PREFIX);
+    bindir += "/bin";
+
+
+    // construct the front end command:
+
+    std::string parserCmd = bindir;
+    parserCmd += "/";
+    parserCmd += "parser";
+
+    std::string frontEnd = "cpp ";
+    frontEnd += parsedArgs.inputs[0];
+    frontEnd += " | ";
+    frontEnd += parserCmd;
+    frontEnd += " -";
+
+    std::string irFile;                   // If not empty the back ends read this.
+    if (IrFile::isIrFile(parsedArgs.inputs[0])) {
+        irFile = parsedArgs.inputs[0];
+    } else if (parsedArgs.save_ir_given) {
+        irFile = parsedArgs.save_ir_arg;
+        if (system((frontEnd + " > " + irFile).c_str()) != 0) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+
+        // Back end command depends on the target:
+
+        std::string backend = bindir +"/";
+        if (jobs[i].s_target == target_arg_spectcl) {
+            backend += "specgenerate";
+        } else if (jobs[i].s_target == target_arg_rntuple) {
+            backend += "rntuplegenerate";
+        } else if (jobs[i].s_target == target_arg_columnar) {
+            backend += "columnargenerate";
+        } else if (jobs[i].s_target == target_arg_capture) {
+            backend += "capturegenerate";
+        } else {
+            backend += "rootgenerate";
+        }
+        // Let's generate the command pipeline for the system(3) call:
+
+        std::string command;
+        if (irFile.empty()) {
+            command = frontEnd + " | ";
+        }
+        command += backend + " ";             // The selected backend.
+        command += generateOptionArgs(jobs[i].s_options);
+        command += jobs[i].s_base;
+        if (!irFile.empty()) {
+            command += " " + irFile;
+        }
+        if (system(command.c_str()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+/**
+ * runCpp
+ *    Run the C preprocessor over the declaration file, collecting all of
+ *    its output before anything is parsed.  That way a preprocessor
+ *    failure (e.g. a missing input file) is reported as such rather than
+ *    as a syntax error on empty input.
+ *
+ * @param input - path to the declaration file.
+ * @param text  - (out) the preprocessed text.
+ * @return bool - true if cpp ran and succeeded.
+ */
+static bool
+runCpp(const char* input, std::string& text)
+{
+    std::string command = "cpp ";
+    command += input;
+    FILE* cpp = popen(command.c_str(), "r");
+    if (!cpp) {
+        perror("genx: Unable to run the C preprocessor");
+        return false;
+    }
+    std::vector<char> buffer(8192);
+    size_t n;
+    while ((n = fread(buffer.data(), 1, buffer.size(), cpp)) > 0) {
+        text.append(buffer.data(), n);
+    }
+    int status = pclose(cpp);
+    if (status != 0) {
+        std::cerr << "genx: The C preprocessor failed on " << input << std::endl;
+        return false;
+    }
+    return true;
+}
+/**
+ * preprocess
+ *    Expand the #defines and #includes in the declaration file.  Unless
+ *    --cpp was given this is done by the built-in preprocessor rather
+ *    than by running cpp.
+ *
+ * @param parsedArgs - the parsed command line.
+ * @param text       - (out) the preprocessed text.
+ * @return bool - true on success.
+ */
+static bool
+preprocess(const gengetopt_args_info& parsedArgs, std::string& text)
+{
+    const char* input = parsedArgs.inputs[0];
+    if (parsedArgs.cpp_flag) {
+        return runCpp(input, text);
+    }
+    Preprocessor preprocessor;
+    if (!preprocessor.process(input, text)) {
+        std::cerr << "genx: Preprocessing " << input << " failed\n";
+        return false;
+    }
+    return true;
+}
+/**
+ * parse
+ *    Parse the preprocessed declarations.  The results are left in
+ *    typeList, instanceList and nsName.
+ *
+ * @param text - the preprocessed declaration file.
+ * @return bool - true on success (parse errors exit from yyerror).
+ */
+static bool
+parse(const std::string& text)
+{
+    FILE* preprocessed = fmemopen(const_cast<char*>(text.data()), text.size(), "r");
+    if (!preprocessed) {
+        perror("genx: Unable to open the preprocessed declarations");
+        return false;
+    }
+    bool parsed = parseDeclarations(preprocessed);
+    fclose(preprocessed);
+    return parsed;
+}
+/**
+ * loadIr
+ *    Load previously parsed declarations from a .gxir file rather than
+ *    parsing them again.  nsName is set from the file.
+ *
+ * @param path      - the .gxir file.
+ * @param types     - (out) the struct definitions.
+ * @param instances - (out) the instances.
+ * @return bool - true on success.
+ */
+static bool
+loadIr(const char* path, TypeList& types, InstanceList& instances)
+{
+    IrFile ir;
+    if (!ir.open(path)) {
+        std::cerr << "genx: " << ir.error() << std::endl;
+        return false;
+    }
+    ir.load(nsName, types, instances);
+    return true;
+}
+/**
+ * saveIr
+ *    Write the declarations to a .gxir file.
+ *
+ * @param path      - the file to write.
+ * @param types     - the struct definitions.
+ * @param instances - the instances.
+ * @return bool - true on success.
+ */
+static bool
+saveIr(const char* path, const TypeList& types, const InstanceList& instances)
+{
+    std::ostringstream f;
+    if (!writeIr(f, nsName, types, instances) || !writeIfChanged(path, f.str())) {
+        std::cerr << "genx: Unable to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+/**
+ * readIr
+ *    Read the bytes of a .gxir input file.  These take the place of the
+ *    preprocessed text in the cache key.
+ *
+ * @param path - the file.
+ * @param text - (out) its contents.
+ * @return bool - true on success.
+ */
+static bool
+readIr(const char* path, std::string& text)
+{
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    std::ostringstream contents;
+    if (!f || !(contents << f.rdbuf())) {
+        std::cerr << "genx: Unable to read " << path << std::endl;
+        return false;
+    }
+    text = contents.str();
+    return true;
+}
+/**
+ * generatorIdentity
+ *    Identifies the code generators: the hash of the genx executable
+ *    itself, which contains the back ends and their version strings.
+ *    Any new build of genx therefore invalidates the cache.
+ *
+ * @return uint64_t - the hash (0 if the executable can't be read).
+ */
+static uint64_t
+generatorIdentity()
+{
+    static uint64_t identity = 0;
+    static bool     computed = false;
+    if (!computed) {
+        std::ifstream f("/proc/self/exe", std::ios::in | std::ios::binary);
+        std::ostringstream contents;
+        if (f && (contents << f.rdbuf())) {
+            identity = contentHash(contents.str());
+        }
+        computed = true;
+    }
+    return identity;
+}
+/**
+ * jobKey
+ *    Compute the cache key for a target: a hash of the generator identity,
+ *    the target, the output base name (which also determines the
+ *    namespace), the generation options and the source (preprocessed
+ *    declarations or .gxir file).
+ *
+ * @param job    - the target.
+ * @param source - the source text.
+ * @return uint64_t - the key.
+ */
+static uint64_t
+jobKey(const TargetJob& job, const std::string& source)
+{
+    std::ostringstream key;
+    key << "genx " << std::hex << generatorIdentity() << ' ' << targetName(job.s_target)
+        << ' ' << job.s_base << ' ' << generateOptionArgs(job.s_options) << contentHash(source);
+    return contentHash(key.str());
+}
+/**
+ * stampPath
+ *   @param job - a target.
+ *   @return std::string - the file that remembers the target's last generation.
+ */
+static std::string
+stampPath(const TargetJob& job)
+{
+    return job.s_base + ".genx-stamp";
+}
+/**
+ * dependencies
+ *    List the files the preprocessed text came from using the line markers
+ *    the preprocessor left in it.  Pseudo files such as <built-in>
+ *    are left out.
+ *
+ * @param text - the preprocessed text.
+ * @return std::vector<std::string> - the files, in the order first seen.
+ */
+static std::vector<std::string>
+dependencies(const std::string& text)
+{
+    std::vector<std::string> result;
+    std::set<std::string>    seen;
+    for (size_t pos = 0; pos < text.size(); pos = text.find('\n', pos), pos += (pos != std::string::npos)) {
+        if (text[pos] != '#') continue;
+        size_t eol   = text.find('\n', pos);
+        std::string line = text.substr(pos, eol == std::string::npos ? std::string::npos : eol - pos);
+        size_t open  = line.find('"');
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if ((close == std::string::npos) || (line.find_first_of("0123456789") > open)) continue;
+        std::string file = line.substr(open + 1, close - open - 1);
+        if (file.empty() || (file[0] == '<')) continue;
+        if (seen.insert(file).second) {
+            result.push_back(file);
+        }
+    }
+    return result;
+}
+/**
+ * makeQuote
+ *   @param path - a file name.
+ *   @return std::string - the file name escaped for use in a Makefile rule.
+ */
+static std::string
+makeQuote(const std::string& path)
+{
+    std::string result;
+    for (size_t i = 0; i < path.size(); i++) {
+        if ((path[i] == ' ') || (path[i] == '#')) result += '\\';
+        if (path[i] == '$') result += '$';
+        result += path[i];
+    }
+    return result;
+}
+/**
+ * writeDepfile
+ *    Write output-base.d: a make rule that makes the target's outputs
+ *    depend on the files they were generated from, like cc -MD -MP does.
+ *
+ * @param job  - the target.
+ * @param deps - the source files.
+ * @return bool - true on success.
+ */
+static bool
+writeDepfile(const TargetJob& job, const std::vector<std::string>& deps)
+{
+    std::ostringstream rule;
+    for (size_t i = 0; i < job.s_outputs.size(); i++) {
+        rule << (i ? " " : "") << makeQuote(job.s_outputs[i].s_path);
+    }
+    rule << ":";
+    for (size_t i = 0; i < deps.size(); i++) {
+        rule << " \\\n  " << makeQuote(deps[i]);
+    }
+    rule << "\n";
+    for (size_t i = 0; i < deps.size(); i++) {
+        rule << "\n" << makeQuote(deps[i]) << ":\n";
+    }
+    return writeIfChanged(job.s_base + ".d", rule.str());
+}
+/**
+ * generate
+ *    Run one back end over the type and instance lists.  The back
+ *    ends only read the lists so several can run at once.  The files
+ *    written are recorded in the job and in its stamp file.  If a file
+ *    couldn't be written the job is marked failed and no stamp is
+ *    written, so the next run generates the target again.
+ *
+ * @param job       - the target to generate.
+ * @param types     - the struct definitions.
+ * @param instances - the instances.
+ */
+static void
+generate(TargetJob& job, const TypeList& types, const InstanceList& instances)
+{
+    std::string nsname = namespaceFor(job.s_base);
+    bool        ok;
+    job.s_outputs.clear();
+    setOutputLog(&job.s_outputs);
+    if (job.s_target == target_arg_spectcl) {
+        ok = generateSpecTcl(job.s_base, nsname, types, instances, job.s_options);
+    } else if (job.s_target == target_arg_rntuple) {
+        ok = generateRNTuple(job.s_base, nsname, types, instances, job.s_options);
+    } else if (job.s_target == target_arg_columnar) {
+        ok = generateColumnar(job.s_base, nsname, types, instances, job.s_options);
+    } else if (job.s_target == target_arg_capture) {
+        ok = generateCapture(job.s_base, nsname, types, instances, job.s_options);
+    } else {
+        ok = generateRoot(job.s_base, nsname, types, instances, job.s_options);
+    }
+    setOutputLog(0);
+
+    if (!ok) {
+        remove(stampPath(job).c_str());
+        job.s_failed = true;
+        return;
+    }
+    GenerationStamp stamp;
+    stamp.s_key     = job.s_key;
+    stamp.s_outputs = job.s_outputs;
+    job.s_failed    = !stamp.write(stampPath(job));
+}
+/**
+ * compileInProcess
+ *    Preprocess the declaration file and parse it once (or, if the input
+ *    is a .gxir file, just load it).  The in-memory
+ *    type and instance lists are then handed directly to the back end of
+ *    each target.  When there are several targets, each back end runs on
+ *    its own thread.
+ *
+ *    Targets whose stamp shows that their outputs were generated from the
+ *    same source by the same generators (and haven't been touched since)
+ *    are skipped; if all are, the declarations aren't even parsed.
+ *
+ * @param parsedArgs - the parsed command line.
+ * @param jobs       - the targets to generate.
+ * @return bool - true on success (parse errors exit from yyerror);  false
+ *                if an input can't be read or a target's files can't all
+ *                be written.
+ */
+static bool
+compileInProcess(const gengetopt_args_info& parsedArgs, TargetJobs& jobs)
+{
+    const char*              input = parsedArgs.inputs[0];
+    bool                     irInput = IrFile::isIrFile(input);
+    std::string              source;
+    std::vector<std::string> deps;
+    if (irInput) {
+        if (!readIr(input, source)) {
+            return false;
+        }
+        deps.push_back(input);
+    } else {
+        if (!preprocess(parsedArgs, source)) {
+            return false;
+        }
+        deps = dependencies(source);
+    }
+
+    TargetJobs::iterator outOfDate = jobs.end();
+    for (TargetJobs::iterator p = jobs.begin(); p != jobs.end(); p++) {
+        GenerationStamp stamp;
+        p->s_key      = jobKey(*p, source);
+        p->s_upToDate = !parsedArgs.force_flag &&
+            stamp.read(stampPath(*p)) && stamp.current(p->s_key);
+        if (p->s_upToDate) {
+            p->s_outputs = stamp.s_outputs;
+        } else if (outOfDate == jobs.end()) {
+            outOfDate = p;
+        }
+    }
+
+    if ((outOfDate != jobs.end()) || parsedArgs.save_ir_given) {
+        TypeList            irTypes;
+        InstanceList        irInstances;
+        const TypeList*     types     = &typeList.entries();
+        const InstanceList* instances = &instanceList.entries();
+        if (irInput) {
+            if (!loadIr(input, irTypes, irInstances)) {
+                return false;
+            }
+            types     = &irTypes;
+            instances = &irInstances;
+        } else if (!parse(source)) {
+            return false;
+        }
+        if (parsedArgs.save_ir_given && !saveIr(parsedArgs.save_ir_arg, *types, *instances)) {
+            return false;
+        }
+
+        std::vector<std::thread> workers;
+        for (TargetJobs::iterator p = jobs.begin(); p != jobs.end(); p++) {
+            if (p->s_upToDate) continue;
+            if (p == outOfDate) continue;             // Done on this thread below.
+            workers.push_back(
+                std::thread(generate, std::ref(*p), std::cref(*types), std::cref(*instances))
+            );
+        }
+        if (outOfDate != jobs.end()) {
+            generate(*outOfDate, *types, *instances);
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (jobs[i].s_failed) {
+                return false;
+            }
+        }
+    }
+
+    if (parsedArgs.depfile_flag) {
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (!writeDepfile(jobs[i], deps)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
 
 /**
  * main
  *    Entry point.
  *    -   Need an input file, a basename for the output file and
- *    -   a --target option value.
+ *    -   one or more --target option values.
  */
 int main(int argc, char** argv)
 {
     gengetopt_args_info parsedArgs;
     cmdline_parser(argc, argv, &parsedArgs);
-    
+
     // ensure we have the right number of 'inputs'
-    
+
     if (parsedArgs.inputs_num != 2) {
         usage(
             std::cerr,
             "Incorrect number of non-option parameters.  Need an input file and output basename");
     }
-    // Figure out where all the skeletons are buried:
-    
-    std::string bindir = TOSTRING(PREFIX);
-    bindir += "/bin";
-    
-    
-    // construct the front end command:
-    
-    std::string parserCmd = bindir;
-    parserCmd += "/";
-    parserCmd += "parser";
-    
-    // Back end command depends on the target:
-    
-    std::string backend = bindir +"/";
-    if (parsedArgs.target_arg == target_arg_spectcl) {
-        backend += "specgenerate";
+    TargetJobs jobs = targetJobs(parsedArgs);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!jobs[i].s_directory.empty() && !makeDirectories(jobs[i].s_directory)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = now();
+    bool   ok = true;
+    if (parsedArgs.pipeline_flag) {
+        ok = runPipeline(parsedArgs, jobs);
     } else {
-        backend += "rootgenerate";
+        ok = compileInProcess(parsedArgs, jobs);
     }
-    // Let's generate the command pipeline for the system(3) call:
-    
-    std::string command = "cpp ";
-    command += parsedArgs.inputs[0];
-    command += " | ";
-    command += parserCmd;
-    command += " - | ";
-    command += backend + " ";             // The selected backend.
-    command += parsedArgs.inputs[1];      // second command is the basename.
-    
-    system(command.c_str());
-}
\ No newline at end of file
+    if (parsedArgs.timing_flag) {
+        unsigned upToDate = 0;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            upToDate += jobs[i].s_upToDate;
+        }
+        std::cerr << "genx: " << (parsedArgs.pipeline_flag ? "pipeline" : "in-process")
+                  << " compilation took " << (now() - start) << " seconds";
+        if (upToDate) {
+            std::cerr << " (" << upToDate << " of " << jobs.size() << " targets up to date)";
+        }
+        std::cerr << std::endl;
+    }
+    if (!ok) {
+        std::cerr << "genx: compilation of " << parsedArgs.inputs[0] << " failed\n";
+    }
+    exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
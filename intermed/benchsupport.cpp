@@ -0,0 +1,114 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  benchsupport.cpp
+ *  @brief: Implement what the *bench programs share.
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * run
+ *    Run a shell command, exiting if it fails.
+ *
+ * @param command - the command.
+ * @return std::string - what it wrote to stdout.
+ */
+std::string
+run(const std::string& command)
+{
+    FILE* p = popen(command.c_str(), "r");
+    std::string output;
+    char buffer[1024];
+    size_t n;
+    while (p && ((n = fread(buffer, 1, sizeof(buffer), p)) > 0)) {
+        output.append(buffer, n);
+    }
+    if (!p || (pclose(p) != 0)) {
+        std::cerr << "Failed: " << command << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return output;
+}
+/**
+ * makeBenchDirectory
+ *    Make a new directory in /tmp for a bench's files, exiting if that
+ *    can't be done.
+ *
+ * @param name - the bench's name;  the directory is /tmp/nameXXXXXX.
+ * @return std::string - the directory's path.
+ */
+std::string
+makeBenchDirectory(const std::string& name)
+{
+    std::string path = "/tmp/" + name + "XXXXXX";
+    std::vector<char> tmpl(path.begin(), path.end());
+    tmpl.push_back('\0');
+    if (!mkdtemp(tmpl.data())) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    return std::string(tmpl.data());
+}
+/**
+ * removeBenchDirectory
+ *    Remove the directory and everything the bench put in it.
+ *
+ * @param dir - the directory from makeBenchDirectory.
+ */
+void
+removeBenchDirectory(const std::string& dir)
+{
+    run("rm -rf " + dir);
+}
+/**
+ * makeDictionary
+ *    Run rootcling on the Root code generated as dir/bench, making
+ *    dir/dict.cxx.
+ *
+ * @param rootcling - the rootcling command.
+ * @param dir       - the directory the code was generated in.
+ */
+void
+makeDictionary(const std::string& rootcling, const std::string& dir)
+{
+    run("cd " + dir + " && " + rootcling + " -f dict.cxx bench.h bench-linkdef.h");
+}
+/**
+ * compile
+ *    Compile and link a program with $CXX (or g++) -O2, exiting if that
+ *    fails.
+ *
+ * @param program - the program to make.
+ * @param include - directory searched for headers (where the code was generated).
+ * @param sources - the source files, separated by spaces.
+ * @param flags   - more compiler and linker flags (defines, Root's flags,
+ *                  libraries).  They follow the sources.
+ */
+void
+compile(
+    const std::string& program, const std::string& include, const std::string& sources,
+    const std::string& flags
+)
+{
+    const char* cxx = getenv("CXX");
+    std::string compiler = cxx ? cxx : "g++";
+    run(compiler + " -O2 -o " + program + " -I" + include + " " + sources + " " + flags);
+}
@@ -0,0 +1,36 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Giordano Cerriza
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  benchsupport.h
+ *  @brief: What the *bench programs share: running commands, a scratch directory and compiling.
+ */
+#ifndef BENCHSUPPORT_H
+#define BENCHSUPPORT_H
+#include <string>
+
+std::string run(const std::string& command);         // Its stdout;  exits if it fails.
+
+std::string makeBenchDirectory(const std::string& name);   // /tmp/nameXXXXXX
+void removeBenchDirectory(const std::string& dir);
+
+void makeDictionary(const std::string& rootcling, const std::string& dir);
+void compile(
+    const std::string& program, const std::string& include, const std::string& sources,
+    const std::string& flags
+);
+
+#endif
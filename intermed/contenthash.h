@@ -0,0 +1,54 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  contenthash.h
+ *  @brief: Hash of file contents used to key caches.
+ */
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * contentHash
+ *    64 bit FNV-1a hash of a block of bytes.  This is not a cryptographic
+ *    hash; it's used to notice that two files (or two versions of one file)
+ *    have the same contents.
+ *
+ * @param data   - the bytes to hash.
+ * @param nBytes - number of bytes.
+ * @return uint64_t - the hash.
+ */
+inline uint64_t
+contentHash(const void* data, size_t nBytes)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < nBytes; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+inline uint64_t
+contentHash(const std::string& s)
+{
+    return contentHash(s.data(), s.size());
+}
+
+#endif
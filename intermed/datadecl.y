@@ -16,6 +16,7 @@ static int checkIndex(double);
 static void verifyTypeField(const char* type, const char* field);
 static void verifyTypeInstance(const char* type, const char *instance);
 static void warnIfTypeName(const std::string& inst);
+static std::string numberString(double);
 %}
 %union {
     double number;
@@ -47,7 +48,13 @@ static void warnIfTypeName(const std::string& inst);
 
 %%
 
-/** Production rules */
+/** Production rules
+ *
+ *  Note that the lists (struct declarations, members, options and instances)
+ *  are all left recursive.  This keeps the parser stack depth constant
+ *  regardless of how many declarations there are;  right recursion
+ *  would need a stack entry per list element.
+ */
 
 input_file: input_text | namespace_spec input_text
     ;
@@ -59,7 +66,7 @@ namespace_spec: NAMESPACE NAME
         nsName = $2;
     }
     
-struct_decls: struct_decl | struct_decl struct_decls
+struct_decls: struct_decl | struct_decls struct_decl
     ;
 
 
@@ -74,7 +81,7 @@ struct_name_part: STRUCT NAME
 struct_member_part: LCURLY struct_members RCURLY
     ;
             
-struct_members: struct_member | struct_member struct_members
+struct_members: struct_member | struct_members struct_member
     {
     }
 struct_member: value_field | array_field | vector_field | substruct | substruct_array
@@ -104,10 +111,10 @@ value_fieldname_with_options: value_fieldname valueoptions
         currentInstance.s_options.Reinit();
     }
 
-valueoptions:   valueoption | valueoption valueoptions
+valueoptions:   valueoption | valueoptions valueoption
     ;
     
-valueoption: low_option | high_option | bins_option | units_option
+valueoption: low_option | high_option | bins_option | units_option | attribute
     ;
     
 low_option: LOW EQUALS NUMBER
@@ -131,6 +138,24 @@ units_option: UNITS EQUALS NAME
         free($3);                    // Malloced by strdup.
     }
 
+/* Attributes are back end options for any instance or field, e.g.
+   layout=columns on a struct array. */
+
+attributes: attribute | attributes attribute
+    ;
+
+attribute: NAME EQUALS NAME
+    {
+        addAttribute($1, $3);
+        free($1);
+        free($3);
+    }
+    | NAME EQUALS NUMBER
+    {
+        addAttribute($1, numberString($3));
+        free($1);
+    }
+
 vector_field: vector_fieldname | vector_fieldname_with_options
     ;
 
@@ -175,7 +200,13 @@ array_field_with_options: simple_array_field valueoptions
         currentInstance.s_options.Reinit();
     }
     
-substruct: STRUCT NAME NAME
+substruct: simple_substruct | simple_substruct attributes
+    {
+        setLastFieldOptions(currentInstance.s_options);
+        currentInstance.s_options.Reinit();
+    }
+
+simple_substruct: STRUCT NAME NAME
     {
         // It's an error not to have the name of the substruct defined
         // yet:
@@ -189,7 +220,13 @@ substruct: STRUCT NAME NAME
         addField(newField);
     }
 
-substruct_array: STRUCTARRAY NAME NAME LBRACK NUMBER RBRACK
+substruct_array: simple_substruct_array | simple_substruct_array attributes
+    {
+        setLastFieldOptions(currentInstance.s_options);
+        currentInstance.s_options.Reinit();
+    }
+
+simple_substruct_array: STRUCTARRAY NAME NAME LBRACK NUMBER RBRACK
     {
         verifyTypeField($2, $3);
         int count = checkIndex($5);
@@ -201,7 +238,7 @@ substruct_array: STRUCTARRAY NAME NAME LBRACK NUMBER RBRACK
         addField(newInstance);
     }
 
-instances: instance | instance instances
+instances: instance | instances instance
     ;
     
     
@@ -286,10 +323,16 @@ optioned_array: simple_array valueoptions
         currentInstance.s_options.Reinit();
     }
 
-struct_instance: STRUCTINSTANCE NAME NAME
+struct_instance: simple_struct_instance | simple_struct_instance attributes
+    {
+        instanceList.back().s_options = currentInstance.s_options;
+        currentInstance.s_options.Reinit();
+    }
+
+simple_struct_instance: STRUCTINSTANCE NAME NAME
     {
         verifyTypeInstance($2, $3);
-        currentInstance.s_options.Reinit();   // Don't actully have options but...
+        currentInstance.s_options.Reinit();   // Attributes (if any) come later.
         currentInstance.s_type = structure;
         currentInstance.s_name = $3;
         free ($3);
@@ -300,10 +343,16 @@ struct_instance: STRUCTINSTANCE NAME NAME
         addInstance(currentInstance);
     }
 
-structarray_instance: STRUCTARRAYINSTANCE NAME NAME LBRACK NUMBER RBRACK
+structarray_instance: simple_structarray_instance | simple_structarray_instance attributes
+    {
+        instanceList.back().s_options = currentInstance.s_options;
+        currentInstance.s_options.Reinit();
+    }
+
+simple_structarray_instance: STRUCTARRAYINSTANCE NAME NAME LBRACK NUMBER RBRACK
     {
         verifyTypeInstance($2, $3);
-        currentInstance.s_options.Reinit();   // Don't actully have options but...
+        currentInstance.s_options.Reinit();   // Attributes (if any) come later.
         currentInstance.s_type = structarray;
         currentInstance.s_name = $3;
         free($3);
@@ -332,6 +381,16 @@ static int checkIndex(double value)
     return count;
 }
 
+// Attribute values are kept as written; numbers come to us as doubles.
+
+static std::string numberString(double value)
+{
+    std::ostringstream s;
+    s.precision(15);
+    s << value;
+    return s.str();
+}
+
 // Verify the existence of a struct type field if not yyerror.
 
 static void verifyTypeField(const char* ty, const char* f)
@@ -20,19 +20,22 @@
  */
 
 #include "definedtypes.h"
-#include <set>
+#include <unordered_map>
 #include <sstream>
+#include <libgen.h>
+#include <vector>
 
 
-// The global type definition list:
+// The global type definition table (hashed by type name):
 
-std::list<TypeDefinition> typeList;
+SymbolTable<TypeDefinition> typeList;
 static TypeDefinition     dummy;
 Instance                  currentField;
 std::string nsName("");
 
-static std::set<std::string> typeNames;
-static std::set<std::string> fieldNames;
+// Field name -> position in the fields of the struct being accumulated:
+
+static std::unordered_map<std::string, size_t> fieldIndex;
 
 extern void yyerror(const char* msg);
 /*-----------------------------------------------------------------------------
@@ -49,10 +52,8 @@ extern void yyerror(const char* msg);
 static const TypeDefinition&
 findDefinition(const char* name)
 {
-    for(std::list<TypeDefinition>::const_iterator p = typeList.begin();
-           p != typeList.end(); p++) {
-       if (p->s_typename == name) return *p; 
-    }
+    const TypeDefinition* p = typeList.find(name);
+    if (p) return *p;
     yyerror("BUG - findDefinition - no such type");
     return dummy;
 }
@@ -60,12 +61,12 @@ findDefinition(const char* name)
  * fieldExists
  *   @param  name - name of the field to lookup.
  *   @return bool - true if there's a field of that name in the struct being
- *                  accumulated (fieldnames set).
+ *                  accumulated (fieldIndex map).
  */
 static bool
 fieldExists(const std::string& name)
 {
-    return fieldNames.count(name) > 0;
+    return fieldIndex.count(name) > 0;
 }
 /**
  * findField
@@ -77,9 +78,8 @@ fieldExists(const std::string& name)
 static const Instance&
 findField(TypeDefinition& t, const std::string& name)
 {
-    for (FieldList::const_iterator p = t.s_fields.begin(); p != t.s_fields.end(); p++ ){
-        if (p->s_name == name) return *p;
-    }
+    std::unordered_map<std::string, size_t>::const_iterator p = fieldIndex.find(name);
+    if (p != fieldIndex.end()) return t.s_fields[p->second];
     yyerror("BUG - findField - no such field");
     return currentInstance;
 }
@@ -140,12 +140,11 @@ TypeDefinition::deserialize(std::istream& f)
 {
     s_fields.clear();               // Empty set of fields.
     s_typename = deserializeString(f);
-    unsigned nFields;
+    unsigned nFields = 0;
     f.read(reinterpret_cast<char*>(&nFields), sizeof(unsigned));
-    for (int i = 0; i < nFields; i++) {
-        Instance inst;
-        inst.deserialize(f);
-        s_fields.push_back(inst);
+    for (unsigned i = 0; f && (i < nFields); i++) {
+        s_fields.push_back(Instance());
+        s_fields.back().deserialize(f);
     }
     
     return f;
@@ -153,11 +152,10 @@ TypeDefinition::deserialize(std::istream& f)
 /**
  * newStruct:
  *   - Checks that the type is not a duplicate and yyerror's if it is.
- *   - Adds a instance to the typeList
+ *   - Adds a instance to the typeList (which also indexes its name).
  *   - Initializes the lastFieldOptions.
  *   - Inits the options that are in the currentField.
- *   - Empties the fieldNames set.
- *   - Adds the name of the type to the typeNames set.
+ *   - Empties the fieldIndex map.
  * 
  * @param structName - Name of the new struct being created.
  */
@@ -173,11 +171,10 @@ newStruct(const char* structName)
     } else {
         TypeDefinition newType;
         newType.s_typename = structName;
-        typeList.push_back(newType);
+        typeList.add(newType.s_typename, newType);
         currentField.s_options.Reinit();
         currentInstance.s_options.Reinit();
-        typeNames.insert(std::string(structName));
-        fieldNames.clear();                // New field namespace for each struct.
+        fieldIndex.clear();                // New field namespace for each struct.
     }
 }
 /**
@@ -185,7 +182,7 @@ newStruct(const char* structName)
  *    - Ensure the field is uniquely named in the struct.
  *    - Add the field to the strut.
  *    - Initialize the field options (those'll get set later if needed).
- *    - Add the field name to the set of fieldnames for this struct.
+ *    - Index the field name in the fieldIndex map for this struct.
  *
  *  @param fieldDef - const reference to the field to add.
  */
@@ -198,13 +195,13 @@ addField(const Instance& fieldDef)
         std::stringstream errorMessage;
         errorMessage  << "Struct " << t.s_typename << " already has a field named "
             << fieldDef.s_name << " defined as:\n";
-        const Instance& p = findField(t, fieldDef.s_name);  //TODO: findField.
+        const Instance& p = findField(t, fieldDef.s_name);
         errorMessage << p.toString() << std::endl;
         yyerror(errorMessage.str().c_str());
     } else {
+        fieldIndex[fieldDef.s_name] = t.s_fields.size();
         t.s_fields.push_back(fieldDef);
         t.s_fields.back().s_options.Reinit();
-        fieldNames.insert(fieldDef.s_name);
     }
 }
 
@@ -231,7 +228,7 @@ setLastFieldOptions(const ValueOptions& opts)
 bool
 structExists(const char* name)
 {
-    return typeNames.count(std::string(name)) > 0;    
+    return typeList.exists(name);
 }
 
 
@@ -253,7 +250,7 @@ serializeTypes(std::ostream& f)
 
     unsigned n = typeList.size();
     f.write(reinterpret_cast<char*>(&n), sizeof(unsigned));
-    for (std::list<TypeDefinition>::const_iterator p = typeList.begin();
+    for (SymbolTable<TypeDefinition>::const_iterator p = typeList.begin();
          p != typeList.end(); p++) {
         p->serialize(f);
     }
@@ -271,7 +268,7 @@ serializeTypes(std::ostream& f)
  *              
  */
 std::istream&
-deserializeTypes(std::istream& f, std::list<TypeDefinition>& tlist)
+deserializeTypes(std::istream& f, TypeList& tlist)
 {
     // Deserialize the namespace:
     
@@ -279,12 +276,32 @@ deserializeTypes(std::istream& f, std::list<TypeDefinition>& tlist)
     
     // Get the number of types to deserialize:
     
-    unsigned n;
+    unsigned n = 0;
     f.read(reinterpret_cast<char*>(&n), sizeof(n));
-    for (int i =0; i < n; i++) {
-        TypeDefinition t;
-        t.deserialize(f);
-        tlist.push_back(t);
+    for (unsigned i =0; f && (i < n); i++) {
+        tlist.push_back(TypeDefinition());
+        tlist.back().deserialize(f);
     }
     return f;
 }
+
+/**
+ * namespaceFor
+ *    Determine the namespace generated code goes in.  If the declaration
+ *    file had a namespace directive, that's nsName.  Otherwise it's
+ *    the output base name with any leading path stripped off,
+ *    e.g. ~/rootstuff/base gives base.
+ *
+ * @param base - output file base name.
+ * @return std::string - the namespace name.
+ */
+std::string
+namespaceFor(const std::string& base)
+{
+    if (nsName != "") {
+        return nsName;
+    }
+    std::vector<char> cstrFilename(base.begin(), base.end()); // all because basename(3)
+    cstrFilename.push_back('\0');                             // can modify its parameter.
+    return basename(cstrFilename.data());
+}
@@ -24,7 +24,8 @@
 #ifndef DEFINEDTYPES_H
 #define DEFINEDTYPES_H
 #include "instance.h"           // There's overlap in the needs.
-#include <list>
+#include "symboltable.h"
+#include <vector>
 #include <string>
 #include <ostream>
 #include <istream>
@@ -35,7 +36,7 @@
 // as the information required to keep track of an instance.  Therefore:
 
 
-typedef std::list<Instance> FieldList;
+typedef std::vector<Instance> FieldList;
 
 struct TypeDefinition {
     std::string s_typename;
@@ -45,6 +46,10 @@ struct TypeDefinition {
     std::istream& deserialize(std::istream& f);
 };
 
+// Ordered type list as handed to the code generators:
+
+typedef std::vector<TypeDefinition> TypeList;
+
 // These are operations needed by struct definers:
 // These are a bit whacky because of the order in which productions complete.
 
@@ -53,11 +58,16 @@ void addField(const Instance& fieldDef);           // Add field to last structur
 void setLastFieldOptions(const ValueOptions& opts); // Add option to last field added.
 bool structExists(const char* name);
 std::ostream& serializeTypes(std::ostream& f) ;
-std::istream& deserializeTypes(std::istream& f, std::list<TypeDefinition>& tlist);
+std::istream& deserializeTypes(std::istream& f, TypeList& tlist);
 
-extern std::list<TypeDefinition> typeList;
+extern SymbolTable<TypeDefinition> typeList;
 extern Instance currentField;
 
 extern std::string nsName;
 
+// Namespace generated code lives in: nsName or, if the declaration file
+// did not specify one, the basename of the output file base.
+
+std::string namespaceFor(const std::string& base);
+
 #endif
\ No newline at end of file
@@ -20,32 +20,38 @@
  */
 #include "instance.h"
 #include "definedtypes.h"
+#include "irfile.h"
 #include <iostream>
 #include <stdlib.h>
 
 /**
- *  We deserialize from stdin and dump back out in text form to stdout.
+ *  We read the .gxir intermediate representation from stdin (or the
+ *  file named on the command line) and dump back out in text form to stdout.
  */
 
 int main(int argc, char** argv)
 {
-    std::list<TypeDefinition> types;
-    deserializeTypes(std::cin, types);
-    
-    std::list<Instance> instances;
-    deserializeInstances(std::cin, instances);
+    IrFile ir;
+    bool ok = argc > 1 ? ir.open(argv[1]) : ir.read(std::cin);
+    if (!ok) {
+        std::cerr << "***ERROR** " << ir.error() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    TypeList types;
+    InstanceList instances;
+    ir.load(nsName, types, instances);
     
     // Now dump:
     
     std::cout << "Namespace: " << nsName << std::endl;
     std::cout << "----------------- types ---------------\n";
-    for (std::list<TypeDefinition>::const_iterator p = types.begin(); p != types.end(); p++)
+    for (TypeList::const_iterator p = types.begin(); p != types.end(); p++)
     {
         std::cout << "==\n";
         std::cout << p->toString() << std::endl;
     }
     std::cout << "---------------- instances ------------\n";
-    for (std::list<Instance>::const_iterator p = instances.begin(); p != instances.end(); p++)
+    for (InstanceList::const_iterator p = instances.begin(); p != instances.end(); p++)
     {
         std::cout << "==\n";
         std::cout << p->toString() << std::endl;
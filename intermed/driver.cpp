@@ -2,22 +2,16 @@
 #include <stdio.h>
 #include <iostream>
 #include <stdlib.h>
-#include <list>
 #include "instance.h"
 #include "definedtypes.h"
-
-#include "datadecl.tab.h"
-
-
-
-extern FILE* yyin;
-unsigned lineNum(1);
+#include "parsedecl.h"
+#include "irfile.h"
 
 
 static void dumpTypes()
 {
     std::cerr << "Defined data types: \n";
-    for (std::list<TypeDefinition>::const_iterator p = typeList.begin();
+    for (SymbolTable<TypeDefinition>::const_iterator p = typeList.begin();
          p != typeList.end(); p++) {
         
         std::cerr << "-------------------------\n";
@@ -28,7 +22,7 @@ static void dumpTypes()
 static void dumpInstances()
 {
     std::cerr << "Instancelist dump: \n";
-    for (std::list<Instance>::iterator p = instanceList.begin(); p != instanceList.end(); p++) {
+    for (SymbolTable<Instance>::const_iterator p = instanceList.begin(); p != instanceList.end(); p++) {
         std::cerr << "-----------------------------\n";
         std::cerr << p->toString();
     }
@@ -57,30 +51,16 @@ int main(int argc, char** argv)
         exit(EXIT_FAILURE);
     }
     
-    yyin = declarations;              // Set the FLEX input stream:
-    int result = yyparse();
-    int exitCode = result ? EXIT_FAILURE : EXIT_SUCCESS;
-    if (!result) {
+    bool ok = parseDeclarations(declarations);
+    int exitCode = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (ok) {
         
-        serializeTypes(std::cout);
-        serializeInstances(std::cout);
+        // The intermediate representation goes to stdout as a .gxir file:
+        
+        if (!writeIr(std::cout, nsName, typeList.entries(), instanceList.entries())) {
+            std::cerr << "Failed to write the intermediate representation\n";
+            exitCode = EXIT_FAILURE;
+        }
     }
     exit(exitCode);
-}
-
-
-/**
- *  Bison error reporting hook:
- **/
-void yyerror(const char *s)
-{
-    std::cerr << "*** error: " << lineNum << " : " << s << std::endl;
-    exit(EXIT_FAILURE);
-}
-
-// Non fatal error
-
-void yywarning(const char* s)
-{
-    std::cerr << "** warning: " << lineNum << " : " << s << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,256 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  genoptions.cpp
+ *  @brief: Parse and format back end generation options.
+ */
+#include "genoptions.h"
+#include <string.h>
+#include <stdlib.h>
+
+/**
+ * isInteger
+ *   @param value - a string.
+ *   @param min   - smallest value allowed.
+ *   @param max   - largest value allowed.
+ *   @return bool - true if value is an integer in [min, max].
+ */
+static bool
+isInteger(const std::string& value, long long min, long long max)
+{
+    if (value.empty()) return false;
+    char* end;
+    long long n = strtoll(value.c_str(), &end, 10);
+    return (*end == '\0') && (n >= min) && (n <= max);
+}
+/**
+ * tuningOption
+ *    Locate the member for a TTree or RNTuple tuning option (or --async-depth,
+ *    --batch or a --rollover option).
+ *
+ * @param options - the options.
+ * @param name    - option name without the leading --, e.g. basket-size.
+ * @return std::string* - pointer to the member or null if name isn't one.
+ */
+static std::string*
+tuningOption(GenerateOptions& options, const std::string& name)
+{
+    if (name == "basket-size")       return &options.s_basketSize;
+    if (name == "compression")       return &options.s_compression;
+    if (name == "compression-level") return &options.s_compressionLevel;
+    if (name == "auto-flush")        return &options.s_autoFlush;
+    if (name == "auto-save")         return &options.s_autoSave;
+    if (name == "split-level")       return &options.s_splitLevel;
+    if (name == "precision")         return &options.s_precision;
+    if (name == "async-depth")       return &options.s_asyncDepth;
+    if (name == "batch")             return &options.s_batch;
+    if (name == "rollover-bytes")    return &options.s_rolloverBytes;
+    if (name == "rollover-events")   return &options.s_rolloverEvents;
+    if (name == "rollover-seconds")  return &options.s_rolloverSeconds;
+    if (name == "cluster-size")      return &options.s_clusterSize;
+    if (name == "page-size")         return &options.s_pageSize;
+    if (name == "buffered-write")    return &options.s_bufferedWrite;
+    return 0;
+}
+
+/**
+ * constructor
+ *    Defaults generate what the back ends always have.
+ */
+GenerateOptions::GenerateOptions() :
+    s_split(false), s_sparseReset(false), s_singleBranch(false), s_threads(false),
+    s_context(false), s_async(false), s_pod(false), s_zeroSuppress(false), s_shm(false)
+{}
+
+/**
+ * setTuningOption
+ *    Set one of the TTree or RNTuple tuning options if its value is valid.
+ *
+ * @param options - (in/out) the options.
+ * @param name    - option name without the leading --, e.g. basket-size.
+ * @param value   - its value.
+ * @return bool   - false if there's no such option or the value's invalid.
+ */
+bool
+setTuningOption(GenerateOptions& options, const std::string& name, const std::string& value)
+{
+    std::string* option = tuningOption(options, name);
+    bool ok = false;
+    if (name == "basket-size") {
+        ok = (value == "auto") || isInteger(value, 1, 0x7fffffff);
+    } else if (name == "compression") {
+        ok = (value == "zlib") || (value == "lzma") || (value == "lz4") || (value == "zstd");
+    } else if (name == "compression-level") {
+        ok = isInteger(value, 0, 9);
+    } else if ((name == "auto-flush") || (name == "auto-save")) {
+        ok = isInteger(value, -0x7fffffffffffffffLL, 0x7fffffffffffffffLL);
+    } else if (name == "split-level") {
+        ok = isInteger(value, 0, 99);
+    } else if (name == "precision") {
+        ok = (value == "double") || (value == "float") || (value == "bins");
+    } else if (name == "async-depth") {
+        ok = isInteger(value, 1, 4096);
+    } else if (name == "batch") {
+        ok = isInteger(value, 1, 65536);
+        options.s_context = options.s_context || ok;   // Batches are of EventContexts.
+    } else if ((name == "rollover-bytes") || (name == "rollover-events")
+               || (name == "rollover-seconds")) {
+        ok = isInteger(value, 1, 0x7fffffffffffffffLL);
+    } else if (name == "cluster-size") {
+        ok = isInteger(value, 1, 0x7fffffffffffffffLL);
+    } else if (name == "page-size") {
+        ok = isInteger(value, 1, 0x7fffffff);
+    } else if (name == "buffered-write") {
+        ok = (value == "on") || (value == "off");
+    }
+    if (ok) {
+        *option = value;
+    }
+    return ok;
+}
+
+/**
+ * parseGenerateOptions
+ *    Parse the options at the front of a standalone generator's command line.
+ *
+ * @param argc    - number of command line words.
+ * @param argv    - the command line words.
+ * @param options - (out) the options.
+ * @return int - index in argv of the first word that isn't an option or
+ *               -1 if there's an option we don't know.
+ */
+int
+parseGenerateOptions(int argc, char** argv, GenerateOptions& options)
+{
+    int i;
+    for (i = 1; (i < argc) && (strncmp(argv[i], "--", 2) == 0); i++) {
+        if (strcmp(argv[i], "--split") == 0) {
+            options.s_split = true;
+        } else if (strcmp(argv[i], "--sparse-reset") == 0) {
+            options.s_sparseReset = true;
+        } else if (strcmp(argv[i], "--single-branch") == 0) {
+            options.s_singleBranch = true;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            options.s_threads = true;
+        } else if (strcmp(argv[i], "--context") == 0) {
+            options.s_context = true;
+        } else if (strcmp(argv[i], "--async") == 0) {
+            options.s_async = true;
+        } else if (strcmp(argv[i], "--pod") == 0) {
+            options.s_pod = true;
+        } else if (strcmp(argv[i], "--zero-suppress") == 0) {
+            options.s_zeroSuppress = true;
+        } else if (strcmp(argv[i], "--shm") == 0) {
+            options.s_shm = true;
+            options.s_context = true;         // The published events are EventContexts
+            options.s_pod = true;             // copied as plain data.
+        } else if (strchr(argv[i], '=')) {              // --name=value
+            std::string arg(argv[i] + 2);
+            size_t equals = arg.find('=');
+            if (!setTuningOption(options, arg.substr(0, equals), arg.substr(equals+1))) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return i;
+}
+/**
+ * optionConflict
+ *    Check for options that can't be used together.  --sparse-reset and
+ *    --threads keep per event data outside the instances, so they can't be
+ *    used with --context (or --batch, which implies it).  --async fills a
+ *    single tree from its own thread so it can't be used with --threads
+ *    or --context.  With --threads the merger writes the file, so it can't
+ *    roll over.  --shm publishes fixed size events, so struct arrays can't
+ *    be vectors (--single-branch).
+ *
+ * @param options - the options.
+ * @return const char* - what's wrong or null if nothing is.
+ */
+const char*
+optionConflict(const GenerateOptions& options)
+{
+    if (options.s_context && options.s_sparseReset) {
+        return "--context and --batch can't be used with --sparse-reset";
+    }
+    if (options.s_context && options.s_threads) {
+        return "--context and --batch can't be used with --threads";
+    }
+    if (options.s_async && (options.s_threads || options.s_context)) {
+        return "--async can't be used with --threads, --context or --batch";
+    }
+    if (options.s_threads && (!options.s_rolloverBytes.empty()
+        || !options.s_rolloverEvents.empty() || !options.s_rolloverSeconds.empty())) {
+        return "--rollover-bytes, --rollover-events and --rollover-seconds can't be used "
+               "with --threads";
+    }
+    if (options.s_shm && options.s_singleBranch) {
+        return "--shm can't be used with --single-branch";
+    }
+    return 0;
+}
+/**
+ * generateOptionArgs
+ *    The inverse of parseGenerateOptions.
+ *
+ * @param options - the options.
+ * @return std::string - the command line words that select them (each
+ *                       followed by a space).  Defaulted options are left out.
+ */
+std::string
+generateOptionArgs(const GenerateOptions& options)
+{
+    std::string result;
+    if (options.s_split) result += "--split ";
+    if (options.s_sparseReset) result += "--sparse-reset ";
+    if (options.s_singleBranch) result += "--single-branch ";
+    if (options.s_threads) result += "--threads ";
+    if (options.s_context) result += "--context ";
+    if (options.s_async) result += "--async ";
+    if (options.s_pod) result += "--pod ";
+    if (options.s_zeroSuppress) result += "--zero-suppress ";
+    if (options.s_shm) result += "--shm ";
+    
+    const struct {
+        const char*        s_name;
+        const std::string* s_value;
+    } tuning[] = {
+        {"basket-size", &options.s_basketSize},
+        {"compression", &options.s_compression},
+        {"compression-level", &options.s_compressionLevel},
+        {"auto-flush", &options.s_autoFlush},
+        {"auto-save", &options.s_autoSave},
+        {"split-level", &options.s_splitLevel},
+        {"precision", &options.s_precision},
+        {"async-depth", &options.s_asyncDepth},
+        {"batch", &options.s_batch},
+        {"rollover-bytes", &options.s_rolloverBytes},
+        {"rollover-events", &options.s_rolloverEvents},
+        {"rollover-seconds", &options.s_rolloverSeconds},
+        {"cluster-size", &options.s_clusterSize},
+        {"page-size", &options.s_pageSize},
+        {"buffered-write", &options.s_bufferedWrite}
+    };
+    for (size_t i = 0; i < sizeof(tuning)/sizeof(tuning[0]); i++) {
+        if (!tuning[i].s_value->empty()) {
+            result += std::string("--") + tuning[i].s_name + "=" + *tuning[i].s_value + " ";
+        }
+    }
+    return result;
+}
@@ -0,0 +1,74 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  genoptions.h
+ *  @brief: Options that control how the back ends generate code.
+ */
+#ifndef GENOPTIONS_H
+#define GENOPTIONS_H
+#include <string>
+
+/**
+ * GenerateOptions
+ *    Passed to every back end.  genx sets these from its command line.
+ *    The standalone generators accept them as --option arguments ahead of
+ *    the base name, which is how genx passes them along in --pipeline mode.
+ */
+struct GenerateOptions {
+    bool s_split;              // --split: a .cpp per struct type plus a file list.
+    bool s_sparseReset;        // --sparse-reset: SetupEvent resets only what was set (Root).
+    bool s_singleBranch;       // --single-branch: a branch per struct array, not element (Root).
+    bool s_threads;            // --threads: per thread instances and trees, merged (Root, RNTuple).
+    bool s_context;            // --context: instances are members of an EventContext class.
+    bool s_async;              // --async: CommitEvent queues the event for a filling thread (Root).
+    bool s_pod;                // --pod: struct types are plain classes without TObject (Root).
+    bool s_zeroSuppress;       // --zero-suppress: arrays and struct arrays are stored sparse (Root).
+    bool s_shm;                // --shm: events are published in shared memory (Root, sets s_context, s_pod).
+    
+    // Root TTree I/O tuning.  These are kept as they were given
+    // (setTuningOption checks them);  empty strings leave Root's defaults.
+    
+    std::string s_basketSize;        // --basket-size: bytes per basket or auto.
+    std::string s_compression;       // --compression: zlib, lzma, lz4 or zstd.
+    std::string s_compressionLevel;  // --compression-level: 0 (none) - 9.
+    std::string s_autoFlush;         // --auto-flush: entries or, if < 0, -bytes.
+    std::string s_autoSave;          // --auto-save: entries or, if < 0, -bytes.
+    std::string s_splitLevel;        // --split-level: 0 (no split) - 99.
+    std::string s_precision;         // --precision: double, float or bins.
+    std::string s_asyncDepth;        // --async-depth: events --async can queue (default 4).
+    std::string s_batch;             // --batch: events in an EventBatch (sets s_context).
+    std::string s_rolloverBytes;     // --rollover-bytes: start a new file at this size.
+    std::string s_rolloverEvents;    // --rollover-events: start a new file after this many.
+    std::string s_rolloverSeconds;   // --rollover-seconds: start a new file this often.
+
+    // RNTuple write options (the compression options above apply too).
+
+    std::string s_clusterSize;       // --cluster-size: approximate compressed bytes per cluster.
+    std::string s_pageSize;          // --page-size: largest uncompressed page in bytes.
+    std::string s_bufferedWrite;     // --buffered-write: on or off.
+
+    GenerateOptions();
+};
+
+int parseGenerateOptions(int argc, char** argv, GenerateOptions& options);
+std::string generateOptionArgs(const GenerateOptions& options);
+const char* optionConflict(const GenerateOptions& options);
+bool setTuningOption(
+    GenerateOptions& options, const std::string& name, const std::string& value
+);
+
+#endif
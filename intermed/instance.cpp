@@ -26,7 +26,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sstream>
-#include <set>
 
 extern void yyerror(const char* msg);
 
@@ -43,17 +42,40 @@ extern void yyerror(const char* msg);
 
 
 
-std::list<Instance> instanceList;         // Must be created.
+SymbolTable<Instance> instanceList;       // Hashed by instance name.
 Instance currentInstance;                  // Instance beingcreated.
 
 
-static std::set<std::string> instanceNames;      // Quicker check for dups:
-
-
 /*-----------------------------------------------------------------------------
  * Static utilities:
  */
 
+// The attributes the back ends understand and the values they can have:
+// one of s_values or, if s_max > 0, an integer in [0, s_max].
+
+static const char* noValues[] = {0};
+static const char* layoutValues[] = {"rows", "columns", 0};
+static const char* branchesValues[] = {"elements", "single", 0};
+static const char* basketValues[] = {"auto", 0};
+static const char* compressionValues[] = {"zlib", "lzma", "lz4", "zstd", 0};
+static const char* precisionValues[] = {"double", "float", "bins", 0};
+static const char* storageValues[] = {"dense", "sparse", 0};
+
+static const struct {
+    const char*  s_name;
+    const char** s_values;
+    long         s_max;
+} knownAttributes[] = {
+    {"layout", layoutValues, 0},
+    {"branches", branchesValues, 0},
+    {"basketsize", basketValues, 0x7fffffff},
+    {"compression", compressionValues, 0},
+    {"compressionlevel", noValues, 9},
+    {"splitlevel", noValues, 99},
+    {"precision", precisionValues, 0},
+    {"storage", storageValues, 0}
+};
+
 /**
  * findInstance
  *    Return a reference to the instance with the specified instance name.
@@ -62,12 +84,11 @@ static std::set<std::string> instanceNames;      // Quicker check for dups:
  *  @return const Instance&
  */
 static const Instance&
-findInstance(std::string name)
+findInstance(const std::string& name)
 {
-    for (std::list<Instance>::iterator p = instanceList.begin(); p!= instanceList.end(); p++) {
-        if (p->s_name == name) {
-            return *p;
-        }
+    const Instance* p = instanceList.find(name);
+    if (p) {
+        return *p;
     }
     yyerror("BUGBUG - searched for nonexistent instance name");
     return currentInstance;        // Dummy to prevent compiler warnings.
@@ -92,8 +113,24 @@ ValueOptions::toString() const
     std::stringstream sresult;
     sresult << "Low = " << s_low << " High = " << s_high << " bins= " << s_bins
         <<  " units: " << s_units;
+    for (Attributes::const_iterator p = s_attributes.begin(); p != s_attributes.end(); p++) {
+        sresult << " " << p->first << "=" << p->second;
+    }
     return sresult.str();
 }
+/**
+ * ValueOptions::attribute
+ *
+ * @param name - name of an attribute.
+ * @param dflt - value to return if the attribute was not given.
+ * @return std::string - the attribute's value.
+ */
+std::string
+ValueOptions::attribute(const std::string& name, const std::string& dflt) const
+{
+    Attributes::const_iterator p = s_attributes.find(name);
+    return p == s_attributes.end() ? dflt : p->second;
+}
 
 
 
@@ -112,7 +149,15 @@ ValueOptions::serialize(std::ostream& f) const
     f.write(reinterpret_cast<const char*>(&s_low), sizeof(double));
     f.write(reinterpret_cast<const char*>(&s_high), sizeof(double));
     f.write(reinterpret_cast<const char*>(&s_bins), sizeof(unsigned));
-    return serializeString(f, s_units);
+    serializeString(f, s_units);
+    
+    unsigned n = s_attributes.size();
+    f.write(reinterpret_cast<const char*>(&n), sizeof(unsigned));
+    for (Attributes::const_iterator p = s_attributes.begin(); p != s_attributes.end(); p++) {
+        serializeString(f, p->first);
+        serializeString(f, p->second);
+    }
+    return f;
 }
 
 /**
@@ -131,6 +176,13 @@ ValueOptions::deserialize(std::istream& f)
     f.read(reinterpret_cast<char*>(&s_bins), sizeof(unsigned));
     s_units = deserializeString(f);
     
+    unsigned n = 0;
+    f.read(reinterpret_cast<char*>(&n), sizeof(unsigned));
+    s_attributes.clear();
+    for (unsigned i = 0; f && (i < n); i++) {
+        std::string name = deserializeString(f);
+        s_attributes[name] = deserializeString(f);
+    }
     return f;
 }
 // Instance Methods:
@@ -231,7 +283,7 @@ addInstance(const Instance& inst)
 {
     // Check for duplicate name - that's an error:
     
-    if (instanceNames.count(inst.s_name)) {
+    if (!instanceList.add(inst.s_name, inst)) {
         const Instance& dup = findInstance(inst.s_name);
         
         std::stringstream errorMessage;
@@ -239,9 +291,6 @@ addInstance(const Instance& inst)
             << " already defined as: \n"
             << dup.toString() << std::endl;
         yyerror(errorMessage.str().c_str());
-    } else {
-        instanceList.push_back(inst);
-        instanceNames.insert(inst.s_name);
     }
 }
 /**
@@ -276,7 +325,7 @@ serializeInstances(std::ostream& f)
 {
     unsigned n = instanceList.size();
     f.write(reinterpret_cast<char*>(&n), sizeof(unsigned));
-    for (std::list<Instance>::const_iterator p = instanceList.begin();
+    for (SymbolTable<Instance>::const_iterator p = instanceList.begin();
          p != instanceList.end(); p++) {
         
         p->serialize(f);
@@ -288,22 +337,69 @@ serializeInstances(std::ostream& f)
  *    Given a stream positioned at a serialized std::string recovers that
  *    string from file and returns it:
  *
+ *   The string is read in bounded chunks so that a corrupt count can't
+ *   blow the stack or allocate more than the stream actually holds.
+ *
  *   @param f - input file from which deserialization gets done.
- *   @return std::string - The recovered string.
+ *   @return std::string - The recovered string (truncated if the stream
+ *                         runs out; f is then in the failed state).
  */
 std::string
 deserializeString(std::istream& f)
 {
-    unsigned n;
+    unsigned n = 0;
     f.read(reinterpret_cast<char*>(&n), sizeof(unsigned));
  
-    char recoveredString[n+1];
-    memset(recoveredString, 0, n+1);  /// zero fill the string.
-    if (n > 0) {
-        f.read(recoveredString, n);
+    std::string recoveredString;
+    char        chunk[4096];
+    while (f && (n > 0)) {
+        size_t size = n < sizeof(chunk) ? n : sizeof(chunk);
+        f.read(chunk, size);
+        recoveredString.append(chunk, f.gcount());
+        n -= size;
     }
  
-    return std::string(recoveredString);   
+    return recoveredString;
+}
+/**
+ * addAttribute
+ *    Add an attribute to the options of the instance or field being
+ *    parsed (currentInstance.s_options).  It's an error if the attribute isn't
+ *    one the back ends know about or the value isn't one it can have.
+ *
+ * @param name  - attribute name.
+ * @param value - its value as written.
+ */
+void
+addAttribute(const char* name, const std::string& value)
+{
+    for (size_t i = 0; i < sizeof(knownAttributes)/sizeof(knownAttributes[0]); i++) {
+        if (name == std::string(knownAttributes[i].s_name)) {
+            bool ok = false;
+            for (const char** values = knownAttributes[i].s_values; *values; values++) {
+                if (value == *values) ok = true;
+            }
+            if (knownAttributes[i].s_max > 0) {
+                char* end;
+                long n = strtol(value.c_str(), &end, 10);
+                if (!value.empty() && (*end == '\0') && (n >= 0) && (n <= knownAttributes[i].s_max)) {
+                    ok = true;
+                }
+            }
+            if (!ok) {
+                std::string msg = "Invalid value for attribute ";
+                msg += name;
+                msg += ": ";
+                msg += value;
+                yyerror(msg.c_str());
+            }
+            currentInstance.s_options.s_attributes[name] = value;
+            return;
+        }
+    }
+    std::string msg = "Unknown attribute: ";
+    msg += name;
+    yyerror(msg.c_str());
 }
 /**
  * deserializeInstances
@@ -314,11 +410,11 @@ deserializeString(std::istream& f)
  *  @return istream& - f again
  */
 std::istream&
-deserializeInstances(std::istream& f, std::list<Instance>& iList)
+deserializeInstances(std::istream& f, InstanceList& iList)
 {
-    unsigned n;
+    unsigned n = 0;
     f.read(reinterpret_cast<char*>(&n), sizeof(unsigned));
-    for (int i =0; i < n; i++) {
+    for (unsigned i =0; f && (i < n); i++) {
         Instance inst;
         inst.deserialize(f);
         iList.push_back(inst);
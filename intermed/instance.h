@@ -21,11 +21,13 @@
  */
 #ifndef INSTANCE_H
 #define INSTANCE_H
-#include <list>
+#include <vector>
+#include <map>
 #include <ostream>
 #include <istream>
 
 #include <sstream>
+#include "symboltable.h"
 
 
 // Enum defining the types of instances that can be created.
@@ -38,13 +40,21 @@ enum InstanceType {
     structarray
 };
 
-// Primitives have metadata associated with them.
+// Attributes are name=value options that tell back ends how to lay out or
+// write an instance or field (e.g. layout=columns).  The values are kept as
+// they were written.
+
+typedef std::map<std::string, std::string> Attributes;
+
+// Primitives have metadata associated with them.  Any instance or field
+// can have attributes.
 
 struct ValueOptions {
     double s_low;
     double s_high;
     unsigned s_bins;
     std::string s_units;
+    Attributes  s_attributes;
     
     ValueOptions() : s_low(0), s_high(100), s_bins(100), s_units("")
     {
@@ -53,7 +63,9 @@ struct ValueOptions {
         s_low = 0;
         s_high = s_bins = 100;
         s_units = "";
+        s_attributes.clear();
     }
+    std::string attribute(const std::string& name, const std::string& dflt = "") const;
     std::string toString() const;
     std::ostream& serialize(std::ostream& f) const;
     std::istream& deserialize(std::istream& f);
@@ -72,17 +84,22 @@ struct Instance {
     std::istream& deserialize(std::istream& f);
 };
 
+// Ordered instance list as handed to the code generators:
+
+typedef std::vector<Instance> InstanceList;
+
 void addInstance(const Instance& anInstance);
+void addAttribute(const char* name, const std::string& value);
 std::ostream& serializeInstances(std::ostream& f);
 std::ostream& serializeString(std::ostream& f, const std::string& s);
 std::string deserializeString(std::istream& f);
-std::istream& deserializeInstances(std::istream& f, std::list<Instance>& iList);
+std::istream& deserializeInstances(std::istream& f, InstanceList& iList);
 
 // Exported data:
 // TODO:  the datatype definition API is much better..we should do something like
 //        that instead of exposing these globals.
 
 extern Instance currentInstance;
-extern std::list<Instance> instanceList;
+extern SymbolTable<Instance> instanceList;
 
 #endif
\ No newline at end of file
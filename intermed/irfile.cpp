@@ -0,0 +1,549 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  irfile.cpp
+ *  @brief: Write and read .gxir intermediate representation files.
+ */
+#include "irfile.h"
+#include "contenthash.h"
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const uint32_t IR_VERSION(2);
+
+static const char     IR_MAGIC[8] = {'G', 'X', 'I', 'R', '\r', '\n', '\x1a', '\n'};
+static const uint32_t HEADER_BYTES(64);
+static const uint32_t TYPE_BYTES(16);
+static const uint32_t RECORD_BYTES(48);
+
+/*-----------------------------------------------------------------------------
+ * Little endian encode/decode utilities.
+ */
+
+static inline void
+put32(unsigned char* p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+static inline void
+put64(unsigned char* p, uint64_t v)
+{
+    put32(p, static_cast<uint32_t>(v));
+    put32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+static inline void
+putDouble(unsigned char* p, double d)
+{
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    put64(p, v);
+}
+static inline uint32_t
+get32(const unsigned char* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) |
+        (uint32_t(p[3]) << 24);
+}
+static inline uint64_t
+get64(const unsigned char* p)
+{
+    return uint64_t(get32(p)) | (uint64_t(get32(p + 4)) << 32);
+}
+static inline double
+getDouble(const unsigned char* p)
+{
+    uint64_t v = get64(p);
+    double   d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+/*-----------------------------------------------------------------------------
+ * Writer.
+ */
+
+/**
+ * StringTable
+ *    Builds the string table of a .gxir file, storing each distinct string
+ *    once.
+ */
+class StringTable {
+private:
+    std::vector<unsigned char>                m_bytes;
+    std::unordered_map<std::string, uint32_t> m_offsets;
+public:
+    StringTable() {
+        add("");                      // Offset 0 is the empty string.
+    }
+    uint32_t add(const std::string& s) {
+        std::unordered_map<std::string, uint32_t>::const_iterator p = m_offsets.find(s);
+        if (p != m_offsets.end()) return p->second;
+
+        uint32_t offset = m_bytes.size();
+        size_t   padded = (4 + s.size() + 1 + 3) & ~size_t(3);
+        m_bytes.resize(offset + padded, 0);
+        put32(&m_bytes[offset], s.size());
+        memcpy(&m_bytes[offset + 4], s.data(), s.size());
+        m_offsets[s] = offset;
+        return offset;
+    }
+    const std::vector<unsigned char>& bytes() const { return m_bytes; }
+};
+/**
+ * putRecord
+ *    Encode a field or instance record.
+ */
+static void
+putRecord(unsigned char* p, const Instance& inst, StringTable& strings)
+{
+    put32(p,      inst.s_type);
+    put32(p + 4,  strings.add(inst.s_name));
+    put32(p + 8,  strings.add(inst.s_typename));
+    put32(p + 12, inst.s_elementCount);
+    putDouble(p + 16, inst.s_options.s_low);
+    putDouble(p + 24, inst.s_options.s_high);
+    put32(p + 32, inst.s_options.s_bins);
+    put32(p + 36, strings.add(inst.s_options.s_units));
+    
+    std::string attributes;
+    const Attributes& a(inst.s_options.s_attributes);
+    for (Attributes::const_iterator i = a.begin(); i != a.end(); i++) {
+        attributes += i->first + "=" + i->second + "\n";
+    }
+    put32(p + 40, strings.add(attributes));
+}
+/**
+ * writeIr
+ *    Write the declarations as a .gxir file.
+ *
+ * @param f         - the stream to write to (should be opened in binary mode).
+ * @param nsname    - the namespace the declaration file named (may be empty).
+ * @param types     - the struct definitions.
+ * @param instances - the instances.
+ * @return bool - true if the stream is still good after the write.
+ */
+bool
+writeIr(
+    std::ostream& f, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances
+)
+{
+    size_t nFields = 0;
+    for (size_t i = 0; i < types.size(); i++) {
+        nFields += types[i].s_fields.size();
+    }
+    size_t nRecords = nFields + instances.size();
+
+    StringTable strings;
+    std::vector<unsigned char> typeTable(types.size() * TYPE_BYTES, 0);
+    std::vector<unsigned char> recordTable(nRecords * RECORD_BYTES, 0);
+
+    uint32_t record = 0;
+    for (size_t i = 0; i < types.size(); i++) {
+        const TypeDefinition& t(types[i]);
+        unsigned char* p = &typeTable[i * TYPE_BYTES];
+        put32(p,     strings.add(t.s_typename));
+        put32(p + 4, record);
+        put32(p + 8, t.s_fields.size());
+        for (size_t j = 0; j < t.s_fields.size(); j++, record++) {
+            putRecord(&recordTable[record * RECORD_BYTES], t.s_fields[j], strings);
+        }
+    }
+    for (size_t i = 0; i < instances.size(); i++, record++) {
+        putRecord(&recordTable[record * RECORD_BYTES], instances[i], strings);
+    }
+    uint32_t nsOffset = strings.add(nsname);
+
+    // Assemble everything after the header so it can be checksummed:
+
+    std::vector<unsigned char> body(typeTable);
+    body.insert(body.end(), recordTable.begin(), recordTable.end());
+    body.insert(body.end(), strings.bytes().begin(), strings.bytes().end());
+
+    unsigned char header[HEADER_BYTES];
+    memset(header, 0, sizeof(header));
+    memcpy(header, IR_MAGIC, sizeof(IR_MAGIC));
+    put32(header + 8,  IR_VERSION);
+    put32(header + 12, HEADER_BYTES);
+    put32(header + 16, types.size());
+    put32(header + 20, nRecords);
+    put32(header + 24, instances.size());
+    put32(header + 28, nsOffset);
+    put32(header + 32, HEADER_BYTES);
+    put32(header + 36, HEADER_BYTES + typeTable.size());
+    put32(header + 40, HEADER_BYTES + typeTable.size() + recordTable.size());
+    put32(header + 44, strings.bytes().size());
+    put64(header + 48, contentHash(body.data(), body.size()));
+
+    f.write(reinterpret_cast<const char*>(header), sizeof(header));
+    f.write(reinterpret_cast<const char*>(body.data()), body.size());
+    return f.good();
+}
+
+/*-----------------------------------------------------------------------------
+ * Reader.
+ */
+
+IrFile::IrFile() :
+    m_data(0), m_size(0), m_mapping(0),
+    m_typeCount(0), m_recordCount(0), m_instanceCount(0), m_nsName(0),
+    m_types(0), m_records(0), m_strings(0), m_stringBytes(0)
+{}
+IrFile::~IrFile()
+{
+    close();
+}
+/**
+ * open
+ *    Map a .gxir file and check it.
+ *
+ * @param path - the file.
+ * @return bool - true on success, on failure error() says why.
+ */
+bool
+IrFile::open(const std::string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return fail(path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        std::string msg = path + ": " + strerror(errno);
+        ::close(fd);
+        return fail(msg);
+    }
+    m_size = info.st_size;
+    if (m_size > 0) {
+        m_mapping = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_mapping == MAP_FAILED) {
+            m_mapping = 0;
+            std::string msg = path + ": " + strerror(errno);
+            ::close(fd);
+            return fail(msg);
+        }
+        m_data = static_cast<const unsigned char*>(m_mapping);
+    }
+    ::close(fd);
+    if (!validate()) {
+        m_error = path + ": " + m_error;
+        return false;
+    }
+    return true;
+}
+/**
+ * read
+ *    Read a .gxir file from a stream (e.g. a pipe, which can't be mapped)
+ *    and check it.
+ *
+ * @param f - the stream.
+ * @return bool - true on success, on failure error() says why.
+ */
+bool
+IrFile::read(std::istream& f)
+{
+    close();
+    char buffer[65536];
+    while (f.read(buffer, sizeof(buffer)) || f.gcount()) {
+        m_buffer.insert(m_buffer.end(), buffer, buffer + f.gcount());
+    }
+    if (f.bad()) {
+        return fail("Unable to read the intermediate representation");
+    }
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    return validate();
+}
+/**
+ * close
+ *    Release the file.  Any StringRefs into it become invalid.
+ */
+void
+IrFile::close()
+{
+    if (m_mapping) {
+        munmap(m_mapping, m_size);
+        m_mapping = 0;
+    }
+    m_buffer.clear();
+    m_data = 0;
+    m_size = 0;
+    m_typeCount = m_recordCount = m_instanceCount = 0;
+}
+/**
+ * isIrFile
+ *   @param path - a file.
+ *   @return bool - true if the file starts with the .gxir magic number.
+ */
+bool
+IrFile::isIrFile(const std::string& path)
+{
+    std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+    char magic[sizeof(IR_MAGIC)];
+    return f.read(magic, sizeof(magic)) && (memcmp(magic, IR_MAGIC, sizeof(magic)) == 0);
+}
+/**
+ * validate
+ *    Check the header, the bounds of all tables and every string and
+ *    record.  Once this passes, the accessors don't need to check anything.
+ *
+ * @return bool - true if the file is good.
+ */
+bool
+IrFile::validate()
+{
+    if ((m_size < HEADER_BYTES) || memcmp(m_data, IR_MAGIC, sizeof(IR_MAGIC))) {
+        return fail("Not a genx intermediate representation (.gxir) file");
+    }
+    uint32_t version = get32(m_data + 8);
+    if (version != IR_VERSION) {
+        std::ostringstream msg;
+        msg << "Unsupported .gxir version " << version << " (expected " << IR_VERSION << ")";
+        return fail(msg.str());
+    }
+    uint64_t headerBytes   = get32(m_data + 12);
+    m_typeCount            = get32(m_data + 16);
+    m_recordCount          = get32(m_data + 20);
+    m_instanceCount        = get32(m_data + 24);
+    m_nsName               = get32(m_data + 28);
+    uint64_t typeOffset    = get32(m_data + 32);
+    uint64_t recordOffset  = get32(m_data + 36);
+    uint64_t stringOffset  = get32(m_data + 40);
+    m_stringBytes          = get32(m_data + 44);
+
+    if ((headerBytes < HEADER_BYTES) ||
+        (typeOffset < headerBytes)   || (typeOffset + uint64_t(m_typeCount) * TYPE_BYTES > m_size) ||
+        (recordOffset < headerBytes) || (recordOffset + uint64_t(m_recordCount) * RECORD_BYTES > m_size) ||
+        (stringOffset < headerBytes) || (stringOffset + m_stringBytes > m_size) ||
+        (m_instanceCount > m_recordCount)) {
+        return fail("Corrupt .gxir file: table out of bounds");
+    }
+    if (get64(m_data + 48) != contentHash(m_data + headerBytes, m_size - headerBytes)) {
+        return fail("Corrupt .gxir file: checksum mismatch");
+    }
+    m_types   = m_data + typeOffset;
+    m_records = m_data + recordOffset;
+    m_strings = m_data + stringOffset;
+
+    if (!validString(m_nsName)) return fail("Corrupt .gxir file: bad namespace string");
+    uint32_t nFields = m_recordCount - m_instanceCount;
+    for (uint32_t i = 0; i < m_typeCount; i++) {
+        const unsigned char* p = m_types + i * TYPE_BYTES;
+        uint64_t first = get32(p + 4);
+        if (!validString(get32(p)) || (first + get32(p + 8) > nFields)) {
+            return fail("Corrupt .gxir file: bad type record");
+        }
+    }
+    for (uint32_t i = 0; i < m_recordCount; i++) {
+        const unsigned char* p = m_records + i * RECORD_BYTES;
+        if ((get32(p) > structarray) || !validString(get32(p + 4)) ||
+            !validString(get32(p + 8)) || !validString(get32(p + 36)) ||
+            !validString(get32(p + 40))) {
+            return fail("Corrupt .gxir file: bad field or instance record");
+        }
+    }
+    return true;
+}
+/**
+ * validString
+ *   @param offset - a string table offset.
+ *   @return bool - true if a string lies entirely within the table there and
+ *                  is NUL terminated.
+ */
+bool
+IrFile::validString(uint32_t offset) const
+{
+    if ((uint64_t(offset) + 4 > m_stringBytes)) return false;
+    uint64_t size = get32(m_strings + offset);
+    if (offset + 4 + size + 1 > m_stringBytes) return false;
+    return m_strings[offset + 4 + size] == 0;
+}
+StringRef
+IrFile::string(uint32_t offset) const
+{
+    return StringRef(
+        reinterpret_cast<const char*>(m_strings + offset + 4), get32(m_strings + offset)
+    );
+}
+bool
+IrFile::fail(const std::string& msg)
+{
+    m_error = msg;
+    m_typeCount = m_recordCount = m_instanceCount = 0;
+    return false;
+}
+
+/**
+ * nsName
+ *   @return StringRef - the namespace named in the declaration file (empty if none).
+ */
+StringRef
+IrFile::nsName() const
+{
+    return m_data ? string(m_nsName) : StringRef();
+}
+/**
+ * type
+ *   @param i - index of a struct definition (< typeCount()).
+ *   @return Type - view of it.
+ */
+IrFile::Type
+IrFile::type(uint32_t i) const
+{
+    return Type(this, m_types + i * TYPE_BYTES);
+}
+/**
+ * instance
+ *   @param i - index of an instance (< instanceCount()).
+ *   @return Record - view of it.
+ */
+IrFile::Record
+IrFile::instance(uint32_t i) const
+{
+    return Record(this, m_records + (m_recordCount - m_instanceCount + i) * RECORD_BYTES);
+}
+/**
+ * load
+ *    Build the in memory representation the code generators take.
+ *
+ * @param nsname    - (out) the namespace named in the declaration file.
+ * @param types     - struct definitions are appended here.
+ * @param instances - instances are appended here.
+ */
+void
+IrFile::load(std::string& nsname, TypeList& types, InstanceList& instances) const
+{
+    nsname = nsName().str();
+    types.reserve(types.size() + m_typeCount);
+    for (uint32_t i = 0; i < m_typeCount; i++) {
+        types.push_back(type(i).toTypeDefinition());
+    }
+    instances.reserve(instances.size() + m_instanceCount);
+    for (uint32_t i = 0; i < m_instanceCount; i++) {
+        instances.push_back(instance(i).toInstance());
+    }
+}
+
+// IrFile::Type methods:
+
+StringRef
+IrFile::Type::name() const
+{
+    return m_file->string(get32(m_p));
+}
+uint32_t
+IrFile::Type::fieldCount() const
+{
+    return get32(m_p + 8);
+}
+IrFile::Record
+IrFile::Type::field(uint32_t i) const
+{
+    return Record(m_file, m_file->m_records + (get32(m_p + 4) + i) * RECORD_BYTES);
+}
+TypeDefinition
+IrFile::Type::toTypeDefinition() const
+{
+    TypeDefinition result;
+    result.s_typename = name().str();
+    result.s_fields.reserve(fieldCount());
+    for (uint32_t i = 0; i < fieldCount(); i++) {
+        result.s_fields.push_back(field(i).toInstance());
+    }
+    return result;
+}
+
+// IrFile::Record methods:
+
+InstanceType
+IrFile::Record::type() const
+{
+    return static_cast<InstanceType>(get32(m_p));
+}
+StringRef
+IrFile::Record::name() const
+{
+    return m_file->string(get32(m_p + 4));
+}
+StringRef
+IrFile::Record::typeName() const
+{
+    return m_file->string(get32(m_p + 8));
+}
+uint32_t
+IrFile::Record::elementCount() const
+{
+    return get32(m_p + 12);
+}
+double
+IrFile::Record::low() const
+{
+    return getDouble(m_p + 16);
+}
+double
+IrFile::Record::high() const
+{
+    return getDouble(m_p + 24);
+}
+uint32_t
+IrFile::Record::bins() const
+{
+    return get32(m_p + 32);
+}
+StringRef
+IrFile::Record::units() const
+{
+    return m_file->string(get32(m_p + 36));
+}
+StringRef
+IrFile::Record::attributes() const
+{
+    return m_file->string(get32(m_p + 40));
+}
+Instance
+IrFile::Record::toInstance() const
+{
+    Instance result;
+    result.s_type             = type();
+    result.s_name             = name().str();
+    result.s_typename         = typeName().str();
+    result.s_elementCount     = elementCount();
+    result.s_options.s_low    = low();
+    result.s_options.s_high   = high();
+    result.s_options.s_bins   = bins();
+    result.s_options.s_units  = units().str();
+    
+    std::string attributes = this->attributes().str();
+    size_t start = 0, end;
+    while ((end = attributes.find('\n', start)) != std::string::npos) {
+        size_t equals = attributes.find('=', start);
+        if (equals < end) {
+            result.s_options.s_attributes[attributes.substr(start, equals - start)] =
+                attributes.substr(equals + 1, end - equals - 1);
+        }
+        start = end + 1;
+    }
+    return result;
+}
@@ -0,0 +1,178 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  irfile.h
+ *  @brief: The .gxir intermediate representation file format.
+ */
+#ifndef IRFILE_H
+#define IRFILE_H
+#include "definedtypes.h"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <istream>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The parser hands the declarations to the back ends as a .gxir file.
+ * All integers are little endian regardless of the host and doubles are
+ * IEEE 754 binary64 stored as little endian 64 bit integers.  The file
+ * is laid out so that it can be mapped and used in place:
+ *
+ *   offset  size   contents
+ *   0       8      magic: "GXIR\r\n\x1a\n"
+ *   8       4      format version (IR_VERSION)
+ *   12      4      header size in bytes (64)
+ *   16      4      number of type (struct) records
+ *   20      4      number of field/instance records
+ *   24      4      number of instance records (the last ones)
+ *   28      4      string offset of the namespace name
+ *   32      4      offset of the type records
+ *   36      4      offset of the field/instance records
+ *   40      4      offset of the string table
+ *   44      4      size of the string table
+ *   48      8      contentHash of everything after the header
+ *   56      8      reserved (0)
+ *
+ * Type records (16 bytes): name, index of the first field record, number of
+ * fields, reserved.
+ *
+ * Field/instance records (48 bytes): InstanceType, name, typename,
+ * element count, low, high (8 bytes each), bins, units, attributes,
+ * reserved.  The attributes are a string of name=value lines in name
+ * order.  The fields of all structs come first, in declaration order,
+ * followed by the instances.
+ *
+ * Strings are offsets into the string table.  Each string there is a
+ * 4 byte length, the characters and a terminating NUL padded to a
+ * multiple of 4 bytes.  Offset 0 is the empty string.  Identical strings are
+ * stored once.
+ */
+extern const uint32_t IR_VERSION;
+
+/**
+ * StringRef
+ *    A view of a string held in an IrFile.  It's only valid while the
+ *    IrFile is open.  The characters are NUL terminated.
+ */
+class StringRef {
+private:
+    const char* m_data;
+    size_t      m_size;
+public:
+    StringRef() : m_data(""), m_size(0) {}
+    StringRef(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+    const char* data()  const { return m_data; }
+    const char* c_str() const { return m_data; }
+    size_t      size()  const { return m_size; }
+    bool        empty() const { return m_size == 0; }
+    std::string str()   const { return std::string(m_data, m_size); }
+    bool operator==(const std::string& rhs) const {
+        return rhs.compare(0, std::string::npos, m_data, m_size) == 0;
+    }
+};
+
+bool writeIr(
+    std::ostream& f, const std::string& nsname,
+    const TypeList& types, const InstanceList& instances
+);
+
+/**
+ * IrFile
+ *    Reader for .gxir files.  The file is mapped (or, for a stream, read
+ *    into memory) and checked once when it's opened.  After that the
+ *    accessors decode the records in place and strings are returned as
+ *    StringRef views into the file, so nothing is copied unless load()
+ *    is used to build the TypeList/InstanceList the generators take.
+ */
+class IrFile {
+public:
+    class Record {                    // A struct field or an instance.
+        friend class IrFile;
+        const IrFile*        m_file;
+        const unsigned char* m_p;
+        Record(const IrFile* file, const unsigned char* p) : m_file(file), m_p(p) {}
+    public:
+        InstanceType type() const;
+        StringRef    name() const;
+        StringRef    typeName() const;
+        uint32_t     elementCount() const;
+        double       low() const;
+        double       high() const;
+        uint32_t     bins() const;
+        StringRef    units() const;
+        StringRef    attributes() const;
+        Instance     toInstance() const;
+    };
+    class Type {                      // A struct definition.
+        friend class IrFile;
+        const IrFile*        m_file;
+        const unsigned char* m_p;
+        Type(const IrFile* file, const unsigned char* p) : m_file(file), m_p(p) {}
+    public:
+        StringRef      name() const;
+        uint32_t       fieldCount() const;
+        Record         field(uint32_t i) const;
+        TypeDefinition toTypeDefinition() const;
+    };
+private:
+    const unsigned char*        m_data;
+    size_t                      m_size;
+    void*                       m_mapping;
+    std::vector<unsigned char>  m_buffer;
+    std::string                 m_error;
+
+    uint32_t                    m_typeCount;
+    uint32_t                    m_recordCount;
+    uint32_t                    m_instanceCount;
+    uint32_t                    m_nsName;
+    const unsigned char*        m_types;
+    const unsigned char*        m_records;
+    const unsigned char*        m_strings;
+    uint32_t                    m_stringBytes;
+public:
+    IrFile();
+    ~IrFile();
+private:
+    IrFile(const IrFile&);
+    IrFile& operator=(const IrFile&);
+public:
+    bool open(const std::string& path);
+    bool read(std::istream& f);
+    void close();
+    const std::string& error() const { return m_error; }
+
+    static bool isIrFile(const std::string& path);
+
+    StringRef nsName() const;
+    uint32_t  typeCount() const     { return m_typeCount; }
+    Type      type(uint32_t i) const;
+    uint32_t  instanceCount() const { return m_instanceCount; }
+    Record    instance(uint32_t i) const;
+
+    void load(std::string& nsname, TypeList& types, InstanceList& instances) const;
+
+private:
+    bool validate();
+    bool validString(uint32_t offset) const;
+    StringRef string(uint32_t offset) const;
+    bool fail(const std::string& msg);
+};
+
+#endif
@@ -0,0 +1,235 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  outputfile.cpp
+ *  @brief: Implement write-if-changed output files and generation stamps.
+ */
+#include "outputfile.h"
+#include "contenthash.h"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+static thread_local OutputLog* outputLog(0);
+
+/**
+ * setOutputLog
+ *    Set the log in which this thread records the files it generates.
+ *
+ * @param log - the log (null to stop logging).
+ */
+void
+setOutputLog(OutputLog* log)
+{
+    outputLog = log;
+}
+/**
+ * readFile
+ *   @param path     - a file.
+ *   @param contents - (out) its contents.
+ *   @return bool - false if the file could not be read.
+ */
+static bool
+readFile(const std::string& path, std::string& contents)
+{
+    std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+    if (!f) return false;
+    std::ostringstream s;
+    s << f.rdbuf();
+    contents = s.str();
+    return !f.bad();
+}
+/**
+ * logOutput
+ *    Record a file that now has these contents in the thread's output
+ *    log, if it has one.
+ *
+ * @param path     - the file.
+ * @param contents - its contents.
+ */
+static void
+logOutput(const std::string& path, const std::string& contents)
+{
+    if (outputLog) {
+        OutputRecord record = {path, contentHash(contents)};
+        outputLog->push_back(record);
+    }
+}
+/**
+ * writeIfChanged
+ *    Write a file unless it already has exactly these contents.  The new
+ *    contents go to a temporary file that's renamed over the old one,
+ *    so readers never see a partially written file.  Once the file has
+ *    the contents it's logged in the thread's output log;  a file that
+ *    couldn't be written isn't.
+ *
+ * @param path     - the file.
+ * @param contents - what it should contain.
+ * @return bool - true on success (whether or not the file was written).
+ */
+bool
+writeIfChanged(const std::string& path, const std::string& contents)
+{
+    std::string existing;
+    if (readFile(path, existing) && (existing == contents)) {
+        logOutput(path, contents);
+        return true;
+    }
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream f(temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        f.write(contents.data(), contents.size());
+        if (!f.flush()) {
+            std::cerr << "Unable to write " << path << ": " << strerror(errno) << std::endl;
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) < 0) {
+        std::cerr << "Unable to write " << path << ": " << strerror(errno) << std::endl;
+        remove(temp.c_str());
+        return false;
+    }
+    logOutput(path, contents);
+    return true;
+}
+
+/**
+ * writeSourceList
+ *    Write base.mk, a Makefile fragment that lists the C++ sources
+ *    generated for base, so they can be compiled in parallel with make -j.
+ *    For base dir/ev it looks like:
+ *
+ *        ev_SOURCES = dir/ev.cpp dir/ev-type1.cpp ...
+ *        ev_OBJECTS = $(ev_SOURCES:.cpp=.o)
+ *
+ * @param base    - output base name (may include a path).
+ * @param sources - the generated .cpp files.
+ * @return bool - true on success.
+ */
+bool
+writeSourceList(const std::string& base, const std::vector<std::string>& sources)
+{
+    std::string name = base.substr(base.rfind('/') + 1);      // npos + 1 == 0.
+    for (size_t i = 0; i < name.size(); i++) {
+        if (!isalnum(name[i] & 0xff)) name[i] = '_';
+    }
+    std::ostringstream f;
+    f << "# Generated C++ sources for " << base << "\n";
+    f << "# Do not edit by hand\n\n";
+    f << name << "_SOURCES =";
+    for (size_t i = 0; i < sources.size(); i++) {
+        f << " \\\n   " << sources[i];
+    }
+    f << "\n\n" << name << "_OBJECTS = $(" << name << "_SOURCES:.cpp=.o)\n";
+    return writeIfChanged(base + ".mk", f.str());
+}
+
+// OutputFile methods:
+
+OutputFile::OutputFile(const std::string& path) :
+    m_path(path), m_closed(false)
+{}
+OutputFile::~OutputFile()
+{
+    close();
+}
+/**
+ * close
+ *    Write the file if its contents changed.  Further closes do nothing.
+ *
+ * @return bool - true on success.
+ */
+bool
+OutputFile::close()
+{
+    if (m_closed) return true;
+    m_closed = true;
+    return writeIfChanged(m_path, str());
+}
+
+// GenerationStamp methods:
+
+/**
+ * read
+ *    Read a stamp file.  The format is line oriented text:
+ *        genx-stamp 1
+ *        key <hex>
+ *        output <hex content hash> <path>
+ *        ...
+ *
+ * @param path - the stamp file.
+ * @return bool - false if it doesn't exist or isn't a stamp file.
+ */
+bool
+GenerationStamp::read(const std::string& path)
+{
+    std::ifstream f(path.c_str());
+    std::string   line;
+    s_outputs.clear();
+    if (!std::getline(f, line) || (line != "genx-stamp 1")) return false;
+    if (!std::getline(f, line) || (sscanf(line.c_str(), "key %16llx", (unsigned long long*)&s_key) != 1)) {
+        return false;
+    }
+    while (std::getline(f, line)) {
+        unsigned long long hash;
+        int                pathStart;
+        if (sscanf(line.c_str(), "output %16llx %n", &hash, &pathStart) != 1) return false;
+        OutputRecord record = {line.substr(pathStart), hash};
+        s_outputs.push_back(record);
+    }
+    return true;
+}
+/**
+ * write
+ *   @param path - the stamp file to write.
+ *   @return bool - true on success.
+ */
+bool
+GenerationStamp::write(const std::string& path) const
+{
+    std::ostringstream s;
+    s << "genx-stamp 1\n" << std::hex << std::setfill('0');
+    s << "key " << std::setw(16) << s_key << "\n";
+    for (size_t i = 0; i < s_outputs.size(); i++) {
+        s << "output " << std::setw(16) << s_outputs[i].s_hash << " " << s_outputs[i].s_path << "\n";
+    }
+    return writeIfChanged(path, s.str());
+}
+/**
+ * current
+ *   @param key - the key for a run that's about to happen.
+ *   @return bool - true if the stamp has the same key and the outputs it
+ *                  lists all still have the contents they were written with.
+ */
+bool
+GenerationStamp::current(uint64_t key) const
+{
+    if ((key != s_key) || s_outputs.empty()) return false;
+    for (size_t i = 0; i < s_outputs.size(); i++) {
+        std::string contents;
+        if (!readFile(s_outputs[i].s_path, contents) ||
+            (contentHash(contents) != s_outputs[i].s_hash)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  outputfile.h
+ *  @brief: Generated output files that are only rewritten when they change.
+ */
+#ifndef OUTPUTFILE_H
+#define OUTPUTFILE_H
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdint.h>
+
+/**
+ * Every generated file is recorded (path and content hash) in the output
+ * log of the thread that wrote it, if that thread has one.  genx uses this
+ * to remember what each back end produced.
+ */
+struct OutputRecord {
+    std::string s_path;
+    uint64_t    s_hash;
+};
+typedef std::vector<OutputRecord> OutputLog;
+
+void setOutputLog(OutputLog* log);
+
+bool writeIfChanged(const std::string& path, const std::string& contents);
+bool writeSourceList(const std::string& base, const std::vector<std::string>& sources);
+
+/**
+ * OutputFile
+ *    Used by the code generators in place of an std::ofstream.  The text
+ *    is accumulated in memory and, when the file is closed, only written
+ *    if it differs from what's already in the file.  Leaving unchanged
+ *    files untouched keeps their modification times so make doesn't
+ *    rebuild everything that depends on them.
+ */
+class OutputFile : public std::ostringstream {
+private:
+    std::string m_path;
+    bool        m_closed;
+public:
+    explicit OutputFile(const std::string& path);
+    ~OutputFile();
+
+    bool close();
+};
+
+/**
+ * GenerationStamp
+ *    What genx remembers about a back end's last run: a key hashed from
+ *    everything that determines the output and the outputs it wrote.
+ *    If the key is the same and the outputs are all still as written
+ *    there's no need to generate again.
+ */
+struct GenerationStamp {
+    uint64_t   s_key;
+    OutputLog  s_outputs;
+
+    bool read(const std::string& path);
+    bool write(const std::string& path) const;
+    bool current(uint64_t key) const;
+};
+
+#endif
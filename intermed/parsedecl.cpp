@@ -0,0 +1,93 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  parsedecl.cpp
+ *  @brief: Drive the bison parser and provide its error reporting hooks.
+ */
+#include "parsedecl.h"
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+
+extern FILE* yyin;
+extern int yyparse();
+
+unsigned lineNum(1);
+static std::string fileName;                // From line markers, if any.
+
+/**
+ * parseDeclarations
+ *    Point the flex scanner at the stream and run the parser over it.
+ *
+ * @param declarations - stream to parse.
+ * @return bool - true on success.
+ */
+bool
+parseDeclarations(FILE* declarations)
+{
+    yyin    = declarations;              // Set the FLEX input stream:
+    lineNum = 1;
+    fileName.clear();
+    return yyparse() == 0;
+}
+/**
+ * lineDirective
+ *    Called by the scanner for the # line "file" markers the preprocessor
+ *    (built in or cpp) leaves in its output, so that errors are reported
+ *    against the original file and line.
+ *
+ * @param marker - the text of the marker line.  Since the scanner
+ *                 counts the newline that ends it, lineNum is set one
+ *                 less than the line number in the marker.
+ */
+void
+lineDirective(const char* marker)
+{
+    const char* p = marker;
+    while (*p == '#' || *p == ' ' || *p == '\t') p++;
+    char* end;
+    unsigned long line = strtoul(p, &end, 10);
+    if (end == p) return;
+    lineNum = line - 1;
+
+    const char* open = strchr(end, '"');
+    const char* close = open ? strchr(open + 1, '"') : 0;
+    if (close) {
+        fileName.assign(open + 1, close - open - 1);
+    }
+}
+
+/**
+ *  Bison error reporting hook:
+ **/
+void yyerror(const char *s)
+{
+    std::cerr << "*** error: ";
+    if (!fileName.empty()) std::cerr << fileName << ":";
+    std::cerr << lineNum << " : " << s << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+// Non fatal error
+
+void yywarning(const char* s)
+{
+    std::cerr << "** warning: ";
+    if (!fileName.empty()) std::cerr << fileName << ":";
+    std::cerr << lineNum << " : " << s << std::endl;
+}
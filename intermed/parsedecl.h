@@ -0,0 +1,43 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  parsedecl.h
+ *  @brief: Entry point to the declaration parser for programs that link it in.
+ */
+#ifndef PARSEDECL_H
+#define PARSEDECL_H
+#include <stdio.h>
+
+/**
+ * parseDeclarations
+ *    Parses a (preprocessed) declaration file.  On success the results are
+ *    in the typeList and instanceList symbol tables and nsName
+ *    (see definedtypes.h and instance.h).  Syntax and semantic errors are
+ *    reported via yyerror which exits.
+ *
+ * @param declarations - the stream to parse.
+ * @return bool - true on success.
+ */
+bool parseDeclarations(FILE* declarations);
+
+extern unsigned lineNum;                    // Current line in the input.
+
+void lineDirective(const char* marker);     // Handle a # line "file" marker.
+void yyerror(const char* s);
+void yywarning(const char* s);
+
+#endif
@@ -0,0 +1,587 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  preprocess.cpp
+ *  @brief: Implement the built-in #define/#include stage.
+ */
+#include "preprocess.h"
+#include "contenthash.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+
+static const size_t MAX_INCLUDE_DEPTH(200);
+
+/**
+ * isIdentStart, isIdentChar
+ *    Characters that can start/continue a preprocessor identifier.
+ */
+static inline bool isIdentStart(char c) { return isalpha((unsigned char)c) || (c == '_'); }
+static inline bool isIdentChar(char c)  { return isalnum((unsigned char)c) || (c == '_'); }
+
+/**
+ * trim
+ *   @param s - a string.
+ *   @return std::string - s without leading and trailing whitespace.
+ */
+static std::string
+trim(const std::string& s)
+{
+    size_t first = s.find_first_not_of(" \t\n\r\f\v");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t\n\r\f\v");
+    return s.substr(first, last - first + 1);
+}
+/**
+ * identifier
+ *    Extract the identifier at the start of a string.
+ *
+ * @param s    - the string (leading whitespace is skipped).
+ * @param rest - (out) whatever follows the identifier.
+ * @return std::string - the identifier, empty if there isn't one.
+ */
+static std::string
+identifier(const std::string& s, std::string& rest)
+{
+    size_t i = s.find_first_not_of(" \t");
+    if ((i == std::string::npos) || !isIdentStart(s[i])) {
+        rest = s;
+        return "";
+    }
+    size_t end = i;
+    while ((end < s.size()) && isIdentChar(s[end])) end++;
+    rest = s.substr(end);
+    return s.substr(i, end - i);
+}
+/**
+ * nextLogicalLine
+ *    Pull the next logical line out of a file's contents.  Block comments
+ *    are replaced by a space and line comments are dropped, as
+ *    is the newline of lines continued with a backslash.  A block comment
+ *    that spans lines joins them into one logical line just as it does for cpp.
+ *    The newlines inside such a comment are kept in the line so that
+ *    what follows the comment stays on its original line.
+ *
+ * @param text   - the file contents.
+ * @param pos    - (in/out) where the line starts/where the next one does.
+ * @param line   - (out) the logical line.
+ * @param nLines - (out) the number of physical lines consumed.
+ * @return bool - false if there was nothing left.
+ */
+static bool
+nextLogicalLine(const std::string& text, size_t& pos, std::string& line, unsigned& nLines)
+{
+    if (pos >= text.size()) return false;
+    line.clear();
+    nLines = 0;
+    bool blockComment = false;
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (blockComment) {
+            if (c == '\n') {
+                line += c;
+                nLines++;
+            } else if ((c == '*') && (pos+1 < text.size()) && (text[pos+1] == '/')) {
+                blockComment = false;
+                pos++;
+            }
+            pos++;
+        } else if (c == '\n') {
+            pos++;
+            nLines++;
+            break;
+        } else if ((c == '\\') && (pos+1 < text.size()) && (text[pos+1] == '\n')) {
+            pos += 2;
+            nLines++;
+        } else if ((c == '\\') && (pos+2 < text.size()) &&
+                   (text[pos+1] == '\r') && (text[pos+2] == '\n')) {
+            pos += 3;
+            nLines++;
+        } else if ((c == '/') && (pos+1 < text.size()) && (text[pos+1] == '*')) {
+            blockComment = true;
+            line += ' ';
+            pos += 2;
+        } else if ((c == '/') && (pos+1 < text.size()) && (text[pos+1] == '/')) {
+            while ((pos < text.size()) && (text[pos] != '\n')) pos++;
+        } else if (c == '"') {
+            size_t end = text.find_first_of("\"\n", pos+1);
+            if ((end == std::string::npos) || (text[end] == '\n')) {
+                end = (end == std::string::npos) ? text.size() : end;
+                line.append(text, pos, end - pos);
+                pos = end;
+            } else {
+                line.append(text, pos, end - pos + 1);
+                pos = end + 1;
+            }
+        } else {
+            line += c;
+            pos++;
+        }
+    }
+    return true;
+}
+/**
+ * lineMarker
+ *   @param line - line number.
+ *   @param file - file name.
+ *   @return std::string - a cpp style # line "file" marker line.
+ */
+static std::string
+lineMarker(unsigned line, const std::string& file)
+{
+    std::ostringstream s;
+    s << "# " << line << " \"" << file << "\"\n";
+    return s.str();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// IncludeCache implementation.
+
+/**
+ * load
+ *    Return the cached contents of a file, reading it if this is the first
+ *    time it's been asked for.
+ *
+ * @param path - path to the file.
+ * @return IncludeCache::Entry* - the file's entry or null if it can't be
+ *                  read (errno says why).
+ */
+IncludeCache::Entry*
+IncludeCache::load(const std::string& path)
+{
+    char* real = realpath(path.c_str(), NULL);
+    if (!real) return 0;
+    std::string key(real);
+    free(real);
+
+    std::unordered_map<std::string, uint64_t>::iterator p = m_pathHashes.find(key);
+    if (p != m_pathHashes.end()) {
+        return &m_entries[p->second];
+    }
+
+    std::ifstream f(key.c_str(), std::ios::in | std::ios::binary);
+    if (!f) return 0;
+    std::stringstream contents;
+    contents << f.rdbuf();
+    if (f.bad()) return 0;
+    m_reads++;
+
+    Entry entry;
+    entry.s_contents = contents.str();
+    entry.s_once     = false;
+
+    // Identical contents share an entry. On a (very unlikely) hash collision
+    // probe for the next free slot.
+
+    uint64_t hash = contentHash(entry.s_contents);
+    std::unordered_map<uint64_t, Entry>::iterator e;
+    while (((e = m_entries.find(hash)) != m_entries.end()) &&
+           (e->second.s_contents != entry.s_contents)) {
+        hash++;
+    }
+    if (e == m_entries.end()) {
+        e = m_entries.insert(std::make_pair(hash, entry)).first;
+    }
+    m_pathHashes[key] = hash;
+    return &e->second;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Preprocessor implementation.
+
+/**
+ * constructors
+ *    The default constructor uses a cache of its own, the other
+ *    shares the one it's given.
+ */
+Preprocessor::Preprocessor() :
+    m_cache(m_ownCache), m_output(0)
+{}
+Preprocessor::Preprocessor(IncludeCache& cache) :
+    m_cache(cache), m_output(0)
+{}
+
+/**
+ * process
+ *    Preprocess a top level declaration file.  Macros defined by earlier
+ *    calls are forgotten; the include cache is not.
+ *
+ * @param filename - the file to preprocess.
+ * @param output   - (out) the preprocessed text.
+ * @return bool - true on success.  Errors are reported on stderr.
+ */
+bool
+Preprocessor::process(const std::string& filename, std::string& output)
+{
+    m_macros.clear();
+    m_included.clear();
+    m_conditionals.clear();
+    m_sources.clear();
+    m_output = &output;
+
+    IncludeCache::Entry* file = m_cache.load(filename);
+    if (!file) {
+        std::cerr << filename << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return processFile(filename, *file);
+}
+/**
+ * processFile
+ *    Preprocess one file into the output.
+ *
+ * @param path - the path to the file (as it's named in line markers).
+ * @param file - its cache entry.
+ * @return bool - true on success.
+ */
+bool
+Preprocessor::processFile(const std::string& path, IncludeCache::Entry& file)
+{
+    Source source;
+    source.s_name = path;
+    size_t slash  = path.rfind('/');
+    source.s_directory = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+    source.s_line = 1;
+    source.s_nextLine = 1;
+    source.s_conditionalBase = m_conditionals.size();
+    m_sources.push_back(source);
+    m_included.insert(&file);
+
+    Guard guard;
+    guard.s_state = Guard::unknown;
+
+    *m_output += lineMarker(1, path);
+
+    const std::string& text(file.s_contents);
+    size_t      pos = 0;
+    std::string line;
+    unsigned    nLines;
+    while (nextLogicalLine(text, pos, line, nLines)) {
+        unsigned    embedded = std::count(line.begin(), line.end(), '\n');
+        std::string newlines(nLines > embedded ? nLines - embedded : 1, '\n');
+        m_sources.back().s_nextLine = m_sources.back().s_line + nLines;
+        std::string trimmed = trim(line);
+        if (!trimmed.empty() && (trimmed[0] == '#')) {
+            *m_output += std::string(embedded, '\n') + newlines;
+            std::replace(trimmed.begin(), trimmed.end(), '\n', ' ');
+            if (!directive(trimmed.substr(1), file, guard)) return false;
+        } else {
+            if (!trimmed.empty() && active()) {
+                if (guard.s_state == Guard::closed || guard.s_state == Guard::unknown) {
+                    guard.s_state = Guard::none;
+                }
+                if (m_macros.empty()) {
+                    *m_output += line;
+                } else {
+                    std::set<std::string> expanding;
+                    *m_output += expand(line, expanding);
+                }
+            } else {
+                *m_output += std::string(embedded, '\n');
+            }
+            *m_output += newlines;
+        }
+        m_sources.back().s_line = m_sources.back().s_nextLine;
+    }
+    if (m_conditionals.size() > m_sources.back().s_conditionalBase) {
+        return error("unterminated conditional directive");
+    }
+    if (guard.s_state == Guard::closed) {
+        file.s_guard = guard.s_macro;
+    }
+    m_sources.pop_back();
+    return true;
+}
+/**
+ * directive
+ *    Process a preprocessor directive.
+ *
+ * @param line  - the directive without its leading '#'.
+ * @param file  - the file it's in.
+ * @param guard - include guard detection state for the file.
+ * @return bool - true on success.
+ */
+bool
+Preprocessor::directive(const std::string& line, IncludeCache::Entry& file, Guard& guard)
+{
+    std::string operand;
+    std::string name = identifier(line, operand);
+    operand = trim(operand);
+    size_t depth = m_conditionals.size() - m_sources.back().s_conditionalBase;
+
+    // Include guard detection: the first thing in the file must be #ifndef
+    // and its #endif the last.
+
+    if ((guard.s_state == Guard::unknown) && (name == "ifndef")) {
+        std::string rest;
+        guard.s_macro = identifier(operand, rest);
+        guard.s_state = Guard::open;
+    } else if (guard.s_state == Guard::unknown || guard.s_state == Guard::closed) {
+        guard.s_state = Guard::none;
+    } else if ((guard.s_state == Guard::open) && (depth == 1)) {
+        if (name == "endif") {
+            guard.s_state = Guard::closed;
+        } else if ((name == "else") || (name == "elif")) {
+            guard.s_state = Guard::none;
+        }
+    }
+
+    // Conditionals are tracked even in skipped sections:
+
+    if ((name == "ifdef") || (name == "ifndef")) {
+        std::string rest;
+        std::string macro = identifier(operand, rest);
+        if (macro.empty()) return error("#" + name + " with no macro name");
+        bool defined = m_macros.count(macro) > 0;
+        Conditional c;
+        c.s_parentActive = active();
+        c.s_active       = c.s_parentActive && (name == "ifdef" ? defined : !defined);
+        c.s_sawElse      = false;
+        m_conditionals.push_back(c);
+        return true;
+    }
+    if (name == "if") {
+        if (active()) {
+            return error("#if expressions are not supported by the built-in preprocessor (use --cpp)");
+        }
+        Conditional c;
+        c.s_parentActive = false;
+        c.s_active       = false;
+        c.s_sawElse      = false;
+        m_conditionals.push_back(c);
+        return true;
+    }
+    if ((name == "else") || (name == "elif") || (name == "endif")) {
+        if (depth == 0) return error("#" + name + " without #if");
+        Conditional& c(m_conditionals.back());
+        if (name == "endif") {
+            m_conditionals.pop_back();
+            return true;
+        }
+        if (c.s_sawElse) return error("#" + name + " after #else");
+        if (name == "elif") {
+            if (c.s_parentActive) {
+                return error("#elif is not supported by the built-in preprocessor (use --cpp)");
+            }
+            return true;
+        }
+        c.s_sawElse = true;
+        bool taken  = c.s_active;
+        c.s_active  = c.s_parentActive && !taken;
+        return true;
+    }
+    if (!active()) return true;
+
+    // The rest only matter in sections that are in use:
+
+    if (name.empty()) {
+        if (operand.empty()) return true;                  // Null directive.
+        if (isdigit((unsigned char)operand[0])) {
+            *m_output += "# " + operand + "\n";           // Line marker.
+            return true;
+        }
+        return error("invalid preprocessing directive #" + operand);
+    }
+    if (name == "define") {
+        std::string body;
+        std::string macro = identifier(operand, body);
+        if (macro.empty()) return error("#define with no macro name");
+        if (!body.empty() && (body[0] == '(')) {
+            return error(
+                "function like macro " + macro +
+                " is not supported by the built-in preprocessor (use --cpp)"
+            );
+        }
+        body = trim(body);
+        std::unordered_map<std::string, std::string>::iterator p = m_macros.find(macro);
+        if ((p != m_macros.end()) && (p->second != body)) {
+            std::cerr << m_sources.back().s_name << ":" << m_sources.back().s_line
+                      << ": warning: \"" << macro << "\" redefined\n";
+        }
+        m_macros[macro] = body;
+        return true;
+    }
+    if (name == "undef") {
+        std::string rest;
+        m_macros.erase(identifier(operand, rest));
+        return true;
+    }
+    if (name == "include") {
+        return include(operand);
+    }
+    if (name == "pragma") {
+        std::string rest;
+        if (identifier(operand, rest) == "once") file.s_once = true;
+        return true;                                       // Others are ignored.
+    }
+    if (name == "error") {
+        return error("#error " + operand);
+    }
+    if (name == "warning") {
+        std::cerr << m_sources.back().s_name << ":" << m_sources.back().s_line
+                  << ": warning: #warning " << operand << std::endl;
+        return true;
+    }
+    if (name == "line") {
+        *m_output += "# " + operand + "\n";
+        return true;
+    }
+    return error("invalid preprocessing directive #" + name);
+}
+/**
+ * include
+ *    Process an #include.  "file" is searched for relative to the
+ *    directory of the including file and then the working directory,
+ *    <file> only in the working directory.  Files with an include guard
+ *    whose macro is defined, or that have #pragma once and have already
+ *    been included, are skipped.
+ *
+ * @param operand - what follows #include.
+ * @return bool - true on success.
+ */
+bool
+Preprocessor::include(const std::string& operand)
+{
+    std::string spec = operand;
+    if (spec.empty() || ((spec[0] != '"') && (spec[0] != '<'))) {
+        std::set<std::string> expanding;
+        spec = trim(expand(spec, expanding));
+    }
+    char close = spec.empty() ? 0 : (spec[0] == '"' ? '"' : (spec[0] == '<' ? '>' : 0));
+    size_t end = close ? spec.find(close, 1) : std::string::npos;
+    if (end == std::string::npos) {
+        return error("#include expects \"FILENAME\" or <FILENAME>");
+    }
+    std::string name = spec.substr(1, end - 1);
+
+    if (m_sources.size() >= MAX_INCLUDE_DEPTH) {
+        return error("#include nested too deeply");
+    }
+
+    std::vector<std::string> candidates;
+    if ((name[0] != '/') && (close == '"') && !m_sources.back().s_directory.empty()) {
+        candidates.push_back(m_sources.back().s_directory + name);
+    }
+    candidates.push_back(name);
+
+    IncludeCache::Entry* file = 0;
+    std::string          path;
+    for (size_t i = 0; !file && (i < candidates.size()); i++) {
+        path = candidates[i];
+        file = m_cache.load(path);
+    }
+    if (!file) {
+        return error(name + ": " + strerror(errno));
+    }
+    if ((file->s_once && m_included.count(file)) ||
+        (!file->s_guard.empty() && m_macros.count(file->s_guard))) {
+        return true;
+    }
+    if (!processFile(path, *file)) return false;
+
+    *m_output += lineMarker(m_sources.back().s_nextLine, m_sources.back().s_name);
+    return true;
+}
+/**
+ * expand
+ *    Replace the macros in a string with their definitions (recursively).
+ *    Numbers are copied as is so that e.g. the e10 in 1e10 is not taken for
+ *    a macro name.
+ *
+ * @param text      - the text to expand.
+ * @param expanding - the macros being expanded; these aren't expanded again
+ *                    which stops a self-referential macro from recursing forever.
+ * @return std::string - the expanded text.
+ */
+std::string
+Preprocessor::expand(const std::string& text, std::set<std::string>& expanding) const
+{
+    std::string result;
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        size_t end = i + 1;
+        if (isIdentStart(c)) {
+            while ((end < text.size()) && isIdentChar(text[end])) end++;
+            std::string name = text.substr(i, end - i);
+            std::unordered_map<std::string, std::string>::const_iterator p =
+                m_macros.find(name);
+            if ((p != m_macros.end()) && !expanding.count(name)) {
+                expanding.insert(name);
+                result += expand(p->second, expanding);
+                expanding.erase(name);
+            } else {
+                result += name;
+            }
+        } else if (isdigit((unsigned char)c) ||
+                   ((c == '.') && (end < text.size()) && isdigit((unsigned char)text[end]))) {
+            while (end < text.size()) {
+                char d = text[end];
+                if (isIdentChar(d) || (d == '.')) {
+                    end++;
+                } else if (((d == '+') || (d == '-')) && strchr("eEpP", text[end-1])) {
+                    end++;
+                } else {
+                    break;
+                }
+            }
+            result.append(text, i, end - i);
+        } else if (c == '"') {
+            end = text.find('"', end);
+            end = (end == std::string::npos) ? text.size() : end + 1;
+            result.append(text, i, end - i);
+        } else {
+            result += c;
+        }
+        i = end;
+    }
+    return result;
+}
+/**
+ * active
+ *   @return bool - true if lines at this point are being used (not skipped
+ *                  by a conditional).
+ */
+bool
+Preprocessor::active() const
+{
+    return m_conditionals.empty() || m_conditionals.back().s_active;
+}
+/**
+ * error
+ *    Report an error at the current line.
+ *
+ * @param msg - the message.
+ * @return bool - false so callers can return error(...).
+ */
+bool
+Preprocessor::error(const std::string& msg) const
+{
+    if (m_sources.empty()) {
+        std::cerr << "error: " << msg << std::endl;
+    } else {
+        std::cerr << m_sources.back().s_name << ":" << m_sources.back().s_line
+                  << ": error: " << msg << std::endl;
+    }
+    return false;
+}
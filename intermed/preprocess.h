@@ -0,0 +1,112 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  preprocess.h
+ *  @brief: Built-in #define/#include stage for declaration files.
+ */
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <stdint.h>
+
+/**
+ * IncludeCache
+ *    The contents of the declaration files read so far.  Each file is read
+ *    once.  Its contents are stored under their hash, so a file reached
+ *    through several paths (or several identical copies) is held once.
+ *    When a file turns out to be wrapped in an include guard (or has
+ *    #pragma once), later #includes of it are skipped without even
+ *    rescanning it.  A cache can outlive a Preprocessor and be shared by
+ *    the preprocessing of several top level files.
+ */
+class IncludeCache {
+public:
+    struct Entry {
+        std::string s_contents;
+        std::string s_guard;          // Include guard macro (empty if none).
+        bool        s_once;           // Had #pragma once.
+    };
+private:
+    std::unordered_map<std::string, uint64_t> m_pathHashes;  // realpath -> hash.
+    std::unordered_map<uint64_t, Entry>       m_entries;
+    unsigned                                  m_reads;
+public:
+    IncludeCache() : m_reads(0) {}
+
+    Entry* load(const std::string& path);
+    unsigned reads() const { return m_reads; }   // Number of files actually read.
+};
+
+/**
+ * Preprocessor
+ *    Handles the subset of the C preprocessor that declaration files
+ *    use: object like #define and #undef, #include "file" and
+ *    #include <file> (searched relative to the including file and then
+ *    the working directory), #ifdef/#ifndef/#else/#endif,
+ *    #pragma once and #error.  Comments are stripped and backslash
+ *    continued lines joined.  The output has "# line "file"" markers as
+ *    cpp's does, so the parser can report errors against the original
+ *    files.
+ *
+ *    Anything else (function like macros, #if expressions...) is
+ *    reported as an error; the external cpp must be used for those.
+ */
+class Preprocessor {
+private:
+    struct Conditional {
+        bool s_active;                // Lines in this branch are used.
+        bool s_parentActive;          // The enclosing branch is used.
+        bool s_sawElse;
+    };
+    struct Source {                   // A file being preprocessed.
+        std::string  s_name;
+        std::string  s_directory;
+        unsigned     s_line;          // Line the current logical line starts on.
+        unsigned     s_nextLine;      // Line the next one starts on.
+        size_t       s_conditionalBase;
+    };
+    struct Guard {                    // Include guard detection state.
+        enum { unknown, open, closed, none } s_state;
+        std::string  s_macro;
+    };
+
+    IncludeCache&                                 m_cache;
+    IncludeCache                                  m_ownCache;
+    std::unordered_map<std::string, std::string>  m_macros;
+    std::vector<Conditional>                      m_conditionals;
+    std::vector<Source>                           m_sources;
+    std::set<const IncludeCache::Entry*>          m_included;
+    std::string*                                  m_output;
+public:
+    Preprocessor();
+    Preprocessor(IncludeCache& cache);
+
+    bool process(const std::string& filename, std::string& output);
+
+private:
+    bool processFile(const std::string& path, IncludeCache::Entry& file);
+    bool directive(const std::string& line, IncludeCache::Entry& file, Guard& guard);
+    bool include(const std::string& operand);
+    std::string expand(const std::string& text, std::set<std::string>& expanding) const;
+    bool active() const;
+    bool error(const std::string& msg) const;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  scalebench.cpp
+ *  @brief: Measure how parse time and memory scale with declaration size.
+ */
+
+/**
+ * Generates synthetic declaration files with 1k, 10k ... leaves (values)
+ * and runs the parser on each of them, reporting the wall clock time and
+ * the peak resident set size of the parser process.  If the parser is
+ * linear, the time per leaf column should stay (roughly) flat.
+ *
+ * Usage:
+ *     scalebench ?parser? ?maxleaves?
+ *
+ *  parser    - path to the parser (defaults to ./parser).
+ *  maxleaves - largest declaration to try (defaults to 1000000).
+ */
+#include "benchsupport.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+static const unsigned FIELDS_PER_STRUCT(10);
+
+/**
+ * writeDeclarations
+ *    Write a synthetic declaration file.  Half of the leaves are value
+ *    fields in structs of FIELDS_PER_STRUCT fields, the other half are
+ *    top level value instances.  Each struct is also instantiated so that
+ *    type lookups get exercised too.
+ *
+ * @param filename - file to write.
+ * @param leaves   - number of value leaves to declare.
+ */
+static void
+writeDeclarations(const std::string& filename, unsigned leaves)
+{
+    std::ofstream f(filename.c_str());
+    f << "namespace bench\n\n";
+
+    unsigned nStructs = leaves / (2*FIELDS_PER_STRUCT);
+    if (nStructs == 0) nStructs = 1;
+    for (unsigned s = 0; s < nStructs; s++) {
+        f << "struct S" << s << " {\n";
+        for (unsigned i = 0; i < FIELDS_PER_STRUCT; i++) {
+            f << "   value f" << i;
+            if (i % 2) {
+                f << " low=0 high=4095 bins=4096 units=channels";
+            }
+            f << "\n";
+        }
+        f << "}\n";
+    }
+    for (unsigned s = 0; s < nStructs; s++) {
+        f << "structinstance S" << s << " s" << s << "\n";
+    }
+    for (unsigned i = 0; i < leaves - nStructs*FIELDS_PER_STRUCT; i++) {
+        f << "value v" << i << "\n";
+    }
+}
+/**
+ * now
+ *   @return double - monotonic time in seconds.
+ */
+static double
+now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1.0e-9;
+}
+/**
+ * runParser
+ *    Run the parser on a file, discarding its output.
+ *
+ * @param parser  - path to the parser.
+ * @param filename - declaration file.
+ * @param seconds  - (out) wall clock time used.
+ * @param maxrssKb - (out) peak resident set size of the parser in KB.
+ * @return bool - true if the parser succeeded.
+ */
+static bool
+runParser(
+    const std::string& parser, const std::string& filename,
+    double& seconds, long& maxrssKb
+)
+{
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDOUT_FILENO);
+        execl(parser.c_str(), parser.c_str(), filename.c_str(), (char*)0);
+        perror("execl");
+        _exit(EXIT_FAILURE);
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    seconds  = now() - start;
+    maxrssKb = usage.ru_maxrss;
+
+    return WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+int main(int argc, char** argv)
+{
+    std::string parser = argc > 1 ? argv[1] : "./parser";
+    unsigned maxLeaves = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+
+    std::string dir      = makeBenchDirectory("scalebench");
+    std::string filename = dir + "/bench.decl";
+
+    std::cout << std::setw(10) << "leaves" << std::setw(12) << "bytes"
+              << std::setw(12) << "seconds" << std::setw(14) << "peak RSS(KB)"
+              << std::setw(12) << "usec/leaf" << std::endl;
+
+    for (unsigned leaves = 1000; leaves <= maxLeaves; leaves *= 10) {
+        writeDeclarations(filename, leaves);
+        struct stat info;
+        stat(filename.c_str(), &info);
+
+        double seconds;
+        long   rss;
+        if (!runParser(parser, filename, seconds, rss)) {
+            std::cerr << "Parser failed for " << leaves << " leaves\n";
+            removeBenchDirectory(dir);
+            exit(EXIT_FAILURE);
+        }
+        std::cout << std::setw(10) << leaves << std::setw(12) << info.st_size
+                  << std::setw(12) << std::fixed << std::setprecision(4) << seconds
+                  << std::setw(14) << rss
+                  << std::setw(12) << std::setprecision(3) << seconds*1.0e6/leaves
+                  << std::endl;
+    }
+    removeBenchDirectory(dir);
+    exit(EXIT_SUCCESS);
+}
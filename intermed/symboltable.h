@@ -0,0 +1,116 @@
+/*
+    This software is Copyright by the Board of Trustees of Michigan
+    State University (c) Copyright 2017.
+
+    You may use this software under the terms of the GNU public license
+    (GPL).  The terms of this license are described at:
+
+     http://www.gnu.org/licenses/gpl.txt
+
+     Authors:
+             Ron Fox
+             Jeromy Tompkins
+	     NSCL
+	     Michigan State University
+	     East Lansing, MI 48824-1321
+*/
+
+/** @file:  symboltable.h
+ *  @brief: Indexed symbol table used by the parser for types and instances.
+ */
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+/**
+ * SymbolTable
+ *    Holds named entries in declaration order.  The entries themselves live
+ *    in contiguous storage (a vector) so that the back ends can walk them
+ *    cheaply, while a hash index from name to position makes duplicate
+ *    checks and lookups O(1) rather than a walk of the whole table.
+ *
+ *    The table only ever grows; positions handed out by indexOf remain
+ *    valid for the life of the table.  References to entries, however,
+ *    are invalidated by add() just as they are for std::vector.
+ */
+template <typename T>
+class SymbolTable {
+public:
+    typedef std::vector<T>                         container_type;
+    typedef typename container_type::const_iterator const_iterator;
+    typedef typename container_type::iterator       iterator;
+
+    static const size_t npos = static_cast<size_t>(-1);
+private:
+    container_type                          m_entries;
+    std::unordered_map<std::string, size_t> m_index;
+public:
+    /**
+     * add
+     *    Adds a new entry under the specified name.
+     *
+     *  @param name  - name the entry is indexed by.
+     *  @param entry - the entry itself.
+     *  @return bool - false if the name was already in the table (in which
+     *                 case nothing is added).
+     */
+    bool add(const std::string& name, const T& entry) {
+        if (!m_index.insert(std::make_pair(name, m_entries.size())).second) {
+            return false;
+        }
+        m_entries.push_back(entry);
+        return true;
+    }
+    /**
+     * indexOf
+     *   @param name - name to lookup.
+     *   @return size_t - position of the named entry or npos if there isn't one.
+     */
+    size_t indexOf(const std::string& name) const {
+        typename std::unordered_map<std::string, size_t>::const_iterator p =
+            m_index.find(name);
+        return p == m_index.end() ? npos : p->second;
+    }
+    /**
+     * find
+     *   @param name - name to lookup.
+     *   @return const T* - pointer to the entry or null if there's no such name.
+     */
+    const T* find(const std::string& name) const {
+        size_t i = indexOf(name);
+        return i == npos ? 0 : &m_entries[i];
+    }
+    bool exists(const std::string& name) const {
+        return m_index.count(name) > 0;
+    }
+
+    void clear() {
+        m_entries.clear();
+        m_index.clear();
+    }
+    void reserve(size_t n) {
+        m_entries.reserve(n);
+        m_index.reserve(n);
+    }
+
+    // Vector like access to the ordered entries:
+
+    size_t size() const { return m_entries.size(); }
+    bool   empty() const { return m_entries.empty(); }
+    T&       back()       { return m_entries.back(); }
+    const T& back() const { return m_entries.back(); }
+    const T& operator[](size_t i) const { return m_entries[i]; }
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end()   const { return m_entries.end(); }
+
+    /**
+     * entries
+     *   @return const container_type& - the entries in declaration order.
+     *           This is what the code generators get handed.
+     */
+    const container_type& entries() const { return m_entries; }
+};
+
+#endif